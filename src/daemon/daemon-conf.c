@@ -73,6 +73,7 @@ static const pa_daemon_conf default_conf = {
     .flat_volumes = TRUE,
     .exit_idle_time = 20,
     .scache_idle_time = 20,
+    .subscription_coalesce_msec = 50,
     .auto_log_target = 1,
     .script_commands = NULL,
     .dl_search_path = NULL,
@@ -96,6 +97,11 @@ static const pa_daemon_conf default_conf = {
     .disable_shm = FALSE,
     .lock_memory = FALSE,
     .deferred_volume = TRUE,
+    .parallel_render = FALSE,
+    .parallel_render_threads = 0,
+    .parallel_probe = FALSE,
+    .rtpoll_backend = PA_RTPOLL_BACKEND_POLL,
+    .smoother_estimator = PA_SMOOTHER_ESTIMATOR_SPLINE,
     .default_n_fragments = 4,
     .default_fragment_size_msec = 25,
     .deferred_volume_safety_margin_usec = 8000,
@@ -280,6 +286,33 @@ int pa_daemon_conf_set_resample_method(pa_daemon_conf *c, const char *string) {
     return 0;
 }
 
+int pa_daemon_conf_set_rtpoll_backend(pa_daemon_conf *c, const char *string) {
+    int b;
+    pa_assert(c);
+    pa_assert(string);
+
+    if ((b = pa_rtpoll_backend_from_string(string)) < 0)
+        return -1;
+
+    if (!pa_rtpoll_backend_supported(b))
+        return -1;
+
+    c->rtpoll_backend = b;
+    return 0;
+}
+
+int pa_daemon_conf_set_smoother_estimator(pa_daemon_conf *c, const char *string) {
+    int e;
+    pa_assert(c);
+    pa_assert(string);
+
+    if ((e = pa_smoother_estimator_from_string(string)) < 0)
+        return -1;
+
+    c->smoother_estimator = e;
+    return 0;
+}
+
 int pa_daemon_conf_set_local_server_type(pa_daemon_conf *c, const char *string) {
     pa_assert(c);
     pa_assert(string);
@@ -341,6 +374,36 @@ static int parse_resample_method(pa_config_parser_state *state) {
     return 0;
 }
 
+static int parse_rtpoll_backend(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    if (pa_daemon_conf_set_rtpoll_backend(c, state->rvalue) < 0) {
+        pa_log(_("[%s:%u] Invalid or unsupported rtpoll backend '%s'."), state->filename, state->lineno, state->rvalue);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_smoother_estimator(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    if (pa_daemon_conf_set_smoother_estimator(c, state->rvalue) < 0) {
+        pa_log(_("[%s:%u] Invalid smoother estimator '%s'."), state->filename, state->lineno, state->rvalue);
+        return -1;
+    }
+
+    return 0;
+}
+
 #ifdef HAVE_SYS_RESOURCE_H
 static int parse_rlimit(pa_config_parser_state *state) {
     struct pa_rlimit *r;
@@ -581,6 +644,7 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "enable-deferred-volume",     pa_config_parse_bool,     &c->deferred_volume, NULL },
         { "exit-idle-time",             pa_config_parse_int,      &c->exit_idle_time, NULL },
         { "scache-idle-time",           pa_config_parse_int,      &c->scache_idle_time, NULL },
+        { "subscription-coalesce-msec", pa_config_parse_unsigned, &c->subscription_coalesce_msec, NULL },
         { "realtime-priority",          parse_rtprio,             c, NULL },
         { "dl-search-path",             pa_config_parse_string,   &c->dl_search_path, NULL },
         { "default-script-file",        pa_config_parse_string,   &c->default_script_file, NULL },
@@ -604,6 +668,11 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "enable-remixing",            pa_config_parse_not_bool, &c->disable_remixing, NULL },
         { "disable-lfe-remixing",       pa_config_parse_bool,     &c->disable_lfe_remixing, NULL },
         { "enable-lfe-remixing",        pa_config_parse_not_bool, &c->disable_lfe_remixing, NULL },
+        { "enable-parallel-render",     pa_config_parse_bool,     &c->parallel_render, NULL },
+        { "parallel-render-threads",    pa_config_parse_unsigned, &c->parallel_render_threads, NULL },
+        { "enable-parallel-probe",      pa_config_parse_bool,     &c->parallel_probe, NULL },
+        { "rtpoll-backend",             parse_rtpoll_backend,     c, NULL },
+        { "smoother-estimator",         parse_smoother_estimator, c, NULL },
         { "load-default-script-file",   pa_config_parse_bool,     &c->load_default_script_file, NULL },
         { "shm-size-bytes",             pa_config_parse_size,     &c->shm_size, NULL },
         { "log-meta",                   pa_config_parse_bool,     &c->log_meta, NULL },
@@ -784,6 +853,7 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "lock-memory = %s\n", pa_yes_no(c->lock_memory));
     pa_strbuf_printf(s, "exit-idle-time = %i\n", c->exit_idle_time);
     pa_strbuf_printf(s, "scache-idle-time = %i\n", c->scache_idle_time);
+    pa_strbuf_printf(s, "subscription-coalesce-msec = %u\n", c->subscription_coalesce_msec);
     pa_strbuf_printf(s, "dl-search-path = %s\n", pa_strempty(c->dl_search_path));
     pa_strbuf_printf(s, "default-script-file = %s\n", pa_strempty(pa_daemon_conf_get_default_script_file(c)));
     pa_strbuf_printf(s, "load-default-script-file = %s\n", pa_yes_no(c->load_default_script_file));
@@ -792,6 +862,11 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "resample-method = %s\n", pa_resample_method_to_string(c->resample_method));
     pa_strbuf_printf(s, "enable-remixing = %s\n", pa_yes_no(!c->disable_remixing));
     pa_strbuf_printf(s, "enable-lfe-remixing = %s\n", pa_yes_no(!c->disable_lfe_remixing));
+    pa_strbuf_printf(s, "enable-parallel-render = %s\n", pa_yes_no(c->parallel_render));
+    pa_strbuf_printf(s, "parallel-render-threads = %u\n", c->parallel_render_threads);
+    pa_strbuf_printf(s, "enable-parallel-probe = %s\n", pa_yes_no(c->parallel_probe));
+    pa_strbuf_printf(s, "rtpoll-backend = %s\n", pa_rtpoll_backend_to_string(c->rtpoll_backend));
+    pa_strbuf_printf(s, "smoother-estimator = %s\n", pa_smoother_estimator_to_string(c->smoother_estimator));
     pa_strbuf_printf(s, "default-sample-format = %s\n", pa_sample_format_to_string(c->default_sample_spec.format));
     pa_strbuf_printf(s, "default-sample-rate = %u\n", c->default_sample_spec.rate);
     pa_strbuf_printf(s, "alternate-sample-rate = %u\n", c->alternate_sample_rate);
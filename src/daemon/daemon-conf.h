@@ -30,6 +30,8 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/time-smoother.h>
 
 #ifdef HAVE_SYS_RESOURCE_H
 #include <sys/resource.h>
@@ -76,7 +78,9 @@ typedef struct pa_daemon_conf {
         log_time,
         flat_volumes,
         lock_memory,
-        deferred_volume;
+        deferred_volume,
+        parallel_render,
+        parallel_probe;
     pa_server_type_t local_server_type;
     int exit_idle_time,
         scache_idle_time,
@@ -87,6 +91,8 @@ typedef struct pa_daemon_conf {
     char *script_commands, *dl_search_path, *default_script_file;
     pa_log_target_t log_target;
     pa_log_level_t log_level;
+    pa_rtpoll_backend_t rtpoll_backend;
+    pa_smoother_estimator_t smoother_estimator;
     unsigned log_backtrace;
     char *config_file;
 
@@ -129,6 +135,8 @@ typedef struct pa_daemon_conf {
 
     unsigned default_n_fragments, default_fragment_size_msec;
     unsigned deferred_volume_safety_margin_usec;
+    unsigned parallel_render_threads;
+    unsigned subscription_coalesce_msec;
     int deferred_volume_extra_delay_usec;
     pa_sample_spec default_sample_spec;
     uint32_t alternate_sample_rate;
@@ -158,6 +166,8 @@ int pa_daemon_conf_env(pa_daemon_conf *c);
 int pa_daemon_conf_set_log_target(pa_daemon_conf *c, const char *string);
 int pa_daemon_conf_set_log_level(pa_daemon_conf *c, const char *string);
 int pa_daemon_conf_set_resample_method(pa_daemon_conf *c, const char *string);
+int pa_daemon_conf_set_rtpoll_backend(pa_daemon_conf *c, const char *string);
+int pa_daemon_conf_set_smoother_estimator(pa_daemon_conf *c, const char *string);
 int pa_daemon_conf_set_local_server_type(pa_daemon_conf *c, const char *string);
 
 const char *pa_daemon_conf_get_default_script_file(pa_daemon_conf *c);
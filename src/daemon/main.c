@@ -1023,12 +1023,26 @@ int main(int argc, char *argv[]) {
     c->deferred_volume_extra_delay_usec = conf->deferred_volume_extra_delay_usec;
     c->exit_idle_time = conf->exit_idle_time;
     c->scache_idle_time = conf->scache_idle_time;
+    c->subscription_coalesce_usec = conf->subscription_coalesce_msec * PA_USEC_PER_MSEC;
     c->resample_method = conf->resample_method;
     c->realtime_priority = conf->realtime_priority;
     c->realtime_scheduling = !!conf->realtime_scheduling;
     c->disable_remixing = !!conf->disable_remixing;
     c->disable_lfe_remixing = !!conf->disable_lfe_remixing;
     c->deferred_volume = !!conf->deferred_volume;
+    c->parallel_module_probe = !!conf->parallel_probe;
+
+    if (conf->parallel_render) {
+        unsigned n = conf->parallel_render_threads;
+
+        if (n <= 0)
+            n = pa_ncpus() > 1 ? pa_ncpus() - 1 : 1;
+
+        c->render_pool = pa_render_pool_new(n, c->realtime_scheduling ? c->realtime_priority : 0);
+    }
+
+    pa_rtpoll_set_default_backend(conf->rtpoll_backend);
+    pa_smoother_set_default_estimator(conf->smoother_estimator);
     c->running_as_daemon = !!conf->daemonize;
     c->disallow_exit = conf->disallow_exit;
     c->flat_volumes = conf->flat_volumes;
@@ -1096,6 +1110,8 @@ int main(int argc, char *argv[]) {
             pa_log(_("Daemon startup without any loaded modules, refusing to work."));
             goto finish;
         }
+
+        pa_module_log_load_times(c);
 #ifdef HAVE_DBUS
     } else {
         /* When we just provide the D-Bus server lookup service, we don't want
@@ -25,6 +25,8 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include <asoundlib.h>
 #include <math.h>
 
@@ -3738,9 +3740,15 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
+    if (pcm_handle)
+        mixer_handle = pa_alsa_open_mixer_for_pcm(pcm_handle, NULL, &hctl_handle);
+    else {
+        pa_assert(profile->cached);
+        pa_assert(m->profile_set->cache_card_index >= 0);
+
+        mixer_handle = pa_alsa_open_mixer(m->profile_set->cache_card_index, NULL, &hctl_handle);
+    }
 
-    mixer_handle = pa_alsa_open_mixer_for_pcm(pcm_handle, NULL, &hctl_handle);
     if (!mixer_handle || !hctl_handle) {
          /* Cannot open mixer, remove all entries */
         pa_hashmap_remove_all(ps->paths, NULL);
@@ -4098,6 +4106,15 @@ void pa_alsa_decibel_fix_dump(pa_alsa_decibel_fix *db_fix) {
     pa_xfree(db_values);
 }
 
+static char *profile_set_path(const char *fname) {
+    if (!fname)
+        fname = "default.conf";
+
+    return pa_maybe_prefix_path(fname,
+                                pa_run_from_build_tree() ? PA_SRCDIR "/modules/alsa/mixer/profile-sets/" :
+                                PA_ALSA_PROFILE_SETS_DIR);
+}
+
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus) {
     pa_alsa_profile_set *ps;
     pa_alsa_profile *p;
@@ -4140,16 +4157,11 @@ pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel
     ps->decibel_fixes = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
     ps->input_paths = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
     ps->output_paths = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    ps->cache_card_index = -1;
 
     items[0].data = &ps->auto_profiles;
 
-    if (!fname)
-        fname = "default.conf";
-
-    fn = pa_maybe_prefix_path(fname,
-                              pa_run_from_build_tree() ? PA_SRCDIR "/modules/alsa/mixer/profile-sets/" :
-                              PA_ALSA_PROFILE_SETS_DIR);
-
+    fn = profile_set_path(fname);
     r = pa_config_parse(fn, NULL, items, NULL, ps);
     pa_xfree(fn);
 
@@ -4290,6 +4302,27 @@ void pa_alsa_profile_set_probe(
     PA_HASHMAP_FOREACH(p, ps->profiles, state) {
         uint32_t idx;
 
+        if (p->cached) {
+            if (!p->supported)
+                continue;
+
+            pa_log_debug("Profile %s supported according to the probe cache.", p->name);
+
+            if (p->output_mappings)
+                PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
+                    m->supported++;
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT);
+                }
+
+            if (p->input_mappings)
+                PA_IDXSET_FOREACH(m, p->input_mappings, idx) {
+                    m->supported++;
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT);
+                }
+
+            continue;
+        }
+
         /* Skip if this is already marked that it is supported (i.e. from the config file) */
         if (!p->supported) {
 
@@ -4441,6 +4474,250 @@ void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *ps) {
     }
 }
 
+static void save_paths(pa_tagstruct *t, pa_alsa_path_set *ps, pa_hashmap *cache, char **names) {
+    pa_alsa_path *p;
+    const void *key;
+    void *state;
+    uint32_t n = 0;
+
+    /* Paths synthesized from element names are cheap, and if the mixer
+     * was never looked at there is nothing to remember */
+    if (!names || !ps) {
+        pa_tagstruct_put_boolean(t, FALSE);
+        return;
+    }
+
+    pa_tagstruct_put_boolean(t, TRUE);
+
+    PA_HASHMAP_FOREACH(p, ps->paths, state)
+        n++;
+
+    pa_tagstruct_putu32(t, n);
+
+    /* The paths might have been renamed, hence look up the names they
+     * were loaded by */
+    state = NULL;
+    while ((p = pa_hashmap_iterate(cache, &state, &key)))
+        if (pa_hashmap_get(ps->paths, p))
+            pa_tagstruct_puts(t, key);
+}
+
+void pa_alsa_profile_set_save_probe(pa_alsa_profile_set *ps, pa_tagstruct *t) {
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    void *state;
+
+    pa_assert(ps);
+    pa_assert(ps->probed);
+    pa_assert(t);
+
+    /* Only the supported profiles and mappings are left */
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->profiles));
+    PA_HASHMAP_FOREACH(p, ps->profiles, state)
+        pa_tagstruct_puts(t, p->name);
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(ps->mappings));
+    PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+        pa_tagstruct_puts(t, m->name);
+        save_paths(t, m->output_path_set, ps->output_paths, m->output_path_names);
+        save_paths(t, m->input_path_set, ps->input_paths, m->input_path_names);
+    }
+}
+
+struct cached_mapping {
+    pa_alsa_mapping *mapping;
+    char **output_path_names;
+    char **input_path_names;
+};
+
+/* Returns 0 and sets *names to NULL if all paths need to be looked at */
+static int load_paths(pa_tagstruct *t, char **known, char ***names) {
+    pa_bool_t restricted;
+    uint32_t i, n;
+    unsigned n_known = 0;
+
+    *names = NULL;
+
+    if (pa_tagstruct_get_boolean(t, &restricted) < 0)
+        return -1;
+
+    if (!restricted)
+        return 0;
+
+    if (!known)
+        return -1;
+
+    while (known[n_known])
+        n_known++;
+
+    if (pa_tagstruct_getu32(t, &n) < 0 || n > n_known)
+        return -1;
+
+    *names = pa_xnew0(char*, n + 1);
+
+    for (i = 0; i < n; i++) {
+        const char *name;
+        char **k;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name)
+            return -1;
+
+        for (k = known; *k; k++)
+            if (pa_streq(*k, name))
+                break;
+
+        if (!*k)
+            return -1;
+
+        (*names)[i] = pa_xstrdup(name);
+    }
+
+    return 0;
+}
+
+int pa_alsa_profile_set_load_probe(pa_alsa_profile_set *ps, pa_tagstruct *t, int alsa_card_index) {
+    pa_hashmap *supported;
+    struct cached_mapping *cached;
+    pa_alsa_profile *p;
+    uint32_t i, n_profiles, n_mappings = 0;
+    void *state;
+    int r = -1;
+
+    pa_assert(ps);
+    pa_assert(!ps->probed);
+    pa_assert(t);
+    pa_assert(alsa_card_index >= 0);
+
+    supported = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    cached = NULL;
+
+    /* Everything is checked before touching the profile set, so that
+     * it can still be probed normally if this fails */
+    if (pa_tagstruct_getu32(t, &n_profiles) < 0 || n_profiles > pa_hashmap_size(ps->profiles))
+        goto finish;
+
+    for (i = 0; i < n_profiles; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name || !(p = pa_hashmap_get(ps->profiles, name)))
+            goto finish;
+
+        pa_hashmap_put(supported, p->name, p);
+    }
+
+    if (pa_tagstruct_getu32(t, &n_mappings) < 0 || n_mappings > pa_hashmap_size(ps->mappings))
+        goto finish;
+
+    cached = pa_xnew0(struct cached_mapping, n_mappings);
+
+    for (i = 0; i < n_mappings; i++) {
+        const char *name;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name || !(cached[i].mapping = pa_hashmap_get(ps->mappings, name)))
+            goto finish;
+
+        if (load_paths(t, cached[i].mapping->output_path_names, &cached[i].output_path_names) < 0 ||
+            load_paths(t, cached[i].mapping->input_path_names, &cached[i].input_path_names) < 0)
+            goto finish;
+    }
+
+    if (!pa_tagstruct_eof(t))
+        goto finish;
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        /* Profiles which are never probed stay as they are */
+        if (p->supported)
+            continue;
+
+        p->cached = TRUE;
+        p->supported = !!pa_hashmap_get(supported, p->name);
+    }
+
+    for (i = 0; i < n_mappings; i++) {
+        if (cached[i].output_path_names) {
+            pa_xstrfreev(cached[i].mapping->output_path_names);
+            cached[i].mapping->output_path_names = cached[i].output_path_names;
+            cached[i].output_path_names = NULL;
+        }
+
+        if (cached[i].input_path_names) {
+            pa_xstrfreev(cached[i].mapping->input_path_names);
+            cached[i].mapping->input_path_names = cached[i].input_path_names;
+            cached[i].input_path_names = NULL;
+        }
+    }
+
+    ps->cache_card_index = alsa_card_index;
+    r = 0;
+
+finish:
+    if (cached) {
+        for (i = 0; i < n_mappings; i++) {
+            pa_xstrfreev(cached[i].output_path_names);
+            pa_xstrfreev(cached[i].input_path_names);
+        }
+
+        pa_xfree(cached);
+    }
+
+    pa_hashmap_free(supported, NULL);
+
+    return r;
+}
+
+struct config_stamp {
+    unsigned n;
+    time_t max_mtime;
+    off_t size;
+};
+
+static void config_stamp_add(struct config_stamp *st, const char *fn) {
+    struct stat s;
+
+    if (stat(fn, &s) < 0)
+        return;
+
+    st->n++;
+    st->max_mtime = PA_MAX(st->max_mtime, s.st_mtime);
+    st->size += s.st_size;
+}
+
+char *pa_alsa_profile_set_config_stamp(const char *fname, const char *paths_dir) {
+    struct config_stamp st;
+    char *fn;
+    DIR *d;
+
+    pa_zero(st);
+
+    fn = profile_set_path(fname);
+    config_stamp_add(&st, fn);
+    pa_xfree(fn);
+
+    if (!paths_dir)
+        paths_dir = get_default_paths_dir();
+
+    config_stamp_add(&st, paths_dir);
+
+    if ((d = opendir(paths_dir))) {
+        struct dirent *de;
+
+        /* Not only the paths themselves, the files they include
+         * (e.g. analog-output.conf.common) matter just as much */
+        while ((de = readdir(d))) {
+            if (pa_streq(de->d_name, ".") || pa_streq(de->d_name, ".."))
+                continue;
+
+            fn = pa_maybe_prefix_path(de->d_name, paths_dir);
+            config_stamp_add(&st, fn);
+            pa_xfree(fn);
+        }
+
+        closedir(d);
+    }
+
+    return pa_sprintf_malloc("%s %u %llu %llu", PACKAGE_VERSION, st.n, (unsigned long long) st.max_mtime, (unsigned long long) st.size);
+}
+
 static pa_device_port* device_port_alsa_init(pa_hashmap *ports,
     const char* name,
     const char* description,
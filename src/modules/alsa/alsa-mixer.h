@@ -32,6 +32,7 @@
 
 #include <pulsecore/llist.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/tagstruct.h>
 
 typedef struct pa_alsa_fdlist pa_alsa_fdlist;
 typedef struct pa_alsa_mixer_pdata pa_alsa_mixer_pdata;
@@ -283,6 +284,9 @@ struct pa_alsa_profile {
 
     pa_bool_t supported:1;
 
+    /* supported was taken from a cache, don't open the PCMs */
+    pa_bool_t cached:1;
+
     char **input_mapping_names;
     char **output_mapping_names;
 
@@ -313,6 +317,10 @@ struct pa_alsa_profile_set {
     pa_hashmap *input_paths;
     pa_hashmap *output_paths;
 
+    /* Where to find the mixer for profiles whose probe results are
+     * cached, or -1 */
+    int cache_card_index;
+
     pa_bool_t auto_profiles;
     pa_bool_t ignore_dB:1;
     pa_bool_t probed:1;
@@ -329,6 +337,19 @@ void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
 
+/* The probe results of a profile set can be stored with
+ * pa_alsa_profile_set_save_probe() after probing. Handing them to
+ * pa_alsa_profile_set_load_probe() of a fresh profile set for the same
+ * card makes pa_alsa_profile_set_probe() skip opening the PCMs, and
+ * parsing and probing all paths which did not work the last time. The
+ * mixer of the card is then opened by its index. The configuration
+ * stamp changes whenever the profile set or any file in the paths
+ * directory (the default one if paths_dir is NULL) may have changed,
+ * which makes the stored results worthless. */
+void pa_alsa_profile_set_save_probe(pa_alsa_profile_set *ps, pa_tagstruct *t);
+int pa_alsa_profile_set_load_probe(pa_alsa_profile_set *ps, pa_tagstruct *t, int alsa_card_index);
+char *pa_alsa_profile_set_config_stamp(const char *fname, const char *paths_dir);
+
 snd_mixer_t *pa_alsa_open_mixer_for_pcm(snd_pcm_t *pcm, char **ctl_device, snd_hctl_t **hctl);
 
 pa_alsa_fdlist *pa_alsa_fdlist_new(void);
@@ -54,6 +54,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/watermark-controller.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -68,13 +69,8 @@
 #define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms  -- Fill up when only this much is left in the buffer */
 
 #define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  -- On underrun, increase watermark by this */
-#define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms   -- When everything's great, decrease watermark by this */
-#define TSCHED_WATERMARK_VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)    /* 20s   -- How long after a drop out recheck if things are good now */
-#define TSCHED_WATERMARK_INC_THRESHOLD_USEC (0*PA_USEC_PER_MSEC)   /* 0ms   -- If the buffer level ever below this threshold, increase the watermark */
-#define TSCHED_WATERMARK_DEC_THRESHOLD_USEC (100*PA_USEC_PER_MSEC) /* 100ms -- If the buffer level didn't drop below this threshold in the verification time, decrease the watermark */
-
-/* Note that TSCHED_WATERMARK_INC_THRESHOLD_USEC == 0 means that we
- * will increase the watermark only if we hit a real underrun. */
+#define TSCHED_WATERMARK_DEC_INTERVAL_USEC (1*PA_USEC_PER_SEC)     /* 1s    -- Decrease the watermark at most this often */
+#define DEFAULT_TSCHED_DROPOUT_PROBABILITY (0.0001)                /* Pick the watermark so that one in 10000 wakeups may underrun */
 
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms  -- Sleep at least 10ms on each iteration */
 #define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms   -- Wakeup at least this long before the buffer runs empty*/
@@ -122,12 +118,12 @@ struct userdata {
         min_sleep,
         min_wakeup,
         watermark_inc_step,
-        watermark_dec_step,
-        watermark_inc_threshold,
-        watermark_dec_threshold,
         rewind_safeguard;
 
+    pa_watermark_controller *watermark_controller;
     pa_usec_t watermark_dec_not_before;
+    pa_usec_t wakeup_deadline;
+    pa_usec_t next_wakeup;
     pa_usec_t min_latency_ref;
 
     pa_memchunk memchunk;
@@ -147,6 +143,15 @@ struct userdata {
     pa_usec_t smoother_interval;
     pa_usec_t last_smoother_update;
 
+    /* The last status snapshot, reused for the smoother update */
+    pa_bool_t have_snapshot;
+    pa_usec_t snapshot_time;
+    int64_t snapshot_position;
+
+    /* Calls into the driver, for the statistics */
+    unsigned n_ioctls, ioctl_rate;
+    pa_usec_t ioctl_period_start;
+
     pa_idxset *formats;
 
     pa_reserve_wrapper *reserve;
@@ -358,38 +363,54 @@ static void increase_watermark(struct userdata *u) {
     /* When we reach this we're officialy fucked! */
 }
 
-static void decrease_watermark(struct userdata *u) {
-    size_t old_watermark;
-    pa_usec_t now;
+/* Follow the suggestion of the watermark controller: increase the
+ * watermark right away when our wakeups got later, decrease it at most
+ * once per TSCHED_WATERMARK_DEC_INTERVAL_USEC and by half at most. */
+static void adjust_watermark(struct userdata *u) {
+    size_t old_watermark, target;
+    pa_usec_t usec, now;
 
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    now = pa_rtclock_now();
-
-    if (u->watermark_dec_not_before <= 0)
-        goto restart;
-
-    if (u->watermark_dec_not_before > now)
+    if ((usec = pa_watermark_controller_get(u->watermark_controller)) <= 0)
         return;
 
+    target = pa_usec_to_bytes_round_up(usec, &u->sink->sample_spec);
     old_watermark = u->tsched_watermark;
 
-    if (u->tsched_watermark < u->watermark_dec_step)
-        u->tsched_watermark = u->tsched_watermark / 2;
-    else
-        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
+    if (target > u->tsched_watermark)
+        u->tsched_watermark = target;
+    else if (target < u->tsched_watermark) {
+        now = pa_rtclock_now();
+
+        if (u->watermark_dec_not_before > now)
+            return;
+
+        u->tsched_watermark = PA_MAX(target, u->tsched_watermark / 2);
+        u->watermark_dec_not_before = now + TSCHED_WATERMARK_DEC_INTERVAL_USEC;
+    }
 
     fix_tsched_watermark(u);
 
+    /* We don't change the latency range*/
+
     if (old_watermark != u->tsched_watermark)
-        pa_log_info("Decreasing wakeup watermark to %0.2f ms",
+        pa_log_info("%s wakeup watermark to %0.2f ms",
+                    u->tsched_watermark > old_watermark ? "Increasing" : "Decreasing",
                     (double) pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
+}
 
-    /* We don't change the latency range*/
+/* Called after data was handed to the device. Tells the controller
+ * how long it took since the timer should have woken us up. */
+static void account_wakeup(struct userdata *u) {
+    pa_assert(u);
+
+    if (u->wakeup_deadline <= 0)
+        return;
 
-restart:
-    u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+    pa_watermark_controller_add(u->watermark_controller, pa_rtclock_now() - u->wakeup_deadline);
+    u->wakeup_deadline = 0;
 }
 
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
@@ -474,35 +495,83 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, pa_bool_t o
     }
 
 #ifdef DEBUG_TIMING
-    pa_log_debug("%0.2f ms left to play; inc threshold = %0.2f ms; dec threshold = %0.2f ms",
-                 (double) pa_bytes_to_usec(left_to_play, &u->sink->sample_spec) / PA_USEC_PER_MSEC,
-                 (double) pa_bytes_to_usec(u->watermark_inc_threshold, &u->sink->sample_spec) / PA_USEC_PER_MSEC,
-                 (double) pa_bytes_to_usec(u->watermark_dec_threshold, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
+    pa_log_debug("%0.2f ms left to play", (double) pa_bytes_to_usec(left_to_play, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
 #endif
 
-    if (u->use_tsched) {
-        pa_bool_t reset_not_before = TRUE;
+    if (u->use_tsched && !u->first && !u->after_rewind) {
+        if (underrun) {
+            /* The controller's suggestion didn't hold, back off and
+             * make sure it doesn't suggest going back right away */
+            increase_watermark(u);
+            pa_watermark_controller_dropout(u->watermark_controller, pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec));
+        } else if (on_timeout)
+            /* Only timer wakeups tell how close to the deadline we
+             * can get, if something else woke us up it's too easy to
+             * fulfill the deadlines... */
+            adjust_watermark(u);
+    }
 
-        if (!u->first && !u->after_rewind) {
-            if (underrun || left_to_play < u->watermark_inc_threshold)
-                increase_watermark(u);
-            else if (left_to_play > u->watermark_dec_threshold) {
-                reset_not_before = FALSE;
+    /* The render that follows has until the device runs dry */
+    pa_sink_set_render_headroom_within_thread(u->sink, pa_bytes_to_usec(left_to_play, &u->sink->sample_spec));
 
-                /* We decrease the watermark only if have actually
-                 * been woken up by a timeout. If something else woke
-                 * us up it's too easy to fulfill the deadlines... */
+    /* What was left when the timer woke us up tells how close we cut
+     * it, later checks in the same wakeup don't */
+    if (on_timeout)
+        pa_render_profile_add(&u->sink->render_profile, PA_RENDER_PROFILE_HEADROOM,
+                              pa_bytes_to_usec(left_to_play, &u->sink->sample_spec));
 
-                if (on_timeout)
-                    decrease_watermark(u);
-            }
-        }
+    return left_to_play;
+}
+
+/* Called from IO context */
+static void count_ioctls(struct userdata *u, unsigned n) {
+    pa_usec_t now;
+
+    u->n_ioctls += n;
+
+    now = pa_rtclock_now();
+
+    if (u->ioctl_period_start <= 0)
+        u->ioctl_period_start = now;
+    else if (now - u->ioctl_period_start >= PA_USEC_PER_SEC) {
+        unsigned rate = (unsigned) ((uint64_t) u->n_ioctls * PA_USEC_PER_SEC / (now - u->ioctl_period_start));
 
-        if (reset_not_before)
-            u->watermark_dec_not_before = 0;
+        /* Only tell when it changed noticeably */
+        if (rate > u->ioctl_rate + u->ioctl_rate / 10 || rate < u->ioctl_rate - u->ioctl_rate / 10)
+            pa_log_debug("%u ioctls per second on %s.", rate, u->device_name);
+
+        u->ioctl_rate = rate;
+        u->n_ioctls = 0;
+        u->ioctl_period_start = now;
     }
+}
 
-    return left_to_play;
+/* Gets avail, delay and timestamp from a single snd_pcm_status()
+ * call. The delay and timestamp are kept for update_smoother(). */
+static int query_status(struct userdata *u, snd_pcm_sframes_t *avail) {
+    snd_pcm_sframes_t delay = 0;
+    snd_pcm_status_t *status;
+    snd_htimestamp_t htstamp = { 0, 0 };
+    int err;
+
+    snd_pcm_status_alloca(&status);
+
+    count_ioctls(u, 1);
+
+    if (PA_UNLIKELY((err = pa_alsa_safe_status(u->pcm_handle, status, avail, &delay, u->hwbuf_size, &u->sink->sample_spec, FALSE)) < 0))
+        return err;
+
+    snd_pcm_status_get_htstamp(status, &htstamp);
+    u->snapshot_time = pa_timespec_load(&htstamp);
+
+    /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
+    if (u->snapshot_time <= 0)
+        u->snapshot_time = pa_rtclock_now();
+
+    u->snapshot_position = (int64_t) u->write_count - ((int64_t) delay * (int64_t) u->frame_size);
+    u->have_snapshot = TRUE;
+
+    return 0;
 }
 
 static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled, pa_bool_t on_timeout) {
@@ -522,13 +591,14 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
         size_t n_bytes;
         int r;
         pa_bool_t after_avail = TRUE;
+        pa_usec_t t;
 
         /* First we determine how many samples are missing to fill the
          * buffer up to 100% */
 
-        if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
+        if (PA_UNLIKELY((r = query_status(u, &n)) < 0)) {
 
-            if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
+            if ((r = try_recover(u, "snd_pcm_status", r)) == 0)
                 continue;
 
             return r;
@@ -644,7 +714,12 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
             pa_sink_render_into_full(u->sink, &chunk);
             pa_memblock_unref_fixed(chunk.memblock);
 
-            if (PA_UNLIKELY((sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames)) < 0)) {
+            t = pa_rtclock_now();
+            sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames);
+            count_ioctls(u, 1);
+            pa_render_profile_add(&u->sink->render_profile, PA_RENDER_PROFILE_DEVICE_IO, pa_rtclock_now() - t);
+
+            if (PA_UNLIKELY(sframes < 0)) {
 
                 if (!after_avail && (int) sframes == -EAGAIN)
                     break;
@@ -655,6 +730,8 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
                 return r;
             }
 
+            account_wakeup(u);
+
             work_done = TRUE;
 
             u->write_count += written;
@@ -708,10 +785,11 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
         size_t n_bytes;
         int r;
         pa_bool_t after_avail = TRUE;
+        pa_usec_t t;
 
-        if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
+        if (PA_UNLIKELY((r = query_status(u, &n)) < 0)) {
 
-            if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
+            if ((r = try_recover(u, "snd_pcm_status", r)) == 0)
                 continue;
 
             return r;
@@ -783,7 +861,10 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
                 frames = (snd_pcm_sframes_t) (n_bytes/u->frame_size);
 
             p = pa_memblock_acquire(u->memchunk.memblock);
+            t = pa_rtclock_now();
             frames = snd_pcm_writei(u->pcm_handle, (const uint8_t*) p + u->memchunk.index, (snd_pcm_uframes_t) frames);
+            count_ioctls(u, 1);
+            pa_render_profile_add(&u->sink->render_profile, PA_RENDER_PROFILE_DEVICE_IO, pa_rtclock_now() - t);
             pa_memblock_release(u->memchunk.memblock);
 
             if (PA_UNLIKELY(frames < 0)) {
@@ -803,6 +884,8 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
             pa_assert(frames > 0);
             after_avail = FALSE;
 
+            account_wakeup(u);
+
             written = frames * u->frame_size;
             u->memchunk.index += written;
             u->memchunk.length -= written;
@@ -847,38 +930,34 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
 }
 
 static void update_smoother(struct userdata *u) {
-    snd_pcm_sframes_t delay = 0;
     int64_t position;
     int err;
     pa_usec_t now1 = 0, now2;
-    snd_pcm_status_t *status;
-    snd_htimestamp_t htstamp = { 0, 0 };
-
-    snd_pcm_status_alloca(&status);
 
     pa_assert(u);
     pa_assert(u->pcm_handle);
 
-    /* Let's update the time smoother */
+    /* Let's update the time smoother, from the snapshot the write
+     * was based on if we have one */
 
-    if (PA_UNLIKELY((err = pa_alsa_safe_delay(u->pcm_handle, status, &delay, u->hwbuf_size, &u->sink->sample_spec, FALSE)) < 0)) {
-        pa_log_warn("Failed to query DSP status data: %s", pa_alsa_strerror(err));
-        return;
-    }
+    if (!u->have_snapshot) {
+        snd_pcm_sframes_t avail;
 
-    snd_pcm_status_get_htstamp(status, &htstamp);
-    now1 = pa_timespec_load(&htstamp);
+        if (PA_UNLIKELY((err = query_status(u, &avail)) < 0)) {
+            pa_log_warn("Failed to query DSP status data: %s", pa_alsa_strerror(err));
+            return;
+        }
+    }
 
-    /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
-    if (now1 <= 0)
-        now1 = pa_rtclock_now();
+    u->have_snapshot = FALSE;
+    now1 = u->snapshot_time;
 
     /* check if the time since the last update is bigger than the interval */
     if (u->last_smoother_update > 0)
         if (u->last_smoother_update + u->smoother_interval > now1)
             return;
 
-    position = (int64_t) u->write_count - ((int64_t) delay * (int64_t) u->frame_size);
+    position = u->snapshot_position;
 
     if (PA_UNLIKELY(position < 0))
         position = 0;
@@ -1025,10 +1104,6 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
                                                     &u->sink->sample_spec);
 
     u->watermark_inc_step = pa_usec_to_bytes(TSCHED_WATERMARK_INC_STEP_USEC, &u->sink->sample_spec);
-    u->watermark_dec_step = pa_usec_to_bytes(TSCHED_WATERMARK_DEC_STEP_USEC, &u->sink->sample_spec);
-
-    u->watermark_inc_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_INC_THRESHOLD_USEC, &u->sink->sample_spec);
-    u->watermark_dec_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_DEC_THRESHOLD_USEC, &u->sink->sample_spec);
 
     fix_min_sleep_wakeup(u);
     fix_tsched_watermark(u);
@@ -1645,6 +1720,8 @@ static int process_rewind(struct userdata *u) {
 
     pa_log_debug("Requested to rewind %lu bytes.", (unsigned long) rewind_nbytes);
 
+    count_ioctls(u, 1);
+
     if (PA_UNLIKELY((unused = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
         pa_log("snd_pcm_avail() failed: %s", pa_alsa_strerror((int) unused));
         return -1;
@@ -1670,6 +1747,8 @@ static int process_rewind(struct userdata *u) {
 
         in_frames = (snd_pcm_sframes_t) (rewind_nbytes / u->frame_size);
         pa_log_debug("before: %lu", (unsigned long) in_frames);
+        count_ioctls(u, 1);
+
         if ((out_frames = snd_pcm_rewind(u->pcm_handle, (snd_pcm_uframes_t) in_frames)) < 0) {
             pa_log("snd_pcm_rewind() failed: %s", pa_alsa_strerror((int) out_frames));
             if (try_recover(u, "process_rewind", out_frames) < 0)
@@ -1713,28 +1792,53 @@ static void thread_func(void *userdata) {
 
     for (;;) {
         int ret;
-        pa_usec_t rtpoll_sleep = 0, real_sleep;
+        pa_usec_t rtpoll_sleep = 0, real_sleep, rewind_wait = 0;
+        pa_bool_t rewind_deferred = FALSE;
 
 #ifdef DEBUG_TIMING
         pa_log_debug("Loop");
 #endif
 
         if (PA_UNLIKELY(u->sink->thread_info.rewind_requested)) {
-            if (process_rewind(u) < 0)
+            /* In timer based scheduling mode the buffer holds enough
+             * to wait a little for more rewind requests, as long as
+             * we are back before it needs refilling */
+            if (u->use_tsched &&
+                PA_SINK_IS_OPENED(u->sink->thread_info.state) &&
+                !pa_rtpoll_timer_elapsed(u->rtpoll))
+                rewind_deferred = pa_sink_defer_rewind(u->sink, u->next_wakeup, &rewind_wait);
+
+            if (!rewind_deferred && process_rewind(u) < 0)
                 goto fail;
         }
 
-        /* Render some data and write it to the dsp */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        /* Render some data and write it to the dsp. Nothing may be
+         * rendered while a rewind is pending, so if we are waiting
+         * for one just come back when it's due. */
+        if (rewind_deferred)
+            rtpoll_sleep = rewind_wait;
+        else if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
             int work_done;
             pa_usec_t sleep_usec = 0;
             pa_bool_t on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
 
+            if (on_timeout) {
+                pa_usec_t lateness = pa_rtpoll_get_timer_lateness(u->rtpoll);
+
+                pa_render_profile_add(&u->sink->render_profile, PA_RENDER_PROFILE_WAKEUP_LATENESS, lateness);
+
+                if (u->use_tsched)
+                    u->wakeup_deadline = pa_rtclock_now() - lateness;
+            }
+
             if (u->use_mmap)
                 work_done = mmap_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
             else
                 work_done = unix_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
 
+            /* Nothing was written this time, don't count it later */
+            u->wakeup_deadline = 0;
+
             if (work_done < 0)
                 goto fail;
 
@@ -1745,6 +1849,10 @@ static void thread_func(void *userdata) {
                 if (u->first) {
                     pa_log_info("Starting playback.");
                     snd_pcm_start(u->pcm_handle);
+                    count_ioctls(u, 1);
+
+                    /* The snapshot predates the start */
+                    u->have_snapshot = FALSE;
 
                     pa_smoother_resume(u->smoother, pa_rtclock_now(), TRUE);
 
@@ -1754,6 +1862,8 @@ static void thread_func(void *userdata) {
                 update_smoother(u);
             }
 
+            u->have_snapshot = FALSE;
+
             if (u->use_tsched) {
                 pa_usec_t cusec;
 
@@ -1808,9 +1918,14 @@ static void thread_func(void *userdata) {
         if (rtpoll_sleep > 0) {
             pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
             real_sleep = pa_rtclock_now();
+
+            if (!rewind_deferred)
+                u->next_wakeup = real_sleep + rtpoll_sleep;
         }
-        else
+        else {
             pa_rtpoll_set_timer_disabled(u->rtpoll);
+            u->next_wakeup = 0;
+        }
 
         /* Hmm, nothing to do. Let's sleep */
         if ((ret = pa_rtpoll_run(u->rtpoll, TRUE)) < 0)
@@ -2029,6 +2144,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark, rewind_safeguard;
     snd_pcm_uframes_t period_frames, buffer_frames, tsched_frames;
     size_t frame_size;
+    double dropout_probability = DEFAULT_TSCHED_DROPOUT_PROBABILITY;
     pa_bool_t use_mmap = TRUE, b, use_tsched = TRUE, d, ignore_dB = FALSE, namereg_fail = FALSE, deferred_volume = FALSE, set_formats = FALSE, fixed_latency_range = FALSE;
     pa_sink_new_data data;
     pa_alsa_profile_set *profile_set = NULL;
@@ -2105,6 +2221,12 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    if (pa_modargs_get_value_double(ma, "tsched_dropout_probability", &dropout_probability) < 0 ||
+        dropout_probability < 0.000001 || dropout_probability > 0.1) {
+        pa_log("Failed to parse tsched_dropout_probability argument.");
+        goto fail;
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -2116,6 +2238,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     u->fixed_latency_range = fixed_latency_range;
     u->first = TRUE;
     u->rewind_safeguard = rewind_safeguard;
+    u->watermark_controller = pa_watermark_controller_new(dropout_probability);
     u->rtpoll = pa_rtpoll_new();
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
 
@@ -2477,6 +2600,9 @@ static void userdata_free(struct userdata *u) {
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->watermark_controller)
+        pa_watermark_controller_free(u->watermark_controller);
+
     if (u->formats)
         pa_idxset_free(u->formats, (pa_free_cb_t) pa_format_info_free);
 
@@ -49,6 +49,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/watermark-controller.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -63,10 +64,8 @@
 #define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms */
 
 #define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  */
-#define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms */
-#define TSCHED_WATERMARK_VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)    /* 20s */
-#define TSCHED_WATERMARK_INC_THRESHOLD_USEC (0*PA_USEC_PER_MSEC)   /* 0ms */
-#define TSCHED_WATERMARK_DEC_THRESHOLD_USEC (100*PA_USEC_PER_MSEC) /* 100ms */
+#define TSCHED_WATERMARK_DEC_INTERVAL_USEC (1*PA_USEC_PER_SEC)     /* 1s */
+#define DEFAULT_TSCHED_DROPOUT_PROBABILITY (0.0001)                /* one in 10000 wakeups */
 #define TSCHED_WATERMARK_STEP_USEC (10*PA_USEC_PER_MSEC)           /* 10ms */
 
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms */
@@ -111,12 +110,11 @@ struct userdata {
         hwbuf_unused,
         min_sleep,
         min_wakeup,
-        watermark_inc_step,
-        watermark_dec_step,
-        watermark_inc_threshold,
-        watermark_dec_threshold;
+        watermark_inc_step;
 
+    pa_watermark_controller *watermark_controller;
     pa_usec_t watermark_dec_not_before;
+    pa_usec_t wakeup_deadline;
     pa_usec_t min_latency_ref;
 
     char *device_name;  /* name of the PCM device */
@@ -133,6 +131,15 @@ struct userdata {
     pa_usec_t smoother_interval;
     pa_usec_t last_smoother_update;
 
+    /* The last status snapshot, reused for the smoother update */
+    pa_bool_t have_snapshot;
+    pa_usec_t snapshot_time;
+    uint64_t snapshot_position;
+
+    /* Calls into the driver, for the statistics */
+    unsigned n_ioctls, ioctl_rate;
+    pa_usec_t ioctl_period_start;
+
     pa_reserve_wrapper *reserve;
     pa_hook_slot *reserve_slot;
     pa_reserve_monitor_wrapper *monitor;
@@ -333,38 +340,54 @@ static void increase_watermark(struct userdata *u) {
     /* When we reach this we're officialy fucked! */
 }
 
-static void decrease_watermark(struct userdata *u) {
-    size_t old_watermark;
-    pa_usec_t now;
+/* Follow the suggestion of the watermark controller: increase the
+ * watermark right away when our wakeups got later, decrease it at most
+ * once per TSCHED_WATERMARK_DEC_INTERVAL_USEC and by half at most. */
+static void adjust_watermark(struct userdata *u) {
+    size_t old_watermark, target;
+    pa_usec_t usec, now;
 
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    now = pa_rtclock_now();
-
-    if (u->watermark_dec_not_before <= 0)
-        goto restart;
-
-    if (u->watermark_dec_not_before > now)
+    if ((usec = pa_watermark_controller_get(u->watermark_controller)) <= 0)
         return;
 
+    target = pa_usec_to_bytes_round_up(usec, &u->source->sample_spec);
     old_watermark = u->tsched_watermark;
 
-    if (u->tsched_watermark < u->watermark_dec_step)
-        u->tsched_watermark = u->tsched_watermark / 2;
-    else
-        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
+    if (target > u->tsched_watermark)
+        u->tsched_watermark = target;
+    else if (target < u->tsched_watermark) {
+        now = pa_rtclock_now();
+
+        if (u->watermark_dec_not_before > now)
+            return;
+
+        u->tsched_watermark = PA_MAX(target, u->tsched_watermark / 2);
+        u->watermark_dec_not_before = now + TSCHED_WATERMARK_DEC_INTERVAL_USEC;
+    }
 
     fix_tsched_watermark(u);
 
+    /* We don't change the latency range*/
+
     if (old_watermark != u->tsched_watermark)
-        pa_log_info("Decreasing wakeup watermark to %0.2f ms",
+        pa_log_info("%s wakeup watermark to %0.2f ms",
+                    u->tsched_watermark > old_watermark ? "Increasing" : "Decreasing",
                     (double) pa_bytes_to_usec(u->tsched_watermark, &u->source->sample_spec) / PA_USEC_PER_MSEC);
+}
 
-    /* We don't change the latency range*/
+/* Called after data was taken from the device. Tells the controller
+ * how long it took since the timer should have woken us up. */
+static void account_wakeup(struct userdata *u) {
+    pa_assert(u);
+
+    if (u->wakeup_deadline <= 0)
+        return;
 
-restart:
-    u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+    pa_watermark_controller_add(u->watermark_controller, pa_rtclock_now() - u->wakeup_deadline);
+    u->wakeup_deadline = 0;
 }
 
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
@@ -452,26 +475,76 @@ static size_t check_left_to_record(struct userdata *u, size_t n_bytes, pa_bool_t
 #endif
 
     if (u->use_tsched) {
-        pa_bool_t reset_not_before = TRUE;
-
-        if (overrun || left_to_record < u->watermark_inc_threshold)
+        if (overrun) {
+            /* The controller's suggestion didn't hold, back off and
+             * make sure it doesn't suggest going back right away */
             increase_watermark(u);
-        else if (left_to_record > u->watermark_dec_threshold) {
-            reset_not_before = FALSE;
+            pa_watermark_controller_dropout(u->watermark_controller, pa_bytes_to_usec(u->tsched_watermark, &u->source->sample_spec));
+        } else if (on_timeout)
+            /* Only timer wakeups tell how close to the deadline we
+             * can get, if something else woke us up it's too easy to
+             * fulfill the deadlines... */
+            adjust_watermark(u);
+    }
 
-            /* We decrease the watermark only if have actually
-             * been woken up by a timeout. If something else woke
-             * us up it's too easy to fulfill the deadlines... */
+    /* What was left when the timer woke us up tells how close we cut
+     * it, later checks in the same wakeup don't */
+    if (on_timeout)
+        pa_render_profile_add(&u->source->render_profile, PA_RENDER_PROFILE_HEADROOM,
+                              pa_bytes_to_usec(left_to_record, &u->source->sample_spec));
 
-            if (on_timeout)
-                decrease_watermark(u);
-        }
+    return left_to_record;
+}
 
-        if (reset_not_before)
-            u->watermark_dec_not_before = 0;
+/* Called from IO context */
+static void count_ioctls(struct userdata *u, unsigned n) {
+    pa_usec_t now;
+
+    u->n_ioctls += n;
+
+    now = pa_rtclock_now();
+
+    if (u->ioctl_period_start <= 0)
+        u->ioctl_period_start = now;
+    else if (now - u->ioctl_period_start >= PA_USEC_PER_SEC) {
+        unsigned rate = (unsigned) ((uint64_t) u->n_ioctls * PA_USEC_PER_SEC / (now - u->ioctl_period_start));
+
+        /* Only tell when it changed noticeably */
+        if (rate > u->ioctl_rate + u->ioctl_rate / 10 || rate < u->ioctl_rate - u->ioctl_rate / 10)
+            pa_log_debug("%u ioctls per second on %s.", rate, u->device_name);
+
+        u->ioctl_rate = rate;
+        u->n_ioctls = 0;
+        u->ioctl_period_start = now;
     }
+}
 
-    return left_to_record;
+/* Gets avail, delay and timestamp from a single snd_pcm_status()
+ * call. The delay and timestamp are kept for update_smoother(). */
+static int query_status(struct userdata *u, snd_pcm_sframes_t *avail) {
+    snd_pcm_sframes_t delay = 0;
+    snd_pcm_status_t *status;
+    snd_htimestamp_t htstamp = { 0, 0 };
+    int err;
+
+    snd_pcm_status_alloca(&status);
+
+    count_ioctls(u, 1);
+
+    if (PA_UNLIKELY((err = pa_alsa_safe_status(u->pcm_handle, status, avail, &delay, u->hwbuf_size, &u->source->sample_spec, TRUE)) < 0))
+        return err;
+
+    snd_pcm_status_get_htstamp(status, &htstamp);
+    u->snapshot_time = pa_timespec_load(&htstamp);
+
+    /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
+    if (u->snapshot_time <= 0)
+        u->snapshot_time = pa_rtclock_now();
+
+    u->snapshot_position = u->read_count + ((uint64_t) delay * (uint64_t) u->frame_size);
+    u->have_snapshot = TRUE;
+
+    return 0;
 }
 
 static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled, pa_bool_t on_timeout) {
@@ -491,10 +564,11 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled
         size_t n_bytes;
         int r;
         pa_bool_t after_avail = TRUE;
+        pa_usec_t t;
 
-        if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->source->sample_spec)) < 0)) {
+        if (PA_UNLIKELY((r = query_status(u, &n)) < 0)) {
 
-            if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
+            if ((r = try_recover(u, "snd_pcm_status", r)) == 0)
                 continue;
 
             return r;
@@ -600,7 +674,12 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled
             pa_source_post(u->source, &chunk);
             pa_memblock_unref_fixed(chunk.memblock);
 
-            if (PA_UNLIKELY((sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames)) < 0)) {
+            t = pa_rtclock_now();
+            sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames);
+            count_ioctls(u, 1);
+            pa_render_profile_add(&u->source->render_profile, PA_RENDER_PROFILE_DEVICE_IO, pa_rtclock_now() - t);
+
+            if (PA_UNLIKELY(sframes < 0)) {
 
                 if ((r = try_recover(u, "snd_pcm_mmap_commit", (int) sframes)) == 0)
                     continue;
@@ -608,6 +687,8 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled
                 return r;
             }
 
+            account_wakeup(u);
+
             work_done = TRUE;
 
             u->read_count += frames * u->frame_size;
@@ -653,10 +734,11 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled
         size_t n_bytes;
         int r;
         pa_bool_t after_avail = TRUE;
+        pa_usec_t t;
 
-        if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->source->sample_spec)) < 0)) {
+        if (PA_UNLIKELY((r = query_status(u, &n)) < 0)) {
 
-            if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
+            if ((r = try_recover(u, "snd_pcm_status", r)) == 0)
                 continue;
 
             return r;
@@ -711,7 +793,10 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled
 /*             pa_log_debug("%lu frames to read", (unsigned long) n); */
 
             p = pa_memblock_acquire(chunk.memblock);
+            t = pa_rtclock_now();
             frames = snd_pcm_readi(u->pcm_handle, (uint8_t*) p, (snd_pcm_uframes_t) frames);
+            count_ioctls(u, 1);
+            pa_render_profile_add(&u->source->render_profile, PA_RENDER_PROFILE_DEVICE_IO, pa_rtclock_now() - t);
             pa_memblock_release(chunk.memblock);
 
             if (PA_UNLIKELY(frames < 0)) {
@@ -734,6 +819,8 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled
             pa_assert(frames > 0);
             after_avail = FALSE;
 
+            account_wakeup(u);
+
             chunk.index = 0;
             chunk.length = (size_t) frames * u->frame_size;
 
@@ -767,38 +854,34 @@ static int unix_read(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polled
 }
 
 static void update_smoother(struct userdata *u) {
-    snd_pcm_sframes_t delay = 0;
     uint64_t position;
     int err;
     pa_usec_t now1 = 0, now2;
-    snd_pcm_status_t *status;
-    snd_htimestamp_t htstamp = { 0, 0 };
-
-    snd_pcm_status_alloca(&status);
 
     pa_assert(u);
     pa_assert(u->pcm_handle);
 
-    /* Let's update the time smoother */
+    /* Let's update the time smoother, from the snapshot the read
+     * was based on if we have one */
 
-    if (PA_UNLIKELY((err = pa_alsa_safe_delay(u->pcm_handle, status, &delay, u->hwbuf_size, &u->source->sample_spec, TRUE)) < 0)) {
-        pa_log_warn("Failed to get delay: %s", pa_alsa_strerror(err));
-        return;
-    }
+    if (!u->have_snapshot) {
+        snd_pcm_sframes_t avail;
 
-    snd_pcm_status_get_htstamp(status, &htstamp);
-    now1 = pa_timespec_load(&htstamp);
+        if (PA_UNLIKELY((err = query_status(u, &avail)) < 0)) {
+            pa_log_warn("Failed to get delay: %s", pa_alsa_strerror(err));
+            return;
+        }
+    }
 
-    /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
-    if (now1 <= 0)
-        now1 = pa_rtclock_now();
+    u->have_snapshot = FALSE;
+    now1 = u->snapshot_time;
 
     /* check if the time since the last update is bigger than the interval */
     if (u->last_smoother_update > 0)
         if (u->last_smoother_update + u->smoother_interval > now1)
             return;
 
-    position = u->read_count + ((uint64_t) delay * (uint64_t) u->frame_size);
+    position = u->snapshot_position;
     now2 = pa_bytes_to_usec(position, &u->source->sample_spec);
 
     pa_smoother_put(u->smoother, now1, now2);
@@ -917,10 +1000,6 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
                                                     &u->source->sample_spec);
 
     u->watermark_inc_step = pa_usec_to_bytes(TSCHED_WATERMARK_INC_STEP_USEC, &u->source->sample_spec);
-    u->watermark_dec_step = pa_usec_to_bytes(TSCHED_WATERMARK_DEC_STEP_USEC, &u->source->sample_spec);
-
-    u->watermark_inc_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_INC_THRESHOLD_USEC, &u->source->sample_spec);
-    u->watermark_dec_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_DEC_THRESHOLD_USEC, &u->source->sample_spec);
 
     fix_min_sleep_wakeup(u);
     fix_tsched_watermark(u);
@@ -1464,9 +1543,19 @@ static void thread_func(void *userdata) {
             pa_usec_t sleep_usec = 0;
             pa_bool_t on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
 
+            if (on_timeout) {
+                pa_usec_t lateness = pa_rtpoll_get_timer_lateness(u->rtpoll);
+
+                pa_render_profile_add(&u->source->render_profile, PA_RENDER_PROFILE_WAKEUP_LATENESS, lateness);
+
+                if (u->use_tsched)
+                    u->wakeup_deadline = pa_rtclock_now() - lateness;
+            }
+
             if (u->first) {
                 pa_log_info("Starting capture.");
                 snd_pcm_start(u->pcm_handle);
+                count_ioctls(u, 1);
 
                 pa_smoother_resume(u->smoother, pa_rtclock_now(), TRUE);
 
@@ -1478,6 +1567,9 @@ static void thread_func(void *userdata) {
             else
                 work_done = unix_read(u, &sleep_usec, revents & POLLIN, on_timeout);
 
+            /* Nothing was read this time, don't count it later */
+            u->wakeup_deadline = 0;
+
             if (work_done < 0)
                 goto fail;
 
@@ -1486,6 +1578,8 @@ static void thread_func(void *userdata) {
             if (work_done)
                 update_smoother(u);
 
+            u->have_snapshot = FALSE;
+
             if (u->use_tsched) {
                 pa_usec_t cusec;
 
@@ -1737,6 +1831,7 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark;
     snd_pcm_uframes_t period_frames, buffer_frames, tsched_frames;
     size_t frame_size;
+    double dropout_probability = DEFAULT_TSCHED_DROPOUT_PROBABILITY;
     pa_bool_t use_mmap = TRUE, b, use_tsched = TRUE, d, ignore_dB = FALSE, namereg_fail = FALSE, deferred_volume = FALSE, fixed_latency_range = FALSE;
     pa_source_new_data data;
     pa_alsa_profile_set *profile_set = NULL;
@@ -1807,6 +1902,12 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
         goto fail;
     }
 
+    if (pa_modargs_get_value_double(ma, "tsched_dropout_probability", &dropout_probability) < 0 ||
+        dropout_probability < 0.000001 || dropout_probability > 0.1) {
+        pa_log("Failed to parse tsched_dropout_probability argument.");
+        goto fail;
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -1817,6 +1918,7 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     u->deferred_volume = deferred_volume;
     u->fixed_latency_range = fixed_latency_range;
     u->first = TRUE;
+    u->watermark_controller = pa_watermark_controller_new(dropout_probability);
     u->rtpoll = pa_rtpoll_new();
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
 
@@ -2148,6 +2250,9 @@ static void userdata_free(struct userdata *u) {
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->watermark_controller)
+        pa_watermark_controller_free(u->watermark_controller);
+
     if (u->rates)
         pa_xfree(u->rates);
 
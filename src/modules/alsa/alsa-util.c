@@ -1102,19 +1102,12 @@ pa_rtpoll_item* pa_alsa_build_pollfd(snd_pcm_t *pcm, pa_rtpoll *rtpoll) {
     return item;
 }
 
-snd_pcm_sframes_t pa_alsa_safe_avail(snd_pcm_t *pcm, size_t hwbuf_size, const pa_sample_spec *ss) {
-    snd_pcm_sframes_t n;
+static snd_pcm_sframes_t check_avail(snd_pcm_t *pcm, snd_pcm_sframes_t n, size_t hwbuf_size, const pa_sample_spec *ss) {
     size_t k;
 
-    pa_assert(pcm);
-    pa_assert(hwbuf_size > 0);
-    pa_assert(ss);
-
     /* Some ALSA driver expose weird bugs, let's inform the user about
      * what is going on */
 
-    n = snd_pcm_avail(pcm);
-
     if (n <= 0)
         return n;
 
@@ -1141,6 +1134,14 @@ snd_pcm_sframes_t pa_alsa_safe_avail(snd_pcm_t *pcm, size_t hwbuf_size, const pa
     return n;
 }
 
+snd_pcm_sframes_t pa_alsa_safe_avail(snd_pcm_t *pcm, size_t hwbuf_size, const pa_sample_spec *ss) {
+    pa_assert(pcm);
+    pa_assert(hwbuf_size > 0);
+    pa_assert(ss);
+
+    return check_avail(pcm, snd_pcm_avail(pcm), hwbuf_size, ss);
+}
+
 int pa_alsa_safe_delay(snd_pcm_t *pcm, snd_pcm_status_t *status, snd_pcm_sframes_t *delay, size_t hwbuf_size, const pa_sample_spec *ss,
                        pa_bool_t capture) {
     ssize_t k;
@@ -1233,6 +1234,25 @@ int pa_alsa_safe_delay(snd_pcm_t *pcm, snd_pcm_status_t *status, snd_pcm_sframes
     return 0;
 }
 
+int pa_alsa_safe_status(snd_pcm_t *pcm, snd_pcm_status_t *status, snd_pcm_sframes_t *avail, snd_pcm_sframes_t *delay, size_t hwbuf_size, const pa_sample_spec *ss,
+                        pa_bool_t capture) {
+    int err;
+
+    pa_assert(pcm);
+    pa_assert(avail);
+
+    if ((err = pa_alsa_safe_delay(pcm, status, delay, hwbuf_size, ss, capture)) < 0)
+        return err;
+
+    /* snd_pcm_status() already synchronized the hardware pointer, so
+     * unlike snd_pcm_avail() this doesn't need to ask the driver
+     * again. It still has to be called, since the mmap functions
+     * and plugins rely on the pointers it updates. */
+    *avail = check_avail(pcm, snd_pcm_avail_update(pcm), hwbuf_size, ss);
+
+    return *avail < 0 ? (int) *avail : 0;
+}
+
 int pa_alsa_safe_mmap_begin(snd_pcm_t *pcm, const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames, size_t hwbuf_size, const pa_sample_spec *ss) {
     int r;
     snd_pcm_uframes_t before;
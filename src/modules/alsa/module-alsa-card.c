@@ -23,9 +23,12 @@
 #include <config.h>
 #endif
 
+#include <dirent.h>
+
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/queue.h>
@@ -64,6 +67,7 @@ PA_MODULE_USAGE(
         "tsched=<enable system timer based scheduling mode?> "
         "tsched_buffer_size=<buffer size when using timer based scheduling> "
         "tsched_buffer_watermark=<lower fill watermark> "
+        "tsched_dropout_probability=<acceptable dropout probability per wakeup> "
         "profile=<profile name> "
         "fixed_latency_range=<disable latency range changes on underrun?> "
         "ignore_dB=<ignore dB information from the device?> "
@@ -71,6 +75,7 @@ PA_MODULE_USAGE(
         "profile_set=<profile set configuration file> "
         "paths_dir=<directory containing the path configuration files> "
         "use_ucm=<load use case manager> "
+        "probe_cache=<reuse the results of earlier probes of this card?> "
 );
 
 static const char* const valid_modargs[] = {
@@ -91,6 +96,7 @@ static const char* const valid_modargs[] = {
     "tsched",
     "tsched_buffer_size",
     "tsched_buffer_watermark",
+    "tsched_dropout_probability",
     "fixed_latency_range",
     "profile",
     "ignore_dB",
@@ -98,11 +104,14 @@ static const char* const valid_modargs[] = {
     "profile_set",
     "paths_dir",
     "use_ucm",
+    "probe_cache",
     NULL
 };
 
 #define DEFAULT_DEVICE_ID "0"
 
+#define PROBE_CACHE_VERSION 1
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -121,6 +130,20 @@ struct userdata {
 
     pa_alsa_profile_set *profile_set;
 
+    /* Held while the card is being set up */
+    pa_reserve_wrapper *reserve;
+
+    /* Copies of the core settings the probe needs, since it may run
+     * on a worker thread */
+    pa_sample_spec probe_sample_spec;
+    unsigned probe_n_fragments, probe_fragment_size_msec;
+
+    /* Identify the card and its configuration in the probe cache */
+    char *probe_cache_key;
+    char *probe_cache_stamp;
+    pa_bool_t probe_cached;
+    pa_bool_t probe_cache_save;
+
     /* ucm stuffs */
     pa_bool_t use_ucm;
     pa_alsa_ucm_config ucm;
@@ -603,17 +626,295 @@ static pa_hook_result_t source_output_unlink_hook_callback(pa_core *c, pa_source
     return PA_HOOK_OK;
 }
 
-int pa__init(pa_module *m) {
+/* Probing fails for PCMs which somebody else has open, and such
+ * results must not end up in the cache */
+static pa_bool_t card_in_use(int alsa_card_index) {
+    char *dn;
+    DIR *d;
+    struct dirent *de;
+    pa_bool_t busy = FALSE;
+
+    dn = pa_sprintf_malloc("/proc/asound/card%i", alsa_card_index);
+
+    if (!(d = opendir(dn))) {
+        /* We can't tell */
+        pa_xfree(dn);
+        return TRUE;
+    }
+
+    while (!busy && (de = readdir(d))) {
+        unsigned sub;
+
+        if (!pa_startswith(de->d_name, "pcm"))
+            continue;
+
+        for (sub = 0; !busy; sub++) {
+            char *fn, *ln;
+
+            fn = pa_sprintf_malloc("%s/%s/sub%u/status", dn, de->d_name, sub);
+            ln = pa_read_line_from_file(fn);
+            pa_xfree(fn);
+
+            if (!ln)
+                break;
+
+            busy = !pa_streq(ln, "closed");
+            pa_xfree(ln);
+        }
+    }
+
+    closedir(d);
+    pa_xfree(dn);
+
+    return busy;
+}
+
+static char *probe_cache_key(int alsa_card_index, const char *profile_set) {
+    snd_ctl_t *ctl;
+    snd_ctl_card_info_t *info;
+    char *dev, *key = NULL;
+    int err;
+
+    snd_ctl_card_info_alloca(&info);
+
+    dev = pa_sprintf_malloc("hw:%i", alsa_card_index);
+
+    if ((err = snd_ctl_open(&ctl, dev, 0)) < 0) {
+        pa_log_debug("Failed to open control device %s: %s", dev, pa_alsa_strerror(err));
+        pa_xfree(dev);
+        return NULL;
+    }
+
+    if ((err = snd_ctl_card_info(ctl, info)) < 0)
+        pa_log_debug("Failed to get card info of %s: %s", dev, pa_alsa_strerror(err));
+    else
+        key = pa_sprintf_malloc("%s\n%s\n%s\n%s\n%s",
+                                snd_ctl_card_info_get_driver(info),
+                                snd_ctl_card_info_get_longname(info),
+                                snd_ctl_card_info_get_mixername(info),
+                                snd_ctl_card_info_get_components(info),
+                                pa_strnull(profile_set));
+
+    snd_ctl_close(ctl);
+    pa_xfree(dev);
+
+    return key;
+}
+
+static char *probe_cache_stamp(struct userdata *u, const char *profile_set) {
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX];
+    char *config, *stamp;
+
+    config = pa_alsa_profile_set_config_stamp(profile_set, NULL);
+    stamp = pa_sprintf_malloc("%s %s %u %u %s", config,
+                              pa_sample_spec_snprint(ss, sizeof(ss), &u->probe_sample_spec),
+                              u->probe_n_fragments, u->probe_fragment_size_msec,
+                              pa_yes_no(u->profile_set->ignore_dB));
+    pa_xfree(config);
+
+    return stamp;
+}
+
+static pa_database *probe_cache_open(pa_bool_t for_write) {
+    pa_database *db;
+    char *fn;
+
+    if (!(fn = pa_state_path("alsa-probe-cache", TRUE)))
+        return NULL;
+
+    db = pa_database_open(fn, for_write);
+    pa_xfree(fn);
+
+    return db;
+}
+
+static void probe_cache_load(struct userdata *u, const char *profile_set) {
+    pa_database *db;
+    pa_datum key, data;
+
+    pa_assert(u);
+
+    if (!(u->probe_cache_key = probe_cache_key(u->alsa_card_index, profile_set)))
+        return;
+
+    u->probe_cache_stamp = probe_cache_stamp(u, profile_set);
+    u->probe_cache_save = !card_in_use(u->alsa_card_index);
+
+    if (!(db = probe_cache_open(FALSE)))
+        return;
+
+    key.data = u->probe_cache_key;
+    key.size = strlen(u->probe_cache_key);
+
+    pa_zero(data);
+
+    if (pa_database_get(db, &key, &data)) {
+        pa_tagstruct *t;
+        uint8_t version;
+        const char *stamp;
+
+        t = pa_tagstruct_new(data.data, data.size);
+
+        if (pa_tagstruct_getu8(t, &version) < 0 ||
+            version != PROBE_CACHE_VERSION ||
+            pa_tagstruct_gets(t, &stamp) < 0 ||
+            !stamp ||
+            !pa_streq(stamp, u->probe_cache_stamp))
+            pa_log_debug("Cached probe results for card %s are outdated.", u->device_id);
+        else if (pa_alsa_profile_set_load_probe(u->profile_set, t, u->alsa_card_index) < 0)
+            pa_log_warn("Cached probe results for card %s are invalid, probing again.", u->device_id);
+        else {
+            pa_log_info("Using cached probe results for card %s.", u->device_id);
+            u->probe_cached = TRUE;
+        }
+
+        pa_tagstruct_free(t);
+        pa_datum_free(&data);
+    }
+
+    pa_database_close(db);
+}
+
+static void probe_cache_store(struct userdata *u) {
+    pa_database *db;
+    pa_datum key, data;
+    pa_tagstruct *t;
+
+    pa_assert(u);
+
+    if (!u->probe_cache_key || u->probe_cached)
+        return;
+
+    if (!u->probe_cache_save || card_in_use(u->alsa_card_index)) {
+        pa_log_debug("Card %s is in use, not caching its probe results.", u->device_id);
+        return;
+    }
+
+    if (!(db = probe_cache_open(TRUE))) {
+        pa_log_debug("Failed to open the probe cache.");
+        return;
+    }
+
+    t = pa_tagstruct_new(NULL, 0);
+    pa_tagstruct_putu8(t, PROBE_CACHE_VERSION);
+    pa_tagstruct_puts(t, u->probe_cache_stamp);
+    pa_alsa_profile_set_save_probe(u->profile_set, t);
+
+    key.data = u->probe_cache_key;
+    key.size = strlen(u->probe_cache_key);
+
+    data.data = (void*) pa_tagstruct_data(t, &data.size);
+
+    if (pa_database_set(db, &key, &data, TRUE) < 0)
+        pa_log_warn("Failed to store the probe results for card %s.", u->device_id);
+
+    pa_tagstruct_free(t);
+    pa_database_close(db);
+}
+
+static void card_probe(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &u->probe_sample_spec, u->probe_n_fragments, u->probe_fragment_size_msec);
+    pa_alsa_profile_set_dump(u->profile_set);
+}
+
+/* Registers the card once its profiles are probed. On failure pa__done()
+ * is left to the caller. */
+static int card_init(pa_module *m, void *userdata) {
+    struct userdata *u = userdata;
     pa_card_new_data data;
-    pa_modargs *ma;
-    pa_bool_t ignore_dB = FALSE;
-    struct userdata *u;
-    pa_reserve_wrapper *reserve = NULL;
     const char *description;
     const char *profile = NULL;
-    char *fn = NULL;
     pa_bool_t namereg_fail = FALSE;
 
+    pa_assert(m);
+    pa_assert(u);
+
+    pa_card_new_data_init(&data);
+    data.driver = __FILE__;
+    data.module = m;
+
+    pa_alsa_init_proplist_card(m->core, data.proplist, u->alsa_card_index);
+
+    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_STRING, u->device_id);
+    pa_alsa_init_description(data.proplist);
+    set_card_name(&data, u->modargs, u->device_id);
+
+    /* We need to give pa_modargs_get_value_boolean() a pointer to a local
+     * variable instead of using &data.namereg_fail directly, because
+     * data.namereg_fail is a bitfield and taking the address of a bitfield
+     * variable is impossible. */
+    namereg_fail = data.namereg_fail;
+    if (pa_modargs_get_value_boolean(u->modargs, "namereg_fail", &namereg_fail) < 0) {
+        pa_log("Failed to parse namereg_fail argument.");
+        pa_card_new_data_done(&data);
+        return -1;
+    }
+    data.namereg_fail = namereg_fail;
+
+    if (u->reserve)
+        if ((description = pa_proplist_gets(data.proplist, PA_PROP_DEVICE_DESCRIPTION)))
+            pa_reserve_wrapper_set_application_device_name(u->reserve, description);
+
+    add_profiles(u, data.profiles, data.ports);
+
+    if (pa_hashmap_isempty(data.profiles)) {
+        pa_log("Failed to find a working profile.");
+        pa_card_new_data_done(&data);
+        return -1;
+    }
+
+    probe_cache_store(u);
+
+    add_disabled_profile(data.profiles);
+
+    if (pa_modargs_get_proplist(u->modargs, "card_properties", data.proplist, PA_UPDATE_REPLACE) < 0) {
+        pa_log("Invalid properties");
+        pa_card_new_data_done(&data);
+        return -1;
+    }
+
+    if ((profile = pa_modargs_get_value(u->modargs, "profile", NULL)))
+        pa_card_new_data_set_profile(&data, profile);
+
+    u->card = pa_card_new(m->core, &data);
+    pa_card_new_data_done(&data);
+
+    if (!u->card)
+        return -1;
+
+    u->card->userdata = u;
+    u->card->set_profile = card_set_profile;
+
+    init_jacks(u);
+    init_profile(u);
+    init_eld_ctls(u);
+
+    if (u->reserve) {
+        pa_reserve_wrapper_unref(u->reserve);
+        u->reserve = NULL;
+    }
+
+    if (!pa_hashmap_isempty(u->profile_set->decibel_fixes))
+        pa_log_warn("Card %s uses decibel fixes (i.e. overrides the decibel information for some alsa volume elements). "
+                    "Please note that this feature is meant just as a help for figuring out the correct decibel values. "
+                    "PulseAudio is not the correct place to maintain the decibel mappings! The fixed decibel values "
+                    "should be sent to ALSA developers so that they can fix the driver. If it turns out that this feature "
+                    "is abused (i.e. fixes are not pushed to ALSA), the decibel fix feature may be removed in some future "
+                    "PulseAudio version.", u->card->name);
+
+    return 0;
+}
+
+int pa__init(pa_module *m) {
+    pa_modargs *ma;
+    pa_bool_t ignore_dB = FALSE, probe_cache = TRUE;
+    struct userdata *u;
+    char *fn = NULL;
+
     pa_alsa_refcnt_inc();
 
     pa_assert(m);
@@ -628,6 +929,11 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "probe_cache", &probe_cache) < 0) {
+        pa_log("Failed to parse probe_cache argument.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
@@ -646,10 +952,10 @@ int pa__init(pa_module *m) {
         char *rname;
 
         if ((rname = pa_alsa_get_reserve_name(u->device_id))) {
-            reserve = pa_reserve_wrapper_get(m->core, rname);
+            u->reserve = pa_reserve_wrapper_get(m->core, rname);
             pa_xfree(rname);
 
-            if (!reserve)
+            if (!u->reserve)
                 goto fail;
         }
     }
@@ -686,7 +992,6 @@ int pa__init(pa_module *m) {
         }
 
         u->profile_set = pa_alsa_profile_set_new(fn, &u->core->default_channel_map);
-        pa_xfree(fn);
     }
 
     if (!u->profile_set)
@@ -694,84 +999,30 @@ int pa__init(pa_module *m) {
 
     u->profile_set->ignore_dB = ignore_dB;
 
-    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
-    pa_alsa_profile_set_dump(u->profile_set);
+    u->probe_sample_spec = m->core->default_sample_spec;
+    u->probe_n_fragments = m->core->default_n_fragments;
+    u->probe_fragment_size_msec = m->core->default_fragment_size_msec;
 
-    pa_card_new_data_init(&data);
-    data.driver = __FILE__;
-    data.module = m;
+    /* UCM profile sets are not probed the same way */
+    if (!u->use_ucm && probe_cache)
+        probe_cache_load(u, fn);
 
-    pa_alsa_init_proplist_card(m->core, data.proplist, u->alsa_card_index);
+    pa_xfree(fn);
+    fn = NULL;
 
-    pa_proplist_sets(data.proplist, PA_PROP_DEVICE_STRING, u->device_id);
-    pa_alsa_init_description(data.proplist);
-    set_card_name(&data, ma, u->device_id);
-
-    /* We need to give pa_modargs_get_value_boolean() a pointer to a local
-     * variable instead of using &data.namereg_fail directly, because
-     * data.namereg_fail is a bitfield and taking the address of a bitfield
-     * variable is impossible. */
-    namereg_fail = data.namereg_fail;
-    if (pa_modargs_get_value_boolean(ma, "namereg_fail", &namereg_fail) < 0) {
-        pa_log("Failed to parse namereg_fail argument.");
-        pa_card_new_data_done(&data);
-        goto fail;
-    }
-    data.namereg_fail = namereg_fail;
-
-    if (reserve)
-        if ((description = pa_proplist_gets(data.proplist, PA_PROP_DEVICE_DESCRIPTION)))
-            pa_reserve_wrapper_set_application_device_name(reserve, description);
-
-    add_profiles(u, data.profiles, data.ports);
-
-    if (pa_hashmap_isempty(data.profiles)) {
-        pa_log("Failed to find a working profile.");
-        pa_card_new_data_done(&data);
-        goto fail;
-    }
-
-    add_disabled_profile(data.profiles);
-
-    if (pa_modargs_get_proplist(ma, "card_properties", data.proplist, PA_UPDATE_REPLACE) < 0) {
-        pa_log("Invalid properties");
-        pa_card_new_data_done(&data);
-        goto fail;
-    }
-
-    if ((profile = pa_modargs_get_value(ma, "profile", NULL)))
-        pa_card_new_data_set_profile(&data, profile);
-
-    u->card = pa_card_new(m->core, &data);
-    pa_card_new_data_done(&data);
+    /* Make sure the global ALSA configuration is loaded here, so that
+     * concurrent probes of several cards only ever read it */
+    snd_config_update();
 
-    if (!u->card)
+    /* Opening all the PCMs and mixers is what takes long, so this may
+     * happen in parallel with other cards */
+    if (pa_module_probe(m, card_probe, card_init, u) < 0)
         goto fail;
 
-    u->card->userdata = u;
-    u->card->set_profile = card_set_profile;
-
-    init_jacks(u);
-    init_profile(u);
-    init_eld_ctls(u);
-
-    if (reserve)
-        pa_reserve_wrapper_unref(reserve);
-
-    if (!pa_hashmap_isempty(u->profile_set->decibel_fixes))
-        pa_log_warn("Card %s uses decibel fixes (i.e. overrides the decibel information for some alsa volume elements). "
-                    "Please note that this feature is meant just as a help for figuring out the correct decibel values. "
-                    "PulseAudio is not the correct place to maintain the decibel mappings! The fixed decibel values "
-                    "should be sent to ALSA developers so that they can fix the driver. If it turns out that this feature "
-                    "is abused (i.e. fixes are not pushed to ALSA), the decibel fix feature may be removed in some future "
-                    "PulseAudio version.", u->card->name);
-
     return 0;
 
 fail:
-    if (reserve)
-        pa_reserve_wrapper_unref(reserve);
-
+    pa_xfree(fn);
     pa__done(m);
 
     return -1;
@@ -839,6 +1090,12 @@ void pa__done(pa_module*m) {
     if (u->profile_set)
         pa_alsa_profile_set_free(u->profile_set);
 
+    if (u->reserve)
+        pa_reserve_wrapper_unref(u->reserve);
+
+    pa_xfree(u->probe_cache_key);
+    pa_xfree(u->probe_cache_stamp);
+
     pa_alsa_ucm_free(&u->ucm);
 
     pa_xfree(u->device_id);
@@ -54,6 +54,7 @@ PA_MODULE_USAGE(
         "tsched=<enable system timer based scheduling mode?> "
         "tsched_buffer_size=<buffer size when using timer based scheduling> "
         "tsched_buffer_watermark=<lower fill watermark> "
+        "tsched_dropout_probability=<acceptable underrun probability per wakeup> "
         "ignore_dB=<ignore dB information from the device?> "
         "control=<name of mixer control> "
         "rewind_safeguard=<number of bytes that cannot be rewound> "
@@ -80,6 +81,7 @@ static const char* const valid_modargs[] = {
     "tsched",
     "tsched_buffer_size",
     "tsched_buffer_watermark",
+    "tsched_dropout_probability",
     "ignore_dB",
     "control",
     "rewind_safeguard",
@@ -63,6 +63,7 @@ PA_MODULE_USAGE(
         "tsched=<enable system timer based scheduling mode?> "
         "tsched_buffer_size=<buffer size when using timer based scheduling> "
         "tsched_buffer_watermark=<upper fill watermark> "
+        "tsched_dropout_probability=<acceptable overrun probability per wakeup> "
         "ignore_dB=<ignore dB information from the device?> "
         "control=<name of mixer control>"
         "deferred_volume=<Synchronize software and hardware volume changes to avoid momentary jumps?> "
@@ -88,6 +89,7 @@ static const char* const valid_modargs[] = {
     "tsched",
     "tsched_buffer_size",
     "tsched_buffer_watermark",
+    "tsched_dropout_probability",
     "ignore_dB",
     "control",
     "deferred_volume",
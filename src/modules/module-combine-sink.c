@@ -43,6 +43,9 @@
 #include <pulsecore/namereg.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/asyncq.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/flist.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
 #include <pulsecore/strlist.h>
@@ -85,6 +88,17 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
+/* A block rendered by the combine sink that some outputs still have
+ * to pick up. The same entry is queued for every output that was
+ * active when it was rendered (except the one that requested it) and
+ * is released as soon as the last of them has read it. */
+struct cache_entry {
+    pa_memchunk chunk;
+    pa_atomic_t readers;
+};
+
+PA_STATIC_FLIST_DECLARE(cache_entries, 0, pa_xfree);
+
 struct output {
     struct userdata *userdata;
 
@@ -92,13 +106,16 @@ struct output {
     pa_sink_input *sink_input;
     pa_bool_t ignore_state_change;
 
-    pa_asyncmsgq *inq,    /* Message queue from the sink thread to this sink input */
-                 *outq;   /* Message queue from this sink input to the sink thread */
-    pa_rtpoll_item *inq_rtpoll_item_read, *inq_rtpoll_item_write;
+    pa_asyncmsgq *outq;   /* Message queue from this sink input to the sink thread */
     pa_rtpoll_item *outq_rtpoll_item_read, *outq_rtpoll_item_write;
 
     pa_memblockq *memblockq;
 
+    /* Rendered blocks from the sink thread to us, and how many bytes
+     * are waiting in there */
+    pa_asyncq *cache;
+    pa_atomic_t cache_pending;
+
     /* For communication of the stream latencies to the main thread */
     pa_usec_t total_latency;
 
@@ -153,10 +170,6 @@ enum {
     SINK_MESSAGE_UPDATE_REQUESTED_LATENCY
 };
 
-enum {
-    SINK_INPUT_MESSAGE_POST = PA_SINK_INPUT_MESSAGE_MAX,
-};
-
 static void output_disable(struct output *o);
 static void output_enable(struct output *o);
 static void output_free(struct output *o);
@@ -348,6 +361,102 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* Called from any context */
+static void cache_entry_unref(struct cache_entry *e) {
+    pa_assert(e);
+
+    if (pa_atomic_dec(&e->readers) > 1)
+        return;
+
+    pa_memblock_unref(e->chunk.memblock);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(cache_entries), e) < 0)
+        pa_xfree(e);
+}
+
+/* Called from I/O thread context of the combine sink */
+static void cache_push(struct userdata *u, struct output *requester, const pa_memchunk *chunk) {
+    struct cache_entry *e;
+    struct output *j;
+    unsigned readers = 0;
+
+    pa_assert(u);
+    pa_assert(requester);
+    pa_assert(chunk);
+
+    PA_LLIST_FOREACH(j, u->thread_info.active_outputs)
+        if (j != requester)
+            readers++;
+
+    if (readers <= 0)
+        return;
+
+    if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(cache_entries))))
+        e = pa_xnew(struct cache_entry, 1);
+
+    e->chunk = *chunk;
+    pa_memblock_ref(e->chunk.memblock);
+    pa_atomic_store(&e->readers, (int) readers);
+
+    PA_LLIST_FOREACH(j, u->thread_info.active_outputs) {
+        if (j == requester)
+            continue;
+
+        /* Don't let a stalled output pin an unbounded amount of
+         * memory. Outputs that lag behind further than this, or
+         * whose queue is full, simply miss this block. */
+        if ((size_t) pa_atomic_load(&j->cache_pending) + chunk->length > MEMBLOCKQ_MAXLENGTH) {
+            cache_entry_unref(e);
+            continue;
+        }
+
+        pa_atomic_add(&j->cache_pending, (int) chunk->length);
+
+        if (pa_asyncq_push(j->cache, e, FALSE) < 0) {
+            pa_atomic_sub(&j->cache_pending, (int) chunk->length);
+            cache_entry_unref(e);
+        }
+    }
+}
+
+/* Called from I/O thread context of the output, or of the combine sink
+ * while the output is waiting for it */
+static void cache_pull(struct output *o) {
+    struct cache_entry *e;
+
+    pa_assert(o);
+
+    while ((e = pa_asyncq_pop(o->cache, FALSE))) {
+        pa_atomic_sub(&o->cache_pending, (int) e->chunk.length);
+
+        if (PA_SINK_IS_OPENED(o->sink_input->sink->thread_info.state))
+            pa_memblockq_push_align(o->memblockq, &e->chunk);
+        else
+            pa_memblockq_flush_write(o->memblockq, TRUE);
+
+        cache_entry_unref(e);
+    }
+}
+
+/* Called from main context, once the output is no longer active */
+static void cache_flush(struct output *o) {
+    struct cache_entry *e;
+
+    pa_assert(o);
+
+    while ((e = pa_asyncq_pop(o->cache, FALSE)))
+        cache_entry_unref(e);
+
+    pa_atomic_store(&o->cache_pending, 0);
+}
+
+/* Called from any context */
+static size_t cache_get_pending(struct output *o) {
+    pa_assert(o);
+
+    return (size_t) pa_atomic_load(&o->cache_pending);
+}
+
 /* Called from I/O thread context */
 static void render_memblock(struct userdata *u, struct output *o, size_t length) {
     pa_assert(u);
@@ -355,20 +464,17 @@ static void render_memblock(struct userdata *u, struct output *o, size_t length)
 
     /* We are run by the sink thread, on behalf of an output (o). The
      * output is waiting for us, hence it is safe to access its
-     * mainblockq and asyncmsgq directly. */
+     * memblockq directly. */
 
     /* If we are not running, we cannot produce any data */
     if (!pa_atomic_load(&u->thread_info.running))
         return;
 
-    /* Maybe there's some data in the requesting output's queue
-     * now? */
-    while (pa_asyncmsgq_process_one(o->inq) > 0)
-        ;
+    /* Maybe another output made us render something in the meantime? */
+    cache_pull(o);
 
     /* Ok, now let's prepare some data if we really have to */
     while (!pa_memblockq_is_readable(o->memblockq)) {
-        struct output *j;
         pa_memchunk chunk;
 
         /* Render data! */
@@ -376,13 +482,9 @@ static void render_memblock(struct userdata *u, struct output *o, size_t length)
 
         u->thread_info.counter += chunk.length;
 
-        /* OK, let's send this data to the other threads */
-        PA_LLIST_FOREACH(j, u->thread_info.active_outputs) {
-            if (j == o)
-                continue;
-
-            pa_asyncmsgq_post(j->inq, PA_MSGOBJECT(j->sink_input), SINK_INPUT_MESSAGE_POST, NULL, 0, &chunk, NULL);
-        }
+        /* OK, let's make this data available to the other outputs,
+         * they will pick it up from the cache when they need it */
+        cache_push(u, o, &chunk);
 
         /* And place it directly into the requesting output's queue */
         pa_memblockq_push_align(o->memblockq, &chunk);
@@ -396,11 +498,9 @@ static void request_memblock(struct output *o, size_t length) {
     pa_sink_input_assert_ref(o->sink_input);
     pa_sink_assert_ref(o->userdata->sink);
 
-    /* If another thread already prepared some data we received
-     * the data over the asyncmsgq, hence let's first process
-     * it. */
-    while (pa_asyncmsgq_process_one(o->inq) > 0)
-        ;
+    /* If another thread already prepared some data it is waiting
+     * for us in the render cache, hence let's first pick it up. */
+    cache_pull(o);
 
     /* Check whether we're now readable */
     if (pa_memblockq_is_readable(o->memblockq))
@@ -500,13 +600,8 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(o = i->userdata);
 
-    /* Set up the queue from the sink thread to us */
-    pa_assert(!o->inq_rtpoll_item_read && !o->outq_rtpoll_item_write);
-
-    o->inq_rtpoll_item_read = pa_rtpoll_item_new_asyncmsgq_read(
-            i->sink->thread_info.rtpoll,
-            PA_RTPOLL_LATE,  /* This one is not that important, since we check for data in _peek() anyway. */
-            o->inq);
+    /* Set up the queue from us to the sink thread */
+    pa_assert(!o->outq_rtpoll_item_write);
 
     o->outq_rtpoll_item_write = pa_rtpoll_item_new_asyncmsgq_write(
             i->sink->thread_info.rtpoll,
@@ -531,11 +626,6 @@ static void sink_input_detach_cb(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(o = i->userdata);
 
-    if (o->inq_rtpoll_item_read) {
-        pa_rtpoll_item_free(o->inq_rtpoll_item_read);
-        o->inq_rtpoll_item_read = NULL;
-    }
-
     if (o->outq_rtpoll_item_write) {
         pa_rtpoll_item_free(o->outq_rtpoll_item_write);
         o->outq_rtpoll_item_write = NULL;
@@ -563,21 +653,13 @@ static int sink_input_process_msg(pa_msgobject *obj, int code, void *data, int64
         case PA_SINK_INPUT_MESSAGE_GET_LATENCY: {
             pa_usec_t *r = data;
 
-            *r = pa_bytes_to_usec(pa_memblockq_get_length(o->memblockq), &o->sink_input->sample_spec);
+            *r = pa_bytes_to_usec(pa_memblockq_get_length(o->memblockq) + cache_get_pending(o),
+                                  &o->sink_input->sample_spec);
 
             /* Fall through, the default handler will add in the extra
              * latency added by the resampler */
             break;
         }
-
-        case SINK_INPUT_MESSAGE_POST:
-
-            if (PA_SINK_IS_OPENED(o->sink_input->sink->thread_info.state))
-                pa_memblockq_push_align(o->memblockq, chunk);
-            else
-                pa_memblockq_flush_write(o->memblockq, TRUE);
-
-            return 0;
     }
 
     return pa_sink_input_process_msg(obj, code, data, offset, chunk);
@@ -703,16 +785,12 @@ static void output_add_within_thread(struct output *o) {
 
     PA_LLIST_PREPEND(struct output, o->userdata->thread_info.active_outputs, o);
 
-    pa_assert(!o->outq_rtpoll_item_read && !o->inq_rtpoll_item_write);
+    pa_assert(!o->outq_rtpoll_item_read);
 
     o->outq_rtpoll_item_read = pa_rtpoll_item_new_asyncmsgq_read(
             o->userdata->rtpoll,
             PA_RTPOLL_EARLY-1,  /* This item is very important */
             o->outq);
-    o->inq_rtpoll_item_write = pa_rtpoll_item_new_asyncmsgq_write(
-            o->userdata->rtpoll,
-            PA_RTPOLL_EARLY,
-            o->inq);
 }
 
 /* Called from thread context of the io thread */
@@ -726,11 +804,6 @@ static void output_remove_within_thread(struct output *o) {
         pa_rtpoll_item_free(o->outq_rtpoll_item_read);
         o->outq_rtpoll_item_read = NULL;
     }
-
-    if (o->inq_rtpoll_item_write) {
-        pa_rtpoll_item_free(o->inq_rtpoll_item_write);
-        o->inq_rtpoll_item_write = NULL;
-    }
 }
 
 /* Called from thread context of the io thread */
@@ -898,8 +971,8 @@ static struct output *output_new(struct userdata *u, pa_sink *sink) {
 
     o = pa_xnew0(struct output, 1);
     o->userdata = u;
-    o->inq = pa_asyncmsgq_new(0);
     o->outq = pa_asyncmsgq_new(0);
+    o->cache = pa_asyncq_new(0);
     o->sink = sink;
     o->memblockq = pa_memblockq_new(
             "module-combine-sink output memblockq",
@@ -927,22 +1000,17 @@ static void output_free(struct output *o) {
     pa_assert_se(pa_idxset_remove_by_data(o->userdata->outputs, o, NULL));
     update_description(o->userdata);
 
-    if (o->inq_rtpoll_item_read)
-        pa_rtpoll_item_free(o->inq_rtpoll_item_read);
-    if (o->inq_rtpoll_item_write)
-        pa_rtpoll_item_free(o->inq_rtpoll_item_write);
-
     if (o->outq_rtpoll_item_read)
         pa_rtpoll_item_free(o->outq_rtpoll_item_read);
     if (o->outq_rtpoll_item_write)
         pa_rtpoll_item_free(o->outq_rtpoll_item_write);
 
-    if (o->inq)
-        pa_asyncmsgq_unref(o->inq);
-
     if (o->outq)
         pa_asyncmsgq_unref(o->outq);
 
+    if (o->cache)
+        pa_asyncq_free(o->cache, NULL);
+
     if (o->memblockq)
         pa_memblockq_free(o->memblockq);
 
@@ -1003,8 +1071,8 @@ static void output_disable(struct output *o) {
 
     /* Finally, drop all queued data */
     pa_memblockq_flush_write(o->memblockq, TRUE);
-    pa_asyncmsgq_flush(o->inq, FALSE);
     pa_asyncmsgq_flush(o->outq, FALSE);
+    cache_flush(o);
 }
 
 /* Called from main context */
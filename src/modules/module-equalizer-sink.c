@@ -633,6 +633,9 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     /* Hmm, process any rewind request that might be queued up */
     pa_sink_process_rewind(u->sink, 0);
 
+    /* The FFT needs fixed, overlapping windows of input, which is why
+     * this gathers the rendered audio in input_q rather than
+     * processing it in place with pa_sink_render_filtered() */
     //pa_log_debug("start output-buffered %ld, input-buffered %ld, requested %ld",buffered_samples,u->samples_gathered,samples_requested);
     //pa_rtclock_get(&start);
     do{
@@ -67,7 +67,6 @@ PA_MODULE_USAGE(
       "input_ladspaport_map=<comma separated list of input LADSPA port names> "
       "output_ladspaport_map=<comma separated list of output LADSPA port names> "));
 
-#define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
 /* PLEASE NOTICE: The PortAudio ports and the LADSPA ports are two different concepts.
 They are not related and where possible the names of the LADSPA port variables contains "ladspa" to avoid confusion */
@@ -90,8 +89,6 @@ struct userdata {
     about control out ports. We connect them all to this single buffer. */
     LADSPA_Data control_out;
 
-    pa_memblockq *memblockq;
-
     pa_bool_t *use_default;
     pa_sample_spec ss;
 
@@ -401,9 +398,7 @@ static void sink_request_rewind_cb(pa_sink *s) {
         return;
 
     /* Just hand this one over to the master sink */
-    pa_sink_input_request_rewind(u->sink_input,
-                                 s->thread_info.rewind_nbytes +
-                                 pa_memblockq_get_length(u->memblockq), TRUE, FALSE, FALSE);
+    pa_sink_input_request_rewind(u->sink_input, s->thread_info.rewind_nbytes, TRUE, FALSE, FALSE);
 }
 
 /* Called from I/O thread context */
@@ -438,57 +433,38 @@ static void sink_set_mute_cb(pa_sink *s) {
 }
 
 /* Called from I/O thread context */
-static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
-    struct userdata *u;
-    float *src, *dst;
-    size_t fs;
+static void filter_cb(pa_sink *s, void *data, size_t length, void *userdata) {
+    struct userdata *u = userdata;
+    float *samples = data;
     unsigned n, h, c;
-    pa_memchunk tchunk;
-
-    pa_sink_input_assert_ref(i);
-    pa_assert(chunk);
-    pa_assert_se(u = i->userdata);
-
-    /* Hmm, process any rewind request that might be queued up */
-    pa_sink_process_rewind(u->sink, 0);
-
-    while (pa_memblockq_peek(u->memblockq, &tchunk) < 0) {
-        pa_memchunk nchunk;
-
-        pa_sink_render(u->sink, nbytes, &nchunk);
-        pa_memblockq_push(u->memblockq, &nchunk);
-        pa_memblock_unref(nchunk.memblock);
-    }
-
-    tchunk.length = PA_MIN(nbytes, tchunk.length);
-    pa_assert(tchunk.length > 0);
-
-    fs = pa_frame_size(&i->sample_spec);
-    n = (unsigned) (PA_MIN(tchunk.length, u->block_size) / fs);
 
+    n = (unsigned) (length / pa_frame_size(&s->sample_spec));
     pa_assert(n > 0);
 
-    chunk->index = 0;
-    chunk->length = n*fs;
-    chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
-
-    pa_memblockq_drop(u->memblockq, chunk->length);
-
-    src = pa_memblock_acquire_chunk(&tchunk);
-    dst = pa_memblock_acquire(chunk->memblock);
-
+    /* Each group of channels is copied into the port buffers before
+     * the output is written back, so this works in place */
     for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
         for (c = 0; c < u->input_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c], sizeof(float), src+ h*u->max_ladspaport_count + c, u->channels*sizeof(float), n);
+            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c], sizeof(float), samples + h*u->max_ladspaport_count + c, u->channels*sizeof(float), n);
         u->descriptor->run(u->handle[h], n);
         for (c = 0; c < u->output_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[c], sizeof(float), n);
+            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, samples + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[c], sizeof(float), n);
     }
+}
+
+/* Called from I/O thread context */
+static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    struct userdata *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert(chunk);
+    pa_assert_se(u = i->userdata);
 
-    pa_memblock_release(tchunk.memblock);
-    pa_memblock_release(chunk->memblock);
+    /* Hmm, process any rewind request that might be queued up */
+    pa_sink_process_rewind(u->sink, 0);
 
-    pa_memblock_unref(tchunk.memblock);
+    /* The port buffers take at most block_size bytes per run */
+    pa_sink_render_filtered(u->sink, nbytes, u->block_size, filter_cb, u, chunk);
 
     return 0;
 }
@@ -501,18 +477,15 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
 
+    /* We don't keep anything buffered, so we can only rewrite what
+     * the master rewinds */
     if (u->sink->thread_info.rewind_nbytes > 0) {
-        size_t max_rewrite;
-
-        max_rewrite = nbytes + pa_memblockq_get_length(u->memblockq);
-        amount = PA_MIN(u->sink->thread_info.rewind_nbytes, max_rewrite);
+        amount = PA_MIN(u->sink->thread_info.rewind_nbytes, nbytes);
         u->sink->thread_info.rewind_nbytes = 0;
 
         if (amount > 0) {
             unsigned c;
 
-            pa_memblockq_seek(u->memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, TRUE);
-
             pa_log_debug("Resetting plugin");
 
             /* Reset the plugin */
@@ -526,7 +499,6 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
     }
 
     pa_sink_process_rewind(u->sink, amount);
-    pa_memblockq_rewind(u->memblockq, nbytes);
 }
 
 /* Called from I/O thread context */
@@ -538,7 +510,6 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
 
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
-    pa_memblockq_set_maxrewind(u->memblockq, nbytes);
     pa_sink_set_max_rewind_within_thread(u->sink, nbytes);
 }
 
@@ -1004,7 +975,6 @@ int pa__init(pa_module*m) {
     u = pa_xnew0(struct userdata, 1);
     u->module = m;
     m->userdata = u;
-    u->memblockq = pa_memblockq_new("module-ladspa-sink memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0, &ss, 1, 1, 0, NULL);
     u->max_ladspaport_count = 1; /*to avoid division by zero etc. in pa__done when failing before this value has been set*/
     u->channels = 0;
     u->input = NULL;
@@ -1372,9 +1342,6 @@ void pa__done(pa_module*m) {
         }
     }
 
-    if (u->memblockq)
-        pa_memblockq_free(u->memblockq);
-
     pa_xfree(u->control);
     pa_xfree(u->use_default);
     pa_xfree(u);
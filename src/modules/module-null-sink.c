@@ -42,6 +42,7 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/io-thread-pool.h>
 
 #include "module-null-sink-symdef.h"
 
@@ -55,7 +56,8 @@ PA_MODULE_USAGE(
         "format=<sample format> "
         "rate=<sample rate> "
         "channels=<number of channels> "
-        "channel_map=<channel map>");
+        "channel_map=<channel map> "
+        "shared_thread=<use an IO thread shared with other devices?>");
 
 #define DEFAULT_SINK_NAME "null"
 #define BLOCK_USEC (PA_USEC_PER_SEC * 2)
@@ -69,6 +71,9 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    pa_io_thread_pool *io_pool;
+    pa_io_thread_pool_client *io_client;
+
     pa_usec_t block_usec;
     pa_usec_t timestamp;
 };
@@ -80,6 +85,7 @@ static const char* const valid_modargs[] = {
     "rate",
     "channels",
     "channel_map",
+    "shared_thread",
     NULL
 };
 
@@ -195,6 +201,36 @@ static void process_render(struct userdata *u, pa_usec_t now) {
 /*     pa_log_debug("Ate in sum %lu bytes (of %lu)", (unsigned long) ate, (unsigned long) nbytes); */
 }
 
+/* Called from IO context. Does one iteration of the thread loop and
+ * returns the time we want to be woken up at, or 0 for never. */
+static pa_usec_t process(struct userdata *u, pa_usec_t now) {
+    if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
+        process_rewind(u, now);
+
+    /* Render some data and drop it immediately */
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        if (u->timestamp <= now)
+            process_render(u, now);
+
+        return u->timestamp;
+    }
+
+    return 0;
+}
+
+/* Called from the shared IO thread */
+static void io_client_cb(pa_io_thread_pool_client *c, pa_usec_t now, void *userdata) {
+    struct userdata *u = userdata;
+    pa_usec_t wakeup;
+
+    pa_assert(u);
+
+    if ((wakeup = process(u, now)) > 0)
+        pa_io_thread_pool_client_set_timer_absolute(c, wakeup);
+    else
+        pa_io_thread_pool_client_set_timer_disabled(c);
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
 
@@ -207,22 +243,15 @@ static void thread_func(void *userdata) {
     u->timestamp = pa_rtclock_now();
 
     for (;;) {
-        pa_usec_t now = 0;
+        pa_usec_t now = 0, wakeup;
         int ret;
 
         if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
             now = pa_rtclock_now();
 
-        if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
-            process_rewind(u, now);
-
-        /* Render some data and drop it immediately */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            if (u->timestamp <= now)
-                process_render(u, now);
-
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp);
-        } else
+        if ((wakeup = process(u, now)) > 0)
+            pa_rtpoll_set_timer_absolute(u->rtpoll, wakeup);
+        else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
@@ -250,6 +279,7 @@ int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
     pa_sink_new_data data;
     size_t nbytes;
+    pa_bool_t shared_thread = FALSE;
 
     pa_assert(m);
 
@@ -265,11 +295,19 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "shared_thread", &shared_thread) < 0) {
+        pa_log("Failed to parse shared_thread argument.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->rtpoll = pa_rtpoll_new();
-    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+
+    if (!shared_thread) {
+        u->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+    }
 
     pa_sink_new_data_init(&data);
     data.driver = __FILE__;
@@ -298,17 +336,30 @@ int pa__init(pa_module*m) {
     u->sink->update_requested_latency = sink_update_requested_latency_cb;
     u->sink->userdata = u;
 
-    pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
-    pa_sink_set_rtpoll(u->sink, u->rtpoll);
-
     u->block_usec = BLOCK_USEC;
     nbytes = pa_usec_to_bytes(u->block_usec, &u->sink->sample_spec);
     pa_sink_set_max_rewind(u->sink, nbytes);
     pa_sink_set_max_request(u->sink, nbytes);
 
-    if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if (shared_thread) {
+        u->io_pool = pa_io_thread_pool_get(m->core);
+        u->timestamp = pa_rtclock_now();
+
+        if (!(u->io_client = pa_io_thread_pool_client_new(u->io_pool, m, io_client_cb, u))) {
+            pa_log("Failed to set up shared IO thread.");
+            goto fail;
+        }
+
+        pa_sink_set_asyncmsgq(u->sink, pa_io_thread_pool_client_get_asyncmsgq(u->io_client));
+        pa_sink_set_rtpoll(u->sink, pa_io_thread_pool_client_get_rtpoll(u->io_client));
+    } else {
+        pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
+        pa_sink_set_rtpoll(u->sink, u->rtpoll);
+
+        if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
     }
 
     pa_sink_set_latency_range(u->sink, 0, BLOCK_USEC);
@@ -353,7 +404,14 @@ void pa__done(pa_module*m) {
         pa_thread_free(u->thread);
     }
 
-    pa_thread_mq_done(&u->thread_mq);
+    if (u->io_client)
+        pa_io_thread_pool_client_free(u->io_client);
+
+    if (u->io_pool)
+        pa_io_thread_pool_unref(u->io_pool);
+
+    if (u->rtpoll)
+        pa_thread_mq_done(&u->thread_mq);
 
     if (u->sink)
         pa_sink_unref(u->sink);
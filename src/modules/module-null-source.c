@@ -34,6 +34,7 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/core-util.h>
+#include <pulsecore/io-thread-pool.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/modargs.h>
@@ -56,7 +57,8 @@ PA_MODULE_USAGE(
         "source_name=<name of source> "
         "channel_map=<channel map> "
         "description=<description for the source> "
-        "latency_time=<latency time in ms>");
+        "latency_time=<latency time in ms> "
+        "shared_thread=<use an IO thread shared with other devices?>");
 
 #define DEFAULT_SOURCE_NAME "source.null"
 #define DEFAULT_LATENCY_TIME 20
@@ -71,6 +73,9 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    pa_io_thread_pool *io_pool;
+    pa_io_thread_pool_client *io_client;
+
     size_t block_size;
 
     pa_usec_t block_usec;
@@ -86,6 +91,7 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "description",
     "latency_time",
+    "shared_thread",
     NULL
 };
 
@@ -123,6 +129,48 @@ static void source_update_requested_latency_cb(pa_source *s) {
     u->block_usec = pa_source_get_requested_latency_within_thread(s);
 }
 
+/* Called from IO context. Does one iteration of the thread loop and
+ * returns the time we want to be woken up at, or 0 for never. */
+static pa_usec_t process(struct userdata *u, pa_usec_t now) {
+    pa_memchunk chunk;
+
+    if (!PA_SOURCE_IS_OPENED(u->source->thread_info.state))
+        return 0;
+
+    /* Generate some null data */
+    if ((chunk.length = pa_usec_to_bytes(now - u->timestamp, &u->source->sample_spec)) > 0) {
+
+        chunk.memblock = pa_memblock_new(u->core->mempool, (size_t) -1); /* or chunk.length? */
+        chunk.index = 0;
+        pa_source_post(u->source, &chunk);
+        pa_memblock_unref(chunk.memblock);
+
+        u->timestamp = now;
+    }
+
+    return u->timestamp + u->latency_time * PA_USEC_PER_MSEC;
+}
+
+/* Called from the shared IO thread */
+static void io_client_cb(pa_io_thread_pool_client *c, pa_usec_t now, void *userdata) {
+    struct userdata *u = userdata;
+    pa_usec_t wakeup;
+
+    pa_assert(u);
+
+    /* We are also woken up on behalf of the other devices on this
+     * thread, don't post anything before our next block is due. */
+    wakeup = u->timestamp + u->latency_time * PA_USEC_PER_MSEC;
+
+    if (!PA_SOURCE_IS_OPENED(u->source->thread_info.state) || now >= wakeup)
+        wakeup = process(u, now);
+
+    if (wakeup > 0)
+        pa_io_thread_pool_client_set_timer_absolute(c, wakeup);
+    else
+        pa_io_thread_pool_client_set_timer_disabled(c);
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
 
@@ -135,27 +183,12 @@ static void thread_func(void *userdata) {
     u->timestamp = pa_rtclock_now();
 
     for (;;) {
+        pa_usec_t wakeup;
         int ret;
 
-        /* Generate some null data */
-        if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
-            pa_usec_t now;
-            pa_memchunk chunk;
-
-            now = pa_rtclock_now();
-
-            if ((chunk.length = pa_usec_to_bytes(now - u->timestamp, &u->source->sample_spec)) > 0) {
-
-                chunk.memblock = pa_memblock_new(u->core->mempool, (size_t) -1); /* or chunk.length? */
-                chunk.index = 0;
-                pa_source_post(u->source, &chunk);
-                pa_memblock_unref(chunk.memblock);
-
-                u->timestamp = now;
-            }
-
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp + u->latency_time * PA_USEC_PER_MSEC);
-        } else
+        if ((wakeup = process(u, pa_rtclock_now())) > 0)
+            pa_rtpoll_set_timer_absolute(u->rtpoll, wakeup);
+        else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
@@ -183,6 +216,7 @@ int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
     pa_source_new_data data;
     uint32_t latency_time = DEFAULT_LATENCY_TIME;
+    pa_bool_t shared_thread = FALSE;
 
     pa_assert(m);
 
@@ -198,11 +232,19 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "shared_thread", &shared_thread) < 0) {
+        pa_log("Failed to parse shared_thread argument.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->rtpoll = pa_rtpoll_new();
-    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+
+    if (!shared_thread) {
+        u->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+    }
 
     pa_source_new_data_init(&data);
     data.driver = __FILE__;
@@ -232,18 +274,31 @@ int pa__init(pa_module*m) {
     u->source->update_requested_latency = source_update_requested_latency_cb;
     u->source->userdata = u;
 
-    pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
-    pa_source_set_rtpoll(u->source, u->rtpoll);
-
     pa_source_set_latency_range(u->source, 0, MAX_LATENCY_USEC);
     u->block_usec = u->source->thread_info.max_latency;
 
     u->source->thread_info.max_rewind =
         pa_usec_to_bytes(u->block_usec, &u->source->sample_spec);
 
-    if (!(u->thread = pa_thread_new("null-source", thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if (shared_thread) {
+        u->io_pool = pa_io_thread_pool_get(m->core);
+        u->timestamp = pa_rtclock_now();
+
+        if (!(u->io_client = pa_io_thread_pool_client_new(u->io_pool, m, io_client_cb, u))) {
+            pa_log("Failed to set up shared IO thread.");
+            goto fail;
+        }
+
+        pa_source_set_asyncmsgq(u->source, pa_io_thread_pool_client_get_asyncmsgq(u->io_client));
+        pa_source_set_rtpoll(u->source, pa_io_thread_pool_client_get_rtpoll(u->io_client));
+    } else {
+        pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
+        pa_source_set_rtpoll(u->source, u->rtpoll);
+
+        if (!(u->thread = pa_thread_new("null-source", thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
     }
 
     pa_source_put(u->source);
@@ -277,7 +332,14 @@ void pa__done(pa_module*m) {
         pa_thread_free(u->thread);
     }
 
-    pa_thread_mq_done(&u->thread_mq);
+    if (u->io_client)
+        pa_io_thread_pool_client_free(u->io_client);
+
+    if (u->io_pool)
+        pa_io_thread_pool_unref(u->io_pool);
+
+    if (u->rtpoll)
+        pa_thread_mq_done(&u->thread_mq);
 
     if (u->source)
         pa_source_unref(u->source);
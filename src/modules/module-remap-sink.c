@@ -158,6 +158,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     /* Hmm, process any rewind request that might be queued up */
     pa_sink_process_rewind(u->sink, 0);
 
+    /* The remapping happens in the resampler of our sink input, so
+     * there is nothing to filter here */
     pa_sink_render(u->sink, nbytes, chunk);
     return 0;
 }
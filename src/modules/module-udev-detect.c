@@ -297,6 +297,11 @@ static void verify_access(struct userdata *u, struct device *d) {
 
     pa_xfree(cd);
 
+    /* The module may have failed after it was loaded, if it probed
+     * the card in parallel with others */
+    if (d->module != PA_INVALID_INDEX && !pa_idxset_get_by_index(u->core->modules, d->module))
+        d->module = PA_INVALID_INDEX;
+
     if (d->module == PA_INVALID_INDEX) {
 
         /* If we are not loaded, try to load */
@@ -792,10 +797,16 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    /* The cards present at startup don't depend on each other, so
+     * they may probe their devices at the same time */
+    pa_module_probe_batch_begin(u->core);
+
     first = udev_enumerate_get_list_entry(enumerate);
     udev_list_entry_foreach(item, first)
         process_path(u, udev_list_entry_get_name(item));
 
+    pa_module_probe_batch_end(u->core);
+
     udev_enumerate_unref(enumerate);
 
     pa_log_info("Found %u cards.", pa_hashmap_size(u->devices));
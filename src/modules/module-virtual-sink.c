@@ -55,8 +55,6 @@ PA_MODULE_USAGE(
           "force_flat_volume=<yes or no> "
         ));
 
-#define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
-
 struct userdata {
     pa_module *module;
 
@@ -66,8 +64,6 @@ struct userdata {
     pa_sink *sink;
     pa_sink_input *sink_input;
 
-    pa_memblockq *memblockq;
-
     pa_bool_t auto_desc;
     unsigned channels;
 };
@@ -142,9 +138,7 @@ static void sink_request_rewind_cb(pa_sink *s) {
         return;
 
     /* Just hand this one over to the master sink */
-    pa_sink_input_request_rewind(u->sink_input,
-                                 s->thread_info.rewind_nbytes +
-                                 pa_memblockq_get_length(u->memblockq), TRUE, FALSE, FALSE);
+    pa_sink_input_request_rewind(u->sink_input, s->thread_info.rewind_nbytes, TRUE, FALSE, FALSE);
 }
 
 /* Called from I/O thread context */
@@ -192,13 +186,27 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
+/* Called from I/O thread context */
+static void filter_cb(pa_sink *s, void *data, size_t length, void *userdata) {
+    struct userdata *u = userdata;
+    float *samples = data;
+    unsigned n;
+
+    n = (unsigned) (length / pa_frame_size(&s->sample_spec));
+
+    /* (3) PUT YOUR CODE HERE TO DO SOMETHING WITH THE DATA. IT IS
+     * PROCESSED IN PLACE, n FRAMES OF u->channels SAMPLES EACH. */
+
+    /* As an example, clamp the samples */
+    pa_sample_clamp(PA_SAMPLE_FLOAT32NE,
+                    samples, sizeof(float),
+                    samples, sizeof(float),
+                    n * u->channels);
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
-    float *src, *dst;
-    size_t fs;
-    unsigned n, c;
-    pa_memchunk tchunk;
     pa_usec_t current_latency PA_GCC_UNUSED;
 
     pa_sink_input_assert_ref(i);
@@ -208,51 +216,14 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     /* Hmm, process any rewind request that might be queued up */
     pa_sink_process_rewind(u->sink, 0);
 
-    /* (1) IF YOU NEED A FIXED BLOCK SIZE USE
-     * pa_memblockq_peek_fixed_size() HERE INSTEAD. NOTE THAT FILTERS
-     * WHICH CAN DEAL WITH DYNAMIC BLOCK SIZES ARE HIGHLY
-     * PREFERRED. */
-    while (pa_memblockq_peek(u->memblockq, &tchunk) < 0) {
-        pa_memchunk nchunk;
-
-        pa_sink_render(u->sink, nbytes, &nchunk);
-        pa_memblockq_push(u->memblockq, &nchunk);
-        pa_memblock_unref(nchunk.memblock);
-    }
-
-    /* (2) IF YOU NEED A FIXED BLOCK SIZE, THIS NEXT LINE IS NOT
-     * NECESSARY */
-    tchunk.length = PA_MIN(nbytes, tchunk.length);
-    pa_assert(tchunk.length > 0);
-
-    fs = pa_frame_size(&i->sample_spec);
-    n = (unsigned) (tchunk.length / fs);
+    /* (1) IF YOUR FILTER CAN ONLY PROCESS A LIMITED NUMBER OF BYTES
+     * AT A TIME PASS THAT INSTEAD OF 0 HERE. */
 
-    pa_assert(n > 0);
-
-    chunk->index = 0;
-    chunk->length = n*fs;
-    chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
-
-    pa_memblockq_drop(u->memblockq, chunk->length);
-
-    src = pa_memblock_acquire_chunk(&tchunk);
-    dst = pa_memblock_acquire(chunk->memblock);
-
-    /* (3) PUT YOUR CODE HERE TO DO SOMETHING WITH THE DATA */
-
-    /* As an example, copy input to output */
-    for (c = 0; c < u->channels; c++) {
-        pa_sample_clamp(PA_SAMPLE_FLOAT32NE,
-                        dst+c, u->channels * sizeof(float),
-                        src+c, u->channels * sizeof(float),
-                        n);
-    }
-
-    pa_memblock_release(tchunk.memblock);
-    pa_memblock_release(chunk->memblock);
-
-    pa_memblock_unref(tchunk.memblock);
+    /* (2) IF YOU NEED A FIXED BLOCK SIZE YOU HAVE TO QUEUE UP THE
+     * RENDERED DATA YOURSELF AND USE pa_memblockq_peek_fixed_size(),
+     * SEE module-equalizer-sink.c. NOTE THAT FILTERS WHICH CAN DEAL
+     * WITH DYNAMIC BLOCK SIZES ARE HIGHLY PREFERRED. */
+    pa_sink_render_filtered(u->sink, nbytes, 0, filter_cb, u, chunk);
 
     /* (4) IF YOU NEED THE LATENCY FOR SOMETHING ACQUIRE IT LIKE THIS: */
     current_latency =
@@ -273,22 +244,18 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
 
+    /* We don't keep anything buffered, so we can only rewrite what
+     * the master rewinds */
     if (u->sink->thread_info.rewind_nbytes > 0) {
-        size_t max_rewrite;
-
-        max_rewrite = nbytes + pa_memblockq_get_length(u->memblockq);
-        amount = PA_MIN(u->sink->thread_info.rewind_nbytes, max_rewrite);
+        amount = PA_MIN(u->sink->thread_info.rewind_nbytes, nbytes);
         u->sink->thread_info.rewind_nbytes = 0;
 
         if (amount > 0) {
-            pa_memblockq_seek(u->memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, TRUE);
-
             /* (5) PUT YOUR CODE HERE TO RESET YOUR FILTER  */
         }
     }
 
     pa_sink_process_rewind(u->sink, amount);
-    pa_memblockq_rewind(u->memblockq, nbytes);
 }
 
 /* Called from I/O thread context */
@@ -300,7 +267,6 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
 
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
-    pa_memblockq_set_maxrewind(u->memblockq, nbytes);
     pa_sink_set_max_rewind_within_thread(u->sink, nbytes);
 }
 
@@ -474,7 +440,6 @@ int pa__init(pa_module*m) {
     pa_sink_new_data sink_data;
     pa_bool_t use_volume_sharing = TRUE;
     pa_bool_t force_flat_volume = FALSE;
-    pa_memchunk silence;
 
     pa_assert(m);
 
@@ -602,10 +567,6 @@ int pa__init(pa_module*m) {
 
     u->sink->input_to_master = u->sink_input;
 
-    pa_sink_input_get_silence(u->sink_input, &silence);
-    u->memblockq = pa_memblockq_new("module-virtual-sink memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0, &ss, 1, 1, 0, &silence);
-    pa_memblock_unref(silence.memblock);
-
     /* (9) INITIALIZE ANYTHING ELSE YOU NEED HERE */
 
     pa_sink_put(u->sink);
@@ -656,8 +617,5 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
-    if (u->memblockq)
-        pa_memblockq_free(u->memblockq);
-
     pa_xfree(u);
 }
@@ -63,7 +63,8 @@ static const pa_client_conf default_conf = {
     .cookie_valid = FALSE,
     .shm_size = 0,
     .auto_connect_localhost = FALSE,
-    .auto_connect_display = FALSE
+    .auto_connect_display = FALSE,
+    .smoother_estimator = PA_SMOOTHER_ESTIMATOR_SPLINE
 };
 
 pa_client_conf *pa_client_conf_new(void) {
@@ -88,6 +89,23 @@ void pa_client_conf_free(pa_client_conf *c) {
     pa_xfree(c);
 }
 
+static int parse_smoother_estimator(pa_config_parser_state *state) {
+    pa_client_conf *c;
+    int e;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    if ((e = pa_smoother_estimator_from_string(state->rvalue)) < 0) {
+        pa_log(_("[%s:%u] Invalid smoother estimator '%s'."), state->filename, state->lineno, state->rvalue);
+        return -1;
+    }
+
+    c->smoother_estimator = e;
+    return 0;
+}
+
 int pa_client_conf_load(pa_client_conf *c, const char *filename) {
     FILE *f = NULL;
     char *fn = NULL;
@@ -108,6 +126,7 @@ int pa_client_conf_load(pa_client_conf *c, const char *filename) {
         { "shm-size-bytes",         pa_config_parse_size,     &c->shm_size, NULL },
         { "auto-connect-localhost", pa_config_parse_bool,     &c->auto_connect_localhost, NULL },
         { "auto-connect-display",   pa_config_parse_bool,     &c->auto_connect_display, NULL },
+        { "smoother-estimator",     parse_smoother_estimator, c, NULL },
         { NULL,                     NULL,                     NULL, NULL },
     };
 
@@ -24,6 +24,7 @@
 
 #include <pulsecore/macro.h>
 #include <pulsecore/native-common.h>
+#include <pulsecore/time-smoother.h>
 
 /* A structure containing configuration data for PulseAudio clients. */
 
@@ -33,6 +34,7 @@ typedef struct pa_client_conf {
     uint8_t cookie[PA_NATIVE_COOKIE_LENGTH];
     pa_bool_t cookie_valid; /* non-zero, when cookie is valid */
     size_t shm_size;
+    pa_smoother_estimator_t smoother_estimator;
 } pa_client_conf;
 
 /* Create a new configuration data object and reset it to defaults */
@@ -1898,6 +1898,291 @@ pa_operation* pa_context_set_port_latency_offset(pa_context *c, const char *card
     return o;
 }
 
+/*** Render profiles ***/
+
+/* Far more than any server sends, so that a broken one can't make us
+ * allocate arbitrary amounts of memory */
+#define RENDER_PROFILE_HISTOGRAMS_MAX 64
+#define RENDER_PROFILE_BUCKETS_MAX 64
+
+static void context_get_render_profile_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    pa_render_profile_info i;
+    uint32_t k, j;
+    int eol = 1;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    pa_zero(i);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, FALSE) < 0)
+            goto finish;
+
+        eol = -1;
+    } else {
+
+        if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+            pa_tagstruct_getu32(t, &i.n_histograms) < 0 ||
+            i.n_histograms > RENDER_PROFILE_HISTOGRAMS_MAX)
+            goto fail;
+
+        if (i.n_histograms > 0)
+            i.histograms = pa_xnew0(pa_render_histogram_info, i.n_histograms);
+
+        for (k = 0; k < i.n_histograms; k++) {
+            uint32_t *counts;
+
+            if (pa_tagstruct_gets(t, &i.histograms[k].name) < 0 ||
+                pa_tagstruct_get_usec(t, &i.histograms[k].max) < 0 ||
+                pa_tagstruct_getu32(t, &i.histograms[k].n_buckets) < 0 ||
+                i.histograms[k].n_buckets > RENDER_PROFILE_BUCKETS_MAX)
+                goto fail;
+
+            if (i.histograms[k].n_buckets <= 0)
+                continue;
+
+            i.histograms[k].counts = counts = pa_xnew(uint32_t, i.histograms[k].n_buckets);
+
+            for (j = 0; j < i.histograms[k].n_buckets; j++)
+                if (pa_tagstruct_getu32(t, &counts[j]) < 0)
+                    goto fail;
+        }
+
+        if (!pa_tagstruct_eof(t))
+            goto fail;
+
+        if (o->callback) {
+            pa_render_profile_info_cb_t cb = (pa_render_profile_info_cb_t) o->callback;
+            cb(o->context, &i, 0, o->userdata);
+        }
+    }
+
+    if (o->callback) {
+        pa_render_profile_info_cb_t cb = (pa_render_profile_info_cb_t) o->callback;
+        cb(o->context, NULL, eol, o->userdata);
+    }
+
+    goto finish;
+
+fail:
+    pa_context_fail(o->context, PA_ERR_PROTOCOL);
+
+finish:
+    if (i.histograms) {
+        for (k = 0; k < i.n_histograms; k++)
+            pa_xfree((uint32_t*) i.histograms[k].counts);
+
+        pa_xfree(i.histograms);
+    }
+
+    pa_operation_done(o);
+    pa_operation_unref(o);
+}
+
+static pa_operation* get_render_profile(pa_context *c, uint32_t command, uint32_t idx, const char *name, pa_render_profile_info_cb_t cb, void *userdata) {
+    pa_tagstruct *t;
+    pa_operation *o;
+    uint32_t tag;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(cb);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !name || *name, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 29, PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
+
+    t = pa_tagstruct_command(c, command, &tag);
+    pa_tagstruct_putu32(t, idx);
+    if (command != PA_COMMAND_GET_SINK_INPUT_RENDER_PROFILE)
+        pa_tagstruct_puts(t, name);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_render_profile_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
+pa_operation* pa_context_get_sink_render_profile_by_index(pa_context *c, uint32_t idx, pa_render_profile_info_cb_t cb, void *userdata) {
+    return get_render_profile(c, PA_COMMAND_GET_SINK_RENDER_PROFILE, idx, NULL, cb, userdata);
+}
+
+pa_operation* pa_context_get_sink_render_profile_by_name(pa_context *c, const char *name, pa_render_profile_info_cb_t cb, void *userdata) {
+    return get_render_profile(c, PA_COMMAND_GET_SINK_RENDER_PROFILE, PA_INVALID_INDEX, name, cb, userdata);
+}
+
+pa_operation* pa_context_get_source_render_profile_by_index(pa_context *c, uint32_t idx, pa_render_profile_info_cb_t cb, void *userdata) {
+    return get_render_profile(c, PA_COMMAND_GET_SOURCE_RENDER_PROFILE, idx, NULL, cb, userdata);
+}
+
+pa_operation* pa_context_get_source_render_profile_by_name(pa_context *c, const char *name, pa_render_profile_info_cb_t cb, void *userdata) {
+    return get_render_profile(c, PA_COMMAND_GET_SOURCE_RENDER_PROFILE, PA_INVALID_INDEX, name, cb, userdata);
+}
+
+pa_operation* pa_context_get_sink_input_render_profile(pa_context *c, uint32_t idx, pa_render_profile_info_cb_t cb, void *userdata) {
+    PA_CHECK_VALIDITY_RETURN_NULL(c, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    return get_render_profile(c, PA_COMMAND_GET_SINK_INPUT_RENDER_PROFILE, idx, NULL, cb, userdata);
+}
+
+/*** Snapshots ***/
+
+struct snapshot_request {
+    pa_operation *operation;
+    pa_snapshot_callbacks callbacks;
+};
+
+static void snapshot_request_free(struct snapshot_request *r) {
+    pa_assert(r);
+
+    pa_operation_unref(r->operation);
+    pa_xfree(r);
+}
+
+static void context_get_snapshot_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    struct snapshot_request *r = userdata;
+    pa_operation *o;
+    uint64_t generation = 0;
+    pa_bool_t full = FALSE;
+    int success = 1;
+    unsigned k;
+
+    pa_assert(pd);
+    pa_assert(r);
+
+    o = r->operation;
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, FALSE) < 0)
+            goto finish;
+
+        success = 0;
+    } else {
+        /* In the order the server sends them */
+        const struct {
+            pa_pdispatch_cb_t parse;
+            pa_operation_cb_t callback;
+        } sections[] = {
+            { context_get_module_info_callback, (pa_operation_cb_t) r->callbacks.module },
+            { context_get_client_info_callback, (pa_operation_cb_t) r->callbacks.client },
+            { context_get_card_info_callback, (pa_operation_cb_t) r->callbacks.card },
+            { context_get_sink_info_callback, (pa_operation_cb_t) r->callbacks.sink },
+            { context_get_source_info_callback, (pa_operation_cb_t) r->callbacks.source },
+            { context_get_sink_input_info_callback, (pa_operation_cb_t) r->callbacks.sink_input },
+            { context_get_source_output_info_callback, (pa_operation_cb_t) r->callbacks.source_output },
+            { context_get_sample_info_callback, (pa_operation_cb_t) r->callbacks.sample }
+        };
+
+        if (pa_tagstruct_getu64(t, &generation) < 0 ||
+            pa_tagstruct_get_boolean(t, &full) < 0)
+            goto fail;
+
+        for (k = 0; k < PA_ELEMENTSOF(sections); k++) {
+            uint32_t length;
+            const void *data;
+            pa_tagstruct *section;
+
+            if (pa_tagstruct_getu32(t, &length) < 0 ||
+                pa_tagstruct_get_arbitrary(t, &data, length) < 0)
+                goto fail;
+
+            if (!sections[k].callback)
+                continue;
+
+            /* Each section is laid out like the reply to the matching
+             * list request, so parse it the same way */
+            section = pa_tagstruct_new(length > 0 ? data : NULL, length);
+            sections[k].parse(pd, PA_COMMAND_REPLY, tag, section,
+                              pa_operation_new(o->context, NULL, sections[k].callback, o->userdata));
+            pa_tagstruct_free(section);
+
+            /* A broken entry fails the whole context */
+            if (!o->context)
+                goto finish;
+        }
+
+        if (!full) {
+            uint32_t n, facility, idx;
+
+            if (pa_tagstruct_getu32(t, &n) < 0)
+                goto fail;
+
+            for (; n > 0; n--) {
+                if (pa_tagstruct_getu32(t, &facility) < 0 ||
+                    pa_tagstruct_getu32(t, &idx) < 0 ||
+                    (facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK))
+                    goto fail;
+
+                if (r->callbacks.removed)
+                    r->callbacks.removed(o->context, (pa_subscription_event_type_t) facility, idx, o->userdata);
+            }
+        }
+
+        if (!pa_tagstruct_eof(t))
+            goto fail;
+    }
+
+    if (r->callbacks.done)
+        r->callbacks.done(o->context, success, generation, (int) full, o->userdata);
+
+    goto finish;
+
+fail:
+    pa_context_fail(o->context, PA_ERR_PROTOCOL);
+
+finish:
+    pa_operation_done(o);
+    snapshot_request_free(r);
+}
+
+static pa_operation* get_snapshot(pa_context *c, uint64_t generation, const pa_snapshot_callbacks *cbs, void *userdata) {
+    struct snapshot_request *r;
+    pa_tagstruct *t;
+    pa_operation *o;
+    uint32_t tag;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(cbs);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 30, PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, NULL, userdata);
+
+    r = pa_xnew(struct snapshot_request, 1);
+    r->operation = pa_operation_ref(o);
+    r->callbacks = *cbs;
+
+    t = pa_tagstruct_command(c, PA_COMMAND_GET_SNAPSHOT, &tag);
+    pa_tagstruct_putu64(t, generation);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_snapshot_callback, r, (pa_free_cb_t) snapshot_request_free);
+
+    return o;
+}
+
+pa_operation* pa_context_get_snapshot(pa_context *c, const pa_snapshot_callbacks *cbs, void *userdata) {
+    return get_snapshot(c, 0, cbs, userdata);
+}
+
+pa_operation* pa_context_get_snapshot_delta(pa_context *c, uint64_t generation, const pa_snapshot_callbacks *cbs, void *userdata) {
+    return get_snapshot(c, generation, cbs, userdata);
+}
+
 /*** Autoload stuff ***/
 
 PA_WARN_REFERENCE(pa_context_get_autoload_info_by_name, "Module auto-loading no longer supported.");
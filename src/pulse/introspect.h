@@ -136,6 +136,19 @@
  * either pa_context_get_client_info() or pa_context_get_client_info_list().
  * The information structure is called pa_client_info.
  *
+ * \subsection snapshot_subsec Snapshots
+ *
+ * Clients which mirror the state of the server can fetch all modules,
+ * clients, cards, sinks, sources, sink inputs, source outputs and samples
+ * in a single request with pa_context_get_snapshot(). The objects are
+ * handed to the same callbacks the list functions use, collected in a
+ * pa_snapshot_callbacks structure. The snapshot comes with a generation
+ * number, which can later be passed to pa_context_get_snapshot_delta()
+ * to get only the objects which changed since, and the indexes of those
+ * which went away. If the server cannot tell what changed since that
+ * generation, e.g. because it was restarted in between, a full snapshot
+ * is sent instead.
+ *
  * \section ctrl_sec Control
  *
  * Some parts of the server are only possible to read, but most can also be
@@ -353,6 +366,51 @@ pa_operation* pa_context_set_source_port_by_name(pa_context *c, const char*name,
 
 /** @} */
 
+/** @{ \name Render Profiles */
+
+/** Timing histogram of one step of a device's IO cycle. Bucket 0
+ * counts samples below 1 usec, bucket k > 0 samples of at least
+ * 2^(k-1) and below 2^k usec, the last bucket also everything
+ * above. The counts are totals since the device was created. \since 5.0 */
+typedef struct pa_render_histogram_info {
+    const char *name;                   /**< Name of the measured step, e.g. "wakeup-lateness" */
+    pa_usec_t max;                      /**< Largest value seen so far */
+    uint32_t n_buckets;                 /**< Number of entries in counts */
+    const uint32_t *counts;             /**< Number of samples per bucket */
+} pa_render_histogram_info;
+
+/** Timing histograms of the IO thread of a sink or source, or of
+ * the steps of it which handle one sink input. Please note that this
+ * structure can be extended as part of evolutionary API updates at
+ * any time in any new release. \since 5.0 */
+typedef struct pa_render_profile_info {
+    uint32_t index;                     /**< Index of the sink, source or sink input */
+    uint32_t n_histograms;              /**< Number of entries in histograms */
+    pa_render_histogram_info *histograms; /**< Array of histograms */
+} pa_render_profile_info;
+
+/** Callback prototype for pa_context_get_sink_render_profile_...(), pa_context_get_source_render_profile_...() and pa_context_get_sink_input_render_profile() \since 5.0 */
+typedef void (*pa_render_profile_info_cb_t) (pa_context *c, const pa_render_profile_info *i, int eol, void *userdata);
+
+/** Get the render profile of a sink by its index \since 5.0 */
+pa_operation* pa_context_get_sink_render_profile_by_index(pa_context *c, uint32_t idx, pa_render_profile_info_cb_t cb, void *userdata);
+
+/** Get the render profile of a sink by its name \since 5.0 */
+pa_operation* pa_context_get_sink_render_profile_by_name(pa_context *c, const char *name, pa_render_profile_info_cb_t cb, void *userdata);
+
+/** Get the render profile of a source by its index \since 5.0 */
+pa_operation* pa_context_get_source_render_profile_by_index(pa_context *c, uint32_t idx, pa_render_profile_info_cb_t cb, void *userdata);
+
+/** Get the render profile of a source by its name \since 5.0 */
+pa_operation* pa_context_get_source_render_profile_by_name(pa_context *c, const char *name, pa_render_profile_info_cb_t cb, void *userdata);
+
+/** Get the render profile of a sink input by its index. Only the
+ * "stream" histogram is filled in, it covers the time spent getting
+ * data from this stream, whichever sink it was connected to. \since 5.0 */
+pa_operation* pa_context_get_sink_input_render_profile(pa_context *c, uint32_t idx, pa_render_profile_info_cb_t cb, void *userdata);
+
+/** @} */
+
 /** @{ \name Server */
 
 /** Server information. Please note that this structure can be
@@ -665,6 +723,47 @@ pa_operation* pa_context_get_sample_info_list(pa_context *c, pa_sample_info_cb_t
 
 /** @} */
 
+/** @{ \name Snapshots */
+
+/** Callback prototype for objects which went away since the generation
+ * passed to pa_context_get_snapshot_delta(). facility is one of the
+ * PA_SUBSCRIPTION_EVENT_xxx facilities, e.g.
+ * PA_SUBSCRIPTION_EVENT_SINK_INPUT. \since 5.0 */
+typedef void (*pa_snapshot_removed_cb_t)(pa_context *c, pa_subscription_event_type_t facility, uint32_t idx, void *userdata);
+
+/** Callback prototype for the end of a snapshot. generation is to be
+ * passed to the next pa_context_get_snapshot_delta(). full is non-zero
+ * if all objects were sent, not just the ones which changed. \since 5.0 */
+typedef void (*pa_snapshot_done_cb_t)(pa_context *c, int success, uint64_t generation, int full, void *userdata);
+
+/** The callbacks a snapshot is handed to. Each class of objects is
+ * passed to its callback like by the matching list function, including
+ * the final call with eol set. Classes without a callback are not
+ * parsed. \since 5.0 */
+typedef struct pa_snapshot_callbacks {
+    pa_module_info_cb_t module;                 /**< Modules */
+    pa_client_info_cb_t client;                 /**< Clients */
+    pa_card_info_cb_t card;                     /**< Cards */
+    pa_sink_info_cb_t sink;                     /**< Sinks */
+    pa_source_info_cb_t source;                 /**< Sources */
+    pa_sink_input_info_cb_t sink_input;         /**< Sink inputs */
+    pa_source_output_info_cb_t source_output;   /**< Source outputs */
+    pa_sample_info_cb_t sample;                 /**< Cached samples */
+    pa_snapshot_removed_cb_t removed;           /**< Objects which went away, delta snapshots only */
+    pa_snapshot_done_cb_t done;                 /**< Called last, also if the server refused */
+} pa_snapshot_callbacks;
+
+/** Get all objects of the server in a single request. The callbacks
+ * are copied. \since 5.0 */
+pa_operation* pa_context_get_snapshot(pa_context *c, const pa_snapshot_callbacks *cbs, void *userdata);
+
+/** Get the objects which changed since the given generation, as
+ * previously passed to the done callback, and the ones which went
+ * away. \since 5.0 */
+pa_operation* pa_context_get_snapshot_delta(pa_context *c, uint64_t generation, const pa_snapshot_callbacks *cbs, void *userdata);
+
+/** @} */
+
 /** \cond fulldocs */
 
 /** @{ \name Autoload Entries */
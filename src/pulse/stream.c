@@ -1258,6 +1258,7 @@ static int create_stream(
                 SMOOTHER_MIN_HISTORY,
                 x,
                 TRUE);
+        pa_smoother_set_estimator(s->smoother, s->context->conf->smoother_estimator);
     }
 
     if (!dev)
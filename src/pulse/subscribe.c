@@ -78,6 +78,38 @@ pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_c
     return o;
 }
 
+pa_operation* pa_context_set_subscribe_filter(pa_context *c, pa_subscription_event_type_t facility, const uint32_t *indexes, unsigned n_indexes, const char *key, const char *value, pa_context_success_cb_t cb, void *userdata) {
+    pa_operation *o;
+    pa_tagstruct *t;
+    uint32_t tag;
+    unsigned i;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, (facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, indexes || n_indexes == 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, n_indexes <= 1024, PA_ERR_TOOLARGE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !key || pa_proplist_key_valid(key), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, key || !value, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 30, PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
+
+    t = pa_tagstruct_command(c, PA_COMMAND_SET_SUBSCRIBE_FILTER, &tag);
+    pa_tagstruct_putu32(t, facility);
+    pa_tagstruct_putu32(t, n_indexes);
+    for (i = 0; i < n_indexes; i++)
+        pa_tagstruct_putu32(t, indexes[i]);
+    pa_tagstruct_puts(t, key);
+    pa_tagstruct_puts(t, value);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, pa_context_simple_ack_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata) {
     pa_assert(c);
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
@@ -41,7 +41,12 @@
  *
  * The application sets the notification mask using pa_context_subscribe()
  * and the function that will be called whenever a notification occurs using
- * pa_context_set_subscribe_callback().
+ * pa_context_set_subscribe_callback(). Notifications can be narrowed down
+ * to certain objects with pa_context_set_subscribe_filter().
+ *
+ * If an object changes many times in quick succession, e.g. while a
+ * volume slider is dragged, the server may merge the change events into
+ * fewer ones. The state queried after the last event is always current.
  *
  * The callback will be called with a \ref pa_subscription_event_type_t
  * representing the event that caused the callback. Clients can examine what
@@ -78,6 +83,22 @@ typedef void (*pa_context_subscribe_cb_t)(pa_context *c, pa_subscription_event_t
 /** Enable event notification */
 pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata);
 
+/** Only be notified about some of the objects of a facility, e.g.
+ * PA_SUBSCRIPTION_EVENT_SINK_INPUT: those whose index is one of
+ * indexes, if n_indexes is non-zero, and those whose property key is
+ * set to value, if key is non-NULL. If value is NULL, the property only
+ * needs to be set. Removal events are not checked against the property,
+ * as the object is gone by then. The property is checked when the event
+ * is sent, so once an object stops matching, e.g. because the property
+ * was changed or unset, nothing more is heard about it, not even about
+ * the change which made it stop matching. To notice that, filter by
+ * index instead. Replaces the earlier filter for the facility; pass
+ * neither indexes nor a key to drop it. Filters apply to the
+ * subscription made by the last pa_context_subscribe(), and are dropped
+ * by the next one. At most 1024 indexes can be given.
+ * \since 5.0 */
+pa_operation* pa_context_set_subscribe_filter(pa_context *c, pa_subscription_event_type_t facility, const uint32_t *indexes, unsigned n_indexes, const char *key, const char *value, pa_context_success_cb_t cb, void *userdata);
+
 /** Set the context specific call back function that is called whenever the state of the daemon changes */
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata);
 
@@ -34,9 +34,19 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/mutex.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/atomic.h>
 
 #include "asyncmsgq.h"
 
+/* Number of items every queue keeps preallocated for posted
+ * messages. Only if more than this many posted messages are in flight
+ * at the same time we fall back to allocating them. */
+#define ASYNCMSGQ_SLOTS 32
+
+/* Slots are padded to this, so that the writer filling in the next
+ * slot doesn't bounce the cache line the reader is working on */
+#define ASYNCMSGQ_CACHELINE 64
+
 PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, pa_xfree);
 PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
 
@@ -49,18 +59,35 @@ struct asyncmsgq_item {
     pa_memchunk memchunk;
     pa_semaphore *semaphore;
     int ret;
+
+    /* Set for items that are part of the slot array, busy is cleared
+     * by the reader once it is done with the item */
+    pa_bool_t is_slot;
+    pa_atomic_t busy;
 };
 
+#define ASYNCMSGQ_SLOT_SIZE PA_ROUND_UP(sizeof(struct asyncmsgq_item), ASYNCMSGQ_CACHELINE)
+
 struct pa_asyncmsgq {
     PA_REFCNT_DECLARE;
     pa_asyncq *asyncq;
     pa_mutex *mutex; /* only for the writer side */
 
     struct asyncmsgq_item *current;
+
+    void *slots_allocation;
+    uint8_t *slots;
+    unsigned n_slots;
+    unsigned next_slot; /* protected by mutex */
 };
 
+static struct asyncmsgq_item *get_slot(pa_asyncmsgq *a, unsigned idx) {
+    return (struct asyncmsgq_item*) (a->slots + idx * ASYNCMSGQ_SLOT_SIZE);
+}
+
 pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     pa_asyncmsgq *a;
+    unsigned i;
 
     a = pa_xnew(pa_asyncmsgq, 1);
 
@@ -69,9 +96,53 @@ pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     pa_assert_se(a->mutex = pa_mutex_new(FALSE, TRUE));
     a->current = NULL;
 
+    a->n_slots = size > 0 ? PA_MIN(size, ASYNCMSGQ_SLOTS) : ASYNCMSGQ_SLOTS;
+    a->next_slot = 0;
+    a->slots_allocation = pa_xmalloc0(a->n_slots * ASYNCMSGQ_SLOT_SIZE + ASYNCMSGQ_CACHELINE - 1);
+    a->slots = (uint8_t*) PA_ROUND_UP((uintptr_t) a->slots_allocation, ASYNCMSGQ_CACHELINE);
+
+    for (i = 0; i < a->n_slots; i++) {
+        struct asyncmsgq_item *slot = get_slot(a, i);
+
+        slot->is_slot = TRUE;
+        pa_atomic_store(&slot->busy, 0);
+    }
+
     return a;
 }
 
+/* Called with the writer mutex held */
+static struct asyncmsgq_item *item_new(pa_asyncmsgq *a) {
+    struct asyncmsgq_item *i;
+
+    /* Slots are normally handed out and given back in order, so if
+     * the next one is still busy the reader is lagging behind and
+     * we just allocate. */
+    i = get_slot(a, a->next_slot);
+
+    if (!pa_atomic_load(&i->busy)) {
+        pa_atomic_store(&i->busy, 1);
+        a->next_slot = (a->next_slot + 1) % a->n_slots;
+        return i;
+    }
+
+    if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(asyncmsgq))))
+        i = pa_xnew(struct asyncmsgq_item, 1);
+
+    i->is_slot = FALSE;
+    return i;
+}
+
+static void item_free(struct asyncmsgq_item *i) {
+    if (i->is_slot) {
+        pa_atomic_store(&i->busy, 0);
+        return;
+    }
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
+        pa_xfree(i);
+}
+
 static void asyncmsgq_free(pa_asyncmsgq *a) {
     struct asyncmsgq_item *i;
     pa_assert(a);
@@ -89,12 +160,12 @@ static void asyncmsgq_free(pa_asyncmsgq *a) {
         if (i->free_cb)
             i->free_cb(i->userdata);
 
-        if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
-            pa_xfree(i);
+        item_free(i);
     }
 
     pa_asyncq_free(a->asyncq, NULL);
     pa_mutex_free(a->mutex);
+    pa_xfree(a->slots_allocation);
     pa_xfree(a);
 }
 
@@ -116,8 +187,10 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
     struct asyncmsgq_item *i;
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(asyncmsgq))))
-        i = pa_xnew(struct asyncmsgq_item, 1);
+    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
+    pa_mutex_lock(a->mutex);
+
+    i = item_new(a);
 
     i->code = code;
     i->object = object ? pa_msgobject_ref(object) : NULL;
@@ -132,8 +205,6 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
         pa_memchunk_reset(&i->memchunk);
     i->semaphore = NULL;
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
     pa_asyncq_post(a->asyncq, i);
     pa_mutex_unlock(a->mutex);
 }
@@ -147,6 +218,7 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     i.userdata = (void*) userdata;
     i.free_cb = NULL;
     i.ret = -1;
+    i.is_slot = FALSE;
     i.offset = offset;
     if (chunk) {
         pa_assert(chunk->memblock);
@@ -226,8 +298,7 @@ void pa_asyncmsgq_done(pa_asyncmsgq *a, int ret) {
         if (a->current->memchunk.memblock)
             pa_memblock_unref(a->current->memchunk.memblock);
 
-        if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), a->current) < 0)
-            pa_xfree(a->current);
+        item_free(a->current);
     }
 
     a->current = NULL;
@@ -88,9 +88,11 @@ char *pa_client_list_to_string(pa_core *c) {
         pa_strbuf_printf(
                 s,
                 "    index: %u\n"
-                "\tdriver: <%s>\n",
+                "\tdriver: <%s>\n"
+                "\tdeferred requests: %llu\n",
                 client->index,
-                client->driver);
+                client->driver,
+                (unsigned long long) client->n_deferred_requests);
 
         if (client->module)
             pa_strbuf_printf(s, "\towner module: %u\n", client->module->index);
@@ -253,6 +255,7 @@ char *pa_sink_list_to_string(pa_core *c) {
             vdb[PA_SW_VOLUME_SNPRINT_DB_MAX],
             cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t;
         const char *cmn;
+        pa_sink_rewind_stats rewind_stats;
 
         cmn = pa_channel_map_to_pretty_name(&sink->channel_map);
 
@@ -333,6 +336,19 @@ char *pa_sink_list_to_string(pa_core *c) {
                     "\tfixed latency: %0.2f ms\n",
                     (double) pa_sink_get_fixed_latency(sink) / PA_USEC_PER_MSEC);
 
+        pa_sink_get_rewind_stats(sink, &rewind_stats);
+        pa_strbuf_printf(
+                s,
+                "\trewinds: %llu for %llu requests, %llu KiB rewound\n",
+                (unsigned long long) rewind_stats.rewinds,
+                (unsigned long long) rewind_stats.requests,
+                (unsigned long long) rewind_stats.bytes / 1024);
+
+        t = pa_render_profile_to_string(&sink->render_profile, "\t\t");
+        if (*t)
+            pa_strbuf_printf(s, "\trender profile:\n%s", t);
+        pa_xfree(t);
+
         if (sink->card)
             pa_strbuf_printf(s, "\tcard: %u <%s>\n", sink->card->index, sink->card->name);
         if (sink->module)
@@ -374,6 +390,7 @@ char *pa_source_list_to_string(pa_core *c) {
             vdb[PA_SW_VOLUME_SNPRINT_DB_MAX],
             cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t;
         const char *cmn;
+        uint64_t delivered, converted;
 
         cmn = pa_channel_map_to_pretty_name(&source->channel_map);
 
@@ -448,6 +465,18 @@ char *pa_source_list_to_string(pa_core *c) {
                     "\tfixed latency: %0.2f ms\n",
                     (double) pa_source_get_fixed_latency(source) / PA_USEC_PER_MSEC);
 
+        pa_source_get_post_stats(source, &delivered, &converted);
+        pa_strbuf_printf(
+                s,
+                "\tdelivered: %llu bytes; converted: %llu bytes\n",
+                (unsigned long long) delivered,
+                (unsigned long long) converted);
+
+        t = pa_render_profile_to_string(&source->render_profile, "\t\t");
+        if (*t)
+            pa_strbuf_printf(s, "\trender profile:\n%s", t);
+        pa_xfree(t);
+
         if (source->monitor_of)
             pa_strbuf_printf(s, "\tmonitor_of: %u\n", source->monitor_of->index);
         if (source->card)
@@ -660,6 +689,11 @@ char *pa_sink_input_list_to_string(pa_core *c) {
         if (i->client)
             pa_strbuf_printf(s, "\tclient: %u <%s>\n", i->client->index, pa_strnull(pa_proplist_gets(i->client->proplist, PA_PROP_APPLICATION_NAME)));
 
+        t = pa_render_profile_to_string(&i->render_profile, "\t\t");
+        if (*t)
+            pa_strbuf_printf(s, "\trender profile:\n%s", t);
+        pa_xfree(t);
+
         t = pa_proplist_to_string_sep(i->proplist, "\n\t\t");
         pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
         pa_xfree(t);
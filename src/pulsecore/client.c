@@ -72,6 +72,7 @@ pa_client *pa_client_new(pa_core *core, pa_client_new_data *data) {
     c->source_outputs = pa_idxset_new(NULL, NULL);
 
     c->userdata = NULL;
+    c->n_deferred_requests = 0;
     c->kill = NULL;
     c->send_event = NULL;
 
@@ -47,6 +47,10 @@ struct pa_client {
 
     void *userdata;
 
+    /* Requests which had to wait because the client used up its share
+     * of a main loop iteration, kept up to date by the protocol */
+    uint64_t n_deferred_requests;
+
     void (*kill)(pa_client *c);
 
     void (*send_event)(pa_client *c, const char *name, pa_proplist *data);
@@ -24,11 +24,25 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/core-scache.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/source.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/source-output.h>
+#include <pulsecore/client.h>
+#include <pulsecore/card.h>
+#include <pulsecore/module.h>
 
 #include "core-subscribe.h"
 
@@ -37,7 +51,19 @@
  * register a callback function that is called whenever an event
  * matching a subscription mask happens. The execution of the callback
  * function is postponed to the next main loop iteration, i.e. is not
- * called from within the stack frame the entity was created in. */
+ * called from within the stack frame the entity was created in.
+ *
+ * Change events for an object which already had one delivered less
+ * than subscription_coalesce_usec ago are held back until that much
+ * time has passed, and merged with whatever changes follow meanwhile. */
+
+/* Only objects which pass both are reported */
+struct subscription_filter {
+    uint32_t *indexes; /* sorted, none means any */
+    unsigned n_indexes;
+
+    char *key, *value; /* value NULL means the property only needs to be set */
+};
 
 struct pa_subscription {
     pa_core *core;
@@ -47,6 +73,8 @@ struct pa_subscription {
     void *userdata;
     pa_subscription_mask_t mask;
 
+    struct subscription_filter *filters[PA_SUBSCRIPTION_EVENT_FACILITY_MASK+1];
+
     PA_LLIST_FIELDS(pa_subscription);
 };
 
@@ -56,10 +84,34 @@ struct pa_subscription_event {
     pa_subscription_event_type_t type;
     uint32_t index;
 
+    /* When a held back change event is due */
+    pa_usec_t due;
+
     PA_LLIST_FIELDS(pa_subscription_event);
 };
 
+/* How many removed objects we remember. Clients which come back after
+ * more went away than this get a full snapshot instead of a delta. */
+#define MAX_REMOVED_OBJECTS 1024
+
+struct pa_object_generation {
+    pa_subscription_event_type_t facility;
+    uint32_t index;
+    uint64_t generation;
+
+    /* Removed objects are listed in the order they went away */
+    pa_bool_t removed;
+    PA_LLIST_FIELDS(pa_object_generation);
+
+    /* When the last change event was queued, and the one held back
+     * since, if any */
+    pa_usec_t last_change;
+    pa_subscription_event *held;
+};
+
 static void sched_event(pa_core *c);
+static void update_coalesce_timer(pa_core *c);
+static void coalesce_cb(pa_mainloop_api *m, pa_time_event *te, const struct timeval *tv, void *userdata);
 
 /* Allocate a new subscription object for the given subscription mask. Use the specified callback function and user data */
 pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m, pa_subscription_cb_t callback, void *userdata) {
@@ -69,7 +121,7 @@ pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m, pa_su
     pa_assert(m);
     pa_assert(callback);
 
-    s = pa_xnew(pa_subscription, 1);
+    s = pa_xnew0(pa_subscription, 1);
     s->core = c;
     s->dead = FALSE;
     s->callback = callback;
@@ -89,14 +141,143 @@ void pa_subscription_free(pa_subscription*s) {
     sched_event(s->core);
 }
 
+static void free_filter(struct subscription_filter *f) {
+    pa_assert(f);
+
+    pa_xfree(f->indexes);
+    pa_xfree(f->key);
+    pa_xfree(f->value);
+    pa_xfree(f);
+}
+
 static void free_subscription(pa_subscription *s) {
+    unsigned i;
+
     pa_assert(s);
     pa_assert(s->core);
 
+    for (i = 0; i < PA_ELEMENTSOF(s->filters); i++)
+        if (s->filters[i])
+            free_filter(s->filters[i]);
+
     PA_LLIST_REMOVE(pa_subscription, s->core->subscriptions, s);
     pa_xfree(s);
 }
 
+static int compare_index(const void *a, const void *b) {
+    const uint32_t *x = a, *y = b;
+
+    return *x < *y ? -1 : (*x > *y ? 1 : 0);
+}
+
+void pa_subscription_set_filter(pa_subscription *s, pa_subscription_event_type_t facility, const uint32_t *indexes, unsigned n_indexes, const char *key, const char *value) {
+    struct subscription_filter *f;
+
+    pa_assert(s);
+    pa_assert(!s->dead);
+    pa_assert((facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0);
+    pa_assert(indexes || n_indexes == 0);
+    pa_assert(key || !value);
+
+    if (s->filters[facility]) {
+        free_filter(s->filters[facility]);
+        s->filters[facility] = NULL;
+    }
+
+    if (n_indexes == 0 && !key)
+        return;
+
+    f = pa_xnew0(struct subscription_filter, 1);
+
+    if (n_indexes > 0) {
+        f->indexes = pa_xmemdup(indexes, sizeof(uint32_t) * n_indexes);
+        f->n_indexes = n_indexes;
+        qsort(f->indexes, n_indexes, sizeof(uint32_t), compare_index);
+    }
+
+    f->key = pa_xstrdup(key);
+    f->value = pa_xstrdup(value);
+
+    s->filters[facility] = f;
+}
+
+static pa_proplist *get_proplist(pa_core *c, pa_subscription_event_type_t facility, uint32_t idx) {
+    pa_assert(c);
+
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK: {
+            pa_sink *sink = pa_idxset_get_by_index(c->sinks, idx);
+            return sink ? sink->proplist : NULL;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE: {
+            pa_source *source = pa_idxset_get_by_index(c->sources, idx);
+            return source ? source->proplist : NULL;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT: {
+            pa_sink_input *i = pa_idxset_get_by_index(c->sink_inputs, idx);
+            return i ? i->proplist : NULL;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT: {
+            pa_source_output *o = pa_idxset_get_by_index(c->source_outputs, idx);
+            return o ? o->proplist : NULL;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_MODULE: {
+            pa_module *m = pa_idxset_get_by_index(c->modules, idx);
+            return m ? m->proplist : NULL;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_CLIENT: {
+            pa_client *client = pa_idxset_get_by_index(c->clients, idx);
+            return client ? client->proplist : NULL;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE: {
+            pa_scache_entry *e = c->scache ? pa_idxset_get_by_index(c->scache, idx) : NULL;
+            return e ? e->proplist : NULL;
+        }
+
+        case PA_SUBSCRIPTION_EVENT_CARD: {
+            pa_card *card = pa_idxset_get_by_index(c->cards, idx);
+            return card ? card->proplist : NULL;
+        }
+
+        default:
+            return NULL;
+    }
+}
+
+static pa_bool_t filter_match(pa_subscription *s, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_subscription_event_type_t facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    struct subscription_filter *f;
+    pa_proplist *p;
+    const char *v;
+
+    pa_assert(s);
+
+    if (!(f = s->filters[facility]))
+        return TRUE;
+
+    if (f->n_indexes > 0 && !bsearch(&idx, f->indexes, f->n_indexes, sizeof(uint32_t), compare_index))
+        return FALSE;
+
+    if (!f->key)
+        return TRUE;
+
+    /* The properties of removed objects are gone, so let those through */
+    if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE)
+        return TRUE;
+
+    if (!(p = get_proplist(s->core, facility, idx)) ||
+        !(v = pa_proplist_gets(p, f->key)))
+        return FALSE;
+
+    return !f->value || pa_streq(v, f->value);
+}
+
 static void free_event(pa_subscription_event *s) {
     pa_assert(s);
     pa_assert(s->core);
@@ -110,8 +291,22 @@ static void free_event(pa_subscription_event *s) {
 
 /* Free all subscription objects */
 void pa_subscription_free_all(pa_core *c) {
+    unsigned i;
+
     pa_assert(c);
 
+    while (c->subscription_held) {
+        pa_subscription_event *e = c->subscription_held;
+
+        PA_LLIST_REMOVE(pa_subscription_event, c->subscription_held, e);
+        pa_xfree(e);
+    }
+
+    if (c->subscription_coalesce_event) {
+        c->mainloop->time_free(c->subscription_coalesce_event);
+        c->subscription_coalesce_event = NULL;
+    }
+
     while (c->subscriptions)
         free_subscription(c->subscriptions);
 
@@ -122,6 +317,16 @@ void pa_subscription_free_all(pa_core *c) {
         c->mainloop->defer_free(c->subscription_defer_event);
         c->subscription_defer_event = NULL;
     }
+
+    for (i = 0; i < PA_ELEMENTSOF(c->object_generations); i++)
+        if (c->object_generations[i]) {
+            pa_hashmap_free(c->object_generations[i], pa_xfree);
+            c->object_generations[i] = NULL;
+        }
+
+    PA_LLIST_HEAD_INIT(pa_object_generation, c->removed_objects);
+    c->removed_objects_last = NULL;
+    c->n_removed_objects = 0;
 }
 
 #ifdef DEBUG
@@ -170,7 +375,7 @@ static void defer_cb(pa_mainloop_api *m, pa_defer_event *de, void *userdata) {
 
         for (s = c->subscriptions; s; s = s->next) {
 
-            if (!s->dead && pa_subscription_match_flags(s->mask, e->type))
+            if (!s->dead && pa_subscription_match_flags(s->mask, e->type) && filter_match(s, e->type, e->index))
                 s->callback(c, e->type, e->index, s->userdata);
         }
 
@@ -203,11 +408,219 @@ static void sched_event(pa_core *c) {
     c->mainloop->defer_enable(c->subscription_defer_event, 1);
 }
 
+static void unlink_removed_object(pa_core *c, pa_object_generation *g) {
+    pa_assert(c);
+    pa_assert(g);
+    pa_assert(g->removed);
+
+    if (c->removed_objects_last == g)
+        c->removed_objects_last = g->prev;
+
+    PA_LLIST_REMOVE(pa_object_generation, c->removed_objects, g);
+    c->n_removed_objects--;
+    g->removed = FALSE;
+}
+
+/* Bump the generation and record it for the object */
+static pa_object_generation *record_generation(pa_core *c, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_object_generation *r;
+    pa_subscription_event_type_t facility = t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    pa_hashmap *h;
+    pa_object_generation *g;
+
+    pa_assert(c);
+
+    c->generation++;
+
+    if (!(h = c->object_generations[facility]))
+        h = c->object_generations[facility] = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    if (!(g = pa_hashmap_get(h, PA_UINT32_TO_PTR(idx)))) {
+        g = pa_xnew0(pa_object_generation, 1);
+        g->facility = facility;
+        g->index = idx;
+        pa_hashmap_put(h, PA_UINT32_TO_PTR(idx), g);
+    } else if (g->removed)
+        unlink_removed_object(c, g);
+
+    g->generation = c->generation;
+
+    if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_REMOVE)
+        return g;
+
+    /* A change held back for the object is pointless now. It must go
+     * even if nobody is listening any more, it may not outlive the
+     * record of the object. */
+    if (g->held) {
+        PA_LLIST_REMOVE(pa_subscription_event, c->subscription_held, g->held);
+        pa_xfree(g->held);
+        g->held = NULL;
+        update_coalesce_timer(c);
+    }
+
+    g->removed = TRUE;
+    PA_LLIST_INSERT_AFTER(pa_object_generation, c->removed_objects, c->removed_objects_last, g);
+    c->removed_objects_last = g;
+    c->n_removed_objects++;
+
+    /* Forget the oldest removal. Anything from before it can't be told
+     * apart any more. */
+    if (c->n_removed_objects > MAX_REMOVED_OBJECTS) {
+        r = c->removed_objects;
+        pa_assert(r != g);
+        pa_assert(!r->held);
+
+        c->generation_horizon = r->generation;
+
+        unlink_removed_object(c, r);
+        pa_hashmap_remove(c->object_generations[r->facility], PA_UINT32_TO_PTR(r->index));
+        pa_xfree(r);
+    }
+
+    return g;
+}
+
+uint64_t pa_subscription_get_generation(pa_core *c) {
+    pa_assert(c);
+
+    return c->generation;
+}
+
+uint64_t pa_subscription_get_object_generation(pa_core *c, pa_subscription_event_type_t facility, uint32_t idx) {
+    pa_object_generation *g;
+
+    pa_assert(c);
+    pa_assert((facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0);
+
+    if (!c->object_generations[facility] ||
+        !(g = pa_hashmap_get(c->object_generations[facility], PA_UINT32_TO_PTR(idx))))
+        return c->generation;
+
+    return g->generation;
+}
+
+pa_bool_t pa_subscription_generation_is_known(pa_core *c, uint64_t g) {
+    pa_assert(c);
+
+    return g >= c->generation_horizon && g <= c->generation;
+}
+
+unsigned pa_subscription_foreach_removed(pa_core *c, uint64_t g, pa_subscription_removed_cb_t cb, void *userdata) {
+    pa_object_generation *i;
+    unsigned n = 0;
+
+    pa_assert(c);
+
+    /* Walk back from the newest removal */
+    for (i = c->removed_objects_last; i && i->prev && i->prev->generation > g; i = i->prev)
+        ;
+
+    for (; i; i = i->next) {
+        if (i->generation <= g)
+            continue;
+
+        if (cb)
+            cb(i->facility, i->index, userdata);
+
+        n++;
+    }
+
+    return n;
+}
+
+static void queue_event(pa_core *c, pa_subscription_event *e) {
+    pa_assert(c);
+    pa_assert(e);
+
+    PA_LLIST_INSERT_AFTER(pa_subscription_event, c->subscription_event_queue, c->subscription_event_last, e);
+    c->subscription_event_last = e;
+
+#ifdef DEBUG
+    dump_event("Queued", e);
+#endif
+
+    sched_event(c);
+}
+
+/* Arm the timer for the held back change event due first */
+static void update_coalesce_timer(pa_core *c) {
+    pa_subscription_event *e;
+    pa_usec_t due = PA_USEC_INVALID;
+
+    pa_assert(c);
+
+    for (e = c->subscription_held; e; e = e->next)
+        if (due == PA_USEC_INVALID || e->due < due)
+            due = e->due;
+
+    if (c->subscription_coalesce_event)
+        pa_core_rttime_restart(c, c->subscription_coalesce_event, due);
+    else if (due != PA_USEC_INVALID)
+        c->subscription_coalesce_event = pa_core_rttime_new(c, due, coalesce_cb, c);
+}
+
+static void release_held(pa_core *c, pa_object_generation *g, pa_usec_t now) {
+    pa_subscription_event *e;
+
+    pa_assert(c);
+    pa_assert(g);
+    pa_assert(g->held);
+
+    e = g->held;
+    g->held = NULL;
+    g->last_change = now;
+
+    PA_LLIST_REMOVE(pa_subscription_event, c->subscription_held, e);
+    queue_event(c, e);
+}
+
+static void coalesce_cb(pa_mainloop_api *m, pa_time_event *te, const struct timeval *tv, void *userdata) {
+    pa_core *c = userdata;
+    pa_subscription_event *e, *n;
+    pa_usec_t now;
+
+    pa_assert(c);
+    pa_assert(c->subscription_coalesce_event == te);
+
+    now = pa_rtclock_now();
+
+    for (e = c->subscription_held; e; e = n) {
+        n = e->next;
+
+        if (e->due <= now)
+            release_held(c, pa_hashmap_get(c->object_generations[e->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK], PA_UINT32_TO_PTR(e->index)), now);
+    }
+
+    update_coalesce_timer(c);
+}
+
+static void hold_change(pa_core *c, pa_object_generation *g, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_subscription_event *e;
+
+    pa_assert(c);
+    pa_assert(g);
+    pa_assert(!g->held);
+
+    e = pa_xnew(pa_subscription_event, 1);
+    e->core = c;
+    e->type = t;
+    e->index = idx;
+    e->due = g->last_change + c->subscription_coalesce_usec;
+
+    PA_LLIST_PREPEND(pa_subscription_event, c->subscription_held, e);
+    g->held = e;
+
+    update_coalesce_timer(c);
+}
+
 /* Append a new subscription event to the subscription event queue and schedule a main loop event */
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx) {
     pa_subscription_event *e;
+    pa_object_generation *g;
     pa_assert(c);
 
+    g = record_generation(c, t, idx);
+
     /* No need for queuing subscriptions of no one is listening */
     if (!c->subscriptions)
         return;
@@ -215,6 +628,11 @@ void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t i
     if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_NEW) {
         pa_subscription_event *i, *n;
 
+        /* The change event held back will do for this one too. A
+         * removal dropped it already. */
+        if (g->held)
+            return;
+
         /* Check for duplicates */
         for (i = c->subscription_event_last; i; i = n) {
             n = i->prev;
@@ -245,19 +663,25 @@ void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t i
                 return;
             }
         }
+
+        if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE && c->subscription_coalesce_usec > 0) {
+            pa_usec_t now = pa_rtclock_now();
+
+            /* Too soon after the last one, hold this one back */
+            if (g->last_change > 0 && now < g->last_change + c->subscription_coalesce_usec) {
+                hold_change(c, g, t, idx);
+                return;
+            }
+
+            g->last_change = now;
+        }
     }
 
     e = pa_xnew(pa_subscription_event, 1);
     e->core = c;
     e->type = t;
     e->index = idx;
+    e->due = 0;
 
-    PA_LLIST_INSERT_AFTER(pa_subscription_event, c->subscription_event_queue, c->subscription_event_last, e);
-    c->subscription_event_last = e;
-
-#ifdef DEBUG
-    dump_event("Queued", e);
-#endif
-
-    sched_event(c);
+    queue_event(c, e);
 }
@@ -24,6 +24,7 @@
 
 typedef struct pa_subscription pa_subscription;
 typedef struct pa_subscription_event pa_subscription_event;
+typedef struct pa_object_generation pa_object_generation;
 
 #include <pulsecore/core.h>
 #include <pulsecore/native-common.h>
@@ -34,6 +35,34 @@ pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m,  pa_s
 void pa_subscription_free(pa_subscription*s);
 void pa_subscription_free_all(pa_core *c);
 
+/* Only pass events about objects of the facility whose index is one of
+ * indexes, if there are any, and, for new and change events, whose
+ * property key is value, or is set at all if value is NULL. The
+ * property is checked against the object as it is when the event is
+ * dispatched, so the change which makes an object stop matching is not
+ * passed either. Replaces the earlier filter for the facility, if
+ * any. */
+void pa_subscription_set_filter(pa_subscription *s, pa_subscription_event_type_t facility, const uint32_t *indexes, unsigned n_indexes, const char *key, const char *value);
+
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx);
 
+/* Every event posted bumps the generation of the core, and records it
+ * for the object concerned, so that clients can be told which objects
+ * changed or went away since a generation they have seen. Unlike the
+ * events themselves, this happens right away. */
+uint64_t pa_subscription_get_generation(pa_core *c);
+
+/* The generation the object last changed in. For objects nothing is
+ * known about this is the current generation, i.e. they have to be
+ * assumed to have just changed. */
+uint64_t pa_subscription_get_object_generation(pa_core *c, pa_subscription_event_type_t facility, uint32_t idx);
+
+/* Whether what changed since generation g can still be told. Only a
+ * limited number of removals is remembered. */
+pa_bool_t pa_subscription_generation_is_known(pa_core *c, uint64_t g);
+
+/* Calls cb for every object removed after generation g, oldest first */
+typedef void (*pa_subscription_removed_cb_t)(pa_subscription_event_type_t facility, uint32_t idx, void *userdata);
+unsigned pa_subscription_foreach_removed(pa_core *c, uint64_t g, pa_subscription_removed_cb_t cb, void *userdata);
+
 #endif
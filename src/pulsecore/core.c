@@ -66,6 +66,7 @@ static void core_free(pa_object *o);
 pa_core* pa_core_new(pa_mainloop_api *m, pa_bool_t shared, size_t shm_size) {
     pa_core* c;
     pa_mempool *pool;
+    uint32_t epoch;
     int j;
 
     pa_assert(m);
@@ -124,6 +125,19 @@ pa_core* pa_core_new(pa_mainloop_api *m, pa_bool_t shared, size_t shm_size) {
     PA_LLIST_HEAD_INIT(pa_subscription_event, c->subscription_event_queue);
     c->subscription_event_last = NULL;
 
+    PA_LLIST_HEAD_INIT(pa_subscription_event, c->subscription_held);
+    c->subscription_coalesce_event = NULL;
+    c->subscription_coalesce_usec = 50 * PA_USEC_PER_MSEC;
+
+    /* Start somewhere random, so that a generation a client got from an
+     * earlier instance of the daemon is not mistaken for one of ours */
+    pa_random(&epoch, sizeof(epoch));
+    c->generation = c->generation_horizon = (uint64_t) epoch << 32;
+    pa_zero(c->object_generations);
+    PA_LLIST_HEAD_INIT(pa_object_generation, c->removed_objects);
+    c->removed_objects_last = NULL;
+    c->n_removed_objects = 0;
+
     c->mempool = pool;
     pa_silence_cache_init(&c->silence_cache);
 
@@ -142,6 +156,9 @@ pa_core* pa_core_new(pa_mainloop_api *m, pa_bool_t shared, size_t shm_size) {
     c->disable_lfe_remixing = FALSE;
     c->deferred_volume = TRUE;
     c->resample_method = PA_RESAMPLER_SPEEX_FLOAT_BASE + 1;
+    c->render_pool = NULL;
+    c->parallel_module_probe = FALSE;
+    c->module_probe_batch = NULL;
 
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
         pa_hook_init(&c->hooks[j], c);
@@ -207,6 +224,9 @@ static void core_free(pa_object *o) {
     pa_assert(!c->default_source);
     pa_assert(!c->default_sink);
 
+    if (c->render_pool)
+        pa_render_pool_free(c->render_pool);
+
     pa_silence_cache_done(&c->silence_cache);
     pa_mempool_free(c->mempool);
 
@@ -27,6 +27,7 @@
 #include <pulsecore/cpu.h>
 
 typedef struct pa_core pa_core;
+typedef struct pa_module_probe_batch pa_module_probe_batch;
 
 /* This is a bitmask that encodes the cause why a sink/source is
  * suspended. */
@@ -43,6 +44,7 @@ typedef enum pa_suspend_cause {
 #include <pulsecore/hashmap.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/resampler.h>
+#include <pulsecore/render-pool.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/hook-list.h>
 #include <pulsecore/asyncmsgq.h>
@@ -161,6 +163,18 @@ struct pa_core {
     PA_LLIST_HEAD(pa_subscription_event, subscription_event_queue);
     pa_subscription_event *subscription_event_last;
 
+    /* Change events held back to be merged with later ones */
+    PA_LLIST_HEAD(pa_subscription_event, subscription_held);
+    pa_time_event *subscription_coalesce_event;
+    pa_usec_t subscription_coalesce_usec;
+
+    /* See pa_subscription_get_generation() */
+    uint64_t generation, generation_horizon;
+    pa_hashmap *object_generations[PA_SUBSCRIPTION_EVENT_FACILITY_MASK+1];
+    PA_LLIST_HEAD(pa_object_generation, removed_objects);
+    pa_object_generation *removed_objects_last;
+    unsigned n_removed_objects;
+
     pa_mempool *mempool;
     pa_silence_cache silence_cache;
 
@@ -184,6 +198,15 @@ struct pa_core {
     pa_server_type_t server_type;
     pa_cpu_info cpu_info;
 
+    /* Worker threads for rendering sink inputs in parallel, NULL if
+     * parallel rendering is disabled */
+    pa_render_pool *render_pool;
+
+    /* Whether modules may probe devices concurrently during a probe
+     * batch, and the batch in progress if any */
+    pa_bool_t parallel_module_probe;
+    pa_module_probe_batch *module_probe_batch;
+
     /* hooks */
     pa_hook hooks[PA_CORE_HOOK_MAX];
 };
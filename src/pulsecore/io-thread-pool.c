@@ -0,0 +1,367 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+#include "io-thread-pool.h"
+
+/* How far ahead of their deadlines clients get serviced if the thread
+ * is awake anyway */
+#define SLACK_USEC (1 * PA_USEC_PER_MSEC)
+
+typedef struct worker {
+    pa_msgobject parent;
+
+    pa_io_thread_pool *pool;
+    unsigned index;
+
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+
+    /* Only accessed from main context */
+    unsigned n_clients;
+
+    /* Only accessed from the worker thread, sorted by deadline */
+    PA_LLIST_HEAD(pa_io_thread_pool_client, clients);
+} worker;
+
+enum {
+    WORKER_MESSAGE_ADD_CLIENT,
+    WORKER_MESSAGE_REMOVE_CLIENT
+};
+
+PA_DEFINE_PRIVATE_CLASS(worker, pa_msgobject);
+#define WORKER(o) (worker_cast(o))
+
+struct pa_io_thread_pool_client {
+    worker *worker;
+    pa_module *module;
+
+    pa_io_thread_pool_cb_t callback;
+    void *userdata;
+
+    pa_bool_t timer_enabled;
+    pa_usec_t deadline;
+
+    PA_LLIST_FIELDS(pa_io_thread_pool_client);
+};
+
+struct pa_io_thread_pool {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+
+    worker **workers;
+    unsigned n_workers;
+};
+
+static pa_bool_t deadline_before(pa_io_thread_pool_client *a, pa_io_thread_pool_client *b) {
+    if (!a->timer_enabled)
+        return FALSE;
+
+    return !b->timer_enabled || a->deadline < b->deadline;
+}
+
+/* Called from IO context */
+static void sort_clients(worker *w) {
+    pa_io_thread_pool_client *sorted = NULL, *c;
+
+    /* Insertion sort. The list is usually almost in order already since
+     * only the clients that were due have moved their deadlines. */
+    while ((c = w->clients)) {
+        pa_io_thread_pool_client *i, *after = NULL;
+
+        PA_LLIST_REMOVE(pa_io_thread_pool_client, w->clients, c);
+
+        for (i = sorted; i && !deadline_before(c, i); i = i->next)
+            after = i;
+
+        PA_LLIST_INSERT_AFTER(pa_io_thread_pool_client, sorted, after, c);
+    }
+
+    w->clients = sorted;
+}
+
+/* Called from IO context */
+static int worker_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    worker *w = WORKER(o);
+    pa_io_thread_pool_client *c = data;
+
+    worker_assert_ref(w);
+    pa_assert(c);
+
+    switch (code) {
+
+        case WORKER_MESSAGE_ADD_CLIENT:
+            c->timer_enabled = FALSE;
+            PA_LLIST_PREPEND(pa_io_thread_pool_client, w->clients, c);
+            return 0;
+
+        case WORKER_MESSAGE_REMOVE_CLIENT:
+            PA_LLIST_REMOVE(pa_io_thread_pool_client, w->clients, c);
+            return 0;
+    }
+
+    return -1;
+}
+
+static void thread_func(void *userdata) {
+    worker *w = userdata;
+    pa_io_thread_pool_client *c;
+
+    pa_assert(w);
+
+    pa_log_debug("Thread starting up");
+
+    if (w->pool->core->realtime_scheduling)
+        pa_make_realtime(w->pool->core->realtime_priority);
+
+    pa_thread_mq_install(&w->thread_mq);
+
+    for (;;) {
+        pa_usec_t now;
+        int ret;
+
+        now = pa_rtclock_now() + SLACK_USEC;
+
+        /* Service the most urgent clients first. */
+        PA_LLIST_FOREACH(c, w->clients)
+            c->callback(c, now, c->userdata);
+
+        sort_clients(w);
+
+        if (w->clients && w->clients->timer_enabled)
+            pa_rtpoll_set_timer_absolute(w->rtpoll, w->clients->deadline);
+        else
+            pa_rtpoll_set_timer_disabled(w->rtpoll);
+
+        /* Hmm, nothing to do. Let's sleep */
+        if ((ret = pa_rtpoll_run(w->rtpoll, TRUE)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+    }
+
+fail:
+    /* If this was no regular exit from the loop we have to continue
+     * processing messages until we received PA_MESSAGE_SHUTDOWN. The
+     * clients are removed while their modules are being unloaded. */
+    PA_LLIST_FOREACH(c, w->clients)
+        pa_asyncmsgq_post(w->thread_mq.outq, PA_MSGOBJECT(w->pool->core), PA_CORE_MESSAGE_UNLOAD_MODULE, c->module, 0, NULL, NULL);
+
+    pa_asyncmsgq_wait_for(w->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+
+finish:
+    pa_log_debug("Thread shutting down");
+}
+
+static void worker_free(pa_object *o) {
+    worker *w = WORKER(o);
+
+    pa_assert(w);
+
+    if (w->thread) {
+        pa_asyncmsgq_send(w->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(w->thread);
+    }
+
+    pa_assert(!w->clients);
+
+    pa_thread_mq_done(&w->thread_mq);
+    pa_rtpoll_free(w->rtpoll);
+
+    pa_xfree(w);
+}
+
+/* Called from main context */
+static worker *worker_new(pa_io_thread_pool *p, unsigned idx) {
+    worker *w;
+    char name[16];
+
+    w = pa_msgobject_new(worker);
+    w->parent.parent.free = worker_free;
+    w->parent.process_msg = worker_process_msg;
+
+    w->pool = p;
+    w->index = idx;
+    w->n_clients = 0;
+    PA_LLIST_HEAD_INIT(pa_io_thread_pool_client, w->clients);
+
+    w->rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&w->thread_mq, p->core->mainloop, w->rtpoll);
+
+    pa_snprintf(name, sizeof(name), "io-%u", idx);
+
+    if (!(w->thread = pa_thread_new(name, thread_func, w))) {
+        pa_log("Failed to create thread.");
+        worker_unref(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+static pa_io_thread_pool* io_thread_pool_new(pa_core *core) {
+    pa_io_thread_pool *p;
+
+    pa_assert(core);
+
+    p = pa_xnew0(pa_io_thread_pool, 1);
+    PA_REFCNT_INIT(p);
+    p->core = core;
+
+    /* The threads are only started once they get their first client */
+    p->n_workers = PA_MAX(pa_ncpus(), 1U);
+    p->workers = pa_xnew0(worker*, p->n_workers);
+
+    pa_assert_se(pa_shared_set(core, "io-thread-pool", p) >= 0);
+
+    return p;
+}
+
+pa_io_thread_pool* pa_io_thread_pool_get(pa_core *core) {
+    pa_io_thread_pool *p;
+
+    if ((p = pa_shared_get(core, "io-thread-pool")))
+        return pa_io_thread_pool_ref(p);
+
+    return io_thread_pool_new(core);
+}
+
+pa_io_thread_pool* pa_io_thread_pool_ref(pa_io_thread_pool *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+
+    PA_REFCNT_INC(p);
+
+    return p;
+}
+
+void pa_io_thread_pool_unref(pa_io_thread_pool *p) {
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+
+    if (PA_REFCNT_DEC(p) > 0)
+        return;
+
+    for (i = 0; i < p->n_workers; i++)
+        if (p->workers[i])
+            worker_unref(p->workers[i]);
+
+    pa_xfree(p->workers);
+
+    pa_assert_se(pa_shared_remove(p->core, "io-thread-pool") >= 0);
+
+    pa_xfree(p);
+}
+
+pa_io_thread_pool_client* pa_io_thread_pool_client_new(pa_io_thread_pool *p, pa_module *m, pa_io_thread_pool_cb_t cb, void *userdata) {
+    pa_io_thread_pool_client *c;
+    unsigned i, best = 0;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+    pa_assert(m);
+    pa_assert(cb);
+
+    /* Spread the clients evenly over the CPUs. On a tie prefer a
+     * thread which is already running over starting a new one. */
+    for (i = 0; i < p->n_workers; i++) {
+        unsigned n = p->workers[i] ? p->workers[i]->n_clients : 0;
+        unsigned n_best = p->workers[best] ? p->workers[best]->n_clients : 0;
+
+        if (n < n_best || (n == n_best && p->workers[i] && !p->workers[best]))
+            best = i;
+    }
+
+    if (!p->workers[best])
+        if (!(p->workers[best] = worker_new(p, best)))
+            return NULL;
+
+    c = pa_xnew0(pa_io_thread_pool_client, 1);
+    c->worker = worker_ref(p->workers[best]);
+    c->module = m;
+    c->callback = cb;
+    c->userdata = userdata;
+
+    c->worker->n_clients++;
+
+    pa_assert_se(pa_asyncmsgq_send(c->worker->thread_mq.inq, PA_MSGOBJECT(c->worker), WORKER_MESSAGE_ADD_CLIENT, c, 0, NULL) == 0);
+
+    pa_log_debug("Module %u is using shared IO thread %u with %u clients.", m->index, best, c->worker->n_clients);
+
+    return c;
+}
+
+void pa_io_thread_pool_client_free(pa_io_thread_pool_client *c) {
+    pa_assert(c);
+
+    pa_assert_se(pa_asyncmsgq_send(c->worker->thread_mq.inq, PA_MSGOBJECT(c->worker), WORKER_MESSAGE_REMOVE_CLIENT, c, 0, NULL) == 0);
+
+    pa_assert(c->worker->n_clients > 0);
+    c->worker->n_clients--;
+
+    worker_unref(c->worker);
+    pa_xfree(c);
+}
+
+pa_asyncmsgq* pa_io_thread_pool_client_get_asyncmsgq(pa_io_thread_pool_client *c) {
+    pa_assert(c);
+
+    return c->worker->thread_mq.inq;
+}
+
+pa_rtpoll* pa_io_thread_pool_client_get_rtpoll(pa_io_thread_pool_client *c) {
+    pa_assert(c);
+
+    return c->worker->rtpoll;
+}
+
+void pa_io_thread_pool_client_set_timer_absolute(pa_io_thread_pool_client *c, pa_usec_t usec) {
+    pa_assert(c);
+
+    c->timer_enabled = TRUE;
+    c->deadline = usec;
+}
+
+void pa_io_thread_pool_client_set_timer_disabled(pa_io_thread_pool_client *c) {
+    pa_assert(c);
+
+    c->timer_enabled = FALSE;
+}
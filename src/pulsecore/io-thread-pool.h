@@ -0,0 +1,75 @@
+#ifndef foopulseiothreadpoolhfoo
+#define foopulseiothreadpoolhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/module.h>
+#include <pulsecore/asyncmsgq.h>
+#include <pulsecore/rtpoll.h>
+
+/* IO threads which are shared by several sinks and sources instead of
+ * every device running a thread of its own. The pool runs at most one
+ * thread per CPU, each with its own pa_rtpoll and pa_thread_mq, and
+ * assigns new clients to the thread with the fewest clients.
+ *
+ * A client passes the asyncmsgq and rtpoll of its thread to
+ * pa_sink_set_asyncmsgq()/pa_sink_set_rtpoll() (or the source
+ * equivalents) like it would its own, so message processing is not
+ * affected. In place of its own thread loop the client provides a
+ * callback which is run on each wakeup of the shared thread, ordered
+ * by the clients' deadlines. */
+
+typedef struct pa_io_thread_pool pa_io_thread_pool;
+typedef struct pa_io_thread_pool_client pa_io_thread_pool_client;
+
+/* Called from IO context on each iteration of the shared thread. The
+ * thread may have been woken up on behalf of another client or for a
+ * message, so the callback needs to check for itself whether there is
+ * anything to do, like the body of a thread loop would. Before
+ * returning it should (re)arm or disable the client's timer.
+ *
+ * now is the time of the wakeup plus a small slack. Clients should
+ * treat everything that is due by then as due already, so that
+ * deadlines which are close together are served by one wakeup. */
+typedef void (*pa_io_thread_pool_cb_t)(pa_io_thread_pool_client *c, pa_usec_t now, void *userdata);
+
+pa_io_thread_pool* pa_io_thread_pool_get(pa_core *core);
+pa_io_thread_pool* pa_io_thread_pool_ref(pa_io_thread_pool *p);
+void pa_io_thread_pool_unref(pa_io_thread_pool *p);
+
+/* Called from main context. The callback may be called right away.
+ * If the thread fails, the module m is asked to unload itself. */
+pa_io_thread_pool_client* pa_io_thread_pool_client_new(pa_io_thread_pool *p, pa_module *m, pa_io_thread_pool_cb_t cb, void *userdata);
+
+/* Called from main context. Returns once the IO thread has stopped
+ * calling the callback. */
+void pa_io_thread_pool_client_free(pa_io_thread_pool_client *c);
+
+pa_asyncmsgq* pa_io_thread_pool_client_get_asyncmsgq(pa_io_thread_pool_client *c);
+pa_rtpoll* pa_io_thread_pool_client_get_rtpoll(pa_io_thread_pool_client *c);
+
+/* Called from IO context */
+void pa_io_thread_pool_client_set_timer_absolute(pa_io_thread_pool_client *c, pa_usec_t usec);
+void pa_io_thread_pool_client_set_timer_disabled(pa_io_thread_pool_client *c);
+
+#endif
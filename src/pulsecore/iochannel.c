@@ -231,6 +231,52 @@ ssize_t pa_iochannel_write(pa_iochannel*io, const void*data, size_t l) {
     return r;
 }
 
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, unsigned n) {
+    ssize_t r;
+
+    pa_assert(io);
+    pa_assert(iov);
+    pa_assert(n > 0);
+    pa_assert(io->ofd >= 0);
+
+#ifdef HAVE_SYS_UIO_H
+    if (n == 1)
+        return pa_iochannel_write(io, iov[0].iov_base, iov[0].iov_len);
+
+    for (;;) {
+        if (io->ofd_type == 0) {
+            struct msghdr mh;
+
+            pa_zero(mh);
+            mh.msg_iov = (struct iovec*) iov;
+            mh.msg_iovlen = n;
+
+            /* Like pa_write(), use send semantics on sockets to avoid
+             * SIGPIPE, and fall back to writev() on anything else */
+            if ((r = sendmsg(io->ofd, &mh, MSG_NOSIGNAL)) < 0 && errno == ENOTSOCK) {
+                io->ofd_type = 1;
+                continue;
+            }
+        } else
+            r = writev(io->ofd, iov, (int) n);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+
+        break;
+    }
+
+    if (r >= 0) {
+        io->writable = io->hungup = FALSE;
+        enable_events(io);
+    }
+
+    return r;
+#else
+    return pa_iochannel_write(io, iov[0].iov_base, iov[0].iov_len);
+#endif
+}
+
 ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l) {
     ssize_t r;
 
@@ -288,10 +334,9 @@ int pa_iochannel_creds_enable(pa_iochannel *io) {
     return 0;
 }
 
-ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l, const pa_creds *ucred) {
+ssize_t pa_iochannel_writev_with_creds(pa_iochannel*io, const struct iovec *iov, unsigned n, const pa_creds *ucred) {
     ssize_t r;
     struct msghdr mh;
-    struct iovec iov;
     union {
         struct cmsghdr hdr;
         uint8_t data[CMSG_SPACE(sizeof(struct ucred))];
@@ -299,14 +344,10 @@ ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l
     struct ucred *u;
 
     pa_assert(io);
-    pa_assert(data);
-    pa_assert(l);
+    pa_assert(iov);
+    pa_assert(n > 0);
     pa_assert(io->ofd >= 0);
 
-    pa_zero(iov);
-    iov.iov_base = (void*) data;
-    iov.iov_len = l;
-
     pa_zero(cmsg);
     cmsg.hdr.cmsg_len = CMSG_LEN(sizeof(struct ucred));
     cmsg.hdr.cmsg_level = SOL_SOCKET;
@@ -324,8 +365,8 @@ ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l
     }
 
     pa_zero(mh);
-    mh.msg_iov = &iov;
-    mh.msg_iovlen = 1;
+    mh.msg_iov = (struct iovec*) iov;
+    mh.msg_iovlen = n;
     mh.msg_control = &cmsg;
     mh.msg_controllen = sizeof(cmsg);
 
@@ -337,6 +378,19 @@ ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l
     return r;
 }
 
+ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l, const pa_creds *ucred) {
+    struct iovec iov;
+
+    pa_assert(data);
+    pa_assert(l);
+
+    pa_zero(iov);
+    iov.iov_base = (void*) data;
+    iov.iov_len = l;
+
+    return pa_iochannel_writev_with_creds(io, &iov, 1, ucred);
+}
+
 ssize_t pa_iochannel_read_with_creds(pa_iochannel*io, void*data, size_t l, pa_creds *creds, pa_bool_t *creds_valid) {
     ssize_t r;
     struct msghdr mh;
@@ -431,6 +485,15 @@ pa_mainloop_api* pa_iochannel_get_mainloop_api(pa_iochannel *io) {
     return io->mainloop;
 }
 
+void pa_iochannel_set_mainloop_api(pa_iochannel *io, pa_mainloop_api *m) {
+    pa_assert(io);
+    pa_assert(m);
+
+    delete_events(io);
+    io->mainloop = m;
+    enable_events(io);
+}
+
 int pa_iochannel_get_recv_fd(pa_iochannel *io) {
     pa_assert(io);
 
@@ -29,6 +29,15 @@
 
 #include <sys/types.h>
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#else
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#endif
+
 #include <pulse/mainloop-api.h>
 #include <pulsecore/creds.h>
 #include <pulsecore/macro.h>
@@ -51,11 +60,16 @@ void pa_iochannel_free(pa_iochannel*io);
 ssize_t pa_iochannel_write(pa_iochannel*io, const void*data, size_t l);
 ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l);
 
+/* Writes n buffers with a single system call. Where that is not
+ * supported only the first buffer is written. */
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, unsigned n);
+
 #ifdef HAVE_CREDS
 pa_bool_t pa_iochannel_creds_supported(pa_iochannel *io);
 int pa_iochannel_creds_enable(pa_iochannel *io);
 
 ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l, const pa_creds *ucred);
+ssize_t pa_iochannel_writev_with_creds(pa_iochannel*io, const struct iovec *iov, unsigned n, const pa_creds *ucred);
 ssize_t pa_iochannel_read_with_creds(pa_iochannel*io, void*data, size_t l, pa_creds *ucred, pa_bool_t *creds_valid);
 #endif
 
@@ -82,6 +96,10 @@ pa_bool_t pa_iochannel_socket_is_local(pa_iochannel *io);
 
 pa_mainloop_api* pa_iochannel_get_mainloop_api(pa_iochannel *io);
 
+/* Move the channel over to another main loop, which may be running in
+ * another thread, as long as that can't dispatch events meanwhile */
+void pa_iochannel_set_mainloop_api(pa_iochannel *io, pa_mainloop_api *m);
+
 int pa_iochannel_get_recv_fd(pa_iochannel *io);
 int pa_iochannel_get_send_fd(pa_iochannel *io);
 
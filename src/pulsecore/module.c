@@ -31,6 +31,8 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/proplist.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/log.h>
@@ -38,6 +40,9 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/ltdl-helper.h>
 #include <pulsecore/modinfo.h>
+#include <pulsecore/dynarray.h>
+#include <pulsecore/semaphore.h>
+#include <pulsecore/thread.h>
 
 #include "module.h"
 
@@ -47,11 +52,32 @@
 #define PA_SYMBOL_GET_N_USED "pa__get_n_used"
 #define PA_SYMBOL_GET_DEPRECATE "pa__get_deprecated"
 
+struct probe_job {
+    pa_module *module;
+    pa_module_probe_cb_t probe;
+    pa_module_probe_finish_cb_t finish;
+    void *userdata;
+
+    pa_semaphore *semaphore;
+    pa_thread *thread;
+    pa_usec_t probe_usec;
+};
+
+struct pa_module_probe_batch {
+    unsigned depth;
+
+    /* Limits how many probes run at the same time */
+    pa_semaphore *semaphore;
+
+    pa_dynarray *jobs;
+};
+
 pa_module* pa_module_load(pa_core *c, const char *name, const char *argument) {
     pa_module *m = NULL;
     pa_bool_t (*load_once)(void);
     const char* (*get_deprecated)(void);
     pa_modinfo *mi;
+    pa_usec_t start;
 
     pa_assert(c);
     pa_assert(name);
@@ -59,11 +85,14 @@ pa_module* pa_module_load(pa_core *c, const char *name, const char *argument) {
     if (c->disallow_module_loading)
         goto fail;
 
+    start = pa_rtclock_now();
+
     m = pa_xnew(pa_module, 1);
     m->name = pa_xstrdup(name);
     m->argument = pa_xstrdup(argument);
     m->load_once = FALSE;
     m->proplist = pa_proplist_new();
+    m->load_usec = m->probe_usec = 0;
 
     if (!(m->dl = lt_dlopenext(name))) {
         /* We used to print the error that is returned by lt_dlerror(), but
@@ -120,6 +149,9 @@ pa_module* pa_module_load(pa_core *c, const char *name, const char *argument) {
     pa_assert_se(pa_idxset_put(c->modules, m, &m->index) >= 0);
     pa_assert(m->index != PA_IDXSET_INVALID);
 
+    /* A probe which is still running is added when it is finished */
+    m->load_usec += pa_rtclock_now() - start - m->probe_usec;
+
     pa_log_info("Loaded \"%s\" (index: #%u; argument: \"%s\").", m->name, m->index, m->argument ? m->argument : "");
 
     pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_MODULE|PA_SUBSCRIPTION_EVENT_NEW, m->index);
@@ -294,3 +326,139 @@ void pa_module_update_proplist(pa_module *m, pa_update_mode_t mode, pa_proplist
 
     pa_subscription_post(m->core, PA_SUBSCRIPTION_EVENT_MODULE|PA_SUBSCRIPTION_EVENT_CHANGE, m->index);
 }
+
+static void probe_thread(void *userdata) {
+    struct probe_job *j = userdata;
+    pa_usec_t start;
+
+    pa_semaphore_wait(j->semaphore);
+
+    start = pa_rtclock_now();
+    j->probe(j->userdata);
+    j->probe_usec = pa_rtclock_now() - start;
+
+    pa_semaphore_post(j->semaphore);
+}
+
+int pa_module_probe(pa_module *m, pa_module_probe_cb_t probe, pa_module_probe_finish_cb_t finish, void *userdata) {
+    pa_module_probe_batch *b;
+    struct probe_job *j;
+    pa_usec_t start;
+
+    pa_assert(m);
+    pa_assert(probe);
+    pa_assert(finish);
+
+    if (!(b = m->core->module_probe_batch)) {
+        start = pa_rtclock_now();
+        probe(userdata);
+        m->probe_usec += pa_rtclock_now() - start;
+
+        return finish(m, userdata);
+    }
+
+    j = pa_xnew0(struct probe_job, 1);
+    j->module = m;
+    j->probe = probe;
+    j->finish = finish;
+    j->userdata = userdata;
+    j->semaphore = b->semaphore;
+
+    /* If we can't get a thread we probe right here, finishing is
+     * still deferred until the end of the batch */
+    if (!(j->thread = pa_thread_new("module-probe", probe_thread, j))) {
+        start = pa_rtclock_now();
+        probe(userdata);
+        j->probe_usec = pa_rtclock_now() - start;
+    }
+
+    pa_dynarray_append(b->jobs, j);
+
+    return 0;
+}
+
+void pa_module_probe_batch_begin(pa_core *c) {
+    pa_module_probe_batch *b;
+    int n;
+
+    pa_assert(c);
+
+    if (!c->parallel_module_probe)
+        return;
+
+    if ((b = c->module_probe_batch)) {
+        b->depth++;
+        return;
+    }
+
+    n = pa_ncpus();
+
+    b = pa_xnew0(pa_module_probe_batch, 1);
+    b->depth = 1;
+    b->semaphore = pa_semaphore_new(n > 0 ? (unsigned) n : 1);
+    b->jobs = pa_dynarray_new();
+
+    c->module_probe_batch = b;
+}
+
+void pa_module_probe_batch_end(pa_core *c) {
+    pa_module_probe_batch *b;
+    struct probe_job *j;
+    unsigned i;
+
+    pa_assert(c);
+
+    if (!(b = c->module_probe_batch))
+        return;
+
+    pa_assert(b->depth > 0);
+
+    if (--b->depth > 0)
+        return;
+
+    /* Modules loaded while finishing probe synchronously */
+    c->module_probe_batch = NULL;
+
+    for (i = 0; i < pa_dynarray_size(b->jobs); i++) {
+        pa_usec_t start;
+        pa_module *m;
+
+        j = pa_dynarray_get(b->jobs, i);
+        m = j->module;
+
+        if (j->thread)
+            pa_thread_free(j->thread);
+
+        start = pa_rtclock_now();
+        m->probe_usec += j->probe_usec;
+
+        if (j->finish(m, j->userdata) < 0) {
+            pa_log_error("Failed to load module \"%s\" (argument: \"%s\"): initialization failed.", m->name, m->argument ? m->argument : "");
+            pa_module_unload(c, m, TRUE);
+        } else
+            m->load_usec += pa_rtclock_now() - start;
+
+        pa_xfree(j);
+    }
+
+    pa_dynarray_free(b->jobs, NULL);
+    pa_semaphore_free(b->semaphore);
+    pa_xfree(b);
+}
+
+void pa_module_log_load_times(pa_core *c) {
+    pa_module *m;
+    uint32_t idx;
+
+    pa_assert(c);
+
+    pa_log_info("Module load times:");
+
+    PA_IDXSET_FOREACH(m, c->modules, idx) {
+        if (m->probe_usec > 0)
+            pa_log_info("    #%u %s: %0.1f ms, and %0.1f ms probing devices", m->index, m->name,
+                        (double) m->load_usec / PA_USEC_PER_MSEC, (double) m->probe_usec / PA_USEC_PER_MSEC);
+        else
+            pa_log_info("    #%u %s: %0.1f ms", m->index, m->name, (double) m->load_usec / PA_USEC_PER_MSEC);
+    }
+}
@@ -48,10 +48,41 @@ struct pa_module {
     pa_bool_t unload_requested:1;
 
     pa_proplist *proplist;
+
+    /* Time spent loading the module on the main thread, including
+     * modules it loaded itself, and the time its pa_module_probe()
+     * took, which may have run on a worker thread instead */
+    pa_usec_t load_usec, probe_usec;
 };
 
 pa_module* pa_module_load(pa_core *c, const char *name, const char*argument);
 
+/* Called from a worker thread, must not touch the core or anything
+ * else owned by the main thread */
+typedef void (*pa_module_probe_cb_t)(void *userdata);
+
+/* Called from main context once the probe is done */
+typedef int (*pa_module_probe_finish_cb_t)(pa_module *m, void *userdata);
+
+/* For modules which need to probe devices before they can register
+ * anything with the core. Called from pa__init(), usually as the last
+ * thing. Outside of a probe batch both callbacks are run right away
+ * and the return value of finish is returned. Inside a batch the probe
+ * is started on a worker thread and 0 is returned, finish is then
+ * called when the batch ends, and if it fails the module is
+ * unloaded. */
+int pa_module_probe(pa_module *m, pa_module_probe_cb_t probe, pa_module_probe_finish_cb_t finish, void *userdata);
+
+/* Modules loaded between these two calls may probe their devices
+ * concurrently, if enabled with core->parallel_module_probe. Calls
+ * may be nested. pa_module_probe_batch_end() waits for all probes and
+ * finishes the modules in the order they were loaded. */
+void pa_module_probe_batch_begin(pa_core *c);
+void pa_module_probe_batch_end(pa_core *c);
+
+/* Logs how long loading each of the modules took */
+void pa_module_log_load_times(pa_core *c);
+
 void pa_module_unload(pa_core *c, pa_module *m, pa_bool_t force);
 void pa_module_unload_by_index(pa_core *c, uint32_t idx, pa_bool_t force);
 
@@ -176,6 +176,15 @@ enum {
     /* Supported since protocol v27 (3.0) */
     PA_COMMAND_SET_PORT_LATENCY_OFFSET,
 
+    /* Supported since protocol v29 (5.0) */
+    PA_COMMAND_GET_SINK_RENDER_PROFILE,
+    PA_COMMAND_GET_SOURCE_RENDER_PROFILE,
+    PA_COMMAND_GET_SINK_INPUT_RENDER_PROFILE,
+
+    /* Supported since protocol v30 (5.0) */
+    PA_COMMAND_GET_SNAPSHOT,
+    PA_COMMAND_SET_SUBSCRIBE_FILTER,
+
     PA_COMMAND_MAX
 };
 
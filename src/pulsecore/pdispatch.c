@@ -33,6 +33,8 @@
 
 #include <pulsecore/native-common.h>
 #include <pulsecore/llist.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
@@ -190,10 +192,21 @@ static const char *command_names[PA_COMMAND_MAX] = {
     [PA_COMMAND_SET_SOURCE_OUTPUT_VOLUME] = "SET_SOURCE_OUTPUT_VOLUME",
     [PA_COMMAND_SET_SOURCE_OUTPUT_MUTE] = "SET_SOURCE_OUTPUT_MUTE",
 
+    /* Supported since protocol v29 (5.0) */
+    [PA_COMMAND_GET_SINK_RENDER_PROFILE] = "GET_SINK_RENDER_PROFILE",
+    [PA_COMMAND_GET_SOURCE_RENDER_PROFILE] = "GET_SOURCE_RENDER_PROFILE",
+    [PA_COMMAND_GET_SINK_INPUT_RENDER_PROFILE] = "GET_SINK_INPUT_RENDER_PROFILE",
+    [PA_COMMAND_GET_SNAPSHOT] = "GET_SNAPSHOT",
+    [PA_COMMAND_SET_SUBSCRIBE_FILTER] = "SET_SUBSCRIBE_FILTER",
+
 };
 
 #endif
 
+/* Replies which are due within this much of each other are timed out
+ * together */
+#define TIMEOUT_SLACK_USEC (10*PA_USEC_PER_MSEC)
+
 PA_STATIC_FLIST_DECLARE(reply_infos, 0, pa_xfree);
 
 struct reply_info {
@@ -203,7 +216,7 @@ struct reply_info {
     void *userdata;
     pa_free_cb_t free_cb;
     uint32_t tag;
-    pa_time_event *time_event;
+    pa_usec_t deadline;
 };
 
 struct pa_pdispatch {
@@ -211,7 +224,16 @@ struct pa_pdispatch {
     pa_mainloop_api *mainloop;
     const pa_pdispatch_cb_t *callback_table;
     unsigned n_commands;
+
+    /* Sorted by deadline, and indexed by tag. A single time event
+     * serves all of them. It is moved earlier when needed, but never
+     * later: when it fires too early it just gets restarted. */
     PA_LLIST_HEAD(struct reply_info, replies);
+    struct reply_info *replies_tail;
+    pa_hashmap *replies_by_tag;
+    pa_time_event *time_event;
+    pa_usec_t time_event_deadline;
+
     pa_pdispatch_drain_cb_t drain_callback;
     void *drain_userdata;
     const pa_creds *creds;
@@ -219,14 +241,20 @@ struct pa_pdispatch {
 };
 
 static void reply_info_free(struct reply_info *r) {
+    pa_pdispatch *pd;
+
     pa_assert(r);
-    pa_assert(r->pdispatch);
-    pa_assert(r->pdispatch->mainloop);
+    pa_assert_se(pd = r->pdispatch);
+
+    /* With tags that wrapped around, another reply may have taken over
+     * the slot */
+    if (pa_hashmap_get(pd->replies_by_tag, PA_UINT32_TO_PTR(r->tag)) == r)
+        pa_hashmap_remove(pd->replies_by_tag, PA_UINT32_TO_PTR(r->tag));
 
-    if (r->time_event)
-        r->pdispatch->mainloop->time_free(r->time_event);
+    if (pd->replies_tail == r)
+        pd->replies_tail = r->prev;
 
-    PA_LLIST_REMOVE(struct reply_info, r->pdispatch->replies, r);
+    PA_LLIST_REMOVE(struct reply_info, pd->replies, r);
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(reply_infos), r) < 0)
         pa_xfree(r);
@@ -244,6 +272,7 @@ pa_pdispatch* pa_pdispatch_new(pa_mainloop_api *mainloop, pa_bool_t use_rtclock,
     pd->callback_table = table;
     pd->n_commands = entries;
     PA_LLIST_HEAD_INIT(struct reply_info, pd->replies);
+    pd->replies_by_tag = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     pd->use_rtclock = use_rtclock;
 
     return pd;
@@ -259,6 +288,11 @@ static void pdispatch_free(pa_pdispatch *pd) {
         reply_info_free(pd->replies);
     }
 
+    if (pd->time_event)
+        pd->mainloop->time_free(pd->time_event);
+
+    pa_hashmap_free(pd->replies_by_tag, NULL);
+
     pa_xfree(pd);
 }
 
@@ -323,11 +357,7 @@ int pa_pdispatch_run(pa_pdispatch *pd, pa_packet*packet, const pa_creds *creds,
     if (command == PA_COMMAND_ERROR || command == PA_COMMAND_REPLY) {
         struct reply_info *r;
 
-        PA_LLIST_FOREACH(r, pd->replies)
-            if (r->tag == tag)
-                break;
-
-        if (r)
+        if ((r = pa_hashmap_get(pd->replies_by_tag, PA_UINT32_TO_PTR(tag))))
             run_action(pd, r, command, ts);
 
     } else if (pd->callback_table && (command < pd->n_commands) && pd->callback_table[command]) {
@@ -352,21 +382,52 @@ finish:
     return ret;
 }
 
+static void timeout_callback(pa_mainloop_api*m, pa_time_event*e, const struct timeval *t, void *userdata);
+
+static void update_time_event(pa_pdispatch *pd) {
+    struct timeval tv;
+
+    pa_assert(pd);
+
+    if (!pd->replies)
+        return;
+
+    if (pd->time_event_deadline > 0 && pd->time_event_deadline <= pd->replies->deadline)
+        return;
+
+    pd->time_event_deadline = pd->replies->deadline;
+    pa_timeval_rtstore(&tv, pd->time_event_deadline, pd->use_rtclock);
+
+    if (pd->time_event)
+        pd->mainloop->time_restart(pd->time_event, &tv);
+    else
+        pa_assert_se(pd->time_event = pd->mainloop->time_new(pd->mainloop, &tv, timeout_callback, pd));
+}
+
 static void timeout_callback(pa_mainloop_api*m, pa_time_event*e, const struct timeval *t, void *userdata) {
-    struct reply_info*r = userdata;
+    pa_pdispatch *pd = userdata;
+    pa_usec_t now;
 
-    pa_assert(r);
-    pa_assert(r->time_event == e);
-    pa_assert(r->pdispatch);
-    pa_assert(r->pdispatch->mainloop == m);
-    pa_assert(r->callback);
+    pa_assert(pd);
+    pa_assert(pd->time_event == e);
+    pa_assert(pd->mainloop == m);
+
+    pd->time_event_deadline = 0;
+
+    pa_pdispatch_ref(pd);
 
-    run_action(r->pdispatch, r, PA_COMMAND_TIMEOUT, NULL);
+    now = pa_rtclock_now() + TIMEOUT_SLACK_USEC;
+
+    while (pd->replies && pd->replies->deadline <= now)
+        run_action(pd, pd->replies, PA_COMMAND_TIMEOUT, NULL);
+
+    update_time_event(pd);
+
+    pa_pdispatch_unref(pd);
 }
 
 void pa_pdispatch_register_reply(pa_pdispatch *pd, uint32_t tag, int timeout, pa_pdispatch_cb_t cb, void *userdata, pa_free_cb_t free_cb) {
-    struct reply_info *r;
-    struct timeval tv;
+    struct reply_info *r, *after;
 
     pa_assert(pd);
     pa_assert(PA_REFCNT_VALUE(pd) >= 1);
@@ -380,12 +441,22 @@ void pa_pdispatch_register_reply(pa_pdispatch *pd, uint32_t tag, int timeout, pa
     r->userdata = userdata;
     r->free_cb = free_cb;
     r->tag = tag;
+    r->deadline = pa_rtclock_now() + timeout * PA_USEC_PER_SEC;
+
+    /* Most replies use the same timeout, so this normally stops right
+     * at the tail */
+    for (after = pd->replies_tail; after && after->deadline > r->deadline; after = after->prev)
+        ;
+
+    PA_LLIST_INSERT_AFTER(struct reply_info, pd->replies, after, r);
+
+    if (after == pd->replies_tail)
+        pd->replies_tail = r;
 
-    pa_assert_se(r->time_event = pd->mainloop->time_new(pd->mainloop,
-                                                        pa_timeval_rtstore(&tv, pa_rtclock_now() + timeout * PA_USEC_PER_SEC, pd->use_rtclock),
-                                                        timeout_callback, r));
+    pa_hashmap_remove(pd->replies_by_tag, PA_UINT32_TO_PTR(tag));
+    pa_assert_se(pa_hashmap_put(pd->replies_by_tag, PA_UINT32_TO_PTR(tag), r) == 0);
 
-    PA_LLIST_PREPEND(struct reply_info, pd->replies, r);
+    update_time_event(pd);
 }
 
 int pa_pdispatch_is_pending(pa_pdispatch *pd) {
@@ -57,6 +57,9 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/ipacl.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/pstream-thread-pool.h>
+#include <pulsecore/request-sizing.h>
+#include <pulsecore/watermark-controller.h>
 
 #include "protocol-native.h"
 
@@ -68,6 +71,24 @@
 /* Don't accept more connection than this */
 #define MAX_CONNECTIONS 64
 
+/* Don't accept longer index lists in subscription filters than this */
+#define MAX_SUBSCRIBE_FILTER_INDEXES 1024
+
+/* Handle this many requests of one client per main loop iteration
+ * before moving on to the next one */
+#define DEFAULT_REQUEST_BUDGET 16
+
+/* Don't start more socket I/O threads than this */
+#define MAX_IO_THREADS 64
+
+/* Adaptive request sizing: the acceptable chance of a client not
+ * answering a request in time, how many answers are collected between
+ * two adaptations, and by how much in percent the turnaround needs to
+ * change to be published in the sink input properties */
+#define ADAPT_DROPOUT_PROBABILITY 0.001
+#define ADAPT_INTERVAL 32
+#define ADAPT_THRESHOLD_PERCENT 10
+
 #define MAX_MEMBLOCKQ_LENGTH (4*1024*1024) /* 4MB */
 #define DEFAULT_TLENGTH_MSEC 2000 /* 2s */
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
@@ -129,6 +150,10 @@ typedef struct playback_stream {
     uint32_t drain_tag;
     uint32_t syncid;
 
+    /* Audio data is posted to the sink right from the I/O thread of
+     * the connection, if it has one */
+    pa_bool_t direct:1;
+
     /* Optimization to avoid too many rewinds with a lot of small blocks */
     pa_atomic_t seek_or_post_in_queue;
     int64_t seek_windex;
@@ -139,6 +164,20 @@ typedef struct playback_stream {
     pa_buffer_attr buffer_attr_req;
     /* Fixed-up and adjusted buffer attributes */
     pa_buffer_attr buffer_attr;
+    /* What fix_playback_buffer_attr() made of the requested ones, the
+     * limits for the adaptive request sizing */
+    pa_buffer_attr buffer_attr_base;
+
+    /* Adaptive request sizing, see playback_stream_adapt(). NULL if
+     * disabled. The controller and the pending request belong to the
+     * IO thread. */
+    pa_watermark_controller *turnaround;
+    pa_bool_t request_pending;
+    pa_usec_t request_time;
+    unsigned n_answers;
+    /* Last reported turnaround, and how often we adapted */
+    pa_usec_t turnaround_usec;
+    unsigned n_adaptations;
 
     /* Only updated after SINK_INPUT_MESSAGE_UPDATE_LATENCY */
     int64_t read_index, write_index;
@@ -196,6 +235,8 @@ struct pa_native_protocol {
     pa_hook hooks[PA_NATIVE_HOOK_MAX];
 
     pa_hashmap *extensions;
+
+    pa_hook_slot *sink_input_move_start_slot;
 };
 
 enum {
@@ -219,7 +260,8 @@ enum {
     PLAYBACK_STREAM_MESSAGE_OVERFLOW,
     PLAYBACK_STREAM_MESSAGE_DRAIN_ACK,
     PLAYBACK_STREAM_MESSAGE_STARTED,
-    PLAYBACK_STREAM_MESSAGE_UPDATE_TLENGTH
+    PLAYBACK_STREAM_MESSAGE_UPDATE_TLENGTH,
+    PLAYBACK_STREAM_MESSAGE_ADAPT              /* the client's turnaround for requests changed */
 };
 
 enum {
@@ -243,6 +285,7 @@ static void sink_input_send_event_cb(pa_sink_input *i, const char *event, pa_pro
 
 static void native_connection_send_memblock(pa_native_connection *c);
 static void playback_stream_request_bytes(struct playback_stream*s);
+static void playback_stream_set_direct(playback_stream *s, pa_bool_t direct);
 
 static void source_output_kill_cb(pa_source_output *o);
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk);
@@ -294,6 +337,9 @@ static void command_extension(pa_pdispatch *pd, uint32_t command, uint32_t tag,
 static void command_set_card_profile(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_set_sink_or_source_port(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void command_set_port_latency_offset(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_get_render_profile(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_get_snapshot(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+static void command_set_subscribe_filter(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 
 static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_ERROR] = NULL,
@@ -397,9 +443,37 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
 
     [PA_COMMAND_SET_PORT_LATENCY_OFFSET] = command_set_port_latency_offset,
 
+    [PA_COMMAND_GET_SINK_RENDER_PROFILE] = command_get_render_profile,
+    [PA_COMMAND_GET_SOURCE_RENDER_PROFILE] = command_get_render_profile,
+    [PA_COMMAND_GET_SINK_INPUT_RENDER_PROFILE] = command_get_render_profile,
+
+    [PA_COMMAND_GET_SNAPSHOT] = command_get_snapshot,
+    [PA_COMMAND_SET_SUBSCRIBE_FILTER] = command_set_subscribe_filter,
+
     [PA_COMMAND_EXTENSION] = command_extension
 };
 
+/* Roughly what an info reply needs per entry, so that its buffer is
+ * not grown bit by bit while the reply is filled in */
+static const size_t info_size_hint[PA_COMMAND_MAX] = {
+    [PA_COMMAND_GET_SINK_INFO] = 2048,
+    [PA_COMMAND_GET_SINK_INFO_LIST] = 2048,
+    [PA_COMMAND_GET_SOURCE_INFO] = 2048,
+    [PA_COMMAND_GET_SOURCE_INFO_LIST] = 2048,
+    [PA_COMMAND_GET_CLIENT_INFO] = 512,
+    [PA_COMMAND_GET_CLIENT_INFO_LIST] = 512,
+    [PA_COMMAND_GET_CARD_INFO] = 4096,
+    [PA_COMMAND_GET_CARD_INFO_LIST] = 4096,
+    [PA_COMMAND_GET_MODULE_INFO] = 256,
+    [PA_COMMAND_GET_MODULE_INFO_LIST] = 256,
+    [PA_COMMAND_GET_SINK_INPUT_INFO] = 1024,
+    [PA_COMMAND_GET_SINK_INPUT_INFO_LIST] = 1024,
+    [PA_COMMAND_GET_SOURCE_OUTPUT_INFO] = 1024,
+    [PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST] = 1024,
+    [PA_COMMAND_GET_SAMPLE_INFO] = 512,
+    [PA_COMMAND_GET_SAMPLE_INFO_LIST] = 512
+};
+
 /* structure management */
 
 /* Called from main context */
@@ -764,6 +838,8 @@ static void playback_stream_unlink(playback_stream *s) {
     if (!s->connection)
         return;
 
+    playback_stream_set_direct(s, FALSE);
+
     if (s->sink_input) {
         pa_sink_input_unlink(s->sink_input);
         pa_sink_input_unref(s->sink_input);
@@ -786,9 +862,107 @@ static void playback_stream_free(pa_object* o) {
     playback_stream_unlink(s);
 
     pa_memblockq_free(s->memblockq);
+
+    if (s->turnaround)
+        pa_watermark_controller_free(s->turnaround);
+
     pa_xfree(s);
 }
 
+/* Called from main context */
+static void playback_stream_send_buffer_attr(playback_stream *s) {
+    pa_tagstruct *t;
+
+    playback_stream_assert_ref(s);
+
+    if (s->connection->version < 15)
+        return;
+
+    t = pa_tagstruct_new(NULL, 0);
+    pa_tagstruct_putu32(t, PA_COMMAND_PLAYBACK_BUFFER_ATTR_CHANGED);
+    pa_tagstruct_putu32(t, (uint32_t) -1); /* tag */
+    pa_tagstruct_putu32(t, s->index);
+    pa_tagstruct_putu32(t, s->buffer_attr.maxlength);
+    pa_tagstruct_putu32(t, s->buffer_attr.tlength);
+    pa_tagstruct_putu32(t, s->buffer_attr.prebuf);
+    pa_tagstruct_putu32(t, s->buffer_attr.minreq);
+    pa_tagstruct_put_usec(t, s->configured_sink_latency);
+    pa_pstream_send_tagstruct(s->connection->pstream, t);
+}
+
+static pa_bool_t changed_significantly(uint64_t old, uint64_t new) {
+    uint64_t d = new > old ? new - old : old - new;
+
+    return d * 100 > old * ADAPT_THRESHOLD_PERCENT;
+}
+
+/* Called from main context. Sizes the requests of an adjust latency
+ * stream after how long its client takes to answer them, see
+ * pa_request_sizing_adapt(). Both minreq and tlength stay within the
+ * limits fix_playback_buffer_attr() worked out, so the latency never
+ * gets larger than what the client asked for, unless the sink needs
+ * more. max_request is what the IO thread saw when it posted the
+ * turnaround. */
+static void playback_stream_adapt(playback_stream *s, pa_usec_t turnaround, size_t max_request) {
+    const pa_sample_spec *ss;
+    pa_request_sizing r;
+    pa_buffer_attr a;
+    pa_usec_t max_latency;
+    pa_bool_t adapt;
+
+    playback_stream_assert_ref(s);
+
+    if (!s->adjust_latency || s->early_requests || !s->sink_input->sink || turnaround <= 0)
+        return;
+
+    ss = &s->sink_input->sample_spec;
+
+    r.sample_spec = *ss;
+    r.base = s->buffer_attr_base;
+    r.minreq_requested = s->buffer_attr_req.minreq != (uint32_t) -1;
+    r.sink_latency = s->configured_sink_latency;
+    r.max_request = max_request;
+
+    /* Requests smaller than the sink's minimal latency only cost
+     * wakeups */
+    pa_sink_get_latency_range(s->sink_input->sink, &r.min_request_usec, &max_latency);
+    if (r.min_request_usec <= 0)
+        r.min_request_usec = DEFAULT_PROCESS_MSEC * PA_USEC_PER_MSEC;
+
+    a = s->buffer_attr;
+    adapt = pa_request_sizing_adapt(&r, turnaround, &a);
+
+    if (adapt) {
+        pa_log_debug("Client of '%s' answers requests within %0.2f ms, changing tlength from %0.2f ms to %0.2f ms and minreq from %0.2f ms to %0.2f ms.",
+                     pa_strnull(pa_proplist_gets(s->sink_input->proplist, PA_PROP_MEDIA_NAME)),
+                     (double) turnaround / PA_USEC_PER_MSEC,
+                     (double) pa_bytes_to_usec(s->buffer_attr.tlength, ss) / PA_USEC_PER_MSEC,
+                     (double) pa_bytes_to_usec(a.tlength, ss) / PA_USEC_PER_MSEC,
+                     (double) pa_bytes_to_usec(s->buffer_attr.minreq, ss) / PA_USEC_PER_MSEC,
+                     (double) pa_bytes_to_usec(a.minreq, ss) / PA_USEC_PER_MSEC);
+
+        s->buffer_attr = a;
+        pa_assert_se(pa_asyncmsgq_send(s->sink_input->sink->asyncmsgq, PA_MSGOBJECT(s->sink_input), SINK_INPUT_MESSAGE_UPDATE_BUFFER_ATTR, NULL, 0, NULL) == 0);
+        s->n_adaptations++;
+
+        playback_stream_send_buffer_attr(s);
+    }
+
+    /* Let the statistics follow, without a change event for each
+     * little wobble */
+    if (adapt || changed_significantly(s->turnaround_usec, turnaround)) {
+        pa_proplist *p;
+
+        s->turnaround_usec = turnaround;
+
+        p = pa_proplist_new();
+        pa_proplist_setf(p, "native-protocol.turnaround-usec", "%llu", (unsigned long long) turnaround);
+        pa_proplist_setf(p, "native-protocol.adaptations", "%u", s->n_adaptations);
+        pa_sink_input_update_proplist(s->sink_input, PA_UPDATE_REPLACE, p);
+        pa_proplist_free(p);
+    }
+}
+
 /* Called from main context */
 static int playback_stream_process_msg(pa_msgobject *o, int code, void*userdata, int64_t offset, pa_memchunk *chunk) {
     playback_stream *s = PLAYBACK_STREAM(o);
@@ -876,22 +1050,11 @@ static int playback_stream_process_msg(pa_msgobject *o, int code, void*userdata,
         case PLAYBACK_STREAM_MESSAGE_UPDATE_TLENGTH:
 
             s->buffer_attr.tlength = (uint32_t) offset;
+            playback_stream_send_buffer_attr(s);
+            break;
 
-            if (s->connection->version >= 15) {
-                pa_tagstruct *t;
-
-                t = pa_tagstruct_new(NULL, 0);
-                pa_tagstruct_putu32(t, PA_COMMAND_PLAYBACK_BUFFER_ATTR_CHANGED);
-                pa_tagstruct_putu32(t, (uint32_t) -1); /* tag */
-                pa_tagstruct_putu32(t, s->index);
-                pa_tagstruct_putu32(t, s->buffer_attr.maxlength);
-                pa_tagstruct_putu32(t, s->buffer_attr.tlength);
-                pa_tagstruct_putu32(t, s->buffer_attr.prebuf);
-                pa_tagstruct_putu32(t, s->buffer_attr.minreq);
-                pa_tagstruct_put_usec(t, s->configured_sink_latency);
-                pa_pstream_send_tagstruct(s->connection->pstream, t);
-            }
-
+        case PLAYBACK_STREAM_MESSAGE_ADAPT:
+            playback_stream_adapt(s, (pa_usec_t) offset, (size_t) PA_PTR_TO_UINT(userdata));
             break;
     }
 
@@ -1059,6 +1222,8 @@ static void fix_playback_buffer_attr(playback_stream *s) {
         s->buffer_attr.prebuf > max_prebuf)
         s->buffer_attr.prebuf = max_prebuf;
 
+    s->buffer_attr_base = s->buffer_attr;
+
 #ifdef PROTOCOL_NATIVE_DEBUG
     pa_log("Client accepted: maxlength=%lu ms tlength=%lu ms minreq=%lu ms prebuf=%lu ms",
            (unsigned long) (pa_bytes_to_usec(s->buffer_attr.maxlength, &s->sink_input->sample_spec) / PA_USEC_PER_MSEC),
@@ -1171,6 +1336,9 @@ static playback_stream* playback_stream_new(
     s->sink_input = sink_input;
     s->is_underrun = TRUE;
     s->drain_request = FALSE;
+    s->direct = FALSE;
+    s->turnaround = NULL;
+    s->request_pending = FALSE;
     pa_atomic_store(&s->missing, 0);
     s->buffer_attr_req = *a;
     s->adjust_latency = adjust_latency;
@@ -1194,6 +1362,9 @@ static playback_stream* playback_stream_new(
 
     fix_playback_buffer_attr(s);
 
+    if (c->options->adaptive_requests)
+        s->turnaround = pa_watermark_controller_new(ADAPT_DROPOUT_PROBABILITY);
+
     pa_sink_input_get_silence(sink_input, &silence);
     memblockq_name = pa_sprintf_malloc("native protocol playback stream memblockq [%u]", s->sink_input->index);
     s->memblockq = pa_memblockq_new(
@@ -1264,8 +1435,48 @@ static void playback_stream_request_bytes(playback_stream *s) {
     minreq = pa_memblockq_get_minreq(s->memblockq);
 
     if (pa_memblockq_prebuf_active(s->memblockq) ||
-        (previous_missing < (int) minreq && previous_missing + (int) m >= (int) minreq))
+        (previous_missing < (int) minreq && previous_missing + (int) m >= (int) minreq)) {
+
+        /* Time how long the client takes to answer */
+        if (s->turnaround && !s->request_pending) {
+            s->request_time = pa_rtclock_now();
+            s->request_pending = TRUE;
+        }
+
         pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_REQUEST_DATA, NULL, 0, NULL, NULL);
+    }
+}
+
+/* Called from IO context */
+static void playback_stream_answered(playback_stream *s) {
+    playback_stream_assert_ref(s);
+
+    if (!s->request_pending)
+        return;
+
+    s->request_pending = FALSE;
+    pa_watermark_controller_add(s->turnaround, pa_rtclock_now() - s->request_time);
+
+    if (++s->n_answers % ADAPT_INTERVAL == 0)
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_ADAPT,
+                          PA_UINT_TO_PTR(pa_sink_input_get_max_request(s->sink_input)),
+                          (int64_t) pa_watermark_controller_get(s->turnaround), NULL, NULL);
+}
+
+/* Called from IO context */
+static void playback_stream_missed(playback_stream *s) {
+    playback_stream_assert_ref(s);
+
+    if (!s->request_pending)
+        return;
+
+    /* We ran dry while the client was still busy answering, so it
+     * needs at least as long as it has had so far. Don't wait for the
+     * next interval to back off. */
+    pa_watermark_controller_dropout(s->turnaround, pa_rtclock_now() - s->request_time);
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_ADAPT,
+                      PA_UINT_TO_PTR(pa_sink_input_get_max_request(s->sink_input)),
+                      (int64_t) pa_watermark_controller_get(s->turnaround), NULL, NULL);
 }
 
 /* Called from main context */
@@ -1469,6 +1680,9 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
                 pa_memblockq_seek(s->memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, TRUE);
             }
 
+            if (chunk && s->turnaround)
+                playback_stream_answered(s);
+
             /* If more data is in queue, we rewind later instead. */
             if (s->seek_windex != -1)
                 windex = PA_MIN(windex, s->seek_windex);
@@ -1603,6 +1817,9 @@ static bool handle_input_underrun(playback_stream *s, bool force)
          pa_log_debug("Drain acknowledged of '%s'", pa_strnull(pa_proplist_gets(s->sink_input->proplist, PA_PROP_MEDIA_NAME)));
     } else if (!s->is_underrun) {
          pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_UNDERFLOW, NULL, pa_memblockq_get_read_index(s->memblockq), NULL, NULL);
+
+         if (!s->drain_request && s->turnaround)
+             playback_stream_missed(s);
     }
     s->is_underrun = true;
     playback_stream_request_bytes(s);
@@ -1954,15 +2171,19 @@ if (!(expression)) { \
 } \
 } while(0);
 
-static pa_tagstruct *reply_new(uint32_t tag) {
+static pa_tagstruct *reply_new_sized(uint32_t tag, size_t size_hint) {
     pa_tagstruct *reply;
 
-    reply = pa_tagstruct_new(NULL, 0);
+    reply = pa_tagstruct_new_sized(size_hint);
     pa_tagstruct_putu32(reply, PA_COMMAND_REPLY);
     pa_tagstruct_putu32(reply, tag);
     return reply;
 }
 
+static pa_tagstruct *reply_new(uint32_t tag) {
+    return reply_new_sized(tag, 0);
+}
+
 static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     playback_stream *s;
@@ -3524,7 +3745,7 @@ static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, p
         return;
     }
 
-    reply = reply_new(tag);
+    reply = reply_new_sized(tag, info_size_hint[command]);
     if (sink)
         sink_fill_tagstruct(c, reply, sink);
     else if (source)
@@ -3544,6 +3765,49 @@ static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, p
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static pa_idxset *info_list_idxset(pa_native_connection *c, uint32_t command) {
+    pa_native_connection_assert_ref(c);
+
+    if (command == PA_COMMAND_GET_SINK_INFO_LIST)
+        return c->protocol->core->sinks;
+    else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
+        return c->protocol->core->sources;
+    else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST)
+        return c->protocol->core->clients;
+    else if (command == PA_COMMAND_GET_CARD_INFO_LIST)
+        return c->protocol->core->cards;
+    else if (command == PA_COMMAND_GET_MODULE_INFO_LIST)
+        return c->protocol->core->modules;
+    else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST)
+        return c->protocol->core->sink_inputs;
+    else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST)
+        return c->protocol->core->source_outputs;
+
+    pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
+    return c->protocol->core->scache;
+}
+
+static void info_list_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, uint32_t command, void *p) {
+    if (command == PA_COMMAND_GET_SINK_INFO_LIST)
+        sink_fill_tagstruct(c, t, p);
+    else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
+        source_fill_tagstruct(c, t, p);
+    else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST)
+        client_fill_tagstruct(c, t, p);
+    else if (command == PA_COMMAND_GET_CARD_INFO_LIST)
+        card_fill_tagstruct(c, t, p);
+    else if (command == PA_COMMAND_GET_MODULE_INFO_LIST)
+        module_fill_tagstruct(c, t, p);
+    else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST)
+        sink_input_fill_tagstruct(c, t, p);
+    else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST)
+        source_output_fill_tagstruct(c, t, p);
+    else {
+        pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
+        scache_fill_tagstruct(c, t, p);
+    }
+}
+
 static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_idxset *i;
@@ -3561,48 +3825,113 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
 
     CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
 
-    reply = reply_new(tag);
+    i = info_list_idxset(c, command);
+    reply = reply_new_sized(tag, i ? info_size_hint[command] * pa_idxset_size(i) : 0);
 
-    if (command == PA_COMMAND_GET_SINK_INFO_LIST)
-        i = c->protocol->core->sinks;
-    else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
-        i = c->protocol->core->sources;
-    else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST)
-        i = c->protocol->core->clients;
-    else if (command == PA_COMMAND_GET_CARD_INFO_LIST)
-        i = c->protocol->core->cards;
-    else if (command == PA_COMMAND_GET_MODULE_INFO_LIST)
-        i = c->protocol->core->modules;
-    else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST)
-        i = c->protocol->core->sink_inputs;
-    else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST)
-        i = c->protocol->core->source_outputs;
-    else {
-        pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
-        i = c->protocol->core->scache;
+    if (i) {
+        PA_IDXSET_FOREACH(p, i, idx)
+            info_list_fill_tagstruct(c, reply, command, p);
     }
 
-    if (i) {
-        PA_IDXSET_FOREACH(p, i, idx) {
-            if (command == PA_COMMAND_GET_SINK_INFO_LIST)
-                sink_fill_tagstruct(c, reply, p);
-            else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
-                source_fill_tagstruct(c, reply, p);
-            else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST)
-                client_fill_tagstruct(c, reply, p);
-            else if (command == PA_COMMAND_GET_CARD_INFO_LIST)
-                card_fill_tagstruct(c, reply, p);
-            else if (command == PA_COMMAND_GET_MODULE_INFO_LIST)
-                module_fill_tagstruct(c, reply, p);
-            else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST)
-                sink_input_fill_tagstruct(c, reply, p);
-            else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST)
-                source_output_fill_tagstruct(c, reply, p);
-            else {
-                pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
-                scache_fill_tagstruct(c, reply, p);
+    pa_pstream_send_tagstruct(c->pstream, reply);
+}
+
+/* The object classes a snapshot covers, in the order they are sent */
+static const struct {
+    uint32_t command;
+    pa_subscription_event_type_t facility;
+} snapshot_classes[] = {
+    { PA_COMMAND_GET_MODULE_INFO_LIST, PA_SUBSCRIPTION_EVENT_MODULE },
+    { PA_COMMAND_GET_CLIENT_INFO_LIST, PA_SUBSCRIPTION_EVENT_CLIENT },
+    { PA_COMMAND_GET_CARD_INFO_LIST, PA_SUBSCRIPTION_EVENT_CARD },
+    { PA_COMMAND_GET_SINK_INFO_LIST, PA_SUBSCRIPTION_EVENT_SINK },
+    { PA_COMMAND_GET_SOURCE_INFO_LIST, PA_SUBSCRIPTION_EVENT_SOURCE },
+    { PA_COMMAND_GET_SINK_INPUT_INFO_LIST, PA_SUBSCRIPTION_EVENT_SINK_INPUT },
+    { PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT },
+    { PA_COMMAND_GET_SAMPLE_INFO_LIST, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE }
+};
+
+static void put_removed(pa_subscription_event_type_t facility, uint32_t idx, void *userdata) {
+    pa_tagstruct *reply = userdata;
+
+    pa_tagstruct_putu32(reply, facility);
+    pa_tagstruct_putu32(reply, idx);
+}
+
+static void command_get_snapshot(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pa_core *core;
+    uint64_t generation;
+    pa_bool_t full;
+    pa_tagstruct *reply;
+    size_t size_hint = 0;
+    unsigned k;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    /* Clients which negotiated an older version don't know this
+     * command, and may well have sent something else */
+    CHECK_VALIDITY(c->pstream, c->version >= 30, tag, PA_ERR_NOTSUPPORTED);
+
+    if (pa_tagstruct_getu64(t, &generation) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+
+    core = c->protocol->core;
+
+    /* Generations from before what we remember, or from an earlier
+     * instance of the daemon, get everything */
+    full = generation == 0 || !pa_subscription_generation_is_known(core, generation);
+
+    if (full)
+        for (k = 0; k < PA_ELEMENTSOF(snapshot_classes); k++) {
+            pa_idxset *i = info_list_idxset(c, snapshot_classes[k].command);
+
+            if (i)
+                size_hint += info_size_hint[snapshot_classes[k].command] * pa_idxset_size(i);
+        }
+
+    reply = reply_new_sized(tag, size_hint);
+    pa_tagstruct_putu64(reply, pa_subscription_get_generation(core));
+    pa_tagstruct_put_boolean(reply, full);
+
+    /* Each class goes into a blob of its own which looks just like the
+     * reply to the matching list command, so that clients can parse it
+     * the same way */
+    for (k = 0; k < PA_ELEMENTSOF(snapshot_classes); k++) {
+        uint32_t list_command = snapshot_classes[k].command;
+        pa_idxset *i = info_list_idxset(c, list_command);
+        pa_tagstruct *section;
+        const uint8_t *data;
+        size_t length;
+        uint32_t idx;
+        void *p;
+
+        section = pa_tagstruct_new_sized(full && i ? info_size_hint[list_command] * pa_idxset_size(i) : 0);
+
+        if (i) {
+            PA_IDXSET_FOREACH(p, i, idx) {
+                if (!full && pa_subscription_get_object_generation(core, snapshot_classes[k].facility, idx) <= generation)
+                    continue;
+
+                info_list_fill_tagstruct(c, section, list_command, p);
             }
         }
+
+        data = pa_tagstruct_data(section, &length);
+        pa_tagstruct_putu32(reply, (uint32_t) length);
+        pa_tagstruct_put_arbitrary(reply, data, length);
+        pa_tagstruct_free(section);
+    }
+
+    if (!full) {
+        pa_tagstruct_putu32(reply, pa_subscription_foreach_removed(core, generation, NULL, NULL));
+        pa_subscription_foreach_removed(core, generation, put_removed, reply);
     }
 
     pa_pstream_send_tagstruct(c->pstream, reply);
@@ -3696,6 +4025,66 @@ static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     pa_pstream_send_simple_ack(c->pstream, tag);
 }
 
+static void command_set_subscribe_filter(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t facility, n, j;
+    uint32_t *indexes = NULL;
+    const char *key, *value;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    /* Like GET_SNAPSHOT, new in version 30 */
+    CHECK_VALIDITY(c->pstream, c->version >= 30, tag, PA_ERR_NOTSUPPORTED);
+
+    if (pa_tagstruct_getu32(t, &facility) < 0 ||
+        pa_tagstruct_getu32(t, &n) < 0 ||
+        n > MAX_SUBSCRIBE_FILTER_INDEXES) {
+        protocol_error(c);
+        return;
+    }
+
+    if (n > 0)
+        indexes = pa_xnew(uint32_t, n);
+
+    for (j = 0; j < n; j++)
+        if (pa_tagstruct_getu32(t, &indexes[j]) < 0)
+            goto fail;
+
+    if (pa_tagstruct_gets(t, &key) < 0 ||
+        pa_tagstruct_gets(t, &value) < 0 ||
+        !pa_tagstruct_eof(t))
+        goto fail;
+
+    if (!c->authorized) {
+        pa_pstream_send_error(c->pstream, tag, PA_ERR_ACCESS);
+        goto finish;
+    }
+
+    if ((facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) ||
+        (key && !pa_proplist_key_valid(key)) ||
+        (value && !key)) {
+        pa_pstream_send_error(c->pstream, tag, PA_ERR_INVALID);
+        goto finish;
+    }
+
+    if (!c->subscription) {
+        pa_pstream_send_error(c->pstream, tag, PA_ERR_BADSTATE);
+        goto finish;
+    }
+
+    pa_subscription_set_filter(c->subscription, facility, indexes, n, key, value);
+    pa_pstream_send_simple_ack(c->pstream, tag);
+
+finish:
+    pa_xfree(indexes);
+    return;
+
+fail:
+    protocol_error(c);
+    pa_xfree(indexes);
+}
+
 static void command_set_volume(
         pa_pdispatch *pd,
         uint32_t command,
@@ -4805,6 +5194,88 @@ static void command_set_port_latency_offset(pa_pdispatch *pd, uint32_t command,
     pa_pstream_send_simple_ack(c->pstream, tag);
 }
 
+static void command_get_render_profile(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t idx;
+    const char *name = NULL;
+    pa_sink *sink = NULL;
+    pa_sink_input *sink_input = NULL;
+    pa_source *source = NULL;
+    const pa_render_profile *profile;
+    pa_tagstruct *reply;
+    unsigned m, k;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    /* Clients which negotiated an older version don't know this
+     * command, and may well have sent something else */
+    CHECK_VALIDITY(c->pstream, c->version >= 29, tag, PA_ERR_NOTSUPPORTED);
+
+    if (pa_tagstruct_getu32(t, &idx) < 0 ||
+        (command != PA_COMMAND_GET_SINK_INPUT_RENDER_PROFILE &&
+         pa_tagstruct_gets(t, &name) < 0) ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    CHECK_VALIDITY(c->pstream, !name ||
+                   (command == PA_COMMAND_GET_SINK_RENDER_PROFILE &&
+                    pa_namereg_is_valid_name_or_wildcard(name, PA_NAMEREG_SINK)) ||
+                   (command == PA_COMMAND_GET_SOURCE_RENDER_PROFILE &&
+                    pa_namereg_is_valid_name_or_wildcard(name, PA_NAMEREG_SOURCE)), tag, PA_ERR_INVALID);
+    CHECK_VALIDITY(c->pstream, idx == PA_INVALID_INDEX || !name, tag, PA_ERR_INVALID);
+
+    if (command == PA_COMMAND_GET_SINK_RENDER_PROFILE) {
+        if (idx != PA_INVALID_INDEX)
+            sink = pa_idxset_get_by_index(c->protocol->core->sinks, idx);
+        else
+            sink = pa_namereg_get(c->protocol->core, name, PA_NAMEREG_SINK);
+
+        CHECK_VALIDITY(c->pstream, sink, tag, PA_ERR_NOENTITY);
+
+        idx = sink->index;
+        profile = &sink->render_profile;
+    } else if (command == PA_COMMAND_GET_SINK_INPUT_RENDER_PROFILE) {
+        CHECK_VALIDITY(c->pstream, idx != PA_INVALID_INDEX, tag, PA_ERR_INVALID);
+        sink_input = pa_idxset_get_by_index(c->protocol->core->sink_inputs, idx);
+        CHECK_VALIDITY(c->pstream, sink_input, tag, PA_ERR_NOENTITY);
+
+        profile = &sink_input->render_profile;
+    } else {
+        pa_assert(command == PA_COMMAND_GET_SOURCE_RENDER_PROFILE);
+
+        if (idx != PA_INVALID_INDEX)
+            source = pa_idxset_get_by_index(c->protocol->core->sources, idx);
+        else
+            source = pa_namereg_get(c->protocol->core, name, PA_NAMEREG_SOURCE);
+
+        CHECK_VALIDITY(c->pstream, source, tag, PA_ERR_NOENTITY);
+
+        idx = source->index;
+        profile = &source->render_profile;
+    }
+
+    reply = reply_new(tag);
+    pa_tagstruct_putu32(reply, idx);
+    pa_tagstruct_putu32(reply, PA_RENDER_PROFILE_METRIC_MAX);
+
+    for (m = 0; m < PA_RENDER_PROFILE_METRIC_MAX; m++) {
+        uint32_t counts[PA_RENDER_PROFILE_BUCKETS];
+
+        pa_tagstruct_puts(reply, pa_render_profile_metric_to_string(m));
+        pa_tagstruct_put_usec(reply, pa_render_profile_get(profile, m, counts));
+        pa_tagstruct_putu32(reply, PA_RENDER_PROFILE_BUCKETS);
+
+        for (k = 0; k < PA_RENDER_PROFILE_BUCKETS; k++)
+            pa_tagstruct_putu32(reply, counts[k]);
+    }
+
+    pa_pstream_send_tagstruct(c->pstream, reply);
+}
+
 /*** pstream callbacks ***/
 
 static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
@@ -4814,12 +5285,68 @@ static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_c
     pa_assert(packet);
     pa_native_connection_assert_ref(c);
 
+    c->client->n_deferred_requests = pa_pstream_get_deferred(p);
+
     if (pa_pdispatch_run(c->pdispatch, packet, creds, c) < 0) {
         pa_log("invalid packet.");
         native_connection_unlink(c);
     }
 }
 
+/* Called from main context, or from the I/O thread of the connection
+ * while the stream is direct */
+static void playback_stream_post_chunk(playback_stream *s, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk) {
+    pa_asyncmsgq *q = s->sink_input->sink->asyncmsgq;
+
+    pa_atomic_inc(&s->seek_or_post_in_queue);
+    if (chunk->memblock) {
+        if (seek != PA_SEEK_RELATIVE || offset != 0)
+            pa_asyncmsgq_post(q, PA_MSGOBJECT(s->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset, chunk, NULL);
+        else
+            pa_asyncmsgq_post(q, PA_MSGOBJECT(s->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
+    } else
+        pa_asyncmsgq_post(q, PA_MSGOBJECT(s->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset+chunk->length, NULL, NULL);
+}
+
+/* Called from the I/O thread of the connection, with the pstream locked */
+static void pstream_direct_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    playback_stream *s = userdata;
+
+    pa_assert(p);
+    pa_assert(chunk);
+    pa_assert(s);
+
+    /* The main loop turns this off before it changes the sink input
+     * or its sink, and it can't do that while we hold the lock */
+    playback_stream_post_chunk(s, offset, seek, chunk);
+}
+
+/* Called from main context */
+static void playback_stream_set_direct(playback_stream *s, pa_bool_t direct) {
+    playback_stream_assert_ref(s);
+
+    if (s->direct == direct)
+        return;
+
+    /* Without an I/O thread the pstream never makes use of this */
+    pa_pstream_set_direct_memblock_callback(s->connection->pstream, s->index, direct ? pstream_direct_memblock_callback : NULL, s);
+    s->direct = direct;
+}
+
+/* Called from main context */
+static pa_hook_result_t sink_input_move_start_cb(pa_core *core, pa_sink_input *i, pa_native_protocol *p) {
+    pa_assert(i);
+    pa_assert(p);
+
+    /* Only our own streams are of interest */
+    if (i->parent.process_msg != sink_input_process_msg)
+        return PA_HOOK_OK;
+
+    playback_stream_set_direct(PLAYBACK_STREAM(i->userdata), FALSE);
+
+    return PA_HOOK_OK;
+}
+
 static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     output_stream *stream;
@@ -4841,14 +5368,11 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
     if (playback_stream_isinstance(stream)) {
         playback_stream *ps = PLAYBACK_STREAM(stream);
 
-        pa_atomic_inc(&ps->seek_or_post_in_queue);
-        if (chunk->memblock) {
-            if (seek != PA_SEEK_RELATIVE || offset != 0)
-                pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset, chunk, NULL);
-            else
-                pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
-        } else
-            pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset+chunk->length, NULL, NULL);
+        playback_stream_post_chunk(ps, offset, seek, chunk);
+
+        /* What follows may take the shortcut, until the next move */
+        if (!ps->direct && ps->sink_input->sink)
+            playback_stream_set_direct(ps, TRUE);
 
     } else {
         upload_stream *u = UPLOAD_STREAM(stream);
@@ -5035,8 +5559,17 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     c->client->send_event = client_send_event_cb;
     c->client->userdata = c;
 
-    c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
+#ifdef HAVE_CREDS
+    if (pa_iochannel_creds_supported(io))
+        pa_iochannel_creds_enable(io);
+#endif
+
+    if (o->io_threads)
+        c->pstream = pa_pstream_new_threaded(pa_pstream_thread_pool_next(o->io_threads), io, p->core->mempool);
+    else
+        c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
     pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
+    pa_pstream_set_receive_budget(c->pstream, o->request_budget);
     pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
     pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
     pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
@@ -5053,11 +5586,6 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
 
     pa_idxset_put(p->connections, c, NULL);
 
-#ifdef HAVE_CREDS
-    if (pa_iochannel_creds_supported(io))
-        pa_iochannel_creds_enable(io);
-#endif
-
     pa_hook_fire(&p->hooks[PA_NATIVE_HOOK_CONNECTION_PUT], c);
 }
 
@@ -5091,6 +5619,10 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
         pa_hook_init(&p->hooks[h], p);
 
+    /* Early, so that no audio data is posted to the old sink behind
+     * the back of the move */
+    p->sink_input_move_start_slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_START], PA_HOOK_EARLY, (pa_hook_cb_t) sink_input_move_start_cb, p);
+
     pa_assert_se(pa_shared_set(c, "native-protocol", p) >= 0);
 
     return p;
@@ -5136,6 +5668,8 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_hashmap_free(p->extensions, NULL);
 
+    pa_hook_slot_free(p->sink_input_move_start_slot);
+
     pa_assert_se(pa_shared_remove(p->core, "native-protocol") >= 0);
 
     pa_xfree(p);
@@ -5200,6 +5734,8 @@ pa_native_options* pa_native_options_new(void) {
     o = pa_xnew0(pa_native_options, 1);
     PA_REFCNT_INIT(o);
 
+    o->request_budget = DEFAULT_REQUEST_BUDGET;
+
     return o;
 }
 
@@ -5227,11 +5763,15 @@ void pa_native_options_unref(pa_native_options *o) {
     if (o->auth_cookie)
         pa_auth_cookie_unref(o->auth_cookie);
 
+    if (o->io_threads)
+        pa_pstream_thread_pool_free(o->io_threads);
+
     pa_xfree(o);
 }
 
 int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
     pa_bool_t enabled;
+    uint32_t n_io_threads;
     const char *acl;
 
     pa_assert(o);
@@ -5243,6 +5783,31 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    if (pa_modargs_get_value_u32(ma, "request-budget", &o->request_budget) < 0) {
+        pa_log("request-budget= expects a non-negative integer argument.");
+        return -1;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "adaptive-requests", &o->adaptive_requests) < 0) {
+        pa_log("adaptive-requests= expects a boolean argument.");
+        return -1;
+    }
+
+    n_io_threads = 0;
+    if (pa_modargs_get_value_u32(ma, "io-threads", &n_io_threads) < 0 || n_io_threads > MAX_IO_THREADS) {
+        pa_log("io-threads= expects an integer argument between 0 and %u.", MAX_IO_THREADS);
+        return -1;
+    }
+
+    if (o->io_threads) {
+        pa_pstream_thread_pool_free(o->io_threads);
+        o->io_threads = NULL;
+    }
+
+    if (n_io_threads > 0)
+        if (!(o->io_threads = pa_pstream_thread_pool_new(c->mainloop, n_io_threads)))
+            return -1;
+
     enabled = TRUE;
     if (pa_modargs_get_value_boolean(ma, "auth-group-enable", &enabled) < 0) {
         pa_log("auth-group-enable= expects a boolean argument.");
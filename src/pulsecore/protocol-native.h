@@ -33,6 +33,7 @@
 #include <pulsecore/hook-list.h>
 #include <pulsecore/pstream.h>
 #include <pulsecore/tagstruct.h>
+#include <pulsecore/pstream-thread-pool.h>
 
 typedef struct pa_native_protocol pa_native_protocol;
 
@@ -47,6 +48,17 @@ typedef struct pa_native_options {
     char *auth_group;
     pa_ip_acl *auth_ip_acl;
     pa_auth_cookie *auth_cookie;
+
+    /* Requests handled per client and main loop iteration */
+    uint32_t request_budget;
+
+    /* Threads doing the socket I/O of the clients, or NULL to do it
+     * in the main loop */
+    pa_pstream_thread_pool *io_threads;
+
+    /* Size the requests of playback streams after how fast their
+     * clients answer */
+    pa_bool_t adaptive_requests;
 } pa_native_options;
 
 typedef enum pa_native_hook {
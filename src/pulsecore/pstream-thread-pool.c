@@ -0,0 +1,215 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/asyncq.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/poll.h>
+#include <pulsecore/thread.h>
+
+#include "pstream-thread-pool.h"
+
+struct io_thread {
+    /* Needs to be first, see post() */
+    pa_pstream_io_thread parent;
+
+    pa_thread *thread;
+    pa_mainloop *mainloop;
+
+    /* What the pstreams received, from the thread to the main loop */
+    pa_asyncq *queue;
+    pa_io_event *queue_event;
+};
+
+struct pa_pstream_thread_pool {
+    pa_mainloop_api *mainloop;
+
+    struct io_thread *threads;
+    unsigned n_threads, next;
+};
+
+/* Called from the thread, with the mutex held exactly once */
+static void post(pa_pstream_io_thread *parent, pa_pstream_event *e) {
+    struct io_thread *t = (struct io_thread*) parent;
+
+    if (pa_asyncq_push(t->queue, e, FALSE) >= 0)
+        return;
+
+    /* The main loop is falling behind. Wait for it, but don't keep it
+     * from getting at our pstreams meanwhile, it may need to in order
+     * to catch up. */
+    pa_mutex_unlock(parent->mutex);
+    pa_assert_se(pa_asyncq_push(t->queue, e, TRUE) >= 0);
+    pa_mutex_lock(parent->mutex);
+}
+
+static void queue_cb(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    struct io_thread *t = userdata;
+    pa_pstream_event *pe;
+
+    pa_assert(t);
+    pa_assert(pa_asyncq_read_fd(t->queue) == fd);
+
+    pa_asyncq_read_after_poll(t->queue);
+
+    /* This handles everything the I/O thread posted, from all of its
+     * pstreams, in one go. The receive budget of a pstream limits how
+     * much the I/O thread reads per iteration of its own loop, which
+     * may run many times for each one of ours, so it doesn't bound the
+     * work a single peer causes here. */
+    for (;;) {
+        while ((pe = pa_asyncq_pop(t->queue, FALSE)))
+            pa_pstream_dispatch_event(pe);
+
+        if (pa_asyncq_read_before_poll(t->queue) == 0)
+            break;
+    }
+}
+
+static int poll_func(struct pollfd *ufds, unsigned long nfds, int timeout, void *userdata) {
+    pa_mutex *mutex = userdata;
+    int r;
+
+    pa_assert(mutex);
+
+    /* Let the main loop at our pstreams while we wait */
+    pa_mutex_unlock(mutex);
+    r = pa_poll(ufds, nfds, timeout);
+    pa_mutex_lock(mutex);
+
+    return r;
+}
+
+static void thread_func(void *userdata) {
+    struct io_thread *t = userdata;
+
+    pa_assert(t);
+
+    pa_mutex_lock(t->parent.mutex);
+
+    if (pa_mainloop_run(t->mainloop, NULL) < 0)
+        pa_log_error("I/O thread main loop failed.");
+
+    pa_mutex_unlock(t->parent.mutex);
+}
+
+pa_pstream_thread_pool* pa_pstream_thread_pool_new(pa_mainloop_api *m, unsigned n_threads) {
+    pa_pstream_thread_pool *pool;
+    unsigned k;
+
+    pa_assert(m);
+    pa_assert(n_threads > 0);
+
+    pool = pa_xnew0(pa_pstream_thread_pool, 1);
+    pool->mainloop = m;
+    pool->threads = pa_xnew0(struct io_thread, n_threads);
+
+    for (k = 0; k < n_threads; k++) {
+        struct io_thread *t = &pool->threads[k];
+        char name[16];
+
+        pa_assert_se(t->mainloop = pa_mainloop_new());
+        t->parent.mainloop = pa_mainloop_get_api(t->mainloop);
+        t->parent.mutex = pa_mutex_new(TRUE, FALSE);
+        t->parent.post = post;
+        pa_mainloop_set_poll_func(t->mainloop, poll_func, t->parent.mutex);
+
+        pa_assert_se(t->queue = pa_asyncq_new(0));
+        pa_assert_se(pa_asyncq_read_before_poll(t->queue) == 0);
+        pa_assert_se(t->queue_event = m->io_new(m, pa_asyncq_read_fd(t->queue), PA_IO_EVENT_INPUT, queue_cb, t));
+
+        pool->n_threads++;
+
+        pa_snprintf(name, sizeof(name), "pstream-io%u", k);
+
+        if (!(t->thread = pa_thread_new(name, thread_func, t))) {
+            pa_log("Failed to create I/O thread.");
+            pa_pstream_thread_pool_free(pool);
+            return NULL;
+        }
+    }
+
+    pa_log_debug("Started %u I/O threads.", n_threads);
+
+    return pool;
+}
+
+void pa_pstream_thread_pool_free(pa_pstream_thread_pool *pool) {
+    unsigned k;
+
+    pa_assert(pool);
+
+    for (k = 0; k < pool->n_threads; k++) {
+        struct io_thread *t = &pool->threads[k];
+        pa_pstream_event *e;
+
+        if (t->thread) {
+            pa_mutex_lock(t->parent.mutex);
+            pa_mainloop_quit(t->mainloop, 0);
+            pa_mutex_unlock(t->parent.mutex);
+
+            /* It might be waiting for room in the queue, and won't see
+             * that it is to quit before it got it. It may then post a
+             * lot more before it gets back to its main loop, so keep
+             * making room until it is gone. */
+            while (pa_thread_is_running(t->thread)) {
+                if ((e = pa_asyncq_pop(t->queue, FALSE)))
+                    pa_pstream_dispatch_event(e);
+                else
+                    pa_thread_yield();
+            }
+
+            pa_thread_free(t->thread);
+        }
+
+        /* The pstreams are unlinked already, so this just drops
+         * whatever was left */
+        while ((e = pa_asyncq_pop(t->queue, FALSE)))
+            pa_pstream_dispatch_event(e);
+
+        pool->mainloop->io_free(t->queue_event);
+        pa_asyncq_free(t->queue, NULL);
+
+        pa_mainloop_free(t->mainloop);
+        pa_mutex_free(t->parent.mutex);
+    }
+
+    pa_xfree(pool->threads);
+    pa_xfree(pool);
+}
+
+pa_pstream_io_thread* pa_pstream_thread_pool_next(pa_pstream_thread_pool *pool) {
+    struct io_thread *t;
+
+    pa_assert(pool);
+
+    t = &pool->threads[pool->next];
+    pool->next = (pool->next + 1) % pool->n_threads;
+
+    return &t->parent;
+}
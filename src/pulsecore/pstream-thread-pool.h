@@ -0,0 +1,43 @@
+#ifndef foopulsepstreamthreadpoolhfoo
+#define foopulsepstreamthreadpoolhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <pulse/mainloop-api.h>
+
+#include <pulsecore/pstream.h>
+
+/* A few threads which take the socket I/O, framing and memory block
+ * import of pstreams off the main loop, see pa_pstream_new_threaded().
+ * Each thread hands what its pstreams received to the main loop
+ * through a lock-free queue of its own. Everything else, in
+ * particular all handling of the requests, stays in the main loop. */
+
+typedef struct pa_pstream_thread_pool pa_pstream_thread_pool;
+
+pa_pstream_thread_pool* pa_pstream_thread_pool_new(pa_mainloop_api *m, unsigned n_threads);
+
+/* All pstreams using the threads need to be gone by now */
+void pa_pstream_thread_pool_free(pa_pstream_thread_pool *pool);
+
+/* The thread to use for the next pstream, taking turns */
+pa_pstream_io_thread* pa_pstream_thread_pool_next(pa_pstream_thread_pool *pool);
+
+#endif
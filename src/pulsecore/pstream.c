@@ -32,14 +32,21 @@
 #include <netinet/in.h>
 #endif
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/socket.h>
 #include <pulsecore/queue.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/log.h>
 #include <pulsecore/creds.h>
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/refcnt.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/mutex.h>
 #include <pulsecore/macro.h>
 
 #include "pstream.h"
@@ -74,7 +81,14 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
 
 #define PA_PSTREAM_DESCRIPTOR_SIZE (PA_PSTREAM_DESCRIPTOR_MAX*sizeof(uint32_t))
 
-#define MINIBUF_SIZE (256)
+/* Up to this many queued frames are handed to the kernel with a
+ * single system call */
+#define WRITE_FRAMES_MAX (16)
+
+/* Whatever follows a frame descriptor is read into a buffer of this
+ * size, so that a burst of small frames needs only one system call.
+ * Larger payloads are read directly into their packet or memblock. */
+#define READ_BUFFER_SIZE (4096)
 
 /* To allow uploading a single sample in one frame, this value should be the
  * same size (16 MB) as PA_SCACHE_ENTRY_SIZE_MAX from pulsecore/core-scache.h.
@@ -82,6 +96,7 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
 #define FRAME_SIZE_MAX_ALLOW (1024*1024*16)
 
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(events, 0, pa_xfree);
 
 struct item_info {
     enum {
@@ -108,6 +123,49 @@ struct item_info {
     uint32_t block_id;
 };
 
+/* Something an I/O thread received, on its way to the main loop */
+struct pa_pstream_event {
+    pa_pstream *pstream;
+
+    enum {
+        PA_PSTREAM_EVENT_PACKET,
+        PA_PSTREAM_EVENT_MEMBLOCK,
+        PA_PSTREAM_EVENT_DRAIN,
+        PA_PSTREAM_EVENT_DIE
+    } type;
+
+    /* packet info */
+    pa_packet *packet;
+#ifdef HAVE_CREDS
+    pa_bool_t with_creds;
+    pa_creds creds;
+#endif
+
+    /* memblock info */
+    pa_memchunk chunk;
+    uint32_t channel;
+    int64_t offset;
+    pa_seek_mode_t seek_mode;
+};
+
+/* A channel whose memory blocks an I/O thread hands on by itself */
+struct direct_memblock {
+    pa_pstream_memblock_cb_t callback;
+    void *userdata;
+};
+
+/* A queued item, ready to be sent */
+struct write_frame {
+    struct item_info *item;
+    pa_pstream_descriptor descriptor;
+
+    /* The payload is either the packet data, the SHM info or the
+     * memchunk */
+    void *data;
+    uint32_t shm_info[PA_PSTREAM_SHM_MAX];
+    pa_memchunk memchunk;
+};
+
 struct pa_pstream {
     PA_REFCNT_DECLARE;
 
@@ -115,20 +173,20 @@ struct pa_pstream {
     pa_defer_event *defer_event;
     pa_iochannel *io;
 
+    /* If set, mainloop is the one of this thread, and everything but
+     * the callbacks is shared with it */
+    pa_pstream_io_thread *thread;
+
     pa_queue *send_queue;
 
     pa_bool_t dead;
 
     struct {
-        union {
-            uint8_t minibuf[MINIBUF_SIZE];
-            pa_pstream_descriptor descriptor;
-        };
-        struct item_info* current;
-        void *data;
+        /* A ring of the frames currently being written. index counts
+         * the bytes of the first one which went out already. */
+        struct write_frame frames[WRITE_FRAMES_MAX];
+        unsigned first, n_frames;
         size_t index;
-        int minibuf_validsize;
-        pa_memchunk memchunk;
     } write;
 
     struct {
@@ -138,6 +196,12 @@ struct pa_pstream {
         uint32_t shm_info[PA_PSTREAM_SHM_MAX];
         void *data;
         size_t index;
+
+        uint8_t buffer[READ_BUFFER_SIZE];
+        size_t buffer_index, buffer_length;
+#ifdef HAVE_CREDS
+        pa_bool_t buffer_creds_valid;
+#endif
     } read;
 
     pa_bool_t use_shm;
@@ -162,18 +226,146 @@ struct pa_pstream {
     pa_pstream_block_id_cb_t release_callback;
     void *release_callback_userdata;
 
+    /* Channel -> struct direct_memblock, only used with a thread */
+    pa_hashmap *direct_memblocks;
+
+    /* Events posted to the main loop which it didn't finish yet. As
+     * long as there are any, nothing may take a shortcut past them. */
+    pa_atomic_t n_posted;
+
     pa_mempool *mempool;
 
+    /* At most receive_budget packets are handed out per main loop
+     * iteration, the rest waits for receive_event, which fires in the
+     * next one together with the I/O events of the other connections.
+     * (A defer event wouldn't do, pa_mainloop doesn't dispatch any I/O
+     * in an iteration with defer events.) The budget is refilled by
+     * receive_event, or by the I/O callback if receive_event didn't
+     * fire in the same iteration, as told by receive_refilled. 0 means
+     * no limit. */
+    unsigned receive_budget, receive_left;
+    pa_time_event *receive_event;
+    pa_bool_t receive_deferred, receive_refilled;
+    uint64_t n_deferred;
+
 #ifdef HAVE_CREDS
-    pa_creds read_creds, write_creds;
-    pa_bool_t read_creds_valid, send_creds_now;
+    pa_creds read_creds;
+    pa_bool_t read_creds_valid;
 #endif
 };
 
 static int do_write(pa_pstream *p);
 static int do_read(pa_pstream *p);
+static int read_buffered(pa_pstream *p);
+
+static void pstream_lock(pa_pstream *p) {
+    if (p->thread)
+        pa_mutex_lock(p->thread->mutex);
+}
+
+static void pstream_unlock(pa_pstream *p) {
+    if (p->thread)
+        pa_mutex_unlock(p->thread->mutex);
+}
+
+static pa_pstream_event *event_new(pa_pstream *p, int type) {
+    pa_pstream_event *e;
+
+    if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(events))))
+        e = pa_xnew(pa_pstream_event, 1);
+
+    e->pstream = pa_pstream_ref(p);
+    e->type = type;
+    e->packet = NULL;
+    pa_memchunk_reset(&e->chunk);
+
+    return e;
+}
+
+static void post_event(pa_pstream *p, pa_pstream_event *e) {
+    pa_atomic_inc(&p->n_posted);
+    p->thread->post(p->thread, e);
+}
+
+/* The deliver functions pass on what was received right away, or,
+ * with an I/O thread, from the main loop */
+static void deliver_packet(pa_pstream *p, pa_packet *packet, const pa_creds *creds) {
+    pa_pstream_event *e;
+
+    if (!p->receive_packet_callback)
+        return;
+
+    if (!p->thread) {
+        p->receive_packet_callback(p, packet, creds, p->receive_packet_callback_userdata);
+        return;
+    }
+
+    e = event_new(p, PA_PSTREAM_EVENT_PACKET);
+    e->packet = pa_packet_ref(packet);
+#ifdef HAVE_CREDS
+    if ((e->with_creds = !!creds))
+        e->creds = *creds;
+#endif
+
+    post_event(p, e);
+}
+
+static void deliver_memblock(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek_mode, const pa_memchunk *chunk) {
+    pa_pstream_event *e;
+    struct direct_memblock *d;
+
+    if (!p->receive_memblock_callback)
+        return;
+
+    if (!p->thread) {
+        p->receive_memblock_callback(p, channel, offset, seek_mode, chunk, p->receive_memblock_callback_userdata);
+        return;
+    }
+
+    /* Skip the main loop if we may. If it still has something of ours
+     * to handle, this block needs to wait its turn. */
+    if (pa_atomic_load(&p->n_posted) == 0 &&
+        (d = pa_hashmap_get(p->direct_memblocks, PA_UINT32_TO_PTR(channel)))) {
+        d->callback(p, channel, offset, seek_mode, chunk, d->userdata);
+        return;
+    }
+
+    e = event_new(p, PA_PSTREAM_EVENT_MEMBLOCK);
+    e->channel = channel;
+    e->offset = offset;
+    e->seek_mode = seek_mode;
+
+    /* Failed imports come without a memblock */
+    e->chunk = *chunk;
+    if (e->chunk.memblock)
+        pa_memblock_ref(e->chunk.memblock);
+
+    post_event(p, e);
+}
+
+/* Stops all I/O, but leaves the callbacks alone */
+static void stop_io(pa_pstream *p) {
+    p->dead = TRUE;
+
+    if (p->io) {
+        pa_iochannel_free(p->io);
+        p->io = NULL;
+    }
+
+    if (p->defer_event) {
+        p->mainloop->defer_free(p->defer_event);
+        p->defer_event = NULL;
+    }
 
-static void do_pstream_read_write(pa_pstream *p) {
+    if (p->receive_event) {
+        p->mainloop->time_free(p->receive_event);
+        p->receive_event = NULL;
+    }
+}
+
+/* refill is TRUE if this is the first call in this main loop iteration
+ * which may use up receive budget */
+static void do_pstream_read_write(pa_pstream *p, pa_bool_t refill) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
@@ -181,11 +373,25 @@ static void do_pstream_read_write(pa_pstream *p) {
 
     p->mainloop->defer_enable(p->defer_event, 0);
 
-    if (!p->dead && pa_iochannel_is_readable(p->io)) {
-        if (do_read(p) < 0)
+    if (refill)
+        p->receive_left = p->receive_budget;
+
+    if (!p->dead && p->read.buffer_index < p->read.buffer_length) {
+        /* Carry on where the budget ran out the last time */
+        if (read_buffered(p) < 0)
             goto fail;
-    } else if (!p->dead && pa_iochannel_is_hungup(p->io))
-        goto fail;
+    }
+
+    /* If that was all, the iochannel won't tell us about the data
+     * which came in meanwhile again, so read it now. Once out of
+     * budget this just buffers it for the next iteration. */
+    if (!p->dead && p->read.buffer_index >= p->read.buffer_length) {
+        if (pa_iochannel_is_readable(p->io)) {
+            if (do_read(p) < 0)
+                goto fail;
+        } else if (pa_iochannel_is_hungup(p->io))
+            goto fail;
+    }
 
     if (!p->dead && pa_iochannel_is_writable(p->io)) {
         if (do_write(p) < 0)
@@ -197,21 +403,34 @@ static void do_pstream_read_write(pa_pstream *p) {
 
 fail:
 
-    if (p->die_callback)
-        p->die_callback(p, p->die_callback_userdata);
+    if (p->thread) {
+        /* The main loop does the rest */
+        stop_io(p);
+        post_event(p, event_new(p, PA_PSTREAM_EVENT_DIE));
+    } else {
+        if (p->die_callback)
+            p->die_callback(p, p->die_callback_userdata);
+
+        pa_pstream_unlink(p);
+    }
 
-    pa_pstream_unlink(p);
     pa_pstream_unref(p);
 }
 
 static void io_callback(pa_iochannel*io, void *userdata) {
     pa_pstream *p = userdata;
+    pa_bool_t refill;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
     pa_assert(p->io == io);
 
-    do_pstream_read_write(p);
+    /* Time events are dispatched before I/O events, so if
+     * receive_event fired it was in this iteration */
+    refill = !p->receive_refilled;
+    p->receive_refilled = FALSE;
+
+    do_pstream_read_write(p, refill);
 }
 
 static void defer_callback(pa_mainloop_api *m, pa_defer_event *e, void*userdata) {
@@ -222,7 +441,22 @@ static void defer_callback(pa_mainloop_api *m, pa_defer_event *e, void*userdata)
     pa_assert(p->defer_event == e);
     pa_assert(p->mainloop == m);
 
-    do_pstream_read_write(p);
+    /* Only writing, or whatever is left of the budget */
+    do_pstream_read_write(p, FALSE);
+}
+
+static void receive_callback(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
+    pa_pstream *p = userdata;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->receive_event == e);
+    pa_assert(p->mainloop == m);
+
+    m->time_restart(e, NULL);
+    p->receive_refilled = TRUE;
+
+    do_pstream_read_write(p, TRUE);
 }
 
 static void memimport_release_cb(pa_memimport *i, uint32_t block_id, void *userdata);
@@ -241,17 +475,18 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     p->dead = FALSE;
 
     p->mainloop = m;
+    p->thread = NULL;
     p->defer_event = m->defer_new(m, defer_callback, p);
     m->defer_enable(p->defer_event, 0);
 
     p->send_queue = pa_queue_new();
 
-    p->write.current = NULL;
+    p->write.first = p->write.n_frames = 0;
     p->write.index = 0;
-    pa_memchunk_reset(&p->write.memchunk);
     p->read.memblock = NULL;
     p->read.packet = NULL;
     p->read.index = 0;
+    p->read.buffer_index = p->read.buffer_length = 0;
 
     p->receive_packet_callback = NULL;
     p->receive_packet_callback_userdata = NULL;
@@ -266,8 +501,16 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     p->release_callback = NULL;
     p->release_callback_userdata = NULL;
 
+    p->direct_memblocks = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    pa_atomic_store(&p->n_posted, 0);
+
     p->mempool = pool;
 
+    p->receive_budget = p->receive_left = 0;
+    p->receive_event = NULL;
+    p->receive_deferred = p->receive_refilled = FALSE;
+    p->n_deferred = 0;
+
     p->use_shm = FALSE;
     p->export = NULL;
 
@@ -278,8 +521,8 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     pa_iochannel_socket_set_sndbuf(io, pa_mempool_block_size_max(p->mempool));
 
 #ifdef HAVE_CREDS
-    p->send_creds_now = FALSE;
     p->read_creds_valid = FALSE;
+    p->read.buffer_creds_valid = FALSE;
 #endif
     return p;
 }
@@ -300,6 +543,22 @@ static void item_free(void *item) {
         pa_xfree(i);
 }
 
+static struct write_frame *write_frame_get(pa_pstream *p, unsigned k) {
+    pa_assert(k < p->write.n_frames);
+
+    return &p->write.frames[(p->write.first + k) % WRITE_FRAMES_MAX];
+}
+
+static void write_frame_done(struct write_frame *f) {
+    item_free(f->item);
+    f->item = NULL;
+
+    if (f->memchunk.memblock)
+        pa_memblock_unref(f->memchunk.memblock);
+
+    pa_memchunk_reset(&f->memchunk);
+}
+
 static void pstream_free(pa_pstream *p) {
     pa_assert(p);
 
@@ -307,11 +566,11 @@ static void pstream_free(pa_pstream *p) {
 
     pa_queue_free(p->send_queue, item_free);
 
-    if (p->write.current)
-        item_free(p->write.current);
-
-    if (p->write.memchunk.memblock)
-        pa_memblock_unref(p->write.memchunk.memblock);
+    while (p->write.n_frames > 0) {
+        write_frame_done(write_frame_get(p, 0));
+        p->write.first = (p->write.first + 1) % WRITE_FRAMES_MAX;
+        p->write.n_frames--;
+    }
 
     if (p->read.memblock)
         pa_memblock_unref(p->read.memblock);
@@ -319,6 +578,8 @@ static void pstream_free(pa_pstream *p) {
     if (p->read.packet)
         pa_packet_unref(p->read.packet);
 
+    pa_hashmap_free(p->direct_memblocks, pa_xfree);
+
     pa_xfree(p);
 }
 
@@ -329,8 +590,10 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, const pa_creds *cre
     pa_assert(PA_REFCNT_VALUE(p) > 0);
     pa_assert(packet);
 
+    pstream_lock(p);
+
     if (p->dead)
-        return;
+        goto finish;
 
     if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
         i = pa_xnew(struct item_info, 1);
@@ -346,6 +609,9 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, const pa_creds *cre
     pa_queue_push(p->send_queue, i);
 
     p->mainloop->defer_enable(p->defer_event, 1);
+
+finish:
+    pstream_unlock(p);
 }
 
 void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa_seek_mode_t seek_mode, const pa_memchunk *chunk) {
@@ -357,8 +623,10 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
     pa_assert(channel != (uint32_t) -1);
     pa_assert(chunk);
 
+    pstream_lock(p);
+
     if (p->dead)
-        return;
+        goto finish;
 
     idx = 0;
     length = chunk->length;
@@ -392,6 +660,9 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
     }
 
     p->mainloop->defer_enable(p->defer_event, 1);
+
+finish:
+    pstream_unlock(p);
 }
 
 void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
@@ -399,8 +670,10 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
+
     if (p->dead)
-        return;
+        goto finish;
 
 /*     pa_log("Releasing block %u", block_id); */
 
@@ -414,6 +687,9 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
 
     pa_queue_push(p->send_queue, item);
     p->mainloop->defer_enable(p->defer_event, 1);
+
+finish:
+    pstream_unlock(p);
 }
 
 /* might be called from thread context */
@@ -437,8 +713,10 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
+
     if (p->dead)
-        return;
+        goto finish;
 /*     pa_log("Revoking block %u", block_id); */
 
     if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
@@ -451,6 +729,9 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
 
     pa_queue_push(p->send_queue, item);
     p->mainloop->defer_enable(p->defer_event, 1);
+
+finish:
+    pstream_unlock(p);
 }
 
 /* might be called from thread context */
@@ -466,69 +747,68 @@ static void memexport_revoke_cb(pa_memexport *e, uint32_t block_id, void *userda
         pa_pstream_send_revoke(p, block_id);
 }
 
-static void prepare_next_write_item(pa_pstream *p) {
+/* Moves the next queued item to the end of the write ring */
+static pa_bool_t prepare_write_frame(pa_pstream *p) {
+    struct item_info *i;
+    struct write_frame *f;
+
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->write.n_frames < WRITE_FRAMES_MAX);
 
-    p->write.current = pa_queue_pop(p->send_queue);
+    if (!(i = pa_queue_pop(p->send_queue)))
+        return FALSE;
 
-    if (!p->write.current)
-        return;
-    p->write.index = 0;
-    p->write.data = NULL;
-    p->write.minibuf_validsize = 0;
-    pa_memchunk_reset(&p->write.memchunk);
+    p->write.n_frames++;
+    f = write_frame_get(p, p->write.n_frames - 1);
 
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+    f->item = i;
+    f->data = NULL;
+    pa_memchunk_reset(&f->memchunk);
 
-    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET) {
+    f->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
+    f->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
+    f->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
+    f->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+    f->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
 
-        pa_assert(p->write.current->packet);
-        p->write.data = p->write.current->packet->data;
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->packet->length);
+    if (i->type == PA_PSTREAM_ITEM_PACKET) {
 
-        if (p->write.current->packet->length <= MINIBUF_SIZE - PA_PSTREAM_DESCRIPTOR_SIZE) {
-            memcpy(&p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], p->write.data, p->write.current->packet->length);
-            p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + p->write.current->packet->length;
-        }
+        pa_assert(i->packet);
+        f->data = i->packet->data;
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) i->packet->length);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+    } else if (i->type == PA_PSTREAM_ITEM_SHMRELEASE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(i->block_id);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+    } else if (i->type == PA_PSTREAM_ITEM_SHMREVOKE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(i->block_id);
 
     } else {
         uint32_t flags;
         pa_bool_t send_payload = TRUE;
 
-        pa_assert(p->write.current->type == PA_PSTREAM_ITEM_MEMBLOCK);
-        pa_assert(p->write.current->chunk.memblock);
+        pa_assert(i->type == PA_PSTREAM_ITEM_MEMBLOCK);
+        pa_assert(i->chunk.memblock);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(p->write.current->channel);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) p->write.current->offset) >> 32));
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) p->write.current->offset));
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(i->channel);
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) i->offset) >> 32));
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) i->offset));
 
-        flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
+        flags = (uint32_t) (i->seek_mode & PA_FLAG_SEEKMASK);
 
         if (p->use_shm) {
             uint32_t block_id, shm_id;
             size_t offset, length;
-            uint32_t *shm_info = (uint32_t *) &p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
-            size_t shm_size = sizeof(uint32_t) * PA_PSTREAM_SHM_MAX;
 
             pa_assert(p->export);
 
             if (pa_memexport_put(p->export,
-                                 p->write.current->chunk.memblock,
+                                 i->chunk.memblock,
                                  &block_id,
                                  &shm_id,
                                  &offset,
@@ -537,124 +817,147 @@ static void prepare_next_write_item(pa_pstream *p) {
                 flags |= PA_FLAG_SHMDATA;
                 send_payload = FALSE;
 
-                shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
-                shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
-                shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + p->write.current->chunk.index));
-                shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
+                f->shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
+                f->shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
+                f->shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + i->chunk.index));
+                f->shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) i->chunk.length);
 
-                p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
-                p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
+                f->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(sizeof(f->shm_info));
+                f->data = f->shm_info;
             }
 /*             else */
 /*                 pa_log_warn("Failed to export memory block."); */
         }
 
         if (send_payload) {
-            p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
-            p->write.memchunk = p->write.current->chunk;
-            pa_memblock_ref(p->write.memchunk.memblock);
-            p->write.data = NULL;
+            f->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) i->chunk.length);
+            f->memchunk = i->chunk;
+            pa_memblock_ref(f->memchunk.memblock);
         }
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+        f->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
     }
 
-#ifdef HAVE_CREDS
-    if ((p->send_creds_now = p->write.current->with_creds))
-        p->write_creds = p->write.current->creds;
-#endif
+    return TRUE;
+}
+
+static size_t write_frame_size(struct write_frame *f) {
+    return PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(f->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+}
+
+/* Appends d to the vector, minus the first *skip bytes, which were
+ * already written */
+static void add_iovec(struct iovec *iov, unsigned *n, void *d, size_t l, size_t *skip) {
+    if (*skip >= l) {
+        *skip -= l;
+        return;
+    }
+
+    iov[*n].iov_base = (uint8_t*) d + *skip;
+    iov[*n].iov_len = l - *skip;
+    (*n)++;
+
+    *skip = 0;
 }
 
 static int do_write(pa_pstream *p) {
-    void *d;
-    size_t l;
+    struct iovec iov[2*WRITE_FRAMES_MAX];
+    pa_memblock *release_memblocks[WRITE_FRAMES_MAX];
+    unsigned n_iov = 0, n_release = 0, k;
+    pa_bool_t frame_done = FALSE;
+    struct write_frame *f;
+    size_t skip;
     ssize_t r;
-    pa_memblock *release_memblock = NULL;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (!p->write.current)
-        prepare_next_write_item(p);
+    while (p->write.n_frames < WRITE_FRAMES_MAX)
+        if (!prepare_write_frame(p))
+            break;
 
-    if (!p->write.current)
+    if (p->write.n_frames <= 0)
         return 0;
 
-    if (p->write.minibuf_validsize > 0) {
-        d = p->write.minibuf + p->write.index;
-        l = p->write.minibuf_validsize - p->write.index;
-    } else if (p->write.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
-        d = (uint8_t*) p->write.descriptor + p->write.index;
-        l = PA_PSTREAM_DESCRIPTOR_SIZE - p->write.index;
-    } else {
-        pa_assert(p->write.data || p->write.memchunk.memblock);
+    skip = p->write.index;
+
+    for (k = 0; k < p->write.n_frames; k++) {
+        size_t length;
 
-        if (p->write.data)
-            d = p->write.data;
+        f = write_frame_get(p, k);
+
+#ifdef HAVE_CREDS
+        /* The credentials of a write apply to all the bytes written
+         * with it, so a frame with credentials goes out on its own */
+        if (k > 0 && (f->item->with_creds || write_frame_get(p, 0)->item->with_creds))
+            break;
+#endif
+
+        add_iovec(iov, &n_iov, f->descriptor, PA_PSTREAM_DESCRIPTOR_SIZE, &skip);
+
+        if ((length = ntohl(f->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) <= 0)
+            continue;
+
+        if (f->data)
+            add_iovec(iov, &n_iov, f->data, length, &skip);
         else {
-            d = pa_memblock_acquire_chunk(&p->write.memchunk);
-            release_memblock = p->write.memchunk.memblock;
-        }
+            pa_assert(f->memchunk.memblock);
 
-        d = (uint8_t*) d + p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE);
+            add_iovec(iov, &n_iov, pa_memblock_acquire_chunk(&f->memchunk), length, &skip);
+            release_memblocks[n_release++] = f->memchunk.memblock;
+        }
     }
 
-    pa_assert(l > 0);
-
-#ifdef HAVE_CREDS
-    if (p->send_creds_now) {
+    pa_assert(n_iov > 0);
 
-        if ((r = pa_iochannel_write_with_creds(p->io, d, l, &p->write_creds)) < 0)
-            goto fail;
+    f = write_frame_get(p, 0);
 
-        p->send_creds_now = FALSE;
-    } else
+#ifdef HAVE_CREDS
+    /* Also for the rest of a frame the last write did not finish, or
+     * the peer would read that part with our default credentials */
+    if (f->item->with_creds)
+        r = pa_iochannel_writev_with_creds(p->io, iov, n_iov, &f->item->creds);
+    else
 #endif
+        r = pa_iochannel_writev(p->io, iov, n_iov);
 
-    if ((r = pa_iochannel_write(p->io, d, l)) < 0)
-        goto fail;
+    for (k = 0; k < n_release; k++)
+        pa_memblock_release(release_memblocks[k]);
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+    if (r < 0)
+        return -1;
 
     p->write.index += (size_t) r;
 
-    if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
-        pa_assert(p->write.current);
-        item_free(p->write.current);
-        p->write.current = NULL;
+    while (p->write.n_frames > 0 && p->write.index >= write_frame_size(f = write_frame_get(p, 0))) {
+        p->write.index -= write_frame_size(f);
+        write_frame_done(f);
 
-        if (p->write.memchunk.memblock)
-            pa_memblock_unref(p->write.memchunk.memblock);
+        p->write.first = (p->write.first + 1) % WRITE_FRAMES_MAX;
+        p->write.n_frames--;
 
-        pa_memchunk_reset(&p->write.memchunk);
+        frame_done = TRUE;
+    }
 
-        if (p->drain_callback && !pa_pstream_is_pending(p))
+    if (frame_done && p->drain_callback && !pa_pstream_is_pending(p)) {
+        if (p->thread)
+            post_event(p, event_new(p, PA_PSTREAM_EVENT_DRAIN));
+        else
             p->drain_callback(p, p->drain_callback_userdata);
     }
 
     return 0;
-
-fail:
-
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
-
-    return -1;
 }
 
-static int do_read(pa_pstream *p) {
+/* Where the next bytes of the current frame go */
+static void *read_destination(pa_pstream *p, size_t *l, pa_memblock **release_memblock) {
     void *d;
-    size_t l;
-    ssize_t r;
-    pa_memblock *release_memblock = NULL;
-    pa_assert(p);
-    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    *release_memblock = NULL;
 
     if (p->read.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
         d = (uint8_t*) p->read.descriptor + p->read.index;
-        l = PA_PSTREAM_DESCRIPTOR_SIZE - p->read.index;
+        *l = PA_PSTREAM_DESCRIPTOR_SIZE - p->read.index;
     } else {
         pa_assert(p->read.data || p->read.memblock);
 
@@ -662,31 +965,22 @@ static int do_read(pa_pstream *p) {
             d = p->read.data;
         else {
             d = pa_memblock_acquire(p->read.memblock);
-            release_memblock = p->read.memblock;
+            *release_memblock = p->read.memblock;
         }
 
         d = (uint8_t*) d + p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE);
+        *l = ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE);
     }
 
-#ifdef HAVE_CREDS
-    {
-        pa_bool_t b = 0;
-
-        if ((r = pa_iochannel_read_with_creds(p->io, d, l, &p->read_creds, &b)) <= 0)
-            goto fail;
-
-        p->read_creds_valid = p->read_creds_valid || b;
-    }
-#else
-    if ((r = pa_iochannel_read(p->io, d, l)) <= 0)
-        goto fail;
-#endif
+    return d;
+}
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+/* Processes r bytes which were just stored at the current position of
+ * the frame being read */
+static int frame_read(pa_pstream *p, size_t r) {
+    size_t l;
 
-    p->read.index += (size_t) r;
+    p->read.index += r;
 
     if (p->read.index == PA_PSTREAM_DESCRIPTOR_SIZE) {
         uint32_t flags, length, channel;
@@ -780,7 +1074,7 @@ static int do_read(pa_pstream *p) {
         if (p->read.memblock && p->receive_memblock_callback) {
 
             /* Is this memblock data? Than pass it to the user */
-            l = (p->read.index - (size_t) r) < PA_PSTREAM_DESCRIPTOR_SIZE ? (size_t) (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE) : (size_t) r;
+            l = (p->read.index - r) < PA_PSTREAM_DESCRIPTOR_SIZE ? (size_t) (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE) : r;
 
             if (l > 0) {
                 pa_memchunk chunk;
@@ -796,13 +1090,12 @@ static int do_read(pa_pstream *p) {
                             (((uint64_t) ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
                             (((uint64_t) ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
 
-                    p->receive_memblock_callback(
+                    deliver_memblock(
                         p,
                         ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]),
                         offset,
                         ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
-                        &chunk,
-                        p->receive_memblock_callback_userdata);
+                        &chunk);
                 }
 
                 /* Drop seek info for following callbacks */
@@ -822,11 +1115,16 @@ static int do_read(pa_pstream *p) {
 
             } else if (p->read.packet) {
 
-                if (p->receive_packet_callback)
+                if (p->receive_left > 0)
+                    p->receive_left--;
+
+                if (p->receive_deferred)
+                    p->n_deferred++;
+
 #ifdef HAVE_CREDS
-                    p->receive_packet_callback(p, p->read.packet, p->read_creds_valid ? &p->read_creds : NULL, p->receive_packet_callback_userdata);
+                deliver_packet(p, p->read.packet, p->read_creds_valid ? &p->read_creds : NULL);
 #else
-                    p->receive_packet_callback(p, p->read.packet, NULL, p->receive_packet_callback_userdata);
+                deliver_packet(p, p->read.packet, NULL);
 #endif
 
                 pa_packet_unref(p->read.packet);
@@ -859,13 +1157,12 @@ static int do_read(pa_pstream *p) {
                             (((uint64_t) ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
                             (((uint64_t) ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
 
-                    p->receive_memblock_callback(
+                    deliver_memblock(
                             p,
                             ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]),
                             offset,
                             ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
-                            &chunk,
-                            p->receive_memblock_callback_userdata);
+                            &chunk);
                 }
 
                 if (b)
@@ -889,60 +1186,195 @@ frame_done:
 #endif
 
     return 0;
+}
+
+static int do_read(pa_pstream *p) {
+    void *d;
+    size_t l;
+    ssize_t r;
+    pa_memblock *release_memblock;
+#ifdef HAVE_CREDS
+    pa_bool_t b = FALSE;
+#endif
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->read.buffer_index >= p->read.buffer_length);
+
+    d = read_destination(p, &l, &release_memblock);
+
+    if (p->read.index < PA_PSTREAM_DESCRIPTOR_SIZE || l < READ_BUFFER_SIZE) {
+        /* We don't know or don't care where the frame ends, so read
+         * as much as we can get */
+        if (release_memblock)
+            pa_memblock_release(release_memblock);
+
+        release_memblock = NULL;
+        d = p->read.buffer;
+        l = READ_BUFFER_SIZE;
+    }
+
+#ifdef HAVE_CREDS
+    r = pa_iochannel_read_with_creds(p->io, d, l, &p->read_creds, &b);
+#else
+    r = pa_iochannel_read(p->io, d, l);
+#endif
 
-fail:
     if (release_memblock)
         pa_memblock_release(release_memblock);
 
-    return -1;
+    if (r <= 0)
+        return -1;
+
+#ifdef HAVE_CREDS
+    p->read_creds_valid = p->read_creds_valid || b;
+#endif
+
+    if (d != p->read.buffer)
+        return frame_read(p, (size_t) r);
+
+    p->read.buffer_index = 0;
+    p->read.buffer_length = (size_t) r;
+#ifdef HAVE_CREDS
+    p->read.buffer_creds_valid = b;
+#endif
+
+    return read_buffered(p);
+}
+
+/* Hand out the buffered data frame by frame, until it or the budget
+ * is used up. The callbacks might kill the stream in between. */
+static int read_buffered(pa_pstream *p) {
+    void *d;
+    size_t l;
+    pa_memblock *release_memblock;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    while (!p->dead && p->read.buffer_index < p->read.buffer_length) {
+        size_t n;
+
+        if (p->receive_budget > 0 && p->receive_left <= 0) {
+            struct timeval tv;
+
+            /* Let the other connections have their turn first */
+            p->receive_deferred = TRUE;
+
+            pa_timeval_rtstore(&tv, pa_rtclock_now(), TRUE);
+            if (p->receive_event)
+                p->mainloop->time_restart(p->receive_event, &tv);
+            else
+                p->receive_event = p->mainloop->time_new(p->mainloop, &tv, receive_callback, p);
+
+            return 0;
+        }
+
+        d = read_destination(p, &l, &release_memblock);
+        n = PA_MIN(l, p->read.buffer_length - p->read.buffer_index);
+
+        memcpy(d, p->read.buffer + p->read.buffer_index, n);
+
+        if (release_memblock)
+            pa_memblock_release(release_memblock);
+
+        p->read.buffer_index += n;
+
+#ifdef HAVE_CREDS
+        p->read_creds_valid = p->read_creds_valid || p->read.buffer_creds_valid;
+#endif
+
+        if (frame_read(p, n) < 0)
+            return -1;
+    }
+
+    p->read.buffer_index = p->read.buffer_length = 0;
+    p->receive_deferred = FALSE;
+
+    return 0;
 }
 
 void pa_pstream_set_die_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->die_callback = cb;
     p->die_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_drain_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->drain_callback = cb;
     p->drain_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_receive_packet_callback(pa_pstream *p, pa_pstream_packet_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->receive_packet_callback = cb;
     p->receive_packet_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_receive_memblock_callback(pa_pstream *p, pa_pstream_memblock_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->receive_memblock_callback = cb;
     p->receive_memblock_callback_userdata = userdata;
+    pstream_unlock(p);
+}
+
+void pa_pstream_set_direct_memblock_callback(pa_pstream *p, uint32_t channel, pa_pstream_memblock_cb_t cb, void *userdata) {
+    struct direct_memblock *d;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    pstream_lock(p);
+
+    if (!cb)
+        pa_xfree(pa_hashmap_remove(p->direct_memblocks, PA_UINT32_TO_PTR(channel)));
+    else {
+        if (!(d = pa_hashmap_get(p->direct_memblocks, PA_UINT32_TO_PTR(channel)))) {
+            d = pa_xnew(struct direct_memblock, 1);
+            pa_assert_se(pa_hashmap_put(p->direct_memblocks, PA_UINT32_TO_PTR(channel), d) == 0);
+        }
+
+        d->callback = cb;
+        d->userdata = userdata;
+    }
+
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_release_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->release_callback = cb;
     p->release_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_revoke_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->release_callback = cb;
     p->release_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 pa_bool_t pa_pstream_is_pending(pa_pstream *p) {
@@ -951,10 +1383,14 @@ pa_bool_t pa_pstream_is_pending(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
+
     if (p->dead)
         b = FALSE;
     else
-        b = p->write.current || !pa_queue_isempty(p->send_queue);
+        b = p->write.n_frames > 0 || !pa_queue_isempty(p->send_queue);
+
+    pstream_unlock(p);
 
     return b;
 }
@@ -978,9 +1414,10 @@ pa_pstream* pa_pstream_ref(pa_pstream*p) {
 void pa_pstream_unlink(pa_pstream *p) {
     pa_assert(p);
 
-    if (p->dead)
-        return;
+    pstream_lock(p);
 
+    /* An I/O thread might have stopped the I/O already, so carry on
+     * even if we are dead */
     p->dead = TRUE;
 
     if (p->import) {
@@ -993,26 +1430,22 @@ void pa_pstream_unlink(pa_pstream *p) {
         p->export = NULL;
     }
 
-    if (p->io) {
-        pa_iochannel_free(p->io);
-        p->io = NULL;
-    }
-
-    if (p->defer_event) {
-        p->mainloop->defer_free(p->defer_event);
-        p->defer_event = NULL;
-    }
+    stop_io(p);
 
     p->die_callback = NULL;
     p->drain_callback = NULL;
     p->receive_packet_callback = NULL;
     p->receive_memblock_callback = NULL;
+
+    pstream_unlock(p);
 }
 
 void pa_pstream_enable_shm(pa_pstream *p, pa_bool_t enable) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
+
     p->use_shm = enable;
 
     if (enable) {
@@ -1027,11 +1460,114 @@ void pa_pstream_enable_shm(pa_pstream *p, pa_bool_t enable) {
             p->export = NULL;
         }
     }
+
+    pstream_unlock(p);
 }
 
 pa_bool_t pa_pstream_get_shm(pa_pstream *p) {
+    pa_bool_t b;
+
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    return p->use_shm;
+    pstream_lock(p);
+    b = p->use_shm;
+    pstream_unlock(p);
+
+    return b;
+}
+
+void pa_pstream_set_receive_budget(pa_pstream *p, unsigned n) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    pstream_lock(p);
+    p->receive_budget = n;
+    pstream_unlock(p);
+}
+
+uint64_t pa_pstream_get_deferred(pa_pstream *p) {
+    uint64_t n;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    pstream_lock(p);
+    n = p->n_deferred;
+    pstream_unlock(p);
+
+    return n;
+}
+
+pa_pstream* pa_pstream_new_threaded(pa_pstream_io_thread *t, pa_iochannel *io, pa_mempool *pool) {
+    pa_pstream *p;
+
+    pa_assert(t);
+    pa_assert(io);
+    pa_assert(pool);
+
+    /* Keep the thread from dispatching anything until we are done */
+    pa_mutex_lock(t->mutex);
+
+    pa_iochannel_set_mainloop_api(io, t->mainloop);
+    p = pa_pstream_new(t->mainloop, io, pool);
+    p->thread = t;
+
+    pa_mutex_unlock(t->mutex);
+
+    return p;
+}
+
+void pa_pstream_dispatch_event(pa_pstream_event *e) {
+    pa_pstream *p;
+
+    pa_assert(e);
+    pa_assert_se(p = e->pstream);
+
+    /* The callbacks are only ever changed from the main loop, under
+     * the lock. The I/O thread reads them too, in deliver_packet() and
+     * deliver_memblock(), but it holds the lock for that. So reading
+     * them here, in the main loop, needs no lock. */
+
+    switch (e->type) {
+        case PA_PSTREAM_EVENT_PACKET:
+            if (p->receive_packet_callback)
+#ifdef HAVE_CREDS
+                p->receive_packet_callback(p, e->packet, e->with_creds ? &e->creds : NULL, p->receive_packet_callback_userdata);
+#else
+                p->receive_packet_callback(p, e->packet, NULL, p->receive_packet_callback_userdata);
+#endif
+
+            pa_packet_unref(e->packet);
+            break;
+
+        case PA_PSTREAM_EVENT_MEMBLOCK:
+            if (p->receive_memblock_callback)
+                p->receive_memblock_callback(p, e->channel, e->offset, e->seek_mode, &e->chunk, p->receive_memblock_callback_userdata);
+
+            if (e->chunk.memblock)
+                pa_memblock_unref(e->chunk.memblock);
+            break;
+
+        case PA_PSTREAM_EVENT_DRAIN:
+            /* More might have been queued since */
+            if (p->drain_callback && !pa_pstream_is_pending(p))
+                p->drain_callback(p, p->drain_callback_userdata);
+            break;
+
+        case PA_PSTREAM_EVENT_DIE:
+            if (p->die_callback)
+                p->die_callback(p, p->die_callback_userdata);
+
+            pa_pstream_unlink(p);
+            break;
+    }
+
+    /* Only now that it is done with, blocks may go past the main loop
+     * again */
+    pa_atomic_dec(&p->n_posted);
+    pa_pstream_unref(p);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(events), e) < 0)
+        pa_xfree(e);
 }
@@ -33,17 +33,37 @@
 #include <pulsecore/iochannel.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/creds.h>
+#include <pulsecore/mutex.h>
 #include <pulsecore/macro.h>
 
 typedef struct pa_pstream pa_pstream;
+typedef struct pa_pstream_event pa_pstream_event;
+typedef struct pa_pstream_io_thread pa_pstream_io_thread;
 
 typedef void (*pa_pstream_packet_cb_t)(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata);
 typedef void (*pa_pstream_memblock_cb_t)(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata);
 typedef void (*pa_pstream_notify_cb_t)(pa_pstream *p, void *userdata);
 typedef void (*pa_pstream_block_id_cb_t)(pa_pstream *p, uint32_t block_id, void *userdata);
 
+/* A thread with a main loop of its own, in which pstreams can do their
+ * socket I/O, framing and memory block import. It holds the mutex
+ * whenever it isn't waiting for events. What the pstreams receive is
+ * handed to post(), which has to get it to the main loop and pass it
+ * to pa_pstream_dispatch_event() there. See pstream-thread-pool.h. */
+struct pa_pstream_io_thread {
+    pa_mainloop_api *mainloop;
+    pa_mutex *mutex; /* recursive */
+    void (*post)(pa_pstream_io_thread *t, pa_pstream_event *e);
+};
+
 pa_pstream* pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *p);
 
+/* Like pa_pstream_new(), but the channel is moved over to the thread
+ * and serviced from there. All functions are still to be called, and
+ * all callbacks are still made, in the main loop. */
+pa_pstream* pa_pstream_new_threaded(pa_pstream_io_thread *t, pa_iochannel *io, pa_mempool *p);
+void pa_pstream_dispatch_event(pa_pstream_event *e);
+
 pa_pstream* pa_pstream_ref(pa_pstream*p);
 void pa_pstream_unref(pa_pstream*p);
 
@@ -56,6 +76,14 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id);
 
 void pa_pstream_set_receive_packet_callback(pa_pstream *p, pa_pstream_packet_cb_t cb, void *userdata);
 void pa_pstream_set_receive_memblock_callback(pa_pstream *p, pa_pstream_memblock_cb_t cb, void *userdata);
+
+/* With an I/O thread, memory blocks for the channel are passed to cb
+ * right from that thread, with the pstream locked, instead of going
+ * through the main loop. That happens only while the main loop has
+ * nothing else from this pstream left to handle, so nothing gets
+ * reordered. Pass NULL to stop it, after which cb is not running
+ * anymore. */
+void pa_pstream_set_direct_memblock_callback(pa_pstream *p, uint32_t channel, pa_pstream_memblock_cb_t cb, void *userdata);
 void pa_pstream_set_drain_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void *userdata);
 void pa_pstream_set_die_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void *userdata);
 void pa_pstream_set_release_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata);
@@ -66,4 +94,14 @@ pa_bool_t pa_pstream_is_pending(pa_pstream *p);
 void pa_pstream_enable_shm(pa_pstream *p, pa_bool_t enable);
 pa_bool_t pa_pstream_get_shm(pa_pstream *p);
 
+/* Hand out at most n packets per main loop iteration, so that a peer
+ * flooding us with requests cannot hold up everybody else. 0, the
+ * default, means no limit. With an I/O thread this applies to the
+ * iterations of the thread's loop, the main loop still handles all the
+ * packets the thread passed on in one go. */
+void pa_pstream_set_receive_budget(pa_pstream *p, unsigned n);
+
+/* How many packets had to wait for a later iteration because of that */
+uint64_t pa_pstream_get_deferred(pa_pstream *p);
+
 #endif
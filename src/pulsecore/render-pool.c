@@ -0,0 +1,222 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/semaphore.h>
+#include <pulsecore/thread.h>
+
+#include "render-pool.h"
+
+#define RENDER_POOL_THREADS_MAX 16
+
+struct range {
+    pa_atomic_t next;
+    int end;
+};
+
+struct worker {
+    pa_render_pool *pool;
+    unsigned index;
+    pa_thread *thread;
+    pa_semaphore *wakeup;
+};
+
+struct pa_render_pool {
+    unsigned n_threads;
+    int realtime_priority;
+
+    struct worker workers[RENDER_POOL_THREADS_MAX];
+
+    /* One range per worker, plus one for the thread running the batch */
+    struct range ranges[RENDER_POOL_THREADS_MAX + 1];
+    unsigned n_ranges;
+
+    pa_mutex *mutex;
+    pa_semaphore *done;
+    pa_atomic_t active;
+    pa_bool_t quit;
+
+    /* The current batch */
+    pa_render_pool_job_cb_t cb;
+    uint8_t *jobs;
+    size_t job_size;
+    void *userdata;
+};
+
+static void work(pa_render_pool *p, unsigned own) {
+    unsigned i;
+
+    /* Start with our own range and then go on stealing from the
+     * others until everything has been claimed */
+    for (i = 0; i < p->n_ranges; i++) {
+        struct range *r = &p->ranges[(own + i) % p->n_ranges];
+        int k;
+
+        while ((k = pa_atomic_inc(&r->next)) < r->end)
+            p->cb(p->jobs + (size_t) k * p->job_size, p->userdata);
+    }
+}
+
+static void thread_func(void *userdata) {
+    struct worker *w = userdata;
+    pa_render_pool *p = w->pool;
+
+    if (p->realtime_priority > 0)
+        pa_make_realtime(p->realtime_priority);
+
+    for (;;) {
+        pa_semaphore_wait(w->wakeup);
+
+        if (p->quit)
+            break;
+
+        work(p, w->index + 1);
+
+        if (pa_atomic_dec(&p->active) == 1)
+            pa_semaphore_post(p->done);
+    }
+}
+
+pa_render_pool *pa_render_pool_new(unsigned n_threads, int realtime_priority) {
+    pa_render_pool *p;
+    unsigned i;
+
+    pa_assert(n_threads > 0);
+
+    if (n_threads > RENDER_POOL_THREADS_MAX)
+        n_threads = RENDER_POOL_THREADS_MAX;
+
+    p = pa_xnew0(pa_render_pool, 1);
+    p->realtime_priority = realtime_priority;
+    p->mutex = pa_mutex_new(FALSE, FALSE);
+    p->done = pa_semaphore_new(0);
+
+    for (i = 0; i < n_threads; i++) {
+        char name[16];
+        struct worker *w = &p->workers[i];
+
+        w->pool = p;
+        w->index = i;
+        w->wakeup = pa_semaphore_new(0);
+
+        pa_snprintf(name, sizeof(name), "render-%u", i);
+
+        if (!(w->thread = pa_thread_new(name, thread_func, w))) {
+            pa_log("Failed to create render thread.");
+            pa_semaphore_free(w->wakeup);
+            break;
+        }
+
+        p->n_threads++;
+    }
+
+    if (p->n_threads <= 0) {
+        pa_render_pool_free(p);
+        return NULL;
+    }
+
+    pa_log_info("Using %u threads for parallel rendering.", p->n_threads);
+
+    return p;
+}
+
+void pa_render_pool_free(pa_render_pool *p) {
+    unsigned i;
+
+    pa_assert(p);
+
+    p->quit = TRUE;
+
+    for (i = 0; i < p->n_threads; i++)
+        pa_semaphore_post(p->workers[i].wakeup);
+
+    for (i = 0; i < p->n_threads; i++) {
+        pa_thread_free(p->workers[i].thread);
+        pa_semaphore_free(p->workers[i].wakeup);
+    }
+
+    pa_semaphore_free(p->done);
+    pa_mutex_free(p->mutex);
+    pa_xfree(p);
+}
+
+unsigned pa_render_pool_get_n_threads(pa_render_pool *p) {
+    pa_assert(p);
+
+    return p->n_threads;
+}
+
+pa_bool_t pa_render_pool_run(pa_render_pool *p, pa_render_pool_job_cb_t cb, void *jobs, size_t job_size, unsigned n_jobs, void *userdata) {
+    unsigned i, n_wake, start;
+
+    pa_assert(p);
+    pa_assert(cb);
+    pa_assert(jobs);
+    pa_assert(job_size > 0);
+
+    if (n_jobs <= 0)
+        return TRUE;
+
+    /* Another IO thread is using the pool, don't wait for it */
+    if (!pa_mutex_try_lock(p->mutex))
+        return FALSE;
+
+    p->cb = cb;
+    p->jobs = jobs;
+    p->job_size = job_size;
+    p->userdata = userdata;
+
+    /* There's no point in waking up more threads than we have jobs */
+    n_wake = PA_MIN(p->n_threads, n_jobs - 1);
+    p->n_ranges = n_wake + 1;
+
+    for (i = 0, start = 0; i < p->n_ranges; i++) {
+        unsigned end = (unsigned) (((uint64_t) n_jobs * (i + 1)) / p->n_ranges);
+
+        pa_atomic_store(&p->ranges[i].next, (int) start);
+        p->ranges[i].end = (int) end;
+        start = end;
+    }
+
+    pa_atomic_store(&p->active, (int) n_wake);
+
+    for (i = 0; i < n_wake; i++)
+        pa_semaphore_post(p->workers[i].wakeup);
+
+    work(p, 0);
+
+    /* Wait until every worker we woke up is done, so that nobody
+     * touches the jobs array anymore after we return */
+    if (n_wake > 0)
+        pa_semaphore_wait(p->done);
+
+    pa_mutex_unlock(p->mutex);
+
+    return TRUE;
+}
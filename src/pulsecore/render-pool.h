@@ -0,0 +1,51 @@
+#ifndef foopulserenderpoolhfoo
+#define foopulserenderpoolhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <sys/types.h>
+
+#include <pulsecore/macro.h>
+
+/* A small pool of worker threads which IO threads may use to spread
+ * independent pieces of work of one render cycle over several CPUs.
+ * A batch of jobs is split into one range per participating thread,
+ * threads that run out of work steal from the other ranges. The
+ * calling thread takes part in the work itself and the call returns
+ * only after all jobs of the batch are done. */
+
+typedef struct pa_render_pool pa_render_pool;
+
+typedef void (*pa_render_pool_job_cb_t)(void *job, void *userdata);
+
+/* If realtime_priority is > 0 the worker threads try to acquire
+ * SCHED_FIFO with that priority, like the IO threads do */
+pa_render_pool *pa_render_pool_new(unsigned n_threads, int realtime_priority);
+void pa_render_pool_free(pa_render_pool *p);
+
+unsigned pa_render_pool_get_n_threads(pa_render_pool *p);
+
+/* Runs cb once for each of the n_jobs elements of the jobs array,
+ * which are job_size bytes each. Returns FALSE without running
+ * anything if the pool is currently busy with a batch of another
+ * thread, in which case the caller should do the work itself. */
+pa_bool_t pa_render_pool_run(pa_render_pool *p, pa_render_pool_job_cb_t cb, void *jobs, size_t job_size, unsigned n_jobs, void *userdata);
+
+#endif
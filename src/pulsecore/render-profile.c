@@ -0,0 +1,129 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <limits.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/strbuf.h>
+
+#include "render-profile.h"
+
+static const char* const metric_table[PA_RENDER_PROFILE_METRIC_MAX] = {
+    [PA_RENDER_PROFILE_WAKEUP_LATENESS] = "wakeup-lateness",
+    [PA_RENDER_PROFILE_PROCESS] = "process",
+    [PA_RENDER_PROFILE_STREAM] = "stream",
+    [PA_RENDER_PROFILE_DEVICE_IO] = "device-io",
+    [PA_RENDER_PROFILE_HEADROOM] = "headroom"
+};
+
+void pa_render_profile_init(pa_render_profile *p) {
+    pa_assert(p);
+
+    memset(p, 0, sizeof(*p));
+}
+
+static unsigned bucket_for(pa_usec_t usec) {
+    unsigned k = 0;
+
+    while (usec > 0 && k < PA_RENDER_PROFILE_BUCKETS - 1) {
+        usec >>= 1;
+        k++;
+    }
+
+    return k;
+}
+
+/* Called from IO context */
+void pa_render_profile_add(pa_render_profile *p, pa_render_profile_metric_t m, pa_usec_t usec) {
+    int v, old;
+
+    pa_assert(p);
+    pa_assert(m < PA_RENDER_PROFILE_METRIC_MAX);
+
+    pa_atomic_inc(&p->buckets[m][bucket_for(usec)]);
+
+    v = usec > INT_MAX ? INT_MAX : (int) usec;
+
+    while (v > (old = pa_atomic_load(&p->max[m])))
+        if (pa_atomic_cmpxchg(&p->max[m], old, v))
+            break;
+}
+
+const char *pa_render_profile_metric_to_string(pa_render_profile_metric_t m) {
+    pa_assert(m < PA_RENDER_PROFILE_METRIC_MAX);
+
+    return metric_table[m];
+}
+
+pa_usec_t pa_render_profile_get(const pa_render_profile *p, pa_render_profile_metric_t m, uint32_t *counts) {
+    unsigned k;
+
+    pa_assert(p);
+    pa_assert(m < PA_RENDER_PROFILE_METRIC_MAX);
+    pa_assert(counts);
+
+    for (k = 0; k < PA_RENDER_PROFILE_BUCKETS; k++)
+        counts[k] = (uint32_t) pa_atomic_load(&p->buckets[m][k]);
+
+    return (pa_usec_t) pa_atomic_load(&p->max[m]);
+}
+
+char *pa_render_profile_to_string(const pa_render_profile *p, const char *prefix) {
+    pa_strbuf *buf;
+    unsigned m, k;
+
+    pa_assert(p);
+    pa_assert(prefix);
+
+    buf = pa_strbuf_new();
+
+    for (m = 0; m < PA_RENDER_PROFILE_METRIC_MAX; m++) {
+        uint32_t counts[PA_RENDER_PROFILE_BUCKETS];
+        pa_usec_t max;
+        pa_bool_t any = FALSE;
+
+        max = pa_render_profile_get(p, m, counts);
+
+        for (k = 0; k < PA_RENDER_PROFILE_BUCKETS; k++) {
+            if (counts[k] <= 0)
+                continue;
+
+            if (!any)
+                pa_strbuf_printf(buf, "%s%s (max %llu usec):", prefix, metric_table[m], (unsigned long long) max);
+
+            /* Label the buckets with their lower bound */
+            if (k == 0)
+                pa_strbuf_printf(buf, " <1us=%u", counts[k]);
+            else
+                pa_strbuf_printf(buf, " %lluus=%u", 1ULL << (k-1), counts[k]);
+
+            any = TRUE;
+        }
+
+        if (any)
+            pa_strbuf_puts(buf, "\n");
+    }
+
+    return pa_strbuf_tostring_free(buf);
+}
@@ -0,0 +1,74 @@
+#ifndef foopulserenderprofilehfoo
+#define foopulserenderprofilehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+
+#include <pulsecore/atomic.h>
+
+/* Timing histograms for the IO thread of a sink or source. The IO
+ * thread (and the render pool workers acting on its behalf) add
+ * samples with a single atomic increment, the main thread may read
+ * them at any time without taking a lock. They are never reset,
+ * readers that want rates should take differences. */
+
+/* Bucket 0 counts values below 1 usec, bucket k values in
+ * [2^(k-1), 2^k) usec and the last bucket everything above */
+#define PA_RENDER_PROFILE_BUCKETS 20
+
+typedef enum pa_render_profile_metric {
+    /* How late the IO thread woke up after its timer elapsed */
+    PA_RENDER_PROFILE_WAKEUP_LATENESS,
+    /* One pa_sink_render() or pa_source_post() call */
+    PA_RENDER_PROFILE_PROCESS,
+    /* Peeking one sink input or pushing to one source output */
+    PA_RENDER_PROFILE_STREAM,
+    /* Handing data to or taking it from the device */
+    PA_RENDER_PROFILE_DEVICE_IO,
+    /* Audio left in the device buffer when we got to refill it, or
+     * room left in it when we got to empty it */
+    PA_RENDER_PROFILE_HEADROOM,
+    PA_RENDER_PROFILE_METRIC_MAX
+} pa_render_profile_metric_t;
+
+typedef struct pa_render_profile {
+    pa_atomic_t buckets[PA_RENDER_PROFILE_METRIC_MAX][PA_RENDER_PROFILE_BUCKETS];
+    pa_atomic_t max[PA_RENDER_PROFILE_METRIC_MAX];
+} pa_render_profile;
+
+void pa_render_profile_init(pa_render_profile *p);
+
+/* Called from IO context */
+void pa_render_profile_add(pa_render_profile *p, pa_render_profile_metric_t m, pa_usec_t usec);
+
+const char *pa_render_profile_metric_to_string(pa_render_profile_metric_t m);
+
+/* Copies the histogram of metric m to counts, which needs room for
+ * PA_RENDER_PROFILE_BUCKETS entries, and returns the largest value
+ * seen so far */
+pa_usec_t pa_render_profile_get(const pa_render_profile *p, pa_render_profile_metric_t m, uint32_t *counts);
+
+/* One line per metric which has seen samples, for the CLI */
+char *pa_render_profile_to_string(const pa_render_profile *p, const char *prefix);
+
+#endif
@@ -0,0 +1,87 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "request-sizing.h"
+
+/* By how much in percent minreq or tlength need to change for an
+ * adaptation to be worth telling the client */
+#define THRESHOLD_PERCENT 10
+
+static pa_bool_t changed_significantly(uint64_t old, uint64_t new) {
+    uint64_t d = new > old ? new - old : old - new;
+
+    return d * 100 > old * THRESHOLD_PERCENT;
+}
+
+pa_bool_t pa_request_sizing_adapt(const pa_request_sizing *r, pa_usec_t turnaround, pa_buffer_attr *a) {
+    const pa_sample_spec *ss;
+    pa_buffer_attr n;
+    uint32_t frame_size, min_minreq, max_minreq, min_tlength;
+
+    pa_assert(r);
+    pa_assert(a);
+
+    ss = &r->sample_spec;
+    frame_size = (uint32_t) pa_frame_size(ss);
+
+    /* Requests never get smaller than what the client explicitly asked
+     * for, or else than what the sink can make use of, nor larger than
+     * a quarter of the latency the client accepts */
+    if (r->minreq_requested)
+        min_minreq = r->base.minreq;
+    else
+        min_minreq = PA_MAX(frame_size, (uint32_t) pa_usec_to_bytes_round_up(r->min_request_usec, ss));
+
+    max_minreq = PA_MAX(r->base.minreq, (uint32_t) pa_frame_align(r->base.tlength / 4, ss));
+    min_minreq = PA_MIN(min_minreq, max_minreq);
+
+    n = *a;
+    n.minreq = (uint32_t) pa_usec_to_bytes_round_up(2 * turnaround, ss);
+    n.minreq = PA_CLAMP(n.minreq, min_minreq, max_minreq);
+
+    n.tlength = (uint32_t) pa_usec_to_bytes_round_up(r->sink_latency, ss) + 2 * n.minreq;
+    n.tlength = PA_MIN(n.tlength, r->base.tlength);
+
+    /* Whatever the client asked for, the sink may take max_request at
+     * once, and then we need two more requests to refill in time. If
+     * the sink already made us go beyond the client's limit for that
+     * (see sink_input_update_max_request_cb() in protocol-native.c),
+     * don't go back on it. */
+    min_tlength = (uint32_t) r->max_request + 2 * n.minreq;
+    if (a->tlength > r->base.tlength)
+        min_tlength = PA_MAX(min_tlength, a->tlength);
+
+    n.tlength = PA_MAX(n.tlength, min_tlength);
+    n.tlength = PA_MAX(n.tlength, n.minreq + frame_size);
+
+    n.prebuf = PA_MIN(r->base.prebuf, n.tlength + frame_size - n.minreq);
+
+    if (!changed_significantly(a->minreq, n.minreq) && !changed_significantly(a->tlength, n.tlength))
+        return FALSE;
+
+    *a = n;
+    return TRUE;
+}
@@ -0,0 +1,60 @@
+#ifndef foopulserequestsizinghfoo
+#define foopulserequestsizinghfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <pulse/def.h>
+#include <pulse/sample.h>
+
+#include <pulsecore/macro.h>
+
+/* Sizes the requests of an adjust latency playback stream after how
+ * long its client takes to answer them: minreq becomes twice that
+ * turnaround, so that fast clients get small requests and slow ones
+ * get to batch more, and tlength covers the sink latency plus two
+ * requests. */
+
+typedef struct pa_request_sizing {
+    pa_sample_spec sample_spec;
+
+    /* What the client asked for, after fixing up. tlength is the upper
+     * limit for the latency; minreq is the lower limit for requests if
+     * minreq_requested is set. */
+    pa_buffer_attr base;
+    pa_bool_t minreq_requested;
+
+    /* The smallest request worth making if the client didn't ask for
+     * a minreq, usually the sink's minimal latency */
+    pa_usec_t min_request_usec;
+
+    pa_usec_t sink_latency;
+
+    /* The largest request of the sink, in bytes of the stream. The
+     * memblockq always needs to hold that plus two requests. */
+    size_t max_request;
+} pa_request_sizing;
+
+/* Works out new buffer attributes for a client which answers requests
+ * within turnaround, starting from the current ones in a. Returns
+ * TRUE and updates a if minreq or tlength changed enough to be worth
+ * telling the client, FALSE otherwise. */
+pa_bool_t pa_request_sizing_adapt(const pa_request_sizing *r, pa_usec_t turnaround, pa_buffer_attr *a);
+
+#endif
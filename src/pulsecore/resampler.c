@@ -47,6 +47,32 @@
 /* Number of samples of extra space we allow the resamplers to return */
 #define EXTRA_FRAMES 128
 
+/* Number of block boundaries we remember the resampler state for, so
+ * that a rewind can continue from there instead of resetting */
+#define CHECKPOINTS_MAX 32
+
+/* Number of input frames we replay into resamplers whose filter state
+ * we cannot copy, in order to restore their history after a rewind */
+#define PRIME_FRAMES 256
+
+typedef struct checkpoint {
+    /* Position in frames since the last reset */
+    uint64_t in_pos;
+    uint64_t out_pos;
+
+    /* Copy of the state of the trivial and peaks resamplers */
+    unsigned o_counter;
+    unsigned i_counter;
+    float max_f[PA_CHANNELS_MAX];
+    int16_t max_i[PA_CHANNELS_MAX];
+
+    /* The last input frames in work format, for priming */
+    pa_memchunk history;
+
+    /* The block that followed, to get to a position within it */
+    pa_memchunk input;
+} checkpoint;
+
 struct pa_resampler {
     pa_resample_method_t method;
     pa_resample_flags_t flags;
@@ -79,6 +105,18 @@ struct pa_resampler {
     void (*impl_update_rates)(pa_resampler *r);
     void (*impl_resample)(pa_resampler *r, const pa_memchunk *in, unsigned in_samples, pa_memchunk *out, unsigned *out_samples);
     void (*impl_reset)(pa_resampler *r);
+    void (*impl_save)(pa_resampler *r, checkpoint *cp);
+    void (*impl_restore)(pa_resampler *r, const checkpoint *cp);
+
+    struct { /* checkpoints at block boundaries, used for rewinding */
+        bool enabled;
+        bool prime;
+        uint64_t in_pos;
+        uint64_t out_pos;
+        checkpoint cp[CHECKPOINTS_MAX];
+        unsigned idx, n;
+        pa_memchunk history;
+    } rewind;
 
     struct { /* data specific to the trivial resampler */
         unsigned o_counter;
@@ -124,6 +162,8 @@ static int libsamplerate_init(pa_resampler*r);
 #endif
 
 static void calc_map_table(pa_resampler *r);
+static void drop_checkpoints(pa_resampler *r);
+static void free_checkpoints(pa_resampler *r);
 
 static int (* const init_table[])(pa_resampler*r) = {
 #ifdef HAVE_LIBSAMPLERATE
@@ -343,6 +383,15 @@ pa_resampler* pa_resampler_new(
     if (init_table[method](r) < 0)
         goto fail;
 
+    /* Resamplers without internal state can always be rewound. For
+     * the others we either copy their state at block boundaries or,
+     * if that state is opaque, replay the last input frames into a
+     * freshly reset filter. */
+    if (!r->impl_resample || r->impl_restore)
+        r->rewind.enabled = true;
+    else if (r->impl_reset && r->method >= PA_RESAMPLER_SPEEX_FLOAT_BASE && r->method <= PA_RESAMPLER_SPEEX_FIXED_MAX)
+        r->rewind.enabled = r->rewind.prime = true;
+
     return r;
 
 fail:
@@ -366,6 +415,8 @@ void pa_resampler_free(pa_resampler *r) {
     if (r->from_work_format_buf.memblock)
         pa_memblock_unref(r->from_work_format_buf.memblock);
 
+    free_checkpoints(r);
+
     pa_xfree(r);
 }
 
@@ -379,6 +430,7 @@ void pa_resampler_set_input_rate(pa_resampler *r, uint32_t rate) {
     r->i_ss.rate = rate;
 
     r->impl_update_rates(r);
+    drop_checkpoints(r);
 }
 
 void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate) {
@@ -391,6 +443,7 @@ void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate) {
     r->o_ss.rate = rate;
 
     r->impl_update_rates(r);
+    drop_checkpoints(r);
 }
 
 size_t pa_resampler_request(pa_resampler *r, size_t out_length) {
@@ -460,6 +513,237 @@ void pa_resampler_reset(pa_resampler *r) {
         r->impl_reset(r);
 
     r->remap_buf_contains_leftover_data = false;
+
+    r->rewind.in_pos = r->rewind.out_pos = 0;
+    r->rewind.history.length = 0;
+    drop_checkpoints(r);
+}
+
+static void copy_history(pa_resampler *r, pa_memchunk *dst, const pa_memchunk *src) {
+    pa_assert(r);
+    pa_assert(dst);
+    pa_assert(src);
+
+    if (!dst->memblock) {
+        dst->index = 0;
+        dst->memblock = pa_memblock_new(r->mempool, PRIME_FRAMES * r->w_sz * r->work_channels);
+    }
+
+    dst->length = src->length;
+
+    if (src->length > 0) {
+        void *d, *s;
+
+        d = pa_memblock_acquire(dst->memblock);
+        s = pa_memblock_acquire(src->memblock);
+        memcpy(d, s, src->length);
+        pa_memblock_release(src->memblock);
+        pa_memblock_release(dst->memblock);
+    }
+}
+
+static void drop_input(checkpoint *cp) {
+    pa_assert(cp);
+
+    if (cp->input.memblock) {
+        pa_memblock_unref(cp->input.memblock);
+        pa_memchunk_reset(&cp->input);
+    }
+}
+
+static void drop_checkpoints(pa_resampler *r) {
+    unsigned i;
+
+    pa_assert(r);
+
+    for (i = 0; i < CHECKPOINTS_MAX; i++)
+        drop_input(&r->rewind.cp[i]);
+
+    r->rewind.n = 0;
+}
+
+static void free_checkpoints(pa_resampler *r) {
+    unsigned i;
+
+    pa_assert(r);
+
+    drop_checkpoints(r);
+
+    for (i = 0; i < CHECKPOINTS_MAX; i++)
+        if (r->rewind.cp[i].history.memblock)
+            pa_memblock_unref(r->rewind.cp[i].history.memblock);
+
+    if (r->rewind.history.memblock)
+        pa_memblock_unref(r->rewind.history.memblock);
+}
+
+static void save_checkpoint(pa_resampler *r, const pa_memchunk *in) {
+    checkpoint *cp;
+
+    pa_assert(r);
+    pa_assert(in);
+
+    /* Remember the state before the next block, overwriting the oldest
+     * checkpoint if we are out of slots */
+    cp = &r->rewind.cp[r->rewind.idx];
+    r->rewind.idx = (r->rewind.idx + 1) % CHECKPOINTS_MAX;
+
+    if (r->rewind.n < CHECKPOINTS_MAX)
+        r->rewind.n++;
+
+    cp->in_pos = r->rewind.in_pos;
+    cp->out_pos = r->rewind.out_pos;
+
+    /* Memory blocks don't change once handed out, a reference is as
+     * good as a copy */
+    drop_input(cp);
+    cp->input = *in;
+    pa_memblock_ref(cp->input.memblock);
+
+    if (r->impl_save)
+        r->impl_save(r, cp);
+    else if (r->rewind.prime)
+        copy_history(r, &cp->history, &r->rewind.history);
+}
+
+static void update_history(pa_resampler *r, const pa_memchunk *input) {
+    size_t fz, max, keep;
+    uint8_t *h, *s;
+
+    pa_assert(r);
+    pa_assert(input);
+
+    /* Keep the last PRIME_FRAMES frames of input of the filter */
+    fz = r->w_sz * r->work_channels;
+    max = PRIME_FRAMES * fz;
+
+    if (!r->rewind.history.memblock) {
+        r->rewind.history.index = r->rewind.history.length = 0;
+        r->rewind.history.memblock = pa_memblock_new(r->mempool, max);
+    }
+
+    h = pa_memblock_acquire(r->rewind.history.memblock);
+    s = pa_memblock_acquire_chunk(input);
+
+    if (input->length >= max) {
+        memcpy(h, s + input->length - max, max);
+        r->rewind.history.length = max;
+    } else {
+        keep = PA_MIN(r->rewind.history.length, max - input->length);
+        memmove(h, h + r->rewind.history.length - keep, keep);
+        memcpy(h + keep, s, input->length);
+        r->rewind.history.length = keep + input->length;
+    }
+
+    pa_memblock_release(input->memblock);
+    pa_memblock_release(r->rewind.history.memblock);
+}
+
+static void prime_filter(pa_resampler *r, const pa_memchunk *history) {
+    pa_memchunk out;
+    unsigned in_n_frames, out_n_frames;
+
+    pa_assert(r);
+    pa_assert(history);
+
+    r->impl_reset(r);
+
+    if (!history->length)
+        return;
+
+    in_n_frames = (unsigned) (history->length / (r->w_sz * r->work_channels));
+    out_n_frames = ((in_n_frames * r->o_ss.rate) / r->i_ss.rate) + EXTRA_FRAMES;
+
+    /* Run the history through the filter and throw the result away,
+     * we are only interested in the state it leaves behind */
+    out.index = 0;
+    out.length = out_n_frames * r->w_sz * r->work_channels;
+    out.memblock = pa_memblock_new(r->mempool, out.length);
+
+    r->impl_resample(r, history, in_n_frames, &out, &out_n_frames);
+
+    pa_memblock_unref(out.memblock);
+}
+
+size_t pa_resampler_rewind(pa_resampler *r, size_t in_length, size_t *out_length) {
+    uint64_t target, in_pos, out_pos, cp_in_pos;
+    checkpoint *cp = NULL;
+    pa_memchunk input;
+    unsigned i, k = 0;
+
+    pa_assert(r);
+    pa_assert(out_length);
+
+    in_pos = r->rewind.in_pos;
+    out_pos = r->rewind.out_pos;
+
+    target = in_length / r->i_fz;
+    target = target < in_pos ? in_pos - target : 0;
+
+    /* Walk from the newest checkpoint backwards to the first one at or
+     * before the requested position */
+    if (r->rewind.enabled)
+        for (i = 0; i < r->rewind.n; i++) {
+            k = (r->rewind.idx + CHECKPOINTS_MAX - 1 - i) % CHECKPOINTS_MAX;
+
+            if (r->rewind.cp[k].in_pos <= target) {
+                cp = &r->rewind.cp[k];
+                break;
+            }
+        }
+
+    if (!cp) {
+        /* We have nothing to go back to, so let's start afresh */
+        *out_length = pa_resampler_result(r, in_length);
+        pa_resampler_reset(r);
+        return in_length;
+    }
+
+    r->rewind.in_pos = cp_in_pos = cp->in_pos;
+    r->rewind.out_pos = cp->out_pos;
+
+    if (r->impl_restore)
+        r->impl_restore(r, cp);
+    else if (r->rewind.prime) {
+        prime_filter(r, &cp->history);
+        copy_history(r, &r->rewind.history, &cp->history);
+    }
+
+    /* The restored checkpoint describes the current state now and will
+     * be recorded again below or with the next block, anything newer
+     * is gone */
+    input = cp->input;
+    pa_memchunk_reset(&cp->input);
+
+    r->rewind.n -= i + 1;
+    r->rewind.idx = k;
+
+    for (; i > 0; i--)
+        drop_input(&r->rewind.cp[(k + i) % CHECKPOINTS_MAX]);
+
+    /* Run the block up to the requested position again. The caller
+     * already has that output, so it is thrown away. */
+    if (target > cp_in_pos) {
+        pa_memchunk part, out;
+
+        pa_assert(input.memblock);
+
+        part = input;
+        part.length = (size_t) (target - cp_in_pos) * r->i_fz;
+        pa_assert(part.length <= input.length);
+
+        pa_resampler_run(r, &part, &out);
+
+        if (out.memblock)
+            pa_memblock_unref(out.memblock);
+    }
+
+    if (input.memblock)
+        pa_memblock_unref(input.memblock);
+
+    *out_length = out_pos > r->rewind.out_pos ? (size_t) (out_pos - r->rewind.out_pos) * r->o_fz : 0;
+
+    return (size_t) (in_pos - r->rewind.in_pos) * r->i_fz;
 }
 
 pa_resample_method_t pa_resampler_get_method(pa_resampler *r) {
@@ -1170,6 +1454,9 @@ static pa_memchunk *resample(pa_resampler *r, pa_memchunk *input) {
     r->impl_resample(r, input, in_n_frames, &r->resample_buf, &out_n_frames);
     r->resample_buf.length = out_n_frames * r->w_sz * r->work_channels;
 
+    if (r->rewind.prime)
+        update_history(r, input);
+
     return &r->resample_buf;
 }
 
@@ -1219,6 +1506,9 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
     pa_assert(in->memblock);
     pa_assert(in->length % r->i_fz == 0);
 
+    if (r->rewind.enabled)
+        save_checkpoint(r, in);
+
     buf = (pa_memchunk*) in;
     buf = convert_to_work_format(r, buf);
     /* Try to save resampling effort: if we have more output channels than
@@ -1241,6 +1531,9 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
             pa_memchunk_reset(buf);
     } else
         pa_memchunk_reset(out);
+
+    r->rewind.in_pos += in->length / r->i_fz;
+    r->rewind.out_pos += out->length / r->o_fz;
 }
 
 static void save_leftover(pa_resampler *r, void *buf, size_t len) {
@@ -1490,6 +1783,22 @@ static void trivial_update_rates_or_reset(pa_resampler *r) {
     r->trivial.o_counter = 0;
 }
 
+static void trivial_save(pa_resampler *r, checkpoint *cp) {
+    pa_assert(r);
+    pa_assert(cp);
+
+    cp->i_counter = r->trivial.i_counter;
+    cp->o_counter = r->trivial.o_counter;
+}
+
+static void trivial_restore(pa_resampler *r, const checkpoint *cp) {
+    pa_assert(r);
+    pa_assert(cp);
+
+    r->trivial.i_counter = cp->i_counter;
+    r->trivial.o_counter = cp->o_counter;
+}
+
 static int trivial_init(pa_resampler*r) {
     pa_assert(r);
 
@@ -1498,6 +1807,8 @@ static int trivial_init(pa_resampler*r) {
     r->impl_resample = trivial_resample;
     r->impl_update_rates = trivial_update_rates_or_reset;
     r->impl_reset = trivial_update_rates_or_reset;
+    r->impl_save = trivial_save;
+    r->impl_restore = trivial_restore;
 
     return 0;
 }
@@ -1607,6 +1918,26 @@ static void peaks_update_rates_or_reset(pa_resampler *r) {
     r->peaks.o_counter = 0;
 }
 
+static void peaks_save(pa_resampler *r, checkpoint *cp) {
+    pa_assert(r);
+    pa_assert(cp);
+
+    cp->i_counter = r->peaks.i_counter;
+    cp->o_counter = r->peaks.o_counter;
+    memcpy(cp->max_i, r->peaks.max_i, sizeof(cp->max_i));
+    memcpy(cp->max_f, r->peaks.max_f, sizeof(cp->max_f));
+}
+
+static void peaks_restore(pa_resampler *r, const checkpoint *cp) {
+    pa_assert(r);
+    pa_assert(cp);
+
+    r->peaks.i_counter = cp->i_counter;
+    r->peaks.o_counter = cp->o_counter;
+    memcpy(r->peaks.max_i, cp->max_i, sizeof(r->peaks.max_i));
+    memcpy(r->peaks.max_f, cp->max_f, sizeof(r->peaks.max_f));
+}
+
 static int peaks_init(pa_resampler*r) {
     pa_assert(r);
     pa_assert(r->i_ss.rate >= r->o_ss.rate);
@@ -1619,6 +1950,8 @@ static int peaks_init(pa_resampler*r) {
     r->impl_resample = peaks_resample;
     r->impl_update_rates = peaks_update_rates_or_reset;
     r->impl_reset = peaks_update_rates_or_reset;
+    r->impl_save = peaks_save;
+    r->impl_restore = peaks_restore;
 
     return 0;
 }
@@ -87,6 +87,15 @@ void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate);
 /* Reinitialize state of the resampler, possibly due to seeking or other discontinuities */
 void pa_resampler_reset(pa_resampler *r);
 
+/* Go back by in_length bytes of already processed input, restoring the
+ * resampler state of the last block boundary before that and running
+ * the rest of that block again. Returns the amount of input rewound,
+ * which is less than in_length only if less was processed since the
+ * last reset, and stores the corresponding amount of output in
+ * *out_length. If no such state is known the resampler is reset, as
+ * with pa_resampler_reset(). */
+size_t pa_resampler_rewind(pa_resampler *r, size_t in_length, size_t *out_length);
+
 /* Return the resampling method of the resampler object */
 pa_resample_method_t pa_resampler_get_method(pa_resampler *r);
 
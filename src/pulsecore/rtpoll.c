@@ -29,6 +29,12 @@
 #include <string.h>
 #include <errno.h>
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
 
@@ -46,11 +52,43 @@
 
 /* #define DEBUG_TIMING */
 
+#ifdef USE_EPOLL
+/* epoll_event.data of the timerfd, all others carry their index into
+ * the pollfd array */
+#define EPOLL_TIMER_INDEX ((uint32_t) -1)
+#endif
+
+static pa_rtpoll_backend_t default_backend = PA_RTPOLL_BACKEND_POLL;
+
 struct pa_rtpoll {
     struct pollfd *pollfd, *pollfd2;
     unsigned n_pollfd_alloc, n_pollfd_used;
 
+    pa_rtpoll_backend_t backend;
+
+#ifdef USE_EPOLL
+    int epoll_fd, timer_fd;
+
+    /* What is currently registered with epoll_fd. Normally the pollfd
+     * array doesn't change between two iterations, and all we have to
+     * do is compare it with this copy. */
+    struct pollfd *epoll_registered;
+    unsigned n_epoll_registered, n_epoll_alloc;
+    struct epoll_event *epoll_events;
+
+    struct timeval timer_armed_at;
+    pa_bool_t timer_armed:1;
+    pa_bool_t epoll_usable:1;
+
+    /* Set whenever items come or go. An fd might have been closed and
+     * reopened under the same number meanwhile, in which case the
+     * kernel has dropped it from the epoll set, even though the pollfd
+     * array looks just like before. */
+    pa_bool_t epoll_dirty:1;
+#endif
+
     struct timeval next_elapse;
+    pa_usec_t timer_lateness;
     pa_bool_t timer_enabled:1;
 
     pa_bool_t scan_for_dead:1;
@@ -86,7 +124,98 @@ struct pa_rtpoll_item {
 
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
-pa_rtpoll *pa_rtpoll_new(void) {
+void pa_rtpoll_set_default_backend(pa_rtpoll_backend_t backend) {
+    pa_assert(backend == PA_RTPOLL_BACKEND_POLL || backend == PA_RTPOLL_BACKEND_EPOLL);
+
+    default_backend = backend;
+}
+
+pa_rtpoll_backend_t pa_rtpoll_get_default_backend(void) {
+    return default_backend;
+}
+
+const char *pa_rtpoll_backend_to_string(pa_rtpoll_backend_t backend) {
+    switch (backend) {
+        case PA_RTPOLL_BACKEND_POLL:
+            return "poll";
+        case PA_RTPOLL_BACKEND_EPOLL:
+            return "epoll";
+    }
+
+    return NULL;
+}
+
+int pa_rtpoll_backend_from_string(const char *s) {
+    pa_assert(s);
+
+    if (pa_streq(s, "poll"))
+        return PA_RTPOLL_BACKEND_POLL;
+    if (pa_streq(s, "epoll"))
+        return PA_RTPOLL_BACKEND_EPOLL;
+
+    return -1;
+}
+
+pa_bool_t pa_rtpoll_backend_supported(pa_rtpoll_backend_t backend) {
+#ifdef USE_EPOLL
+    return backend == PA_RTPOLL_BACKEND_POLL || backend == PA_RTPOLL_BACKEND_EPOLL;
+#else
+    return backend == PA_RTPOLL_BACKEND_POLL;
+#endif
+}
+
+#ifdef USE_EPOLL
+static int epoll_init(pa_rtpoll *p) {
+    struct epoll_event ev;
+
+    if ((p->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        pa_log_warn("epoll_create1() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    if ((p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK)) < 0) {
+        pa_log_warn("timerfd_create() failed: %s", pa_cstrerror(errno));
+        pa_close(p->epoll_fd);
+        p->epoll_fd = -1;
+        return -1;
+    }
+
+    pa_zero(ev);
+    ev.events = EPOLLIN;
+    ev.data.u32 = EPOLL_TIMER_INDEX;
+
+    if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->timer_fd, &ev) < 0) {
+        pa_log_warn("Failed to add timerfd to epoll: %s", pa_cstrerror(errno));
+        pa_close(p->timer_fd);
+        pa_close(p->epoll_fd);
+        p->timer_fd = p->epoll_fd = -1;
+        return -1;
+    }
+
+    p->n_epoll_alloc = 32;
+    p->epoll_registered = pa_xnew(struct pollfd, p->n_epoll_alloc);
+    p->epoll_events = pa_xnew(struct epoll_event, p->n_epoll_alloc + 1);
+    p->n_epoll_registered = 0;
+    p->epoll_usable = TRUE;
+    p->epoll_dirty = TRUE;
+    p->timer_armed = FALSE;
+
+    return 0;
+}
+
+static void epoll_done(pa_rtpoll *p) {
+    if (p->timer_fd >= 0)
+        pa_close(p->timer_fd);
+
+    if (p->epoll_fd >= 0)
+        pa_close(p->epoll_fd);
+
+    pa_xfree(p->epoll_registered);
+    pa_xfree(p->epoll_events);
+}
+#endif
+
+pa_rtpoll *pa_rtpoll_new_with_backend(pa_rtpoll_backend_t backend) {
     pa_rtpoll *p;
 
     p = pa_xnew0(pa_rtpoll, 1);
@@ -95,6 +224,20 @@ pa_rtpoll *pa_rtpoll_new(void) {
     p->pollfd = pa_xnew(struct pollfd, p->n_pollfd_alloc);
     p->pollfd2 = pa_xnew(struct pollfd, p->n_pollfd_alloc);
 
+    p->backend = PA_RTPOLL_BACKEND_POLL;
+
+#ifdef USE_EPOLL
+    p->epoll_fd = p->timer_fd = -1;
+
+    if (backend == PA_RTPOLL_BACKEND_EPOLL && epoll_init(p) >= 0)
+        p->backend = PA_RTPOLL_BACKEND_EPOLL;
+#endif
+
+    if (p->backend != backend)
+        pa_log_debug("rtpoll backend %s not available, falling back to %s.",
+                     pa_rtpoll_backend_to_string(backend),
+                     pa_rtpoll_backend_to_string(p->backend));
+
 #ifdef DEBUG_TIMING
     p->timestamp = pa_rtclock_now();
 #endif
@@ -102,6 +245,16 @@ pa_rtpoll *pa_rtpoll_new(void) {
     return p;
 }
 
+pa_rtpoll *pa_rtpoll_new(void) {
+    return pa_rtpoll_new_with_backend(default_backend);
+}
+
+pa_rtpoll_backend_t pa_rtpoll_get_backend(pa_rtpoll *p) {
+    pa_assert(p);
+
+    return p->backend;
+}
+
 static void rtpoll_rebuild(pa_rtpoll *p) {
 
     struct pollfd *e, *t;
@@ -112,6 +265,10 @@ static void rtpoll_rebuild(pa_rtpoll *p) {
 
     p->rebuild_needed = FALSE;
 
+#ifdef USE_EPOLL
+    p->epoll_dirty = TRUE;
+#endif
+
     if (p->n_pollfd_used > p->n_pollfd_alloc) {
         /* Hmm, we have to allocate some more space */
         p->n_pollfd_alloc = p->n_pollfd_used * 2;
@@ -162,6 +319,10 @@ static void rtpoll_item_destroy(pa_rtpoll_item *i) {
         pa_xfree(i);
 
     p->rebuild_needed = TRUE;
+
+#ifdef USE_EPOLL
+    p->epoll_dirty = TRUE;
+#endif
 }
 
 void pa_rtpoll_free(pa_rtpoll *p) {
@@ -173,6 +334,11 @@ void pa_rtpoll_free(pa_rtpoll *p) {
     pa_xfree(p->pollfd);
     pa_xfree(p->pollfd2);
 
+#ifdef USE_EPOLL
+    if (p->backend == PA_RTPOLL_BACKEND_EPOLL)
+        epoll_done(p);
+#endif
+
     pa_xfree(p);
 }
 
@@ -203,6 +369,133 @@ static void reset_all_revents(pa_rtpoll *p) {
     }
 }
 
+#ifdef USE_EPOLL
+/* Makes sure the fds registered with epoll match the pollfd array.
+ * Returns FALSE if the current set of fds can't be handled by epoll
+ * (i.e. the same fd is listed twice, or it refers to a regular file),
+ * in which case we fall back to ppoll() for as long as it doesn't
+ * change. */
+static pa_bool_t epoll_sync(pa_rtpoll *p) {
+    unsigned k;
+
+    if (!p->epoll_dirty && p->n_epoll_registered == p->n_pollfd_used) {
+        for (k = 0; k < p->n_pollfd_used; k++)
+            if (p->epoll_registered[k].fd != p->pollfd[k].fd ||
+                p->epoll_registered[k].events != p->pollfd[k].events)
+                break;
+
+        if (k >= p->n_pollfd_used)
+            return p->epoll_usable;
+    }
+
+    /* Something changed, start from scratch. Fds that have been closed
+     * in the meantime have already been dropped by the kernel, hence
+     * we ignore errors here. */
+    for (k = 0; k < p->n_epoll_registered; k++)
+        if (p->epoll_registered[k].fd >= 0)
+            epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, p->epoll_registered[k].fd, NULL);
+
+    if (p->n_pollfd_used > p->n_epoll_alloc) {
+        p->n_epoll_alloc = p->n_pollfd_used * 2;
+        p->epoll_registered = pa_xrealloc(p->epoll_registered, p->n_epoll_alloc * sizeof(struct pollfd));
+        p->epoll_events = pa_xrealloc(p->epoll_events, (p->n_epoll_alloc + 1) * sizeof(struct epoll_event));
+    }
+
+    memcpy(p->epoll_registered, p->pollfd, p->n_pollfd_used * sizeof(struct pollfd));
+    p->n_epoll_registered = p->n_pollfd_used;
+    p->epoll_usable = TRUE;
+    p->epoll_dirty = FALSE;
+
+    for (k = 0; k < p->n_pollfd_used; k++) {
+        struct epoll_event ev;
+
+        /* Like poll() we ignore negative fds */
+        if (p->pollfd[k].fd < 0)
+            continue;
+
+        pa_zero(ev);
+        ev.events = (uint32_t) p->pollfd[k].events;
+        ev.data.u32 = k;
+
+        if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->pollfd[k].fd, &ev) < 0) {
+            pa_log_debug("Can't use epoll for fd %i (%s), falling back to ppoll().", p->pollfd[k].fd, pa_cstrerror(errno));
+            p->epoll_usable = FALSE;
+            break;
+        }
+    }
+
+    return p->epoll_usable;
+}
+
+static void epoll_set_timer(pa_rtpoll *p, pa_bool_t enable) {
+    struct itimerspec its;
+    uint64_t expirations;
+
+    if (enable && p->timer_armed && pa_timeval_cmp(&p->timer_armed_at, &p->next_elapse) == 0)
+        return;
+
+    if (!enable && !p->timer_armed)
+        return;
+
+    /* Drop a pending expiration of the old deadline, so that it
+     * doesn't wake us up for the new one */
+    if (p->timer_armed)
+        (void) read(p->timer_fd, &expirations, sizeof(expirations));
+
+    pa_zero(its);
+
+    if (enable) {
+        /* Our clock is CLOCK_MONOTONIC, too, so we can program the
+         * deadline as it is, without any rounding */
+        its.it_value.tv_sec = p->next_elapse.tv_sec;
+        its.it_value.tv_nsec = p->next_elapse.tv_usec * PA_NSEC_PER_USEC;
+
+        /* An all zero value would disarm the timer */
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+            its.it_value.tv_nsec = 1;
+    }
+
+    pa_assert_se(timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0);
+
+    p->timer_armed = enable;
+    p->timer_armed_at = p->next_elapse;
+}
+
+static int epoll_run(pa_rtpoll *p, pa_bool_t block) {
+    int r, k, n;
+
+    epoll_set_timer(p, block && p->timer_enabled);
+
+    r = epoll_wait(p->epoll_fd, p->epoll_events, (int) p->n_pollfd_used + 1, block ? -1 : 0);
+
+    if (r < 0)
+        return r;
+
+    for (k = 0; k < (int) p->n_pollfd_used; k++)
+        p->pollfd[k].revents = 0;
+
+    for (n = 0, k = 0; k < r; k++) {
+        uint32_t idx = p->epoll_events[k].data.u32;
+
+        if (idx == EPOLL_TIMER_INDEX) {
+            uint64_t expirations;
+
+            (void) read(p->timer_fd, &expirations, sizeof(expirations));
+            p->timer_armed = FALSE;
+            continue;
+        }
+
+        pa_assert(idx < p->n_pollfd_used);
+
+        /* On Linux the EPOLL* and POLL* flags are identical */
+        p->pollfd[idx].revents = (short) (p->epoll_events[k].events & 0xFFFF);
+        n++;
+    }
+
+    return n;
+}
+#endif
+
 int pa_rtpoll_run(pa_rtpoll *p, pa_bool_t wait_op) {
     pa_rtpoll_item *i;
     int r = 0;
@@ -217,6 +510,7 @@ int pa_rtpoll_run(pa_rtpoll *p, pa_bool_t wait_op) {
 
     p->running = TRUE;
     p->timer_elapsed = FALSE;
+    p->timer_lateness = 0;
 
     /* First, let's do some work */
     for (i = p->items; i && i->priority < PA_RTPOLL_NEVER; i = i->next) {
@@ -306,6 +600,11 @@ int pa_rtpoll_run(pa_rtpoll *p, pa_bool_t wait_op) {
 #endif
 
     /* OK, now let's sleep */
+#ifdef USE_EPOLL
+    if (p->backend == PA_RTPOLL_BACKEND_EPOLL && epoll_sync(p))
+        r = epoll_run(p, wait_op && !p->quit);
+    else
+#endif
 #ifdef HAVE_PPOLL
     {
         struct timespec ts;
@@ -319,6 +618,14 @@ int pa_rtpoll_run(pa_rtpoll *p, pa_bool_t wait_op) {
 
     p->timer_elapsed = r == 0;
 
+    if (p->timer_elapsed && wait_op && p->timer_enabled) {
+        struct timeval now;
+        pa_rtclock_get(&now);
+
+        if (pa_timeval_cmp(&now, &p->next_elapse) > 0)
+            p->timer_lateness = pa_timeval_diff(&now, &p->next_elapse);
+    }
+
 #ifdef DEBUG_TIMING
     {
         pa_usec_t now = pa_rtclock_now();
@@ -428,6 +735,10 @@ pa_rtpoll_item *pa_rtpoll_item_new(pa_rtpoll *p, pa_rtpoll_priority_t prio, unsi
     if (n_fds > 0) {
         p->rebuild_needed = 1;
         p->n_pollfd_used += n_fds;
+
+#ifdef USE_EPOLL
+        p->epoll_dirty = TRUE;
+#endif
     }
 
     return i;
@@ -636,3 +947,9 @@ pa_bool_t pa_rtpoll_timer_elapsed(pa_rtpoll *p) {
 
     return p->timer_elapsed;
 }
+
+pa_usec_t pa_rtpoll_get_timer_lateness(pa_rtpoll *p) {
+    pa_assert(p);
+
+    return p->timer_lateness;
+}
@@ -53,9 +53,29 @@ typedef enum pa_rtpoll_priority {
     PA_RTPOLL_NEVER  = INT_MAX,       /* For stuff that doesn't register any callbacks, but only fds to listen on */
 } pa_rtpoll_priority_t;
 
+/* How pa_rtpoll_run() sleeps. The epoll backend keeps the fds
+ * registered between iterations and sleeps on a timerfd armed with the
+ * absolute deadline. It is only available on Linux. */
+typedef enum pa_rtpoll_backend {
+    PA_RTPOLL_BACKEND_POLL,
+    PA_RTPOLL_BACKEND_EPOLL
+} pa_rtpoll_backend_t;
+
+/* The backend used by pa_rtpoll_new(), set once at startup */
+void pa_rtpoll_set_default_backend(pa_rtpoll_backend_t backend);
+pa_rtpoll_backend_t pa_rtpoll_get_default_backend(void);
+
+const char *pa_rtpoll_backend_to_string(pa_rtpoll_backend_t backend);
+int pa_rtpoll_backend_from_string(const char *s);
+pa_bool_t pa_rtpoll_backend_supported(pa_rtpoll_backend_t backend);
+
 pa_rtpoll *pa_rtpoll_new(void);
+/* Falls back to the poll backend if the requested one isn't available */
+pa_rtpoll *pa_rtpoll_new_with_backend(pa_rtpoll_backend_t backend);
 void pa_rtpoll_free(pa_rtpoll *p);
 
+pa_rtpoll_backend_t pa_rtpoll_get_backend(pa_rtpoll *p);
+
 /* Sleep on the rtpoll until the time event, or any of the fd events
  * is triggered. If "wait" is 0 we don't sleep but only update the
  * struct pollfd. Returns negative on error, positive if the loop
@@ -71,6 +91,10 @@ void pa_rtpoll_set_timer_disabled(pa_rtpoll *p);
  * the last pa_rtpoll_run() invocation to finish */
 pa_bool_t pa_rtpoll_timer_elapsed(pa_rtpoll *p);
 
+/* If the elapsed timer ended the last pa_rtpoll_run() invocation,
+ * returns how long after the requested time we woke up, otherwise 0 */
+pa_usec_t pa_rtpoll_get_timer_lateness(pa_rtpoll *p);
+
 /* A new fd wakeup item for pa_rtpoll */
 pa_rtpoll_item *pa_rtpoll_item_new(pa_rtpoll *p, pa_rtpoll_priority_t prio, unsigned n_fds);
 void pa_rtpoll_item_free(pa_rtpoll_item *i);
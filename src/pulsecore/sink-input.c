@@ -547,6 +547,8 @@ int pa_sink_input_new(
     i->thread_info.underrun_for = (uint64_t) -1;
     i->thread_info.underrun_for_sink = 0;
     i->thread_info.playing_for = 0;
+
+    pa_render_profile_init(&i->render_profile);
     i->thread_info.direct_outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
 
     pa_assert_se(pa_idxset_put(core->sink_inputs, i, &i->index) == 0);
@@ -1075,12 +1077,20 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
     }
 
     if (i->thread_info.rewrite_nbytes == (size_t) -1) {
+        size_t dropped;
 
         /* We were asked to drop all buffered data, and rerequest new
          * data from implementor the next time peek() is called */
 
+        dropped = pa_memblockq_get_length(i->thread_info.render_memblockq);
         pa_memblockq_flush_write(i->thread_info.render_memblockq, TRUE);
 
+        /* Silence we handed out in what was dropped is going to be
+         * counted again when peek() finds nothing to play. A plain
+         * rewind replays it from the render queue without counting it
+         * again, so the counter is only corrected here and below. */
+        i->thread_info.underrun_for_sink -= PA_MIN(i->thread_info.underrun_for_sink, (uint64_t) dropped);
+
     } else if (i->thread_info.rewrite_nbytes > 0) {
         size_t max_rewrite, amount;
 
@@ -1095,6 +1105,15 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
         amount = PA_MIN(i->thread_info.rewrite_nbytes, max_rewrite);
 
         if (amount > 0) {
+            size_t samount = amount;
+
+            /* Move the resampler back to where the implementor is going
+             * to continue from. That keeps its filter state instead of
+             * resetting it, and tells us exactly how much to rewind in
+             * the sink domain. */
+            if (i->thread_info.resampler)
+                amount = pa_resampler_rewind(i->thread_info.resampler, amount, &samount);
+
             pa_log_debug("Have to rewind %lu bytes on implementor.", (unsigned long) amount);
 
             /* Tell the implementor */
@@ -1102,20 +1121,23 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
                 i->process_rewind(i, amount);
             called = TRUE;
 
-            /* Convert back to to sink domain */
-            if (i->thread_info.resampler)
-                amount = pa_resampler_result(i->thread_info.resampler, amount);
-
-            if (amount > 0)
+            if (samount > 0) {
                 /* Ok, now update the write pointer */
-                pa_memblockq_seek(i->thread_info.render_memblockq, - ((int64_t) amount), PA_SEEK_RELATIVE, TRUE);
+                pa_memblockq_seek(i->thread_info.render_memblockq, - ((int64_t) samount), PA_SEEK_RELATIVE, TRUE);
+
+                /* Whatever is rendered past the write pointer again
+                 * is counted again */
+                i->thread_info.underrun_for_sink -= PA_MIN(i->thread_info.underrun_for_sink, (uint64_t) samount);
+            }
 
-            if (i->thread_info.rewrite_flush)
+            if (i->thread_info.rewrite_flush) {
                 pa_memblockq_silence(i->thread_info.render_memblockq);
 
-            /* And reset the resampler */
-            if (i->thread_info.resampler)
-                pa_resampler_reset(i->thread_info.resampler);
+                /* The data that follows is unrelated to what the
+                 * resampler has seen so far */
+                if (i->thread_info.resampler)
+                    pa_resampler_reset(i->thread_info.resampler);
+            }
         }
     }
 
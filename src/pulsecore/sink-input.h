@@ -30,6 +30,7 @@ typedef struct pa_sink_input pa_sink_input;
 #include <pulse/sample.h>
 #include <pulse/format.h>
 #include <pulsecore/memblockq.h>
+#include <pulsecore/render-profile.h>
 #include <pulsecore/resampler.h>
 #include <pulsecore/module.h>
 #include <pulsecore/client.h>
@@ -126,6 +127,10 @@ struct pa_sink_input {
 
     pa_resample_method_t requested_resample_method, actual_resample_method;
 
+    /* How long peeking this stream takes, filled in from the IO
+     * thread and the render pool workers, may be read from anywhere */
+    pa_render_profile render_profile;
+
     /* Returns the chunk of audio data and drops it from the
      * queue. Returns -1 on failure. Called from IO thread context. If
      * data needs to be generated from scratch then please in the
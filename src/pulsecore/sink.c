@@ -57,6 +57,15 @@
 #define ABSOLUTE_MAX_LATENCY (10*PA_USEC_PER_SEC)
 #define DEFAULT_FIXED_LATENCY (250*PA_USEC_PER_MSEC)
 
+/* Inputs are peeked by the render workers once peeking all of them
+ * in the IO thread would take up more than this share of the time
+ * left until the device runs dry */
+#define PARALLEL_RENDER_BUDGET_DIVISOR 4
+
+/* Rewind requests coming in this soon after a rewind may be held back
+ * and merged, see pa_sink_defer_rewind() */
+#define REWIND_COALESCE_USEC (5*PA_USEC_PER_MSEC)
+
 PA_DEFINE_PUBLIC_CLASS(pa_sink, pa_msgobject);
 
 struct pa_sink_volume_change {
@@ -318,6 +327,8 @@ pa_sink* pa_sink_new(
     s->save_volume = data->save_volume;
     s->save_muted = data->save_muted;
 
+    pa_render_profile_init(&s->render_profile);
+
     pa_silence_memchunk_get(
             &core->silence_cache,
             core->mempool,
@@ -332,8 +343,12 @@ pa_sink* pa_sink_new(
     s->thread_info.state = s->state;
     s->thread_info.rewind_nbytes = 0;
     s->thread_info.rewind_requested = FALSE;
+    s->thread_info.rewind_not_before = 0;
+    memset(&s->thread_info.rewind_stats, 0, sizeof(s->thread_info.rewind_stats));
     s->thread_info.max_rewind = 0;
     s->thread_info.max_request = 0;
+    s->thread_info.render_headroom = 0;
+    s->thread_info.render_cost = 0;
     s->thread_info.requested_latency_valid = FALSE;
     s->thread_info.requested_latency = 0;
     s->thread_info.min_latency = ABSOLUTE_MIN_LATENCY;
@@ -985,6 +1000,10 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
         pa_log_debug("Processing rewind...");
         if (s->flags & PA_SINK_DEFERRED_VOLUME)
             pa_sink_volume_change_rewind(s, nbytes);
+
+        s->thread_info.rewind_stats.rewinds++;
+        s->thread_info.rewind_stats.bytes += nbytes;
+        s->thread_info.rewind_not_before = pa_rtclock_now() + REWIND_COALESCE_USEC;
     }
 
     PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
@@ -998,21 +1017,197 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     }
 }
 
+/* Called from IO thread context */
+pa_bool_t pa_sink_defer_rewind(pa_sink *s, pa_usec_t next_wakeup, pa_usec_t *wait_usec) {
+    pa_usec_t now;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+    pa_assert(wait_usec);
+
+    if (!s->thread_info.rewind_requested)
+        return FALSE;
+
+    /* Only hold back requests that come in right after a rewind, the
+     * first one of a burst is processed right away */
+    now = pa_rtclock_now();
+
+    if (now >= s->thread_info.rewind_not_before ||
+        s->thread_info.rewind_not_before >= next_wakeup)
+        return FALSE;
+
+    *wait_usec = s->thread_info.rewind_not_before - now;
+    return TRUE;
+}
+
+struct peek_job {
+    pa_sink_input *input;
+    pa_memchunk chunk;
+    pa_cvolume volume;
+    pa_usec_t usec;
+};
+
+struct peek_batch {
+    pa_sink *sink;
+    pa_thread_mq *thread_mq;
+    size_t length;
+};
+
+/* Called from IO thread context or from a render pool worker */
+static void peek_job_cb(void *job, void *userdata) {
+    struct peek_job *j = job;
+    struct peek_batch *b = userdata;
+    pa_thread_mq *q;
+    pa_usec_t t;
+
+    /* Workers act on behalf of the IO thread of the sink while they
+     * are peeking, so that the inputs find the right message queues */
+    if (!(q = pa_thread_mq_get()))
+        pa_thread_mq_install(b->thread_mq);
+
+    t = pa_rtclock_now();
+    pa_sink_input_peek(j->input, b->length, &j->chunk, &j->volume);
+    j->usec = pa_rtclock_now() - t;
+    pa_render_profile_add(&b->sink->render_profile, PA_RENDER_PROFILE_STREAM, j->usec);
+    pa_render_profile_add(&j->input->render_profile, PA_RENDER_PROFILE_STREAM, j->usec);
+
+    if (!q)
+        pa_thread_mq_uninstall(b->thread_mq);
+}
+
+/* Called from IO thread context */
+static void update_render_cost(pa_sink *s, pa_usec_t usec) {
+
+    /* A moving average, so that single slow cycles don't flip us
+     * back and forth */
+    s->thread_info.render_cost = (7 * s->thread_info.render_cost + usec) / 8;
+}
+
+/* Called from IO thread context. Whether the inputs should be peeked
+ * by the render workers this cycle: that pays off when doing it all in
+ * the IO thread would eat a large share of the time until the device
+ * runs dry, but isn't worth waking up the workers otherwise. */
+static pa_bool_t use_parallel_render(pa_sink *s, unsigned maxinfo) {
+    unsigned n_inputs;
+    pa_usec_t budget;
+
+    if (!s->core->render_pool)
+        return FALSE;
+
+    n_inputs = pa_hashmap_size(s->thread_info.inputs);
+    if (n_inputs < 2 || n_inputs > maxinfo)
+        return FALSE;
+
+    /* Drivers that don't tell us what is left in the device are
+     * assumed to keep it filled up to the latency */
+    if ((budget = s->thread_info.render_headroom) <= 0)
+        if ((budget = pa_sink_get_requested_latency_within_thread(s)) == (pa_usec_t) -1)
+            budget = s->thread_info.max_latency;
+
+    return s->thread_info.render_cost * PARALLEL_RENDER_BUDGET_DIVISOR > budget;
+}
+
+/* Called from IO thread context */
+static unsigned fill_mix_info_parallel(pa_sink *s, size_t *length, pa_mix_info *info) {
+    struct peek_job jobs[MAX_MIX_CHANNELS];
+    struct peek_batch batch;
+    pa_sink_input *i;
+    unsigned k, n = 0, n_jobs = 0, n_serial;
+    void *state;
+    size_t mixlength = *length;
+    pa_usec_t cost = 0;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+    pa_assert(info);
+    pa_assert(pa_hashmap_size(s->thread_info.inputs) <= MAX_MIX_CHANNELS);
+
+    batch.sink = s;
+    batch.thread_mq = pa_thread_mq_get();
+    batch.length = *length;
+
+    /* Inputs of filter sinks render their own sink when peeked, and
+     * that may touch our state too. Hence we peek them here before
+     * the workers are started. */
+    PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
+        pa_sink_input_assert_ref(i);
+
+        if (!i->origin_sink)
+            continue;
+
+        jobs[n_jobs].input = i;
+        peek_job_cb(&jobs[n_jobs++], &batch);
+    }
+
+    n_serial = n_jobs;
+
+    PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state)
+        if (!i->origin_sink)
+            jobs[n_jobs++].input = i;
+
+    /* If another sink is using the workers right now we do it all
+     * ourselves, instead of waiting for them */
+    if (!pa_render_pool_run(s->core->render_pool, peek_job_cb, jobs + n_serial, sizeof(struct peek_job), n_jobs - n_serial, &batch))
+        for (k = n_serial; k < n_jobs; k++)
+            peek_job_cb(&jobs[k], &batch);
+
+    for (k = 0; k < n_jobs; k++) {
+
+        cost += jobs[k].usec;
+
+        if (mixlength == 0 || jobs[k].chunk.length < mixlength)
+            mixlength = jobs[k].chunk.length;
+
+        if (pa_memblock_is_silence(jobs[k].chunk.memblock)) {
+            pa_memblock_unref(jobs[k].chunk.memblock);
+            continue;
+        }
+
+        info->chunk = jobs[k].chunk;
+        info->volume = jobs[k].volume;
+        info->userdata = pa_sink_input_ref(jobs[k].input);
+
+        pa_assert(info->chunk.memblock);
+        pa_assert(info->chunk.length > 0);
+
+        info++;
+        n++;
+    }
+
+    update_render_cost(s, cost);
+
+    if (mixlength > 0)
+        *length = mixlength;
+
+    return n;
+}
+
 /* Called from IO thread context */
 static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, unsigned maxinfo) {
     pa_sink_input *i;
     unsigned n = 0;
     void *state = NULL;
     size_t mixlength = *length;
+    pa_usec_t cost = 0;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
     pa_assert(info);
 
+    if (use_parallel_render(s, maxinfo))
+        return fill_mix_info_parallel(s, length, info);
+
     while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL)) && maxinfo > 0) {
+        pa_usec_t t;
+
         pa_sink_input_assert_ref(i);
 
+        t = pa_rtclock_now();
         pa_sink_input_peek(i, *length, &info->chunk, &info->volume);
+        t = pa_rtclock_now() - t;
+        cost += t;
+        pa_render_profile_add(&s->render_profile, PA_RENDER_PROFILE_STREAM, t);
+        pa_render_profile_add(&i->render_profile, PA_RENDER_PROFILE_STREAM, t);
 
         if (mixlength == 0 || info->chunk.length < mixlength)
             mixlength = info->chunk.length;
@@ -1032,6 +1227,8 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
         maxinfo--;
     }
 
+    update_render_cost(s, cost);
+
     if (mixlength > 0)
         *length = mixlength;
 
@@ -1140,6 +1337,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
     size_t block_size_max;
+    pa_usec_t t;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1158,6 +1356,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     }
 
     pa_sink_ref(s);
+    t = pa_rtclock_now();
 
     if (length <= 0)
         length = pa_frame_align(MIX_BUFFER_LENGTH, &s->sample_spec);
@@ -1217,6 +1416,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     inputs_drop(s, info, n, result);
 
+    pa_render_profile_add(&s->render_profile, PA_RENDER_PROFILE_PROCESS, pa_rtclock_now() - t);
     pa_sink_unref(s);
 }
 
@@ -1225,6 +1425,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
     size_t length, block_size_max;
+    pa_usec_t t;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1243,6 +1444,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
     }
 
     pa_sink_ref(s);
+    t = pa_rtclock_now();
 
     length = target->length;
     block_size_max = pa_mempool_block_size_max(s->core->mempool);
@@ -1272,18 +1474,17 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
             pa_memchunk vchunk;
 
             vchunk = info[0].chunk;
-            pa_memblock_ref(vchunk.memblock);
 
             if (vchunk.length > length)
                 vchunk.length = length;
 
-            if (!pa_cvolume_is_norm(&volume)) {
-                pa_memchunk_make_writable(&vchunk, 0);
-                pa_volume_memchunk(&vchunk, &s->sample_spec, &volume);
-            }
-
+            /* Copy first and adjust the volume right in the target,
+             * there's no need for an intermediate writable copy of
+             * the input's data */
             pa_memchunk_memcpy(target, &vchunk);
-            pa_memblock_unref(vchunk.memblock);
+
+            if (!pa_cvolume_is_norm(&volume))
+                pa_volume_memchunk(target, &s->sample_spec, &volume);
         }
 
     } else {
@@ -1302,6 +1503,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     inputs_drop(s, info, n, target);
 
+    pa_render_profile_add(&s->render_profile, PA_RENDER_PROFILE_PROCESS, pa_rtclock_now() - t);
     pa_sink_unref(s);
 }
 
@@ -1377,6 +1579,39 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
     pa_sink_unref(s);
 }
 
+/* Called from IO thread context */
+void pa_sink_render_filtered(pa_sink *s, size_t length, size_t max_block, pa_sink_filter_cb_t cb, void *userdata, pa_memchunk *result) {
+    uint8_t *d;
+    size_t done, n;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+    pa_assert(pa_frame_aligned(max_block, &s->sample_spec));
+    pa_assert(cb);
+    pa_assert(result);
+
+    pa_sink_render(s, length, result);
+
+    /* Blocks we got from a single input or from the silence cache are
+     * shared, everything we mixed ourselves can be modified as is. The
+     * render queue of a single input keeps its block for rewinding, so
+     * that one is copied rather than filtered behind the queue's back. */
+    pa_memchunk_make_writable(result, 0);
+
+    d = pa_memblock_acquire_chunk(result);
+
+    for (done = 0; done < result->length; done += n) {
+        n = result->length - done;
+
+        if (max_block > 0 && n > max_block)
+            n = max_block;
+
+        cb(s, d + done, n, userdata);
+    }
+
+    pa_memblock_release(result->memblock);
+}
+
 /* Called from main thread */
 pa_bool_t pa_sink_update_rate(pa_sink *s, uint32_t rate, pa_bool_t passthrough)
 {
@@ -2510,6 +2745,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
 
         case PA_SINK_MESSAGE_REMOVE_INPUT: {
             pa_sink_input *i = PA_SINK_INPUT(userdata);
+            pa_bool_t rewind = FALSE;
 
             /* If you change anything here, make sure to change the
              * sink input handling a few lines down at
@@ -2540,11 +2776,21 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
                 i->thread_info.sync_next = NULL;
             }
 
+            /* Rewinding only helps if some of what the stream
+             * played is still within reach. If it never played, or
+             * ran dry longer ago than we could rewind, it would just
+             * render the same audio again. */
+            if (i->thread_info.underrun_for != (uint64_t) -1 &&
+                i->thread_info.underrun_for_sink < s->thread_info.max_rewind)
+                rewind = TRUE;
+
             if (pa_hashmap_remove(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index)))
                 pa_sink_input_unref(i);
 
             pa_sink_invalidate_requested_latency(s, TRUE);
-            pa_sink_request_rewind(s, (size_t) -1);
+
+            if (rewind)
+                pa_sink_request_rewind(s, (size_t) -1);
 
             /* In flat volume mode we need to update the volume as
              * well */
@@ -2853,6 +3099,11 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             *((size_t*) userdata) = s->thread_info.max_request;
             return 0;
 
+        case PA_SINK_MESSAGE_GET_REWIND_STATS:
+
+            *((pa_sink_rewind_stats*) userdata) = s->thread_info.rewind_stats;
+            return 0;
+
         case PA_SINK_MESSAGE_SET_MAX_REWIND:
 
             pa_sink_set_max_rewind_within_thread(s, (size_t) offset);
@@ -2979,6 +3230,8 @@ void pa_sink_request_rewind(pa_sink*s, size_t nbytes) {
 
     nbytes = PA_MIN(nbytes, s->thread_info.max_rewind);
 
+    s->thread_info.rewind_stats.requests++;
+
     if (s->thread_info.rewind_requested &&
         nbytes <= s->thread_info.rewind_nbytes)
         return;
@@ -3077,6 +3330,14 @@ void pa_sink_set_max_rewind(pa_sink *s, size_t max_rewind) {
         pa_sink_set_max_rewind_within_thread(s, max_rewind);
 }
 
+/* Called from IO context */
+void pa_sink_set_render_headroom_within_thread(pa_sink *s, pa_usec_t usec) {
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    s->thread_info.render_headroom = usec;
+}
+
 /* Called from IO as well as the main thread -- the latter only before the IO thread started up */
 void pa_sink_set_max_request_within_thread(pa_sink *s, size_t max_request) {
     void *state = NULL;
@@ -3327,6 +3588,20 @@ size_t pa_sink_get_max_rewind(pa_sink *s) {
     return r;
 }
 
+/* Called from main context */
+void pa_sink_get_rewind_stats(pa_sink *s, pa_sink_rewind_stats *stats) {
+    pa_assert_ctl_context();
+    pa_sink_assert_ref(s);
+    pa_assert(stats);
+
+    if (!PA_SINK_IS_LINKED(s->state)) {
+        *stats = s->thread_info.rewind_stats;
+        return;
+    }
+
+    pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_GET_REWIND_STATS, stats, 0, NULL) == 0);
+}
+
 /* Called from main context */
 size_t pa_sink_get_max_request(pa_sink *s) {
     size_t r;
@@ -42,6 +42,7 @@ typedef struct pa_sink_volume_change pa_sink_volume_change;
 #include <pulsecore/asyncmsgq.h>
 #include <pulsecore/msgobject.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/render-profile.h>
 #include <pulsecore/device-port.h>
 #include <pulsecore/card.h>
 #include <pulsecore/queue.h>
@@ -58,6 +59,12 @@ static inline pa_bool_t PA_SINK_IS_LINKED(pa_sink_state_t x) {
 /* A generic definition for void callback functions */
 typedef void(*pa_sink_cb_t)(pa_sink *s);
 
+typedef struct pa_sink_rewind_stats {
+    uint64_t requests; /* pa_sink_request_rewind() calls */
+    uint64_t rewinds;  /* rewinds actually processed */
+    uint64_t bytes;    /* bytes rewound in total */
+} pa_sink_rewind_stats;
+
 struct pa_sink {
     pa_msgobject parent;
 
@@ -118,6 +125,9 @@ struct pa_sink {
 
     unsigned priority;
 
+    /* Filled in from the IO thread, may be read from anywhere */
+    pa_render_profile render_profile;
+
     /* Called when the main loop requests a state change. Called from
      * main loop context. If returns -1 the state change will be
      * inhibited */
@@ -257,10 +267,25 @@ struct pa_sink {
          * every DMA write request */
         size_t max_request;
 
+        /* What was left in the device when the driver last got to
+         * render, 0 if it doesn't know, and a moving average of how
+         * long peeking all inputs takes. Used to decide whether to
+         * render in parallel. */
+        pa_usec_t render_headroom;
+        pa_usec_t render_cost;
+
         /* Maximum of what clients requested to rewind in this cycle */
         size_t rewind_nbytes;
         pa_bool_t rewind_requested;
 
+        /* Rewinds requested before this time may be held back by
+         * pa_sink_defer_rewind() so that they are merged */
+        pa_usec_t rewind_not_before;
+
+        /* Counters, may be read from the main thread with
+         * pa_sink_get_rewind_stats() */
+        pa_sink_rewind_stats rewind_stats;
+
         /* Both dynamic and fixed latencies will be clamped to this
          * range. */
         pa_usec_t min_latency; /* we won't go below this latency */
@@ -324,6 +349,7 @@ typedef enum pa_sink_message {
     PA_SINK_MESSAGE_SET_PORT,
     PA_SINK_MESSAGE_UPDATE_VOLUME_AND_MUTE,
     PA_SINK_MESSAGE_SET_LATENCY_OFFSET,
+    PA_SINK_MESSAGE_GET_REWIND_STATS,
     PA_SINK_MESSAGE_MAX
 } pa_sink_message_t;
 
@@ -423,6 +449,8 @@ pa_usec_t pa_sink_get_fixed_latency(pa_sink *s);
 size_t pa_sink_get_max_rewind(pa_sink *s);
 size_t pa_sink_get_max_request(pa_sink *s);
 
+void pa_sink_get_rewind_stats(pa_sink *s, pa_sink_rewind_stats *stats);
+
 int pa_sink_update_status(pa_sink*s);
 int pa_sink_suspend(pa_sink *s, pa_bool_t suspend, pa_suspend_cause_t cause);
 int pa_sink_suspend_all(pa_core *c, pa_bool_t suspend, pa_suspend_cause_t cause);
@@ -473,8 +501,36 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result);
 void pa_sink_render_into(pa_sink*s, pa_memchunk *target);
 void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target);
 
+/* For filter sinks which process their audio in place and don't keep
+ * any of it buffered themselves. Renders like pa_sink_render() and
+ * runs cb on the result, in pieces of at most max_block bytes if
+ * max_block is not 0. Without a queue of their own, stacked filters
+ * can pass rewinds straight through to their master.
+ *
+ * The rendered block is copied if anyone else still holds a reference
+ * to it. With a single input, which is what every filter in a stack
+ * has, that is always the case: the render queue of the input keeps
+ * the block for rewinding, and must keep it unfiltered. So a filter
+ * still copies once per render; what goes away is its own queue.
+ *
+ * This does not fuse a stack of filters into one chain: every filter
+ * is still a sink with a sink input on the next one, rendered in turn
+ * when its master pulls from it. Filters which need fixed block sizes,
+ * like module-equalizer-sink, keep their own queue and use
+ * pa_sink_render_full() instead. */
+typedef void (*pa_sink_filter_cb_t)(pa_sink *s, void *data, size_t length, void *userdata);
+void pa_sink_render_filtered(pa_sink *s, size_t length, size_t max_block, pa_sink_filter_cb_t cb, void *userdata, pa_memchunk *result);
+
 void pa_sink_process_rewind(pa_sink *s, size_t nbytes);
 
+/* For sinks which keep enough audio buffered to be able to wait a
+ * little before acting on a rewind request. Returns TRUE if the
+ * pending request should be held back so that requests coming in
+ * shortly after can be merged into the same rewind, and sets
+ * *wait_usec to when to look again. Rewinds are never held back past
+ * next_wakeup, the time the sink needs to refill its buffer anyway. */
+pa_bool_t pa_sink_defer_rewind(pa_sink *s, pa_usec_t next_wakeup, pa_usec_t *wait_usec);
+
 int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk);
 
 void pa_sink_attach_within_thread(pa_sink *s);
@@ -484,6 +540,7 @@ pa_usec_t pa_sink_get_requested_latency_within_thread(pa_sink *s);
 
 void pa_sink_set_max_rewind_within_thread(pa_sink *s, size_t max_rewind);
 void pa_sink_set_max_request_within_thread(pa_sink *s, size_t max_request);
+void pa_sink_set_render_headroom_within_thread(pa_sink *s, pa_usec_t usec);
 
 void pa_sink_set_latency_range_within_thread(pa_sink *s, pa_usec_t min_latency, pa_usec_t max_latency);
 void pa_sink_set_fixed_latency_within_thread(pa_sink *s, pa_usec_t latency);
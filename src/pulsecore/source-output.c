@@ -712,6 +712,34 @@ pa_usec_t pa_source_output_get_latency(pa_source_output *o, pa_usec_t *source_la
     return r[0];
 }
 
+/* Called from thread context */
+static void adjust_volume(pa_source_output *o, pa_memchunk *chunk, const pa_cvolume *volume, pa_bool_t muted) {
+    pa_memchunk in;
+
+    /* Other outputs of the same source might have already done the
+     * very same conversion of the very same data during this post */
+    if (pa_source_post_cache_get(o->source, chunk, volume, muted, &in)) {
+        pa_memblock_unref(chunk->memblock);
+        *chunk = in;
+        return;
+    }
+
+    in = *chunk;
+    pa_memblock_ref(in.memblock);
+
+    pa_memchunk_make_writable(chunk, 0);
+
+    if (muted)
+        pa_silence_memchunk(chunk, &o->source->sample_spec);
+    else
+        pa_volume_memchunk(chunk, &o->source->sample_spec, volume);
+
+    o->source->thread_info.converted_bytes += chunk->length;
+
+    pa_source_post_cache_put(o->source, &in, volume, muted, chunk);
+    pa_memblock_unref(in.memblock);
+}
+
 /* Called from thread context */
 void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
     pa_bool_t need_volume_factor_source;
@@ -775,10 +803,9 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
 
         /* It might be necessary to adjust the volume here */
         if (!volume_is_norm) {
-            pa_memchunk_make_writable(&qchunk, 0);
 
             if (o->thread_info.muted) {
-                pa_silence_memchunk(&qchunk, &o->source->sample_spec);
+                adjust_volume(o, &qchunk, &o->thread_info.soft_volume, TRUE);
                 nvfs = FALSE;
 
             } else if (!o->thread_info.resampler && nvfs) {
@@ -788,18 +815,16 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
                  * post and the pre volume adjustment into one */
 
                 pa_sw_cvolume_multiply(&v, &o->thread_info.soft_volume, &o->volume_factor_source);
-                pa_volume_memchunk(&qchunk, &o->source->sample_spec, &v);
+                adjust_volume(o, &qchunk, &v, FALSE);
                 nvfs = FALSE;
 
             } else
-                pa_volume_memchunk(&qchunk, &o->source->sample_spec, &o->thread_info.soft_volume);
+                adjust_volume(o, &qchunk, &o->thread_info.soft_volume, FALSE);
         }
 
         if (!o->thread_info.resampler) {
-            if (nvfs) {
-                pa_memchunk_make_writable(&qchunk, 0);
-                pa_volume_memchunk(&qchunk, &o->thread_info.sample_spec, &o->volume_factor_source);
-            }
+            if (nvfs)
+                adjust_volume(o, &qchunk, &o->volume_factor_source, FALSE);
 
             o->push(o, &qchunk);
         } else {
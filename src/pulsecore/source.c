@@ -305,6 +305,8 @@ pa_source* pa_source_new(
     s->save_volume = data->save_volume;
     s->save_muted = data->save_muted;
 
+    pa_render_profile_init(&s->render_profile);
+
     pa_silence_memchunk_get(
             &core->silence_cache,
             core->mempool,
@@ -330,6 +332,10 @@ pa_source* pa_source_new(
     s->thread_info.volume_change_safety_margin = core->deferred_volume_safety_margin_usec;
     s->thread_info.volume_change_extra_delay = core->deferred_volume_extra_delay_usec;
     s->thread_info.latency_offset = s->latency_offset;
+    s->thread_info.post_cache.active = FALSE;
+    s->thread_info.post_cache.n_entries = 0;
+    s->thread_info.delivered_bytes = 0;
+    s->thread_info.converted_bytes = 0;
 
     /* FIXME: This should probably be moved to pa_source_put() */
     pa_assert_se(pa_idxset_put(core->sources, s, &s->index) >= 0);
@@ -895,10 +901,127 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
 }
 
 /* Called from IO thread context */
-void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
+static void post_cache_flush(pa_source *s) {
+    unsigned i;
+
+    for (i = 0; i < s->thread_info.post_cache.n_entries; i++) {
+        pa_source_post_cache_entry *e = &s->thread_info.post_cache.entries[i];
+
+        pa_memblock_unref(e->in.memblock);
+        pa_memblock_unref(e->out.memblock);
+    }
+
+    s->thread_info.post_cache.n_entries = 0;
+    s->thread_info.post_cache.active = FALSE;
+}
+
+/* Called from IO thread context, by source outputs */
+pa_bool_t pa_source_post_cache_get(pa_source *s, const pa_memchunk *in, const pa_cvolume *volume, pa_bool_t muted, pa_memchunk *out) {
+    unsigned i;
+
+    pa_source_assert_ref(s);
+    pa_assert(in);
+    pa_assert(volume);
+    pa_assert(out);
+
+    if (!s->thread_info.post_cache.active)
+        return FALSE;
+
+    for (i = 0; i < s->thread_info.post_cache.n_entries; i++) {
+        pa_source_post_cache_entry *e = &s->thread_info.post_cache.entries[i];
+
+        if (e->in.memblock != in->memblock ||
+            e->in.index != in->index ||
+            e->in.length != in->length ||
+            e->muted != muted)
+            continue;
+
+        if (!muted && !pa_cvolume_equal(&e->volume, volume))
+            continue;
+
+        *out = e->out;
+        pa_memblock_ref(out->memblock);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Called from IO thread context, by source outputs */
+void pa_source_post_cache_put(pa_source *s, const pa_memchunk *in, const pa_cvolume *volume, pa_bool_t muted, const pa_memchunk *out) {
+    pa_source_post_cache_entry *e;
+
+    pa_source_assert_ref(s);
+    pa_assert(in);
+    pa_assert(volume);
+    pa_assert(out);
+
+    if (!s->thread_info.post_cache.active ||
+        s->thread_info.post_cache.n_entries >= PA_SOURCE_POST_CACHE_MAX)
+        return;
+
+    e = &s->thread_info.post_cache.entries[s->thread_info.post_cache.n_entries++];
+
+    /* We keep a reference to the input block too, so that its address
+     * cannot be reused for different data while we're posting */
+    e->in = *in;
+    pa_memblock_ref(e->in.memblock);
+    e->volume = *volume;
+    e->muted = muted;
+    e->out = *out;
+    pa_memblock_ref(e->out.memblock);
+}
+
+/* Called from IO thread context */
+static void post_to_outputs(pa_source *s, const pa_memchunk *chunk) {
     pa_source_output *o;
     void *state = NULL;
 
+    /* Outputs that see the same data at the same volume share the
+     * volume-adjusted copy, there's no point in that with just one
+     * output */
+    s->thread_info.post_cache.active = pa_hashmap_size(s->thread_info.outputs) > 1;
+
+    while ((o = pa_hashmap_iterate(s->thread_info.outputs, &state, NULL))) {
+        pa_usec_t t;
+
+        pa_source_output_assert_ref(o);
+
+        if (o->thread_info.direct_on_input)
+            continue;
+
+        t = pa_rtclock_now();
+        pa_source_output_push(o, chunk);
+        pa_render_profile_add(&s->render_profile, PA_RENDER_PROFILE_STREAM, pa_rtclock_now() - t);
+
+        s->thread_info.delivered_bytes += chunk->length;
+    }
+
+    post_cache_flush(s);
+}
+
+/* Called from IO thread context. Hands out the shared silence block
+ * instead of copying the recorded data just to overwrite it. */
+static void post_silence(pa_source *s, pa_source_output *o, size_t length) {
+    while (length > 0) {
+        pa_memchunk schunk = s->silence;
+
+        if (schunk.length > length)
+            schunk.length = length;
+
+        if (o)
+            pa_source_output_push(o, &schunk);
+        else
+            post_to_outputs(s, &schunk);
+
+        length -= schunk.length;
+    }
+}
+
+/* Called from IO thread context */
+void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
+    pa_usec_t t;
+
     pa_source_assert_ref(s);
     pa_source_assert_io_context(s);
     pa_assert(PA_SOURCE_IS_LINKED(s->thread_info.state));
@@ -907,34 +1030,26 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     if (s->thread_info.state == PA_SOURCE_SUSPENDED)
         return;
 
-    if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
+    t = pa_rtclock_now();
+
+    if (s->thread_info.soft_muted || pa_cvolume_is_muted(&s->thread_info.soft_volume))
+        post_silence(s, NULL, chunk->length);
+    else if (!pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
         pa_memchunk vchunk = *chunk;
 
         pa_memblock_ref(vchunk.memblock);
         pa_memchunk_make_writable(&vchunk, 0);
+        pa_volume_memchunk(&vchunk, &s->sample_spec, &s->thread_info.soft_volume);
 
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&s->thread_info.soft_volume))
-            pa_silence_memchunk(&vchunk, &s->sample_spec);
-        else
-            pa_volume_memchunk(&vchunk, &s->sample_spec, &s->thread_info.soft_volume);
+        s->thread_info.converted_bytes += vchunk.length;
 
-        while ((o = pa_hashmap_iterate(s->thread_info.outputs, &state, NULL))) {
-            pa_source_output_assert_ref(o);
-
-            if (!o->thread_info.direct_on_input)
-                pa_source_output_push(o, &vchunk);
-        }
+        post_to_outputs(s, &vchunk);
 
         pa_memblock_unref(vchunk.memblock);
-    } else {
-
-        while ((o = pa_hashmap_iterate(s->thread_info.outputs, &state, NULL))) {
-            pa_source_output_assert_ref(o);
+    } else
+        post_to_outputs(s, chunk);
 
-            if (!o->thread_info.direct_on_input)
-                pa_source_output_push(o, chunk);
-        }
-    }
+    pa_render_profile_add(&s->render_profile, PA_RENDER_PROFILE_PROCESS, pa_rtclock_now() - t);
 }
 
 /* Called from IO thread context */
@@ -949,22 +1064,24 @@ void pa_source_post_direct(pa_source*s, pa_source_output *o, const pa_memchunk *
     if (s->thread_info.state == PA_SOURCE_SUSPENDED)
         return;
 
-    if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
+    if (s->thread_info.soft_muted || pa_cvolume_is_muted(&s->thread_info.soft_volume))
+        post_silence(s, o, chunk->length);
+    else if (!pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
         pa_memchunk vchunk = *chunk;
 
         pa_memblock_ref(vchunk.memblock);
         pa_memchunk_make_writable(&vchunk, 0);
+        pa_volume_memchunk(&vchunk, &s->sample_spec, &s->thread_info.soft_volume);
 
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&s->thread_info.soft_volume))
-            pa_silence_memchunk(&vchunk, &s->sample_spec);
-        else
-            pa_volume_memchunk(&vchunk, &s->sample_spec, &s->thread_info.soft_volume);
+        s->thread_info.converted_bytes += vchunk.length;
 
         pa_source_output_push(o, &vchunk);
 
         pa_memblock_unref(vchunk.memblock);
     } else
         pa_source_output_push(o, chunk);
+
+    s->thread_info.delivered_bytes += chunk->length;
 }
 
 /* Called from main thread */
@@ -2175,6 +2292,14 @@ int pa_source_process_msg(pa_msgobject *object, int code, void *userdata, int64_
             *((size_t*) userdata) = s->thread_info.max_rewind;
             return 0;
 
+        case PA_SOURCE_MESSAGE_GET_POST_STATS: {
+            uint64_t *stats = userdata;
+
+            stats[0] = s->thread_info.delivered_bytes;
+            stats[1] = s->thread_info.converted_bytes;
+            return 0;
+        }
+
         case PA_SOURCE_MESSAGE_SET_MAX_REWIND:
 
             pa_source_set_max_rewind_within_thread(s, (size_t) offset);
@@ -2582,6 +2707,25 @@ size_t pa_source_get_max_rewind(pa_source *s) {
     return r;
 }
 
+/* Called from main context */
+void pa_source_get_post_stats(pa_source *s, uint64_t *delivered, uint64_t *converted) {
+    uint64_t stats[2];
+
+    pa_assert_ctl_context();
+    pa_source_assert_ref(s);
+    pa_assert(delivered);
+    pa_assert(converted);
+
+    if (!PA_SOURCE_IS_LINKED(s->state)) {
+        stats[0] = s->thread_info.delivered_bytes;
+        stats[1] = s->thread_info.converted_bytes;
+    } else
+        pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SOURCE_MESSAGE_GET_POST_STATS, stats, 0, NULL) == 0);
+
+    *delivered = stats[0];
+    *converted = stats[1];
+}
+
 /* Called from main context */
 int pa_source_set_port(pa_source *s, const char *name, pa_bool_t save) {
     pa_device_port *port;
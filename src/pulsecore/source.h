@@ -42,6 +42,7 @@ typedef struct pa_source_volume_change pa_source_volume_change;
 #include <pulsecore/asyncmsgq.h>
 #include <pulsecore/msgobject.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/render-profile.h>
 #include <pulsecore/card.h>
 #include <pulsecore/device-port.h>
 #include <pulsecore/queue.h>
@@ -50,6 +51,17 @@ typedef struct pa_source_volume_change pa_source_volume_change;
 
 #define PA_MAX_OUTPUTS_PER_SOURCE 32
 
+/* How many distinct volume-adjusted chunks are shared between the
+ * outputs during a single pa_source_post() */
+#define PA_SOURCE_POST_CACHE_MAX 8
+
+typedef struct pa_source_post_cache_entry {
+    pa_memchunk in;
+    pa_cvolume volume;
+    pa_bool_t muted;
+    pa_memchunk out;
+} pa_source_post_cache_entry;
+
 /* Returns true if source is linked: registered and accessible from client side. */
 static inline pa_bool_t PA_SOURCE_IS_LINKED(pa_source_state_t x) {
     return x == PA_SOURCE_RUNNING || x == PA_SOURCE_IDLE || x == PA_SOURCE_SUSPENDED;
@@ -118,6 +130,9 @@ struct pa_source {
 
     unsigned priority;
 
+    /* Filled in from the IO thread, may be read from anywhere */
+    pa_render_profile render_profile;
+
     /* Called when the main loop requests a state change. Called from
      * main loop context. If returns -1 the state change will be
      * inhibited */
@@ -229,6 +244,20 @@ struct pa_source {
         uint32_t volume_change_safety_margin;
         /* Usec delay added to all volume change events, may be negative. */
         int32_t volume_change_extra_delay;
+
+        /* Volume-adjusted chunks created by the outputs during the
+         * current pa_source_post(), so that outputs reading the same
+         * data at the same volume can share a single copy. */
+        struct {
+            pa_bool_t active;
+            unsigned n_entries;
+            pa_source_post_cache_entry entries[PA_SOURCE_POST_CACHE_MAX];
+        } post_cache;
+
+        /* Bytes handed to outputs vs. bytes that actually had to be
+         * volume-adjusted on the way */
+        uint64_t delivered_bytes;
+        uint64_t converted_bytes;
 } thread_info;
 
     void *userdata;
@@ -261,6 +290,7 @@ typedef enum pa_source_message {
     PA_SOURCE_MESSAGE_SET_PORT,
     PA_SOURCE_MESSAGE_UPDATE_VOLUME_AND_MUTE,
     PA_SOURCE_MESSAGE_SET_LATENCY_OFFSET,
+    PA_SOURCE_MESSAGE_GET_POST_STATS,
     PA_SOURCE_MESSAGE_MAX
 } pa_source_message_t;
 
@@ -354,6 +384,8 @@ pa_usec_t pa_source_get_fixed_latency(pa_source *s);
 
 size_t pa_source_get_max_rewind(pa_source *s);
 
+void pa_source_get_post_stats(pa_source *s, uint64_t *delivered, uint64_t *converted);
+
 int pa_source_update_status(pa_source*s);
 int pa_source_suspend(pa_source *s, pa_bool_t suspend, pa_suspend_cause_t cause);
 int pa_source_suspend_all(pa_core *c, pa_bool_t suspend, pa_suspend_cause_t cause);
@@ -425,6 +457,11 @@ pa_bool_t pa_source_volume_change_apply(pa_source *s, pa_usec_t *usec_to_next);
 void pa_source_invalidate_requested_latency(pa_source *s, pa_bool_t dynamic);
 pa_usec_t pa_source_get_latency_within_thread(pa_source *s);
 
+/* Look up or store a volume-adjusted copy of in, shared with the other
+ * outputs during the current pa_source_post() */
+pa_bool_t pa_source_post_cache_get(pa_source *s, const pa_memchunk *in, const pa_cvolume *volume, pa_bool_t muted, pa_memchunk *out);
+void pa_source_post_cache_put(pa_source *s, const pa_memchunk *in, const pa_cvolume *volume, pa_bool_t muted, const pa_memchunk *out);
+
 #define pa_source_assert_io_context(s) \
     pa_assert(pa_thread_mq_get() || !PA_SOURCE_IS_LINKED((s)->state))
 
@@ -37,6 +37,7 @@
 
 #include <pulsecore/socket.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/flist.h>
 
 #include "tagstruct.h"
 
@@ -50,12 +51,28 @@ struct pa_tagstruct {
     pa_bool_t dynamic;
 };
 
+PA_STATIC_FLIST_DECLARE(tagstructs, 0, pa_xfree);
+
+static pa_tagstruct *tagstruct_new(void) {
+    pa_tagstruct *t;
+
+    if (!(t = pa_flist_pop(PA_STATIC_FLIST_GET(tagstructs))))
+        t = pa_xnew(pa_tagstruct, 1);
+
+    return t;
+}
+
+static void tagstruct_free(pa_tagstruct *t) {
+    if (pa_flist_push(PA_STATIC_FLIST_GET(tagstructs), t) < 0)
+        pa_xfree(t);
+}
+
 pa_tagstruct *pa_tagstruct_new(const uint8_t* data, size_t length) {
     pa_tagstruct*t;
 
     pa_assert(!data || (data && length));
 
-    t = pa_xnew(pa_tagstruct, 1);
+    t = tagstruct_new();
     t->data = (uint8_t*) data;
     t->allocated = t->length = data ? length : 0;
     t->rindex = 0;
@@ -64,12 +81,25 @@ pa_tagstruct *pa_tagstruct_new(const uint8_t* data, size_t length) {
     return t;
 }
 
+pa_tagstruct *pa_tagstruct_new_sized(size_t size_hint) {
+    pa_tagstruct *t;
+
+    t = tagstruct_new();
+    t->data = size_hint > 0 ? pa_xmalloc(size_hint) : NULL;
+    t->allocated = size_hint;
+    t->length = 0;
+    t->rindex = 0;
+    t->dynamic = TRUE;
+
+    return t;
+}
+
 void pa_tagstruct_free(pa_tagstruct*t) {
     pa_assert(t);
 
     if (t->dynamic)
         pa_xfree(t->data);
-    pa_xfree(t);
+    tagstruct_free(t);
 }
 
 uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l) {
@@ -81,10 +111,21 @@ uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l) {
 
     p = t->data;
     *l = t->length;
-    pa_xfree(t);
+    tagstruct_free(t);
     return p;
 }
 
+pa_packet* pa_tagstruct_free_packet(pa_tagstruct*t) {
+    pa_packet *packet;
+
+    pa_assert(t);
+    pa_assert(t->dynamic);
+
+    packet = pa_packet_new_dynamic(t->data, t->length);
+    tagstruct_free(t);
+    return packet;
+}
+
 static void extend(pa_tagstruct*t, size_t l) {
     pa_assert(t);
     pa_assert(t->dynamic);
@@ -150,7 +191,8 @@ void pa_tagstruct_put_arbitrary(pa_tagstruct *t, const void *p, size_t length) {
     uint32_t tmp;
 
     pa_assert(t);
-    pa_assert(p);
+    /* An empty tagstruct has no data at all */
+    pa_assert(p || length == 0);
 
     extend(t, 5+length);
     t->data[t->length] = PA_TAG_ARBITRARY;
@@ -33,6 +33,7 @@
 #include <pulse/proplist.h>
 
 #include <pulsecore/macro.h>
+#include <pulsecore/packet.h>
 
 typedef struct pa_tagstruct pa_tagstruct;
 
@@ -66,6 +67,14 @@ pa_tagstruct *pa_tagstruct_new(const uint8_t* data, size_t length);
 void pa_tagstruct_free(pa_tagstruct*t);
 uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l);
 
+/* An empty tagstruct with room for size_hint bytes, which is how much
+ * the caller expects to put in */
+pa_tagstruct *pa_tagstruct_new_sized(size_t size_hint);
+
+/* Frees the tagstruct and returns its contents as a packet, without
+ * copying them */
+pa_packet* pa_tagstruct_free_packet(pa_tagstruct*t);
+
 int pa_tagstruct_eof(pa_tagstruct*t);
 const uint8_t* pa_tagstruct_data(pa_tagstruct*t, size_t *l);
 
@@ -124,6 +124,13 @@ void pa_thread_mq_install(pa_thread_mq *q) {
     PA_STATIC_TLS_SET(thread_mq, q);
 }
 
+void pa_thread_mq_uninstall(pa_thread_mq *q) {
+    pa_assert(q);
+
+    pa_assert(PA_STATIC_TLS_GET(thread_mq) == q);
+    PA_STATIC_TLS_SET(thread_mq, NULL);
+}
+
 pa_thread_mq *pa_thread_mq_get(void) {
     return PA_STATIC_TLS_GET(thread_mq);
 }
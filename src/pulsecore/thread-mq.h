@@ -42,6 +42,10 @@ void pa_thread_mq_done(pa_thread_mq *q);
 /* Install the specified pa_thread_mq object for the current thread */
 void pa_thread_mq_install(pa_thread_mq *q);
 
+/* Undo pa_thread_mq_install(). Helper threads which temporarily do
+ * work on behalf of an IO thread use this to drop its context again */
+void pa_thread_mq_uninstall(pa_thread_mq *q);
+
 /* Return the pa_thread_mq object that is set for the current thread */
 pa_thread_mq *pa_thread_mq_get(void);
 
@@ -30,11 +30,30 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
 
 #include "time-smoother.h"
 
 #define HISTORY_MAX 64
 
+/* Parameters of the Kalman estimator, in usec and usec^2. The
+ * measurement noise is learned from the data, starting at 1ms. The
+ * clock rate is assumed to be within 1% of the nominal rate
+ * initially, and to wander by about 10ppm per second. */
+#define KALMAN_INITIAL_R 1e6
+#define KALMAN_MIN_R 1.0
+#define KALMAN_INITIAL_P00 1e12
+#define KALMAN_INITIAL_P11 1e-4
+#define KALMAN_Q_RATE 1e-16
+
+/* An innovation this many standard deviations off is taken as a
+ * discontinuity of the remote clock rather than noise. Since it might
+ * as well mean that the noise is much larger than we thought, the
+ * learned measurement noise is multiplied by KALMAN_OUTLIER_R_GROWTH
+ * each time, so that a run of them ends up being treated as noise. */
+#define KALMAN_OUTLIER 10
+#define KALMAN_OUTLIER_R_GROWTH 4
+
 /*
  * Implementation of a time smoothing algorithm to synchronize remote
  * clocks to a local one. Evens out noise, adjusts to clock skew and
@@ -58,6 +77,8 @@
  * guaranteed to be monotonic.
  */
 
+static pa_smoother_estimator_t default_estimator = PA_SMOOTHER_ESTIMATOR_SPLINE;
+
 struct pa_smoother {
     pa_usec_t adjust_time, history_time;
 
@@ -88,6 +109,18 @@ struct pa_smoother {
     pa_usec_t pause_time;
 
     unsigned min_history;
+
+    pa_smoother_estimator_t estimator;
+
+    /* State of the Kalman estimator: remote time ky and its rate kr
+     * at local time kx, and their covariance. kjump is the correction
+     * of the last update that is faded in until kx + kfade. */
+    pa_usec_t kx;
+    double ky, kr, kry;
+    double p00, p01, p11;
+    double r;
+    double kjump;
+    pa_usec_t kfade;
 };
 
 pa_smoother* pa_smoother_new(
@@ -112,6 +145,7 @@ pa_smoother* pa_smoother_new(
     s->min_history = min_history;
     s->monotonic = monotonic;
     s->smoothing = smoothing;
+    s->estimator = default_estimator;
 
     pa_smoother_reset(s, time_offset, paused);
 
@@ -345,6 +379,121 @@ static void estimate(pa_smoother *s, pa_usec_t x, pa_usec_t *y, double *deriv) {
     }
 }
 
+/*
+ * Alternative estimator: a Kalman filter tracking the remote time and
+ * the rate of the remote clock relative to the local one. Each
+ * measurement is weighed against the prediction according to the
+ * current uncertainty of both, so the rate settles after a few
+ * updates instead of requiring the history window to fill up. With
+ * 'smoothing' the offset correction of an update is faded in over the
+ * time the last update interval took, but at most 'adjust_time',
+ * instead of being applied immediately.
+ */
+
+static void kalman_estimate(pa_smoother *s, pa_usec_t x, pa_usec_t *y, double *deriv) {
+    double dx, t, d;
+
+    dx = (double) ((int64_t) x - (int64_t) s->kx);
+    t = s->ky + s->kr * dx;
+    d = s->kr;
+
+    if (s->kjump != 0 && dx >= 0 && dx < (double) s->kfade) {
+        t -= s->kjump * (1 - dx / (double) s->kfade);
+        d += s->kjump / (double) s->kfade;
+    }
+
+    *y = t >= 0 ? (pa_usec_t) llrint(t) : 0;
+
+    if (deriv)
+        *deriv = (s->monotonic && d < 0) ? 0 : d;
+}
+
+static void kalman_put(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
+    double dx, e, sv, k0, k1, p00, p01, p11;
+    pa_usec_t before = 0;
+
+    /* Measurements from before the current state carry no news */
+    if (x < s->kx)
+        return;
+
+    if (s->smoothing)
+        kalman_estimate(s, x, &before, NULL);
+
+    /* Predict */
+    dx = (double) (x - s->kx);
+    s->kfade = PA_CLAMP(x - s->kx, 1, s->adjust_time);
+    s->kx = x;
+    s->ky += s->kr * dx;
+    s->p00 += dx * (2 * s->p01 + dx * s->p11);
+    s->p01 += dx * s->p11;
+    s->p11 += dx * KALMAN_Q_RATE;
+
+    e = (double) y - s->ky;
+    sv = s->p00 + s->r;
+
+    if (e * e > KALMAN_OUTLIER * KALMAN_OUTLIER * sv) {
+        /* The remote clock jumped, restart from this point but keep
+         * the rate. Or the noise is larger than we thought, in which
+         * case the next innovation will be an outlier too, unless r
+         * grows. */
+        s->r *= KALMAN_OUTLIER_R_GROWTH;
+        s->ky = (double) y;
+        s->p00 = s->r;
+        s->p01 = 0;
+    } else {
+        pa_bool_t learn;
+
+        /* While the state is less certain than a measurement the
+         * innovation says next to nothing about the measurement
+         * noise, and e * e - sv would drag r to the floor right away
+         * after a reset. */
+        learn = s->p00 <= s->r;
+
+        /* Correct */
+        k0 = s->p00 / sv;
+        k1 = s->p01 / sv;
+
+        s->ky += k0 * e;
+        s->kr += k1 * e;
+
+        p00 = (1 - k0) * s->p00;
+        p01 = (1 - k0) * s->p01;
+        p11 = s->p11 - k1 * s->p01;
+
+        s->p00 = p00;
+        s->p01 = p01;
+        s->p11 = p11;
+
+        /* Learn the measurement noise from the part of the
+         * innovation the state uncertainty doesn't explain */
+        if (learn) {
+            s->r += (e * e - sv) / 16;
+            if (s->r < KALMAN_MIN_R)
+                s->r = KALMAN_MIN_R;
+        }
+    }
+
+    if (s->monotonic && s->kr < 0)
+        s->kr = 0;
+
+    s->kry = (double) y;
+    s->kjump = s->smoothing ? s->ky - (double) before : 0;
+}
+
+static void kalman_reset(pa_smoother *s) {
+    s->kx = 0;
+    s->ky = s->kry = 0;
+    s->kr = 1;
+
+    s->p00 = KALMAN_INITIAL_P00;
+    s->p01 = 0;
+    s->p11 = KALMAN_INITIAL_P11;
+
+    s->r = KALMAN_INITIAL_R;
+    s->kjump = 0;
+    s->kfade = s->adjust_time;
+}
+
 void pa_smoother_put(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
     pa_usec_t ney;
     double nde;
@@ -358,6 +507,11 @@ void pa_smoother_put(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
 
     x = PA_LIKELY(x >= s->time_offset) ? x - s->time_offset : 0;
 
+    if (s->estimator == PA_SMOOTHER_ESTIMATOR_KALMAN) {
+        kalman_put(s, x, y);
+        goto finish;
+    }
+
     is_new = x >= s->ex;
 
     if (is_new) {
@@ -385,6 +539,7 @@ void pa_smoother_put(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
 
     s->abc_valid = FALSE;
 
+finish:
 #ifdef DEBUG_DATA
     pa_log_debug("%p, put(%llu | %llu) = %llu", s, (unsigned long long) (x + s->time_offset), (unsigned long long) x, (unsigned long long) y);
 #endif
@@ -405,7 +560,10 @@ pa_usec_t pa_smoother_get(pa_smoother *s, pa_usec_t x) {
         if (x <= s->last_x)
             x = s->last_x;
 
-    estimate(s, x, &y, NULL);
+    if (s->estimator == PA_SMOOTHER_ESTIMATOR_KALMAN)
+        kalman_estimate(s, x, &y, NULL);
+    else
+        estimate(s, x, &y, NULL);
 
     if (s->monotonic) {
 
@@ -474,6 +632,12 @@ void pa_smoother_fix_now(pa_smoother *s) {
 
     s->px = s->ex;
     s->py = s->ry;
+
+    /* Continue from the last measurement right away */
+    s->ky = s->kry;
+    s->kjump = 0;
+    if (s->p00 > s->r)
+        s->p00 = s->r;
 }
 
 pa_usec_t pa_smoother_translate(pa_smoother *s, pa_usec_t x, pa_usec_t y_delay) {
@@ -488,12 +652,19 @@ pa_usec_t pa_smoother_translate(pa_smoother *s, pa_usec_t x, pa_usec_t y_delay)
 
     x = PA_LIKELY(x >= s->time_offset) ? x - s->time_offset : 0;
 
-    estimate(s, x, &ney, &nde);
+    if (s->estimator == PA_SMOOTHER_ESTIMATOR_KALMAN) {
+        kalman_estimate(s, x, &ney, &nde);
 
-    /* Play safe and take the larger gradient, so that we wakeup
-     * earlier when this is used for sleeping */
-    if (s->dp > nde)
-        nde = s->dp;
+        if (s->kr > nde)
+            nde = s->kr;
+    } else {
+        estimate(s, x, &ney, &nde);
+
+        /* Play safe and take the larger gradient, so that we wakeup
+         * earlier when this is used for sleeping */
+        if (s->dp > nde)
+            nde = s->dp;
+    }
 
 #ifdef DEBUG_DATA
     pa_log_debug("translate(%llu) = %llu (%0.2f)", (unsigned long long) y_delay, (unsigned long long) ((double) y_delay / nde), nde);
@@ -518,6 +689,8 @@ void pa_smoother_reset(pa_smoother *s, pa_usec_t time_offset, pa_bool_t paused)
 
     s->abc_valid = FALSE;
 
+    kalman_reset(s);
+
     s->paused = paused;
     s->time_offset = s->pause_time = time_offset;
 
@@ -525,3 +698,44 @@ void pa_smoother_reset(pa_smoother *s, pa_usec_t time_offset, pa_bool_t paused)
     pa_log_debug("reset()");
 #endif
 }
+
+void pa_smoother_set_estimator(pa_smoother *s, pa_smoother_estimator_t estimator) {
+    pa_assert(s);
+    pa_assert(estimator < PA_SMOOTHER_ESTIMATOR_MAX);
+
+    s->estimator = estimator;
+}
+
+void pa_smoother_set_default_estimator(pa_smoother_estimator_t estimator) {
+    pa_assert(estimator < PA_SMOOTHER_ESTIMATOR_MAX);
+
+    default_estimator = estimator;
+}
+
+pa_smoother_estimator_t pa_smoother_get_default_estimator(void) {
+    return default_estimator;
+}
+
+static const char* const estimator_table[PA_SMOOTHER_ESTIMATOR_MAX] = {
+    [PA_SMOOTHER_ESTIMATOR_SPLINE] = "spline",
+    [PA_SMOOTHER_ESTIMATOR_KALMAN] = "kalman"
+};
+
+const char *pa_smoother_estimator_to_string(pa_smoother_estimator_t estimator) {
+    if (estimator >= PA_SMOOTHER_ESTIMATOR_MAX)
+        return NULL;
+
+    return estimator_table[estimator];
+}
+
+int pa_smoother_estimator_from_string(const char *s) {
+    int e;
+
+    pa_assert(s);
+
+    for (e = 0; e < PA_SMOOTHER_ESTIMATOR_MAX; e++)
+        if (pa_streq(s, estimator_table[e]))
+            return e;
+
+    return -1;
+}
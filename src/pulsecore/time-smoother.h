@@ -27,6 +27,12 @@
 
 typedef struct pa_smoother pa_smoother;
 
+typedef enum pa_smoother_estimator {
+    PA_SMOOTHER_ESTIMATOR_SPLINE,   /* Linear regression over the history, smoothed with a spline */
+    PA_SMOOTHER_ESTIMATOR_KALMAN,   /* Kalman filter tracking remote time and clock rate */
+    PA_SMOOTHER_ESTIMATOR_MAX
+} pa_smoother_estimator_t;
+
 pa_smoother* pa_smoother_new(
         pa_usec_t x_adjust_time,
         pa_usec_t x_history_time,
@@ -56,4 +62,15 @@ void pa_smoother_reset(pa_smoother *s, pa_usec_t time_offset, pa_bool_t paused);
 
 void pa_smoother_fix_now(pa_smoother *s);
 
+/* Selects the estimation algorithm. Should be called before the first
+ * pa_smoother_put(). */
+void pa_smoother_set_estimator(pa_smoother *s, pa_smoother_estimator_t estimator);
+
+/* The estimator used by pa_smoother_new(), set once at startup */
+void pa_smoother_set_default_estimator(pa_smoother_estimator_t estimator);
+pa_smoother_estimator_t pa_smoother_get_default_estimator(void);
+
+const char *pa_smoother_estimator_to_string(pa_smoother_estimator_t estimator);
+int pa_smoother_estimator_from_string(const char *s);
+
 #endif
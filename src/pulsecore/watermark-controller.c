@@ -0,0 +1,149 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+
+#include "watermark-controller.h"
+
+/* Four buckets per octave, i.e. the suggestion is at most 25% above
+ * the exact percentile, up to 2^25 usec. */
+#define N_BUCKETS 100
+
+/* Weight of a single sample. All weights are halved every half_life
+ * samples, so that old conditions are forgotten. To tell whether we
+ * stay below the requested probability the history needs to span a
+ * multiple of its inverse, but no less than MIN_HALF_LIFE samples. */
+#define SAMPLE_WEIGHT 256
+#define MIN_HALF_LIFE 1024
+
+struct pa_watermark_controller {
+    double probability;
+    unsigned half_life;
+
+    uint32_t buckets[N_BUCKETS];
+    uint64_t total;
+    unsigned n_since_decay;
+};
+
+static unsigned bucket_for(pa_usec_t usec) {
+    unsigned msb = 0, k;
+    pa_usec_t v;
+
+    if (usec < 4)
+        return (unsigned) usec;
+
+    for (v = usec; v > 1; v >>= 1)
+        msb++;
+
+    k = 4 * msb + (unsigned) ((usec >> (msb - 2)) & 3);
+
+    return PA_MIN(k, N_BUCKETS - 1);
+}
+
+/* The smallest value which is above everything in bucket k */
+static pa_usec_t bucket_upper(unsigned k) {
+    /* Buckets 4 to 7 stay empty */
+    if (k < 8)
+        return PA_MIN(k, 3) + 1;
+
+    return (pa_usec_t) (5 + k % 4) << (k / 4 - 2);
+}
+
+pa_watermark_controller* pa_watermark_controller_new(double probability) {
+    pa_watermark_controller *c;
+
+    pa_assert(probability > 0 && probability < 1);
+
+    c = pa_xnew0(pa_watermark_controller, 1);
+    c->probability = probability;
+    c->half_life = PA_MAX(MIN_HALF_LIFE, (unsigned) (2 / probability));
+
+    return c;
+}
+
+void pa_watermark_controller_free(pa_watermark_controller *c) {
+    pa_assert(c);
+
+    pa_xfree(c);
+}
+
+static void decay(pa_watermark_controller *c) {
+    unsigned k;
+
+    c->total = 0;
+
+    for (k = 0; k < N_BUCKETS; k++) {
+        c->buckets[k] >>= 1;
+        c->total += c->buckets[k];
+    }
+
+    c->n_since_decay = 0;
+}
+
+void pa_watermark_controller_add(pa_watermark_controller *c, pa_usec_t usec) {
+    pa_assert(c);
+
+    c->buckets[bucket_for(usec)] += SAMPLE_WEIGHT;
+    c->total += SAMPLE_WEIGHT;
+
+    if (++c->n_since_decay >= c->half_life)
+        decay(c);
+}
+
+void pa_watermark_controller_dropout(pa_watermark_controller *c, pa_usec_t usec) {
+    uint32_t w;
+
+    pa_assert(c);
+
+    /* Just enough weight to pull the percentile up to usec. It is
+     * outweighed again after the next decay unless more dropouts
+     * follow. */
+    w = (uint32_t) (c->probability * (double) c->total / (1 - c->probability)) + SAMPLE_WEIGHT;
+
+    c->buckets[bucket_for(usec)] += w;
+    c->total += w;
+}
+
+pa_usec_t pa_watermark_controller_get(pa_watermark_controller *c) {
+    double threshold;
+    uint64_t above = 0;
+    unsigned k;
+
+    pa_assert(c);
+
+    if (c->total <= 0)
+        return 0;
+
+    threshold = c->probability * (double) c->total;
+
+    for (k = N_BUCKETS; k > 0; k--) {
+        above += c->buckets[k-1];
+
+        if ((double) above > threshold)
+            return bucket_upper(k-1);
+    }
+
+    pa_assert_not_reached();
+}
@@ -0,0 +1,51 @@
+#ifndef foopulsewatermarkcontrollerhfoo
+#define foopulsewatermarkcontrollerhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <pulse/sample.h>
+
+/* Picks the wakeup watermark of a timer-scheduled device. For every
+ * timer wakeup the driver reports how long it took from the time the
+ * timer should have fired until data was handed to (or taken from)
+ * the hardware, i.e. wakeup lateness plus processing time. The
+ * controller keeps an exponentially decaying histogram of these
+ * values and suggests the smallest watermark that is exceeded with at
+ * most the configured probability. */
+
+typedef struct pa_watermark_controller pa_watermark_controller;
+
+/* probability is the acceptable chance of a dropout per wakeup */
+pa_watermark_controller* pa_watermark_controller_new(double probability);
+void pa_watermark_controller_free(pa_watermark_controller *c);
+
+/* Adds the time from the timer deadline until the data was transferred */
+void pa_watermark_controller_add(pa_watermark_controller *c, pa_usec_t usec);
+
+/* Reports a dropout which happened even though the watermark was set
+ * as suggested. The driver decides how far to back off, the
+ * controller will not suggest less than usec until the event has aged
+ * out of the history. */
+void pa_watermark_controller_dropout(pa_watermark_controller *c, pa_usec_t usec);
+
+/* Returns the suggested watermark, or 0 if there is no data yet */
+pa_usec_t pa_watermark_controller_get(pa_watermark_controller *c);
+
+#endif
@@ -0,0 +1,218 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <pulsecore/macro.h>
+
+#include "daemon-test-util.h"
+
+/* Loads an ALSA sink and source on ALSA's "null" device, which needs
+ * no hardware, and streams the same amount of audio through them in a
+ * few configurations. For each one the memory the daemon allocated
+ * meanwhile is reported, which includes every intermediate copy of
+ * the audio. Playing at a reduced volume must not cost more than
+ * playing at full volume, and a muted capture must not cost more than
+ * an unmuted one. */
+
+#define DEVICE "null"
+#define SECONDS 5
+
+enum phase {
+    PLAY_NORM,
+    PLAY_HALF,
+    RECORD_NORM,
+    RECORD_MUTED,
+    N_PHASES
+};
+
+static const char* const phase_name[N_PHASES] = {
+    [PLAY_NORM] = "playback at full volume",
+    [PLAY_HALF] = "playback at half volume",
+    [RECORD_NORM] = "capture",
+    [RECORD_MUTED] = "muted capture"
+};
+
+static pa_stream *stream = NULL;
+
+static pa_sample_spec sample_spec;
+static pa_channel_map channel_map;
+static int mmap_mode = 0;
+
+static enum phase phase = PLAY_NORM;
+static size_t total, done;
+static uint32_t allocated_start;
+static uint32_t allocated[N_PHASES];
+
+static uint8_t data[4096];
+
+static void start_phase(pa_context *c);
+
+static void finish(pa_context *c) {
+    if (mmap_mode)
+        /* The volume is applied while copying into the hardware
+         * buffer, not in a copy of its own */
+        fail_unless(allocated[PLAY_HALF] <= allocated[PLAY_NORM] + allocated[PLAY_NORM] / 10);
+    else
+        fprintf(stderr, "Device is not in mmap mode, not comparing the playback numbers.\n");
+
+    /* A muted capture hands out silence instead of a copy */
+    fail_unless(allocated[RECORD_MUTED] <= allocated[RECORD_NORM] + allocated[RECORD_NORM] / 10);
+
+    daemon_test_unload_modules(c, NULL);
+}
+
+static void stat_end_cb(pa_context *c, const pa_stat_info *i, void *userdata) {
+    fail_unless(i != NULL);
+
+    allocated[phase] = i->memblock_allocated_size - allocated_start;
+
+    fprintf(stderr, "%s: daemon allocated %0.2f bytes per byte of audio\n",
+            phase_name[phase], (double) allocated[phase] / (double) total);
+
+    if (++phase < N_PHASES)
+        start_phase(c);
+    else
+        finish(c);
+}
+
+static void end_stream(pa_context *c) {
+    pa_stream_disconnect(stream);
+    pa_stream_unref(stream);
+    stream = NULL;
+
+    pa_operation_unref(pa_context_stat(c, stat_end_cb, NULL));
+}
+
+static void drained_cb(pa_stream *s) {
+    end_stream(pa_stream_get_context(s));
+}
+
+static void stream_read_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    const void *p;
+    size_t l;
+
+    while (pa_stream_readable_size(s) > 0 && done < total) {
+        fail_unless(pa_stream_peek(s, &p, &l) == 0);
+
+        if (l <= 0)
+            break;
+
+        done += l;
+        pa_stream_drop(s);
+    }
+
+    if (done >= total) {
+        pa_stream_set_read_callback(s, NULL, NULL);
+        end_stream(pa_stream_get_context(s));
+    }
+}
+
+static void stat_start_cb(pa_context *c, const pa_stat_info *i, void *userdata) {
+    pa_cvolume volume;
+
+    fail_unless(i != NULL);
+
+    allocated_start = i->memblock_allocated_size;
+    total = SECONDS * pa_bytes_per_second(&sample_spec);
+    done = 0;
+
+    fprintf(stderr, "Running %s.\n", phase_name[phase]);
+
+    /* The same format as the device, so that nothing but the volume
+     * needs to be adjusted */
+    stream = daemon_test_stream_new(c, "alsa copy test", &sample_spec, &channel_map, NULL);
+
+    switch (phase) {
+        case PLAY_NORM:
+        case PLAY_HALF:
+            pa_cvolume_set(&volume, sample_spec.channels, phase == PLAY_NORM ? PA_VOLUME_NORM : PA_VOLUME_NORM / 2);
+
+            daemon_test_play(stream, data, sizeof(data), total, drained_cb);
+            fail_unless(pa_stream_connect_playback(stream, "alsa_copy_test", NULL, 0, &volume, NULL) == 0);
+            break;
+
+        case RECORD_NORM:
+        case RECORD_MUTED:
+            pa_stream_set_read_callback(stream, stream_read_cb, NULL);
+            fail_unless(pa_stream_connect_record(stream, "alsa_copy_test", NULL, 0) == 0);
+            break;
+
+        default:
+            fail();
+    }
+}
+
+static void mute_cb(pa_context *c, int success, void *userdata) {
+    fail_unless(success);
+
+    pa_operation_unref(pa_context_stat(c, stat_start_cb, NULL));
+}
+
+static void start_phase(pa_context *c) {
+    if (phase == RECORD_MUTED)
+        pa_operation_unref(pa_context_set_source_mute_by_name(c, "alsa_copy_test", 1, mute_cb, NULL));
+    else
+        pa_operation_unref(pa_context_stat(c, stat_start_cb, NULL));
+}
+
+static void sink_info_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    const char *mode;
+
+    if (eol)
+        return;
+
+    fail_unless(i != NULL);
+
+    sample_spec = i->sample_spec;
+    channel_map = i->channel_map;
+
+    mode = pa_proplist_gets(i->proplist, PA_PROP_DEVICE_ACCESS_MODE);
+    mmap_mode = mode && strncmp(mode, "mmap", 4) == 0;
+
+    fprintf(stderr, "Device access mode is %s.\n", mode ? mode : "unknown");
+
+    start_phase(c);
+}
+
+static void source_loaded_cb(pa_context *c) {
+    pa_operation_unref(pa_context_get_sink_info_by_name(c, "alsa_copy_test", sink_info_cb, NULL));
+}
+
+static void sink_loaded_cb(pa_context *c) {
+    daemon_test_load_module(c, "module-alsa-source", "device=" DEVICE " source_name=alsa_copy_test", source_loaded_cb);
+}
+
+static void context_ready_cb(pa_context *c) {
+    daemon_test_load_module(c, "module-alsa-sink", "device=" DEVICE " sink_name=alsa_copy_test", sink_loaded_cb);
+}
+
+int main(int argc, char *argv[]) {
+    return daemon_test_main("ALSA Copy", argv[0], context_ready_cb);
+}
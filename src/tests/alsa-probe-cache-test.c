@@ -0,0 +1,290 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/tagstruct.h>
+
+#include <modules/alsa/alsa-mixer.h>
+
+/* Stores the probe results of a profile set and loads them into a
+ * fresh one, without any sound card. Checks that the results are
+ * thrown away when the profile set no longer matches them, and that
+ * the configuration stamp changes with the profile set and with every
+ * file in the paths directory, including the ones paths include. */
+
+#define PROFILE_SET \
+    "[General]\n" \
+    "auto-profiles = yes\n" \
+    "\n" \
+    "[Mapping analog-stereo]\n" \
+    "device-strings = hw:%f\n" \
+    "channel-map = left,right\n" \
+    "paths-output = analog-output\n" \
+    "direction = output\n" \
+    "\n"
+
+#define MONO_MAPPING \
+    "[Mapping analog-mono]\n" \
+    "device-strings = hw:%f\n" \
+    "channel-map = mono\n" \
+    "paths-output = analog-output\n" \
+    "direction = output\n"
+
+static char *dir, *paths_dir, *profile_set_fn;
+
+static void write_file(const char *fn, const char *mode, const char *data) {
+    FILE *f;
+
+    fail_unless((f = fopen(fn, mode)) != NULL);
+    fputs(data, f);
+    fclose(f);
+}
+
+/* Moves the modification time of fn into the future, as if it had
+ * been edited later without changing its size */
+static void touch_later(const char *fn) {
+    struct stat st;
+    struct timeval tv[2];
+
+    fail_unless(stat(fn, &st) == 0);
+
+    tv[0].tv_sec = tv[1].tv_sec = st.st_mtime + 10;
+    tv[0].tv_usec = tv[1].tv_usec = 0;
+    fail_unless(utimes(fn, tv) == 0);
+}
+
+static void setup(void) {
+    char *fn;
+
+    dir = pa_xstrdup("/tmp/alsa-probe-cache-test-XXXXXX");
+    fail_unless(mkdtemp(dir) != NULL);
+
+    paths_dir = pa_sprintf_malloc("%s/paths", dir);
+    fail_unless(mkdir(paths_dir, 0700) == 0);
+
+    fn = pa_sprintf_malloc("%s/analog-output.conf", paths_dir);
+    write_file(fn, "w", "[Element PCM]\nvolume = merge\n.include analog-output.conf.common\n");
+    pa_xfree(fn);
+
+    fn = pa_sprintf_malloc("%s/analog-output.conf.common", paths_dir);
+    write_file(fn, "w", "[Element Master]\nswitch = mute\n");
+    pa_xfree(fn);
+
+    profile_set_fn = pa_sprintf_malloc("%s/test.conf", dir);
+    write_file(profile_set_fn, "w", PROFILE_SET MONO_MAPPING);
+}
+
+static void teardown(void) {
+    char *cmd;
+
+    cmd = pa_sprintf_malloc("rm -rf '%s'", dir);
+    fail_unless(system(cmd) == 0);
+    pa_xfree(cmd);
+
+    pa_xfree(profile_set_fn);
+    pa_xfree(paths_dir);
+    pa_xfree(dir);
+}
+
+/* What probing would leave behind if only the stereo output worked */
+static pa_tagstruct *probe_stereo_only(void) {
+    pa_alsa_profile_set *ps;
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    pa_tagstruct *t;
+
+    fail_unless((ps = pa_alsa_profile_set_new(profile_set_fn, NULL)) != NULL);
+
+    fail_unless((p = pa_hashmap_get(ps->profiles, "output:analog-stereo")) != NULL);
+    fail_unless(pa_hashmap_get(ps->profiles, "output:analog-mono") != NULL);
+    fail_unless((m = pa_hashmap_get(ps->mappings, "analog-stereo")) != NULL);
+
+    p->supported = TRUE;
+    m->supported = 1;
+    pa_alsa_profile_set_drop_unsupported(ps);
+    ps->probed = TRUE;
+
+    t = pa_tagstruct_new(NULL, 0);
+    pa_alsa_profile_set_save_probe(ps, t);
+    pa_alsa_profile_set_free(ps);
+
+    return t;
+}
+
+/* Hands the stored results to a fresh profile set */
+static pa_alsa_profile_set *load(pa_tagstruct *t, int *r) {
+    pa_alsa_profile_set *ps;
+    const uint8_t *data;
+    size_t length;
+    pa_tagstruct *copy;
+
+    fail_unless((ps = pa_alsa_profile_set_new(profile_set_fn, NULL)) != NULL);
+
+    data = pa_tagstruct_data(t, &length);
+    copy = pa_tagstruct_new(data, length);
+    *r = pa_alsa_profile_set_load_probe(ps, copy, 0);
+    pa_tagstruct_free(copy);
+
+    return ps;
+}
+
+START_TEST (load_test) {
+    pa_alsa_profile_set *ps;
+    pa_alsa_profile *p;
+    pa_tagstruct *t;
+    int r;
+
+    setup();
+
+    t = probe_stereo_only();
+    ps = load(t, &r);
+    fail_unless(r == 0);
+
+    p = pa_hashmap_get(ps->profiles, "output:analog-stereo");
+    fail_unless(p && p->cached && p->supported);
+    p = pa_hashmap_get(ps->profiles, "output:analog-mono");
+    fail_unless(p && p->cached && !p->supported);
+    fail_unless(ps->cache_card_index == 0);
+
+    pa_alsa_profile_set_free(ps);
+    pa_tagstruct_free(t);
+    teardown();
+}
+END_TEST
+
+START_TEST (invalidate_test) {
+    pa_alsa_profile_set *ps;
+    pa_alsa_profile *p;
+    pa_tagstruct *t;
+    void *state;
+    int r;
+
+    setup();
+
+    t = probe_stereo_only();
+
+    /* The stereo mapping the results talk about is gone */
+    write_file(profile_set_fn, "w", MONO_MAPPING);
+
+    ps = load(t, &r);
+    fail_unless(r < 0);
+
+    /* And the profile set can still be probed as if nothing happened */
+    PA_HASHMAP_FOREACH(p, ps->profiles, state)
+        fail_unless(!p->cached && !p->supported);
+    fail_unless(ps->cache_card_index == -1);
+
+    pa_alsa_profile_set_free(ps);
+
+    /* Garbage is refused too */
+    write_file(profile_set_fn, "w", PROFILE_SET MONO_MAPPING);
+    pa_tagstruct_putu32(t, 4711);
+    ps = load(t, &r);
+    fail_unless(r < 0);
+
+    pa_alsa_profile_set_free(ps);
+    pa_tagstruct_free(t);
+    teardown();
+}
+END_TEST
+
+START_TEST (stamp_test) {
+    char *fn, *stamp, *stamp2;
+
+    setup();
+
+    stamp = pa_alsa_profile_set_config_stamp(profile_set_fn, paths_dir);
+    stamp2 = pa_alsa_profile_set_config_stamp(profile_set_fn, paths_dir);
+    fail_unless(pa_streq(stamp, stamp2));
+    pa_xfree(stamp2);
+
+    /* The profile set was edited */
+    write_file(profile_set_fn, "a", "\n");
+    stamp2 = pa_alsa_profile_set_config_stamp(profile_set_fn, paths_dir);
+    fail_unless(!pa_streq(stamp, stamp2));
+    pa_xfree(stamp);
+    stamp = stamp2;
+
+    /* A file included by the paths was edited */
+    fn = pa_sprintf_malloc("%s/analog-output.conf.common", paths_dir);
+    write_file(fn, "a", "volume = merge\n");
+    stamp2 = pa_alsa_profile_set_config_stamp(profile_set_fn, paths_dir);
+    fail_unless(!pa_streq(stamp, stamp2));
+    pa_xfree(stamp);
+    stamp = stamp2;
+
+    /* Or just saved again, with the same size */
+    touch_later(fn);
+    stamp2 = pa_alsa_profile_set_config_stamp(profile_set_fn, paths_dir);
+    fail_unless(!pa_streq(stamp, stamp2));
+    pa_xfree(stamp);
+    stamp = stamp2;
+    pa_xfree(fn);
+
+    /* A new file showed up */
+    fn = pa_sprintf_malloc("%s/analog-input.conf.common", paths_dir);
+    write_file(fn, "w", "");
+    stamp2 = pa_alsa_profile_set_config_stamp(profile_set_fn, paths_dir);
+    fail_unless(!pa_streq(stamp, stamp2));
+    pa_xfree(stamp2);
+    pa_xfree(fn);
+
+    pa_xfree(stamp);
+    teardown();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Alsa-probe-cache");
+    tc = tcase_create("alsa-probe-cache");
+    tcase_add_test(tc, load_test);
+    tcase_add_test(tc, invalidate_test);
+    tcase_add_test(tc, stamp_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -27,11 +27,17 @@
 
 #include <check.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+
 #include <pulsecore/asyncmsgq.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
+#define BENCHMARK_POSTS 200000
+#define BENCHMARK_SENDS 20000
+
 enum {
     OPERATION_A,
     OPERATION_B,
@@ -39,6 +45,14 @@ enum {
     QUIT
 };
 
+enum {
+    BENCHMARK_POST,
+    BENCHMARK_SEND,
+    BENCHMARK_QUIT
+};
+
+static unsigned n_received = 0;
+
 static void the_thread(void *_q) {
     pa_asyncmsgq *q = _q;
     int quit = 0;
@@ -73,6 +87,72 @@ static void the_thread(void *_q) {
     } while (!quit);
 }
 
+static void benchmark_thread(void *_q) {
+    pa_asyncmsgq *q = _q;
+    int code;
+
+    do {
+        pa_assert_se(pa_asyncmsgq_get(q, NULL, &code, NULL, NULL, NULL, 1) == 0);
+
+        if (code == BENCHMARK_POST)
+            n_received++;
+
+        pa_asyncmsgq_done(q, 0);
+
+    } while (code != BENCHMARK_QUIT);
+}
+
+START_TEST (asyncmsgq_benchmark) {
+    pa_asyncmsgq *q;
+    pa_thread *t;
+    pa_usec_t start, stop;
+    unsigned i;
+
+    q = pa_asyncmsgq_new(0);
+    fail_unless(q != NULL);
+
+    t = pa_thread_new("benchmark", benchmark_thread, q);
+    fail_unless(t != NULL);
+
+    /* Throughput: post as fast as we can, then wait until the other
+     * side caught up by doing a synchronous send */
+    start = pa_rtclock_now();
+
+    for (i = 0; i < BENCHMARK_POSTS; i++)
+        pa_asyncmsgq_post(q, NULL, BENCHMARK_POST, NULL, 0, NULL, NULL);
+
+    pa_asyncmsgq_send(q, NULL, BENCHMARK_SEND, NULL, 0, NULL);
+
+    stop = pa_rtclock_now();
+
+    fail_unless(n_received == BENCHMARK_POSTS);
+
+    pa_log_info("Posted %u messages in %0.2f ms, %0.0f messages/s",
+                BENCHMARK_POSTS,
+                (double) (stop - start) / PA_USEC_PER_MSEC,
+                (double) BENCHMARK_POSTS * PA_USEC_PER_SEC / (double) PA_MAX(stop - start, 1U));
+
+    /* Latency: round trips of synchronous sends */
+    start = pa_rtclock_now();
+
+    for (i = 0; i < BENCHMARK_SENDS; i++)
+        pa_asyncmsgq_send(q, NULL, BENCHMARK_SEND, NULL, 0, NULL);
+
+    stop = pa_rtclock_now();
+
+    pa_log_info("Sent %u messages in %0.2f ms, %0.2f us per round trip",
+                BENCHMARK_SENDS,
+                (double) (stop - start) / PA_USEC_PER_MSEC,
+                (double) (stop - start) / BENCHMARK_SENDS);
+
+    pa_asyncmsgq_post(q, NULL, BENCHMARK_QUIT, NULL, 0, NULL, NULL);
+
+    pa_thread_free(t);
+
+    pa_asyncmsgq_unref(q);
+}
+END_TEST
+
 START_TEST (asyncmsgq_test) {
     pa_asyncmsgq *q;
     pa_thread *t;
@@ -113,9 +193,13 @@ int main(int argc, char *argv[]) {
     TCase *tc;
     SRunner *sr;
 
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
     s = suite_create("Async Message Queue");
     tc = tcase_create("asyncmsgq");
     tcase_add_test(tc, asyncmsgq_test);
+    tcase_add_test(tc, asyncmsgq_benchmark);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
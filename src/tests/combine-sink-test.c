@@ -0,0 +1,96 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include "daemon-test-util.h"
+
+/* Plays a few seconds of audio through a combine sink with four null
+ * sink slaves and reports how much CPU time the daemon spent per
+ * second of audio. */
+
+#define NSLAVES 4
+#define SINE_HZ 440
+#define SAMPLE_HZ 44100
+#define PLAY_SECONDS 5
+
+static pa_stream *stream = NULL;
+static unsigned n_slaves = 0;
+
+static int16_t data[SAMPLE_HZ*2]; /* one second of stereo audio */
+
+static pa_usec_t cpu_start = 0;
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_S16NE,
+    .rate = SAMPLE_HZ,
+    .channels = 2
+};
+
+static void drained_cb(pa_stream *s) {
+    pa_context *c = pa_stream_get_context(s);
+
+    fprintf(stderr, "Daemon CPU time: %0.2f ms per second of audio with %u outputs\n",
+            (double) (daemon_test_get_cpu() - cpu_start) / PA_USEC_PER_MSEC / PLAY_SECONDS, NSLAVES);
+
+    pa_stream_disconnect(s);
+    pa_stream_unref(s);
+    stream = NULL;
+
+    daemon_test_unload_modules(c, NULL);
+}
+
+static void stream_ready_cb(pa_stream *s) {
+    fprintf(stderr, "Playing %u seconds of audio on the combined sink.\n", PLAY_SECONDS);
+    cpu_start = daemon_test_get_cpu();
+}
+
+static void create_stream(pa_context *c) {
+    stream = daemon_test_stream_new(c, "combine sink test", &sample_spec, NULL, stream_ready_cb);
+    daemon_test_play(stream, data, sizeof(data), PLAY_SECONDS * sizeof(data), drained_cb);
+    fail_unless(pa_stream_connect_playback(stream, "combine_test", NULL, 0, NULL, NULL) == 0);
+}
+
+static void load_next_module(pa_context *c) {
+    char args[64];
+
+    if (n_slaves < NSLAVES) {
+        snprintf(args, sizeof(args), "sink_name=combine_test_slave%u", n_slaves++);
+        daemon_test_load_module(c, "module-null-sink", args, load_next_module);
+    } else
+        daemon_test_load_module(c, "module-combine-sink",
+                                "sink_name=combine_test adjust_time=0 "
+                                "slaves=combine_test_slave0,combine_test_slave1,combine_test_slave2,combine_test_slave3",
+                                create_stream);
+}
+
+int main(int argc, char *argv[]) {
+    daemon_test_sine(data, SAMPLE_HZ, SAMPLE_HZ, SINE_HZ);
+
+    return daemon_test_main("Combine Sink", argv[0], load_next_module);
+}
@@ -0,0 +1,426 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/util.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-subscribe.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* Posts change events the way a dragged volume slider does, and checks
+ * that subscribers get far fewer of them, with the last one arriving
+ * after the last change. Also checks that removals drop held back
+ * changes, even when nobody is subscribed any more, that index filters
+ * only let the chosen objects through, and that the generations
+ * snapshots are based on tell what changed and went away, up to the
+ * number of removals remembered. */
+
+#define COALESCE_USEC (50 * PA_USEC_PER_MSEC)
+/* For tests which must not see a window run out */
+#define LONG_COALESCE_USEC (60 * PA_USEC_PER_SEC)
+/* How long to wait at most for an event which is due. Only reached
+ * when something is broken, a loaded machine may just delay timers. */
+#define WAIT_USEC (10 * PA_USEC_PER_SEC)
+#define N_CHANGES 100
+#define N_OBJECTS 5
+
+/* What core-subscribe.c remembers */
+#define MAX_REMOVED_OBJECTS 1024
+
+static pa_mainloop *mainloop;
+static pa_core *core;
+
+struct counter {
+    unsigned n_events, n_changes;
+    pa_subscription_event_type_t last_type;
+    uint32_t last_index;
+    pa_usec_t last_event;
+};
+
+static void counting_cb(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+    struct counter *n = userdata;
+
+    n->n_events++;
+    if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE)
+        n->n_changes++;
+
+    n->last_type = t;
+    n->last_index = idx;
+    n->last_event = pa_rtclock_now();
+}
+
+static void setup(pa_usec_t coalesce_usec) {
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    core = pa_core_new(pa_mainloop_get_api(mainloop), FALSE, 0);
+    fail_unless(core != NULL);
+
+    core->subscription_coalesce_usec = coalesce_usec;
+}
+
+static void teardown(void) {
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+}
+
+/* Dispatch whatever is due, without blocking */
+static void dispatch(void) {
+    while (pa_mainloop_iterate(mainloop, 0, NULL) > 0)
+        ;
+}
+
+/* Keep dispatching for a while */
+static void run_for(pa_usec_t usec) {
+    pa_usec_t end = pa_rtclock_now() + usec;
+
+    while (pa_rtclock_now() < end) {
+        dispatch();
+        pa_msleep(1);
+    }
+}
+
+/* Keep dispatching until an event arrives which was delivered at t or
+ * later */
+static void wait_for_event(struct counter *n, pa_usec_t t) {
+    pa_usec_t end = pa_rtclock_now() + WAIT_USEC;
+
+    while (n->last_event < t && pa_rtclock_now() < end) {
+        dispatch();
+        pa_msleep(1);
+    }
+}
+
+/* Returns when the last change was posted. The sleeps only pace the
+ * changes, none of the checks depend on how long they actually take. */
+static pa_usec_t drag_slider(uint32_t idx) {
+    pa_usec_t last = 0;
+    unsigned i;
+
+    for (i = 0; i < N_CHANGES; i++) {
+        last = pa_rtclock_now();
+        pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, idx);
+        dispatch();
+        pa_msleep(2);
+    }
+
+    return last;
+}
+
+START_TEST (coalesce_test) {
+    struct counter n;
+    pa_subscription *s;
+    pa_usec_t start, last_change;
+    unsigned n_changes;
+
+    setup(COALESCE_USEC);
+    pa_zero(n);
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, counting_cb, &n);
+
+    start = pa_rtclock_now();
+    last_change = drag_slider(7);
+
+    /* The last change must get through, held back or not */
+    wait_for_event(&n, last_change);
+    fail_unless(n.last_event >= last_change);
+    fail_unless(n.last_index == 7);
+
+    fprintf(stderr, "%u change events posted over %0.1f ms, %u delivered\n",
+            N_CHANGES, (double) (last_change - start) / PA_USEC_PER_MSEC, n.n_changes);
+
+    /* The first one right away, then at most one per window. However
+     * long the sleeps and timers took, the deliveries are at least a
+     * window apart. */
+    fail_unless(n.n_changes >= 2);
+    fail_unless(n.n_changes <= (n.last_event - start) / COALESCE_USEC + 1);
+
+    /* And nothing is left over */
+    n_changes = n.n_changes;
+    run_for(2 * COALESCE_USEC);
+    fail_unless(n.n_changes == n_changes);
+
+    pa_subscription_free(s);
+    teardown();
+}
+END_TEST
+
+START_TEST (no_coalesce_test) {
+    struct counter n;
+    pa_subscription *s;
+
+    setup(0);
+    pa_zero(n);
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, counting_cb, &n);
+
+    drag_slider(7);
+    run_for(COALESCE_USEC);
+
+    fail_unless(n.n_changes == N_CHANGES);
+
+    pa_subscription_free(s);
+    teardown();
+}
+END_TEST
+
+START_TEST (remove_test) {
+    struct counter n;
+    pa_subscription *s;
+
+    setup(LONG_COALESCE_USEC);
+    pa_zero(n);
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, counting_cb, &n);
+
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, 3);
+    dispatch();
+    fail_unless(n.n_changes == 1);
+
+    /* Held back, and then made pointless by the removal */
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, 3);
+    dispatch();
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_REMOVE, 3);
+    dispatch();
+
+    fail_unless(n.n_changes == 1);
+    fail_unless(n.n_events == 2);
+    fail_unless((n.last_type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE);
+
+    pa_subscription_free(s);
+    teardown();
+}
+END_TEST
+
+START_TEST (remove_unsubscribed_test) {
+    struct counter n;
+    pa_subscription *s;
+    uint32_t i;
+
+    setup(COALESCE_USEC);
+    pa_zero(n);
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, counting_cb, &n);
+
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, 3);
+    dispatch();
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, 3);
+    dispatch();
+    fail_unless(n.n_changes == 1);
+
+    /* The held back change must go with the object, although nobody
+     * hears of the removal */
+    pa_subscription_free(s);
+    dispatch();
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_REMOVE, 3);
+
+    /* And the object may be forgotten before the change was due */
+    for (i = 0; i < MAX_REMOVED_OBJECTS; i++)
+        pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_REMOVE, i);
+
+    pa_zero(n);
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, counting_cb, &n);
+    run_for(2 * COALESCE_USEC);
+    fail_unless(n.n_events == 0);
+
+    pa_subscription_free(s);
+    teardown();
+}
+END_TEST
+
+START_TEST (filter_test) {
+    struct counter all, filtered;
+    pa_subscription *s, *f;
+    const uint32_t indexes[] = { 4, 2 };
+    uint32_t i;
+
+    setup(COALESCE_USEC);
+    pa_zero(all);
+    pa_zero(filtered);
+    s = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, counting_cb, &all);
+    f = pa_subscription_new(core, PA_SUBSCRIPTION_MASK_ALL, counting_cb, &filtered);
+    pa_subscription_set_filter(f, PA_SUBSCRIPTION_EVENT_SINK_INPUT, indexes, PA_ELEMENTSOF(indexes), NULL, NULL);
+
+    for (i = 0; i < N_OBJECTS; i++)
+        pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_NEW, i);
+
+    /* Other facilities are not affected */
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, 0);
+    dispatch();
+
+    fail_unless(all.n_events == N_OBJECTS + 1);
+    fail_unless(filtered.n_events == PA_ELEMENTSOF(indexes) + 1);
+
+    /* Dropping the filter lets everything through again */
+    pa_subscription_set_filter(f, PA_SUBSCRIPTION_EVENT_SINK_INPUT, NULL, 0, NULL, NULL);
+
+    for (i = 0; i < N_OBJECTS; i++)
+        pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_REMOVE, i);
+    dispatch();
+
+    fail_unless(filtered.n_events == PA_ELEMENTSOF(indexes) + 1 + N_OBJECTS);
+
+    pa_subscription_free(s);
+    pa_subscription_free(f);
+    teardown();
+}
+END_TEST
+
+struct removed {
+    unsigned n;
+    pa_subscription_event_type_t facility;
+    uint32_t first, last;
+};
+
+static void removed_cb(pa_subscription_event_type_t facility, uint32_t idx, void *userdata) {
+    struct removed *r = userdata;
+
+    if (r->n == 0)
+        r->first = idx;
+
+    r->n++;
+    r->facility = facility;
+    r->last = idx;
+}
+
+START_TEST (generation_test) {
+    struct removed r;
+    uint64_t g, g_new, g_changed;
+
+    setup(COALESCE_USEC);
+
+    /* Objects nothing is known about have to be taken as new */
+    g = pa_subscription_get_generation(core);
+    fail_unless(g > 0);
+    fail_unless(pa_subscription_generation_is_known(core, g));
+    fail_unless(!pa_subscription_generation_is_known(core, g + 1));
+    fail_unless(pa_subscription_get_object_generation(core, PA_SUBSCRIPTION_EVENT_SINK, 0) == g);
+
+    /* This works without any subscribers */
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, 0);
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, 1);
+    g_new = pa_subscription_get_generation(core);
+    fail_unless(g_new == g + 2);
+
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 1);
+    g_changed = pa_subscription_get_generation(core);
+
+    /* A delta since g_new only has sink 1, and the same index in
+     * another facility is a different object */
+    fail_unless(pa_subscription_get_object_generation(core, PA_SUBSCRIPTION_EVENT_SINK, 0) <= g_new);
+    fail_unless(pa_subscription_get_object_generation(core, PA_SUBSCRIPTION_EVENT_SINK, 1) == g_changed);
+    fail_unless(pa_subscription_get_object_generation(core, PA_SUBSCRIPTION_EVENT_SOURCE, 1) == g_changed);
+    fail_unless(pa_subscription_foreach_removed(core, g, NULL, NULL) == 0);
+
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_REMOVE, 0);
+
+    /* Removals are only told to those which haven't seen them */
+    pa_zero(r);
+    fail_unless(pa_subscription_foreach_removed(core, g_changed, removed_cb, &r) == 1);
+    fail_unless(r.n == 1);
+    fail_unless(r.facility == PA_SUBSCRIPTION_EVENT_SINK);
+    fail_unless(r.last == 0);
+    fail_unless(pa_subscription_foreach_removed(core, pa_subscription_get_generation(core), NULL, NULL) == 0);
+
+    /* An index which is reused is no longer removed */
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, 0);
+    fail_unless(pa_subscription_foreach_removed(core, g, NULL, NULL) == 0);
+    fail_unless(pa_subscription_get_object_generation(core, PA_SUBSCRIPTION_EVENT_SINK, 0) == pa_subscription_get_generation(core));
+
+    teardown();
+}
+END_TEST
+
+START_TEST (horizon_test) {
+    struct removed r;
+    uint64_t g, g_first;
+    uint32_t i;
+
+    setup(COALESCE_USEC);
+
+    for (i = 0; i <= MAX_REMOVED_OBJECTS; i++)
+        pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_NEW, i);
+
+    g = pa_subscription_get_generation(core);
+
+    /* Exactly as many as are remembered */
+    for (i = 0; i < MAX_REMOVED_OBJECTS; i++)
+        pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_REMOVE, i);
+
+    fail_unless(pa_subscription_generation_is_known(core, g));
+
+    pa_zero(r);
+    fail_unless(pa_subscription_foreach_removed(core, g, removed_cb, &r) == MAX_REMOVED_OBJECTS);
+    fail_unless(r.first == 0);
+    fail_unless(r.last == MAX_REMOVED_OBJECTS - 1);
+
+    g_first = g + 1;
+
+    /* One more, and the first removal is forgotten. Only those which
+     * have seen it can still get a delta. */
+    pa_subscription_post(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_REMOVE, MAX_REMOVED_OBJECTS);
+
+    fail_unless(!pa_subscription_generation_is_known(core, g));
+    fail_unless(pa_subscription_generation_is_known(core, g_first));
+
+    pa_zero(r);
+    fail_unless(pa_subscription_foreach_removed(core, g_first, removed_cb, &r) == MAX_REMOVED_OBJECTS);
+    fail_unless(r.first == 1);
+    fail_unless(r.last == MAX_REMOVED_OBJECTS);
+
+    /* Nothing is known about the forgotten object any more */
+    fail_unless(pa_subscription_get_object_generation(core, PA_SUBSCRIPTION_EVENT_SINK_INPUT, 0) == pa_subscription_get_generation(core));
+
+    teardown();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Core subscribe");
+    tc = tcase_create("coresubscribe");
+    tcase_add_test(tc, coalesce_test);
+    tcase_add_test(tc, no_coalesce_test);
+    tcase_add_test(tc, remove_test);
+    tcase_add_test(tc, remove_unsubscribed_test);
+    tcase_add_test(tc, filter_test);
+    tcase_add_test(tc, generation_test);
+    tcase_add_test(tc, horizon_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
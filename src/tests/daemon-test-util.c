@@ -0,0 +1,382 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <math.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+#include <pulse/mainloop.h>
+
+#include "daemon-test-util.h"
+
+#define MAX_MODULES 32
+
+static const char *bname = NULL;
+static daemon_test_cb_t context_ready_cb = NULL;
+static pa_mainloop_api *mainloop_api = NULL;
+
+static uint32_t module_index[MAX_MODULES];
+static unsigned n_modules = 0;
+static unsigned n_unloading = 0;
+static daemon_test_cb_t unloaded_cb = NULL;
+
+static long server_pid = -1;
+
+struct load_data {
+    daemon_test_cb_t cb;
+};
+
+struct stream_data {
+    pa_stream *stream;
+    daemon_test_stream_cb_t ready_cb;
+
+    const uint8_t *data;
+    size_t length, total, written;
+    daemon_test_stream_cb_t drained_cb;
+
+    struct stream_data *next;
+};
+
+static struct stream_data *streams = NULL;
+
+static void load_cb(pa_context *c, uint32_t idx, void *userdata) {
+    struct load_data *d = userdata;
+    daemon_test_cb_t cb = d->cb;
+
+    pa_xfree(d);
+
+    fail_unless(idx != PA_INVALID_INDEX, "Failed to load module: %s", pa_strerror(pa_context_errno(c)));
+    fail_unless(n_modules < MAX_MODULES);
+
+    module_index[n_modules++] = idx;
+
+    if (cb)
+        cb(c);
+}
+
+void daemon_test_load_module(pa_context *c, const char *name, const char *args, daemon_test_cb_t cb) {
+    struct load_data *d;
+
+    d = pa_xnew(struct load_data, 1);
+    d->cb = cb;
+
+    pa_operation_unref(pa_context_load_module(c, name, args, load_cb, d));
+}
+
+static void unload_cb(pa_context *c, int success, void *userdata) {
+    fail_unless(success);
+
+    if (--n_unloading > 0)
+        return;
+
+    if (unloaded_cb)
+        unloaded_cb(c);
+    else
+        pa_context_disconnect(c);
+}
+
+void daemon_test_unload_modules(pa_context *c, daemon_test_cb_t cb) {
+    unloaded_cb = cb;
+
+    if (n_modules == 0) {
+        n_unloading = 1;
+        unload_cb(c, 1, NULL);
+        return;
+    }
+
+    n_unloading = n_modules;
+
+    /* Modules sitting on top of others go first */
+    while (n_modules > 0)
+        pa_operation_unref(pa_context_unload_module(c, module_index[--n_modules], unload_cb, NULL));
+}
+
+static void stream_state_cb(pa_stream *s, void *userdata) {
+    struct stream_data *d = userdata;
+
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_UNCONNECTED:
+        case PA_STREAM_CREATING:
+            break;
+
+        case PA_STREAM_READY:
+            if (d->ready_cb)
+                d->ready_cb(s);
+            break;
+
+        case PA_STREAM_TERMINATED: {
+            struct stream_data **p;
+
+            for (p = &streams; *p != d; p = &(*p)->next)
+                ;
+
+            *p = d->next;
+            pa_xfree(d);
+            break;
+        }
+
+        default:
+        case PA_STREAM_FAILED:
+            fail("Stream error: %s", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+    }
+}
+
+pa_stream *daemon_test_stream_new(pa_context *c, const char *name, const pa_sample_spec *ss, const pa_channel_map *map, daemon_test_stream_cb_t ready_cb) {
+    struct stream_data *d;
+    pa_stream *s;
+
+    s = pa_stream_new(c, name, ss, map);
+    fail_unless(s != NULL);
+
+    d = pa_xnew0(struct stream_data, 1);
+    d->stream = s;
+    d->ready_cb = ready_cb;
+    d->next = streams;
+    streams = d;
+
+    pa_stream_set_state_callback(s, stream_state_cb, d);
+
+    return s;
+}
+
+static void drain_cb(pa_stream *s, int success, void *userdata) {
+    struct stream_data *d = userdata;
+
+    fail_unless(success);
+
+    if (d->drained_cb)
+        d->drained_cb(s);
+}
+
+static void stream_write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    struct stream_data *d = userdata;
+
+    while (nbytes > 0 && (d->total == 0 || d->written < d->total)) {
+        size_t offset = d->written % d->length;
+        size_t l = d->length - offset;
+
+        if (l > nbytes)
+            l = nbytes;
+        if (d->total > 0 && l > d->total - d->written)
+            l = d->total - d->written;
+
+        fail_unless(pa_stream_write(s, d->data + offset, l, NULL, 0, PA_SEEK_RELATIVE) == 0);
+
+        d->written += l;
+        nbytes -= l;
+    }
+
+    if (d->total > 0 && d->written >= d->total) {
+        pa_stream_set_write_callback(s, NULL, NULL);
+        pa_operation_unref(pa_stream_drain(s, drain_cb, d));
+    }
+}
+
+void daemon_test_play(pa_stream *s, const void *data, size_t length, size_t total, daemon_test_stream_cb_t drained_cb) {
+    struct stream_data *d;
+
+    fail_unless(length > 0);
+
+    for (d = streams; d && d->stream != s; d = d->next)
+        ;
+
+    /* Only works on streams made by daemon_test_stream_new() */
+    fail_unless(d != NULL);
+
+    d->data = data;
+    d->length = length;
+    d->total = total;
+    d->written = 0;
+    d->drained_cb = drained_cb;
+
+    pa_stream_set_write_callback(s, stream_write_cb, d);
+}
+
+void daemon_test_sine(int16_t *data, unsigned frames, unsigned rate, unsigned hz) {
+    unsigned i;
+
+    for (i = 0; i < frames; i++)
+        data[2*i] = data[2*i+1] = (int16_t) (sin(((double) i/rate)*2*M_PI*hz) * 0x3fff);
+}
+
+static void find_server_pid(void) {
+    const char *rp;
+    char fn[256];
+    FILE *f;
+
+    if (server_pid > 0)
+        return;
+
+    rp = getenv("PULSE_RUNTIME_PATH");
+    fail_unless(rp != NULL, "PULSE_RUNTIME_PATH is not set, cannot find the daemon to measure. Run the test with test-daemon.sh.");
+
+    snprintf(fn, sizeof(fn), "%s/pid", rp);
+
+    f = fopen(fn, "r");
+    fail_unless(f != NULL, "Cannot open %s to find the daemon to measure.", fn);
+
+    if (fscanf(f, "%li", &server_pid) != 1)
+        server_pid = -1;
+
+    fclose(f);
+
+    fail_unless(server_pid > 0, "No PID in %s.", fn);
+}
+
+pa_usec_t daemon_test_get_cpu(void) {
+    char fn[64], buf[1024], *p;
+    unsigned long long utime, stime;
+    FILE *f;
+
+    find_server_pid();
+
+    snprintf(fn, sizeof(fn), "/proc/%li/stat", server_pid);
+
+    f = fopen(fn, "r");
+    fail_unless(f != NULL, "Cannot open %s, the daemon is gone.", fn);
+
+    p = fgets(buf, sizeof(buf), f);
+    fclose(f);
+
+    /* Skip over the command name, it may contain spaces */
+    fail_unless(p && (p = strrchr(buf, ')')), "Cannot parse %s.", fn);
+    fail_unless(sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) == 2, "Cannot parse %s.", fn);
+
+    return (pa_usec_t) (utime + stime) * PA_USEC_PER_SEC / (pa_usec_t) sysconf(_SC_CLK_TCK);
+}
+
+unsigned long long daemon_test_get_switches(void) {
+    char fn[64], buf[256];
+    unsigned long long sum = 0, n;
+    struct dirent *de;
+    DIR *d;
+
+    find_server_pid();
+
+    snprintf(fn, sizeof(fn), "/proc/%li/task", server_pid);
+
+    d = opendir(fn);
+    fail_unless(d != NULL, "Cannot open %s, the daemon is gone.", fn);
+
+    while ((de = readdir(d))) {
+        FILE *f;
+
+        if (de->d_name[0] == '.')
+            continue;
+
+        snprintf(fn, sizeof(fn), "/proc/%li/task/%s/status", server_pid, de->d_name);
+
+        /* Threads may go away meanwhile */
+        if (!(f = fopen(fn, "r")))
+            continue;
+
+        while (fgets(buf, sizeof(buf), f))
+            if (sscanf(buf, "voluntary_ctxt_switches: %llu", &n) == 1 ||
+                sscanf(buf, "nonvoluntary_ctxt_switches: %llu", &n) == 1)
+                sum += n;
+
+        fclose(f);
+    }
+
+    closedir(d);
+
+    return sum;
+}
+
+static void context_state_callback(pa_context *c, void *userdata) {
+    fail_unless(c != NULL);
+
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+            break;
+
+        case PA_CONTEXT_READY:
+            fprintf(stderr, "Connection established.\n");
+            context_ready_cb(c);
+            break;
+
+        case PA_CONTEXT_TERMINATED:
+            mainloop_api->quit(mainloop_api, 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+        default:
+            fail("Context error: %s", pa_strerror(pa_context_errno(c)));
+    }
+}
+
+START_TEST (daemon_test) {
+    pa_mainloop* m = NULL;
+    pa_context *context;
+    int ret = 0;
+
+    m = pa_mainloop_new();
+    fail_unless(m != NULL);
+
+    mainloop_api = pa_mainloop_get_api(m);
+
+    context = pa_context_new(mainloop_api, bname);
+    fail_unless(context != NULL);
+
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+
+    fail_unless(pa_context_connect(context, NULL, 0, NULL) >= 0, "pa_context_connect() failed.");
+    fail_unless(pa_mainloop_run(m, &ret) >= 0, "pa_mainloop_run() failed.");
+
+    pa_context_unref(context);
+    pa_mainloop_free(m);
+
+    fail_unless(ret == 0);
+}
+END_TEST
+
+int daemon_test_main(const char *suite_name, const char *argv0, daemon_test_cb_t ready_cb) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv0;
+    context_ready_cb = ready_cb;
+
+    s = suite_create(suite_name);
+    tc = tcase_create("daemon");
+    tcase_add_test(tc, daemon_test);
+    tcase_set_timeout(tc, 5 * 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,70 @@
+#ifndef foodaemontestutilhfoo
+#define foodaemontestutilhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/pulseaudio.h>
+
+/* Common code of the tests which need a running daemon (TESTS_daemon
+ * in Makefile.am, run with "make check-daemon"). A test consists of a
+ * chain of callbacks which starts once the context is ready and ends
+ * with daemon_test_unload_modules() or pa_context_disconnect(). Every
+ * error fails the test. */
+
+typedef void (*daemon_test_cb_t)(pa_context *c);
+typedef void (*daemon_test_stream_cb_t)(pa_stream *s);
+
+/* Runs a check suite with a single test which connects to the daemon,
+ * calls ready_cb and runs the main loop until the context terminates */
+int daemon_test_main(const char *suite_name, const char *argv0, daemon_test_cb_t ready_cb);
+
+/* Loads a module, remembers it for daemon_test_unload_modules() and
+ * calls cb once it is loaded */
+void daemon_test_load_module(pa_context *c, const char *name, const char *args, daemon_test_cb_t cb);
+
+/* Unloads all modules loaded so far, the last loaded one first, and
+ * calls cb once they are gone. If cb is NULL the context is
+ * disconnected, which ends the test. */
+void daemon_test_unload_modules(pa_context *c, daemon_test_cb_t cb);
+
+/* Creates a stream which fails the test if it fails, and calls
+ * ready_cb (if not NULL) when it is ready */
+pa_stream *daemon_test_stream_new(pa_context *c, const char *name, const pa_sample_spec *ss, const pa_channel_map *map, daemon_test_stream_cb_t ready_cb);
+
+/* Makes s play data, length bytes repeated over and over, until total
+ * bytes have been written, then drains it and calls drained_cb. With a
+ * total of 0 it plays until it is disconnected. Call before
+ * connecting the stream. */
+void daemon_test_play(pa_stream *s, const void *data, size_t length, size_t total, daemon_test_stream_cb_t drained_cb);
+
+/* Fills frames of interleaved stereo with a sine of the given frequency */
+void daemon_test_sine(int16_t *data, unsigned frames, unsigned rate, unsigned hz);
+
+/* The CPU time (user plus system) the daemon used so far in usec, and
+ * the sum of the context switches of all its threads. The daemon is
+ * found by the PID file in $PULSE_RUNTIME_PATH, as set by
+ * test-daemon.sh; if it can't be found the test fails, rather than
+ * reporting nothing. */
+pa_usec_t daemon_test_get_cpu(void);
+unsigned long long daemon_test_get_switches(void);
+
+#endif
@@ -0,0 +1,223 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include "daemon-test-util.h"
+
+/* Plays a few seconds of audio to a null sink, first directly and then
+ * through a stack of virtual sinks, and reports the CPU time the daemon
+ * spent and the average stream latency for both cases. The virtual
+ * sinks process what they render in place (pa_sink_render_filtered()),
+ * but each of them is still a sink of its own on top of the next.
+ *
+ * The monitor of the null sink is recorded to check that the whole sine
+ * arrives unharmed both ways, and the filters, which keep no audio
+ * buffered, may not add much latency. */
+
+#define NFILTERS 3
+#define SINE_HZ 440
+#define SAMPLE_HZ 44100
+#define PLAY_SECONDS 5
+#define LATENCY_INTERVAL_USEC (50*PA_USEC_PER_MSEC)
+#define MAX_FILTER_LATENCY_USEC (20*PA_USEC_PER_MSEC)
+
+static pa_stream *stream = NULL;
+static pa_stream *monitor = NULL;
+static pa_time_event *latency_event = NULL;
+static unsigned n_filters = 0;
+
+/* 0 when playing to the null sink, 1 when playing through the filters */
+static int filtered = 0;
+
+static int16_t data[SAMPLE_HZ*2]; /* one second of stereo audio */
+
+static pa_usec_t latency_sum = 0;
+static unsigned n_latency = 0;
+static pa_usec_t direct_latency = 0;
+
+/* What the monitor picked up while playing, and the peak it should see */
+static int16_t peak = 0, data_peak = 0;
+static size_t n_audible = 0;
+
+static pa_usec_t cpu_start = 0;
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_S16NE,
+    .rate = SAMPLE_HZ,
+    .channels = 2
+};
+
+static void create_stream(pa_context *c);
+
+static void drained_cb(pa_stream *s) {
+    pa_context *c = pa_stream_get_context(s);
+    const char *what = filtered ? "Through the filters" : "Directly";
+
+    fprintf(stderr, "%s: %0.2f ms daemon CPU time per second of audio\n", what,
+            (double) (daemon_test_get_cpu() - cpu_start) / PA_USEC_PER_MSEC / PLAY_SECONDS);
+
+    fail_unless(n_latency > 0);
+    fprintf(stderr, "%s: %0.2f ms average latency\n", what, (double) latency_sum / n_latency / PA_USEC_PER_MSEC);
+
+    pa_context_rttime_restart(c, latency_event, PA_USEC_INVALID);
+
+    /* All of the sine made it to the null sink, neither silenced nor
+     * changed on the way. Some of it may still be on its way to the
+     * monitor. */
+    fail_unless(peak == data_peak, "Peak is %i rather than %i", peak, data_peak);
+    fail_unless(n_audible >= (PLAY_SECONDS - 1) * SAMPLE_HZ,
+                "Only %lu of %u frames arrived", (unsigned long) n_audible, PLAY_SECONDS * SAMPLE_HZ);
+
+    if (!filtered)
+        direct_latency = latency_sum / n_latency;
+    else
+        fail_unless(latency_sum / n_latency <= direct_latency + NFILTERS * MAX_FILTER_LATENCY_USEC,
+                    "The filters added %0.2f ms of latency",
+                    ((double) (latency_sum / n_latency) - direct_latency) / PA_USEC_PER_MSEC);
+
+    pa_stream_disconnect(s);
+    pa_stream_unref(s);
+    stream = NULL;
+
+    if (!filtered) {
+        /* Once more, through the filters */
+        filtered = 1;
+        create_stream(c);
+    } else {
+        pa_stream_disconnect(monitor);
+        pa_stream_unref(monitor);
+        monitor = NULL;
+
+        daemon_test_unload_modules(c, NULL);
+    }
+}
+
+static void latency_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    pa_context *c = userdata;
+    pa_usec_t latency;
+    int negative;
+
+    if (stream && pa_stream_get_latency(stream, &latency, &negative) >= 0 && !negative) {
+        latency_sum += latency;
+        n_latency++;
+    }
+
+    pa_context_rttime_restart(c, e, pa_rtclock_now() + LATENCY_INTERVAL_USEC);
+}
+
+static void stream_ready_cb(pa_stream *s) {
+    pa_context *c = pa_stream_get_context(s);
+
+    fprintf(stderr, "Playing %u seconds of audio %s.\n", PLAY_SECONDS,
+            filtered ? "through the filters" : "directly");
+    cpu_start = daemon_test_get_cpu();
+
+    if (latency_event)
+        pa_context_rttime_restart(c, latency_event, pa_rtclock_now() + LATENCY_INTERVAL_USEC);
+    else
+        latency_event = pa_context_rttime_new(c, pa_rtclock_now() + LATENCY_INTERVAL_USEC, latency_cb, c);
+}
+
+static void create_stream(pa_context *c) {
+    char name[32];
+
+    snprintf(name, sizeof(name), "filter_test%u", filtered ? NFILTERS : 0);
+
+    latency_sum = 0;
+    n_latency = 0;
+    peak = 0;
+    n_audible = 0;
+
+    stream = daemon_test_stream_new(c, "filter chain test", &sample_spec, NULL, stream_ready_cb);
+    daemon_test_play(stream, data, sizeof(data), PLAY_SECONDS * sizeof(data), drained_cb);
+    fail_unless(pa_stream_connect_playback(stream, name, NULL,
+                                           PA_STREAM_INTERPOLATE_TIMING|PA_STREAM_AUTO_TIMING_UPDATE,
+                                           NULL, NULL) == 0);
+}
+
+static void monitor_read_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    const void *p;
+    const int16_t *d;
+    size_t i, n;
+
+    while (pa_stream_readable_size(s) > 0) {
+        fail_unless(pa_stream_peek(s, &p, &nbytes) == 0);
+
+        /* Only count what arrives while playing */
+        if (p && stream) {
+            d = p;
+            n = nbytes / sizeof(int16_t);
+
+            for (i = 0; i < n; i += 2) {
+                if (abs(d[i]) > peak)
+                    peak = (int16_t) abs(d[i]);
+                if (d[i] != 0 || d[i+1] != 0)
+                    n_audible++;
+            }
+        }
+
+        fail_unless(pa_stream_drop(s) == 0);
+    }
+}
+
+static void monitor_ready_cb(pa_stream *s) {
+    create_stream(pa_stream_get_context(s));
+}
+
+static void load_next_filter(pa_context *c) {
+    char args[64];
+
+    if (n_filters >= NFILTERS) {
+        monitor = daemon_test_stream_new(c, "filter chain monitor", &sample_spec, NULL, monitor_ready_cb);
+        pa_stream_set_read_callback(monitor, monitor_read_cb, NULL);
+        fail_unless(pa_stream_connect_record(monitor, "filter_test0.monitor", NULL, 0) == 0);
+        return;
+    }
+
+    /* Each filter sits on top of the one loaded before */
+    n_filters++;
+    snprintf(args, sizeof(args), "sink_name=filter_test%u master=filter_test%u", n_filters, n_filters - 1);
+    daemon_test_load_module(c, "module-virtual-sink", args, load_next_filter);
+}
+
+static void context_ready_cb(pa_context *c) {
+    daemon_test_load_module(c, "module-null-sink", "sink_name=filter_test0", load_next_filter);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned i;
+
+    daemon_test_sine(data, SAMPLE_HZ, SAMPLE_HZ, SINE_HZ);
+
+    for (i = 0; i < SAMPLE_HZ*2; i++)
+        if (abs(data[i]) > data_peak)
+            data_peak = (int16_t) abs(data[i]);
+
+    return daemon_test_main("Filter Chain", argv[0], context_ready_cb);
+}
@@ -0,0 +1,265 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/pdispatch.h>
+#include <pulsecore/pstream.h>
+#include <pulsecore/pstream-util.h>
+#include <pulsecore/native-common.h>
+#include <pulsecore/socket.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* A client pipelines a large number of requests to a server over a
+ * UNIX socket pair, the way a client changing the volume of many
+ * streams at once does, and waits for all the replies. Then it
+ * registers as many replies which never come and waits for them to
+ * time out. The mainloop API pdispatch gets is wrapped to count the
+ * timer events it creates. */
+
+#define N_REQUESTS 10000
+#define TIMEOUT 1
+
+static pa_mainloop *mainloop;
+static pa_mainloop_api api;
+static pa_mempool *pool;
+static unsigned n_time_new;
+
+static pa_pstream *client_pstream, *server_pstream;
+static pa_pdispatch *client_pdispatch, *server_pdispatch;
+
+static unsigned n_replies, n_timeouts;
+static uint32_t next_tag;
+
+struct counted_time_event {
+    pa_time_event_cb_t callback;
+    void *userdata;
+};
+
+static void counted_time_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    struct counted_time_event *c = userdata;
+
+    c->callback(&api, e, tv, c->userdata);
+}
+
+static void counted_time_destroy(pa_mainloop_api *a, pa_time_event *e, void *userdata) {
+    pa_xfree(userdata);
+}
+
+static pa_time_event* counting_time_new(pa_mainloop_api *a, const struct timeval *tv, pa_time_event_cb_t cb, void *userdata) {
+    pa_mainloop_api *m = pa_mainloop_get_api(mainloop);
+    struct counted_time_event *c;
+    pa_time_event *e;
+
+    n_time_new++;
+
+    c = pa_xnew(struct counted_time_event, 1);
+    c->callback = cb;
+    c->userdata = userdata;
+
+    e = m->time_new(m, tv, counted_time_cb, c);
+    m->time_set_destroy(e, counted_time_destroy);
+
+    return e;
+}
+
+static void command_stat(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    fail_unless(pa_tagstruct_eof(t));
+
+    pa_pstream_send_simple_ack(server_pstream, tag);
+}
+
+static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
+    [PA_COMMAND_STAT] = command_stat
+};
+
+static void server_packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    fail_unless(pa_pdispatch_run(server_pdispatch, packet, creds, NULL) == 0);
+}
+
+static void client_packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    fail_unless(pa_pdispatch_run(client_pdispatch, packet, creds, NULL) == 0);
+}
+
+static void die_cb(pa_pstream *p, void *userdata) {
+    fail();
+}
+
+static void reply_cb(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    fail_unless(command == PA_COMMAND_REPLY);
+
+    /* The server answers in order */
+    fail_unless(tag == n_replies);
+
+    if (++n_replies >= N_REQUESTS)
+        pa_mainloop_quit(mainloop, 0);
+}
+
+static void timeout_cb(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    fail_unless(command == PA_COMMAND_TIMEOUT);
+    fail_unless(t == NULL);
+
+    if (++n_timeouts >= N_REQUESTS)
+        pa_mainloop_quit(mainloop, 0);
+}
+
+static void setup(void) {
+    pa_iochannel *io;
+    int fds[2];
+
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    api = *pa_mainloop_get_api(mainloop);
+    api.time_new = counting_time_new;
+    n_time_new = 0;
+
+    pool = pa_mempool_new(FALSE, 0);
+    fail_unless(pool != NULL);
+
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    pa_make_fd_nonblock(fds[0]);
+    pa_make_fd_nonblock(fds[1]);
+
+    io = pa_iochannel_new(pa_mainloop_get_api(mainloop), fds[0], fds[0]);
+    client_pstream = pa_pstream_new(pa_mainloop_get_api(mainloop), io, pool);
+    pa_pstream_set_die_callback(client_pstream, die_cb, NULL);
+    pa_pstream_set_receive_packet_callback(client_pstream, client_packet_cb, NULL);
+    client_pdispatch = pa_pdispatch_new(&api, TRUE, NULL, 0);
+
+    io = pa_iochannel_new(pa_mainloop_get_api(mainloop), fds[1], fds[1]);
+    server_pstream = pa_pstream_new(pa_mainloop_get_api(mainloop), io, pool);
+    pa_pstream_set_die_callback(server_pstream, die_cb, NULL);
+    pa_pstream_set_receive_packet_callback(server_pstream, server_packet_cb, NULL);
+    server_pdispatch = pa_pdispatch_new(&api, TRUE, command_table, PA_COMMAND_MAX);
+
+    n_replies = n_timeouts = 0;
+    next_tag = 0;
+}
+
+static void teardown(void) {
+    pa_pdispatch_unref(client_pdispatch);
+    pa_pdispatch_unref(server_pdispatch);
+
+    pa_pstream_unlink(client_pstream);
+    pa_pstream_unref(client_pstream);
+    pa_pstream_unlink(server_pstream);
+    pa_pstream_unref(server_pstream);
+
+    pa_mempool_free(pool);
+    pa_mainloop_free(mainloop);
+}
+
+START_TEST (pipeline_test) {
+    pa_usec_t start, elapsed;
+    unsigned i;
+
+    setup();
+
+    start = pa_rtclock_now();
+
+    for (i = 0; i < N_REQUESTS; i++) {
+        pa_tagstruct *t;
+
+        t = pa_tagstruct_new(NULL, 0);
+        pa_tagstruct_putu32(t, PA_COMMAND_STAT);
+        pa_tagstruct_putu32(t, next_tag);
+        pa_pstream_send_tagstruct(client_pstream, t);
+
+        pa_pdispatch_register_reply(client_pdispatch, next_tag++, 30, reply_cb, NULL, NULL);
+    }
+
+    fail_unless(pa_mainloop_run(mainloop, NULL) >= 0);
+
+    elapsed = pa_rtclock_now() - start;
+
+    fail_unless(n_replies == N_REQUESTS);
+    fail_unless(!pa_pdispatch_is_pending(client_pdispatch));
+
+    fprintf(stderr, "%u pipelined requests answered in %0.1f ms, %u timer events created\n",
+            N_REQUESTS, (double) elapsed / PA_USEC_PER_MSEC, n_time_new);
+
+    /* A single one serves all pending replies */
+    fail_unless(n_time_new <= 1);
+
+    teardown();
+}
+END_TEST
+
+START_TEST (timeout_test) {
+    pa_usec_t start, elapsed;
+    unsigned i;
+
+    setup();
+
+    start = pa_rtclock_now();
+
+    for (i = 0; i < N_REQUESTS; i++)
+        pa_pdispatch_register_reply(client_pdispatch, next_tag++, TIMEOUT, timeout_cb, NULL, NULL);
+
+    fail_unless(pa_mainloop_run(mainloop, NULL) >= 0);
+
+    elapsed = pa_rtclock_now() - start;
+
+    fail_unless(n_timeouts == N_REQUESTS);
+    fail_unless(!pa_pdispatch_is_pending(client_pdispatch));
+    fail_unless(elapsed >= TIMEOUT * PA_USEC_PER_SEC - 100 * PA_USEC_PER_MSEC);
+
+    fprintf(stderr, "%u replies timed out after %0.1f ms, %u timer events created\n",
+            N_REQUESTS, (double) elapsed / PA_USEC_PER_MSEC, n_time_new);
+
+    fail_unless(n_time_new <= 1);
+
+    teardown();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Pdispatch");
+    tc = tcase_create("pdispatch");
+    tcase_add_test(tc, pipeline_test);
+    tcase_add_test(tc, timeout_test);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
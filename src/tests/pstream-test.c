@@ -0,0 +1,545 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/pstream.h>
+#include <pulsecore/iochannel.h>
+#include <pulsecore/arpa-inet.h>
+#include <pulsecore/socket.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* Pushes messages from one pstream to another over a UNIX socket pair,
+ * checks that they arrive complete and in order, and reports how many
+ * messages per second got through. Messages are queued in bursts, like
+ * a client which sends a bunch of commands at once, or a server which
+ * answers them. Also checks that writes batching several frames get
+ * them across intact when they end halfway through one, and that
+ * credentials stay with the frames they were sent with. Last,
+ * checks that with a receive budget a flooding peer doesn't keep a
+ * quiet one waiting. */
+
+#define N_MESSAGES 200000
+#define BURST 64
+
+#define PACKET_SIZE 24
+#define MEMBLOCK_CHANNEL 7
+
+#define N_BATCH 20000
+#define CREDS_EVERY 3
+#define SMALL_SNDBUF 4096
+
+#define N_FLOOD 1000
+#define BUDGET 4
+
+static pa_mainloop *mainloop;
+static pa_pstream *sender, *receiver;
+
+/* Every n-th message is a memblock, or none if 0 */
+static unsigned memblock_every;
+static size_t memblock_size;
+
+static unsigned n_total, n_sent, n_received;
+static size_t memblock_received;
+
+static void fill(uint8_t *d, size_t l, unsigned seq) {
+    size_t i;
+
+    for (i = 0; i < l; i++)
+        d[i] = (uint8_t) (seq + i);
+}
+
+/* Checks bytes offset to offset+l of message seq */
+static pa_bool_t check(const uint8_t *d, size_t offset, size_t l, unsigned seq) {
+    size_t i;
+
+    for (i = 0; i < l; i++)
+        if (d[i] != (uint8_t) (seq + offset + i))
+            return FALSE;
+
+    return TRUE;
+}
+
+static pa_bool_t is_memblock(unsigned seq) {
+    return memblock_every > 0 && seq % memblock_every == memblock_every - 1;
+}
+
+static void send_burst(pa_pstream *p, void *userdata) {
+    pa_mempool *pool = userdata;
+    unsigned i;
+
+    for (i = 0; i < BURST && n_sent < n_total; i++, n_sent++) {
+
+        if (is_memblock(n_sent)) {
+            pa_memchunk chunk;
+
+            chunk.memblock = pa_memblock_new(pool, memblock_size);
+            chunk.index = 0;
+            chunk.length = memblock_size;
+
+            fill(pa_memblock_acquire(chunk.memblock), memblock_size, n_sent);
+            pa_memblock_release(chunk.memblock);
+
+            pa_pstream_send_memblock(p, MEMBLOCK_CHANNEL, 0, PA_SEEK_RELATIVE, &chunk);
+            pa_memblock_unref(chunk.memblock);
+        } else {
+            pa_packet *packet;
+
+            packet = pa_packet_new(PACKET_SIZE);
+            fill(packet->data, PACKET_SIZE, n_sent);
+
+            pa_pstream_send_packet(p, packet, NULL);
+            pa_packet_unref(packet);
+        }
+    }
+}
+
+static void message_done(void) {
+    if (++n_received >= n_total)
+        pa_mainloop_quit(mainloop, 0);
+}
+
+static void packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    fail_unless(!is_memblock(n_received));
+    fail_unless(memblock_received == 0);
+    fail_unless(packet->length == PACKET_SIZE);
+
+    fail_unless(check(packet->data, 0, PACKET_SIZE, n_received));
+
+    message_done();
+}
+
+static void memblock_cb(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    uint8_t *d;
+
+    fail_unless(is_memblock(n_received));
+    fail_unless(channel == MEMBLOCK_CHANNEL);
+    fail_unless(memblock_received + chunk->length <= memblock_size);
+
+    /* The payload may come in pieces */
+    d = pa_memblock_acquire_chunk(chunk);
+    fail_unless(check(d, memblock_received, chunk->length, n_received));
+    pa_memblock_release(chunk->memblock);
+
+    if ((memblock_received += chunk->length) >= memblock_size) {
+        memblock_received = 0;
+        message_done();
+    }
+}
+
+static void die_cb(pa_pstream *p, void *userdata) {
+    fail();
+}
+
+static void run(const char *name, unsigned n_messages) {
+    pa_mainloop_api *api;
+    pa_mempool *pool;
+    pa_iochannel *io;
+    pa_usec_t start, elapsed;
+    int fds[2];
+
+    n_sent = n_received = 0;
+    n_total = n_messages;
+    memblock_received = 0;
+
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+    api = pa_mainloop_get_api(mainloop);
+
+    pool = pa_mempool_new(FALSE, 0);
+    fail_unless(pool != NULL);
+
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    pa_make_fd_nonblock(fds[0]);
+    pa_make_fd_nonblock(fds[1]);
+
+    io = pa_iochannel_new(api, fds[0], fds[0]);
+    sender = pa_pstream_new(api, io, pool);
+    pa_pstream_set_die_callback(sender, die_cb, NULL);
+    pa_pstream_set_drain_callback(sender, send_burst, pool);
+
+    io = pa_iochannel_new(api, fds[1], fds[1]);
+    receiver = pa_pstream_new(api, io, pool);
+    pa_pstream_set_die_callback(receiver, die_cb, NULL);
+    pa_pstream_set_receive_packet_callback(receiver, packet_cb, NULL);
+    pa_pstream_set_receive_memblock_callback(receiver, memblock_cb, NULL);
+
+    start = pa_rtclock_now();
+
+    send_burst(sender, pool);
+    fail_unless(pa_mainloop_run(mainloop, NULL) >= 0);
+
+    elapsed = pa_rtclock_now() - start;
+
+    fail_unless(n_received == n_total);
+
+    fprintf(stderr, "%s: %u messages in %0.1f ms, %0.0f messages/s\n", name, n_total,
+            (double) elapsed / PA_USEC_PER_MSEC, (double) n_total * PA_USEC_PER_SEC / (double) elapsed);
+
+    pa_pstream_unlink(sender);
+    pa_pstream_unref(sender);
+    pa_pstream_unlink(receiver);
+    pa_pstream_unref(receiver);
+
+    pa_mempool_free(pool);
+    pa_mainloop_free(mainloop);
+}
+
+START_TEST (packet_test) {
+    memblock_every = 0;
+    run("packets", N_MESSAGES);
+}
+END_TEST
+
+START_TEST (mixed_test) {
+    memblock_every = 4;
+    memblock_size = 1024;
+    run("packets and small memblocks", N_MESSAGES);
+}
+END_TEST
+
+/* Large enough to fill the socket buffer, so that writes end halfway
+ * through a frame */
+START_TEST (large_test) {
+    memblock_every = 2;
+    memblock_size = 60000;
+    run("packets and large memblocks", N_MESSAGES / 10);
+}
+END_TEST
+
+static pa_bool_t with_creds;
+#ifdef HAVE_CREDS
+static pa_creds test_creds;
+#endif
+
+/* Mostly small packets that get batched, now and then one larger
+ * than a small socket buffer */
+static size_t batch_size(unsigned seq) {
+    return seq % 5 == 4 ? 20000 + seq % 1000 : 16 + seq % 64;
+}
+
+static pa_bool_t has_creds(unsigned seq) {
+    return with_creds && seq % CREDS_EVERY == 0;
+}
+
+static void send_batch_burst(pa_pstream *p, void *userdata) {
+    unsigned i;
+
+    for (i = 0; i < BURST && n_sent < n_total; i++, n_sent++) {
+        pa_packet *packet;
+
+        packet = pa_packet_new(batch_size(n_sent));
+        fill(packet->data, packet->length, n_sent);
+
+#ifdef HAVE_CREDS
+        if (has_creds(n_sent))
+            pa_pstream_send_packet(p, packet, &test_creds);
+        else
+#endif
+            pa_pstream_send_packet(p, packet, NULL);
+
+        pa_packet_unref(packet);
+    }
+}
+
+static void batch_packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    fail_unless(packet->length == batch_size(n_received));
+    fail_unless(check(packet->data, 0, packet->length, n_received));
+
+#ifdef HAVE_CREDS
+    if (with_creds) {
+        /* Everything else goes with our own credentials */
+        fail_unless(creds != NULL);
+
+        if (has_creds(n_received))
+            fail_unless(creds->uid == test_creds.uid && creds->gid == test_creds.gid);
+        else
+            fail_unless(creds->uid == getuid() && creds->gid == getgid());
+    }
+#endif
+
+    message_done();
+}
+
+/* Sends N_BATCH packets of batch_size(), every CREDS_EVERY-th with
+ * credentials if creds is TRUE. With a small socket buffer most
+ * writes end halfway through a frame. */
+static void run_batch(const char *name, pa_bool_t creds, pa_bool_t small_sndbuf) {
+    pa_mainloop_api *api;
+    pa_mempool *pool;
+    pa_iochannel *io;
+    int fds[2];
+
+    n_sent = n_received = 0;
+    n_total = N_BATCH;
+    with_creds = creds;
+
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+    api = pa_mainloop_get_api(mainloop);
+
+    pool = pa_mempool_new(FALSE, 0);
+    fail_unless(pool != NULL);
+
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    pa_make_fd_nonblock(fds[0]);
+    pa_make_fd_nonblock(fds[1]);
+
+    io = pa_iochannel_new(api, fds[0], fds[0]);
+    sender = pa_pstream_new(api, io, pool);
+    pa_pstream_set_die_callback(sender, die_cb, NULL);
+    pa_pstream_set_drain_callback(sender, send_batch_burst, NULL);
+
+    if (small_sndbuf)
+        fail_unless(pa_iochannel_socket_set_sndbuf(io, SMALL_SNDBUF) == 0);
+
+    io = pa_iochannel_new(api, fds[1], fds[1]);
+    receiver = pa_pstream_new(api, io, pool);
+    pa_pstream_set_die_callback(receiver, die_cb, NULL);
+    pa_pstream_set_receive_packet_callback(receiver, batch_packet_cb, NULL);
+
+#ifdef HAVE_CREDS
+    if (creds) {
+        fail_unless(pa_iochannel_creds_enable(io) == 0);
+
+        /* Only root may pass on credentials other than its own */
+        test_creds.uid = getuid() == 0 ? 1 : getuid();
+        test_creds.gid = getuid() == 0 ? 1 : getgid();
+    }
+#endif
+
+    send_batch_burst(sender, NULL);
+    fail_unless(pa_mainloop_run(mainloop, NULL) >= 0);
+
+    fail_unless(n_received == n_total);
+
+    fprintf(stderr, "%s: %u packets\n", name, n_total);
+
+    pa_pstream_unlink(sender);
+    pa_pstream_unref(sender);
+    pa_pstream_unlink(receiver);
+    pa_pstream_unref(receiver);
+
+    pa_mempool_free(pool);
+    pa_mainloop_free(mainloop);
+}
+
+START_TEST (partial_test) {
+    run_batch("partial writes", FALSE, TRUE);
+}
+END_TEST
+
+#ifdef HAVE_CREDS
+START_TEST (creds_test) {
+    run_batch("credentials", TRUE, FALSE);
+}
+END_TEST
+
+START_TEST (partial_creds_test) {
+    run_batch("credentials with partial writes", TRUE, TRUE);
+}
+END_TEST
+#endif
+
+static unsigned n_flood_received, n_flood_before_quiet;
+static pa_bool_t quiet_received;
+
+/* If not -1, the quiet request is sent to this fd only once the first
+ * flooded one has been handled */
+static int quiet_late_fd;
+
+static void write_packets(int fd, unsigned seq, unsigned n);
+
+static void flood_packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    fail_unless(packet->length == PACKET_SIZE);
+    fail_unless(check(packet->data, 0, PACKET_SIZE, n_flood_received));
+
+    if (n_flood_received == 0 && quiet_late_fd >= 0)
+        write_packets(quiet_late_fd, 0, 1);
+
+    if (++n_flood_received >= N_FLOOD && quiet_received)
+        pa_mainloop_quit(mainloop, 0);
+}
+
+static void quiet_packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    fail_unless(!quiet_received);
+    fail_unless(packet->length == PACKET_SIZE);
+
+    quiet_received = TRUE;
+    n_flood_before_quiet = n_flood_received;
+
+    if (n_flood_received >= N_FLOOD)
+        pa_mainloop_quit(mainloop, 0);
+}
+
+/* Writes packet frames seq to seq+n-1 to fd in one go, without a
+ * pstream, so that they all wait on the socket right from the start */
+static void write_packets(int fd, unsigned seq, unsigned n) {
+    const size_t frame_size = 5 * sizeof(uint32_t) + PACKET_SIZE;
+    uint8_t *data;
+    unsigned i;
+
+    data = pa_xmalloc(frame_size * n);
+
+    for (i = 0; i < n; i++) {
+        uint32_t *frame = (uint32_t*) (data + i * frame_size);
+
+        frame[0] = htonl(PACKET_SIZE);
+        frame[1] = htonl((uint32_t) -1);
+        frame[2] = frame[3] = frame[4] = 0;
+        fill((uint8_t*) (frame + 5), PACKET_SIZE, seq + i);
+    }
+
+    fail_unless(pa_loop_write(fd, data, frame_size * n, NULL) == (ssize_t) (frame_size * n));
+    pa_xfree(data);
+}
+
+static pa_pstream *new_receiver(pa_mainloop_api *api, int fd, pa_mempool *pool, pa_pstream_packet_cb_t cb) {
+    pa_pstream *p;
+
+    p = pa_pstream_new(api, pa_iochannel_new(api, fd, fd), pool);
+    pa_pstream_set_die_callback(p, die_cb, NULL);
+    pa_pstream_set_receive_packet_callback(p, cb, NULL);
+    pa_pstream_set_receive_budget(p, BUDGET);
+
+    return p;
+}
+
+/* One peer sends lots of requests at once, another one a single
+ * request right after, or only once the first flooded one has been
+ * handled. The latter must not have to wait for the former to be
+ * done. Returns how many flooded requests were handled first. */
+static unsigned run_budget(pa_bool_t late) {
+    pa_mainloop_api *api;
+    pa_mempool *pool;
+    pa_pstream *flood_receiver, *quiet_receiver;
+    int fds[4];
+
+    n_flood_received = n_flood_before_quiet = 0;
+    quiet_received = FALSE;
+
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+    api = pa_mainloop_get_api(mainloop);
+
+    pool = pa_mempool_new(FALSE, 0);
+    fail_unless(pool != NULL);
+
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, fds + 2) == 0);
+    pa_make_fd_nonblock(fds[1]);
+    pa_make_fd_nonblock(fds[3]);
+
+    /* The main loop dispatches the newest I/O events first, so the
+     * flood gets the first go */
+    quiet_receiver = new_receiver(api, fds[3], pool, quiet_packet_cb);
+    flood_receiver = new_receiver(api, fds[1], pool, flood_packet_cb);
+
+    write_packets(fds[0], 0, N_FLOOD);
+
+    if (late)
+        quiet_late_fd = fds[2];
+    else {
+        quiet_late_fd = -1;
+        write_packets(fds[2], 0, 1);
+    }
+
+    fail_unless(pa_mainloop_run(mainloop, NULL) >= 0);
+
+    fprintf(stderr, "%u of %u flooded requests handled before the %s quiet one, %llu deferred\n",
+            n_flood_before_quiet, N_FLOOD, late ? "late" : "early",
+            (unsigned long long) pa_pstream_get_deferred(flood_receiver));
+
+    fail_unless(quiet_received);
+    fail_unless(n_flood_received == N_FLOOD);
+    fail_unless(pa_pstream_get_deferred(flood_receiver) > 0);
+    fail_unless(pa_pstream_get_deferred(quiet_receiver) == 0);
+
+    pa_pstream_unlink(flood_receiver);
+    pa_pstream_unref(flood_receiver);
+    pa_pstream_unlink(quiet_receiver);
+    pa_pstream_unref(quiet_receiver);
+
+    pa_close(fds[0]);
+    pa_close(fds[2]);
+
+    pa_mempool_free(pool);
+    pa_mainloop_free(mainloop);
+
+    return n_flood_before_quiet;
+}
+
+START_TEST (budget_test) {
+    /* Without a budget this would be everything the first read got,
+     * with it the flood gets a single budget's worth in before the
+     * quiet one gets its turn in the same main loop iteration */
+    fail_unless(run_budget(FALSE) <= BUDGET);
+}
+END_TEST
+
+START_TEST (late_budget_test) {
+    /* Here the quiet one only gets its turn in the following
+     * iteration, the flood must not get more than one budget in each
+     * of the two */
+    fail_unless(run_budget(TRUE) <= 2 * BUDGET);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Pstream");
+    tc = tcase_create("pstream");
+    tcase_add_test(tc, packet_test);
+    tcase_add_test(tc, mixed_test);
+    tcase_add_test(tc, large_test);
+    tcase_add_test(tc, partial_test);
+#ifdef HAVE_CREDS
+    tcase_add_test(tc, creds_test);
+    tcase_add_test(tc, partial_creds_test);
+#endif
+    tcase_add_test(tc, budget_test);
+    tcase_add_test(tc, late_budget_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,513 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/thread-mainloop.h>
+#include <pulse/timeval.h>
+#include <pulse/util.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/pdispatch.h>
+#include <pulsecore/pstream.h>
+#include <pulsecore/pstream-util.h>
+#include <pulsecore/pstream-thread-pool.h>
+#include <pulsecore/native-common.h>
+#include <pulsecore/socket.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* Many clients, each on a UNIX socket pair of its own, keep sending a
+ * request to a server and waiting for the reply, the way clients
+ * polling for latency updates do. The clients run in a thread of
+ * their own. The server answers in its main loop, once doing the
+ * socket I/O there as well and once doing it in a pool of I/O threads,
+ * and the test reports the round trip times and throughput of both.
+ *
+ * Then one client streams numbered memory blocks while the main loop
+ * of the server is stuck. They must still get through, right from the
+ * I/O thread, except for those sent after a packet which the main loop
+ * didn't handle yet: those must wait for it, and arrive in order.
+ *
+ * Finally a client hangs up, which the I/O thread notices and the main
+ * loop must hear of after everything the client sent before, and the
+ * server shuts down while the I/O thread still has things queued for
+ * the main loop. */
+
+#define N_CLIENTS 64
+#define N_ROUNDS 200
+#define N_IO_THREADS 4
+#define N_BLOCKS 1000
+#define STALL_USEC (200 * PA_USEC_PER_MSEC)
+#define N_HANGUP_PACKETS 10
+
+static pa_mainloop *mainloop;
+static pa_threaded_mainloop *client_mainloop;
+static pa_mempool *pool;
+static pa_pstream_thread_pool *io_threads;
+static pa_pdispatch *server_pdispatch;
+static pa_atomic_t n_done;
+static pa_atomic_t n_blocks, n_direct_blocks, n_packets, n_died;
+static pa_thread *main_thread;
+
+struct client {
+    pa_pstream *pstream;
+    pa_pstream *server_pstream;
+    unsigned n_replies;
+    pa_usec_t sent, total, max;
+};
+
+static struct client clients[N_CLIENTS];
+
+static void command_stat(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    struct client *c = userdata;
+
+    fail_unless(pa_tagstruct_eof(t));
+
+    pa_pstream_send_simple_ack(c->server_pstream, tag);
+}
+
+static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
+    [PA_COMMAND_STAT] = command_stat
+};
+
+static void server_packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    fail_unless(pa_pdispatch_run(server_pdispatch, packet, creds, userdata) == 0);
+}
+
+static void die_cb(pa_pstream *p, void *userdata) {
+    fail();
+}
+
+/* Called from the client thread */
+static void send_request(struct client *c) {
+    pa_tagstruct *t;
+
+    t = pa_tagstruct_new(NULL, 0);
+    pa_tagstruct_putu32(t, PA_COMMAND_STAT);
+    pa_tagstruct_putu32(t, c->n_replies);
+
+    c->sent = pa_rtclock_now();
+    pa_pstream_send_tagstruct(c->pstream, t);
+}
+
+/* Called from the client thread */
+static void client_packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    struct client *c = userdata;
+    pa_tagstruct *t;
+    uint32_t command, tag;
+    pa_usec_t rtt;
+
+    t = pa_tagstruct_new(packet->data, packet->length);
+    fail_unless(pa_tagstruct_getu32(t, &command) == 0);
+    fail_unless(pa_tagstruct_getu32(t, &tag) == 0);
+    fail_unless(pa_tagstruct_eof(t));
+    pa_tagstruct_free(t);
+
+    fail_unless(command == PA_COMMAND_REPLY);
+    fail_unless(tag == c->n_replies);
+
+    rtt = pa_rtclock_now() - c->sent;
+    c->total += rtt;
+    c->max = PA_MAX(c->max, rtt);
+
+    if (++c->n_replies < N_ROUNDS) {
+        send_request(c);
+        return;
+    }
+
+    pa_atomic_inc(&n_done);
+    pa_mainloop_wakeup(mainloop);
+}
+
+static void setup(unsigned n_io_threads) {
+    unsigned i;
+
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    client_mainloop = pa_threaded_mainloop_new();
+    fail_unless(client_mainloop != NULL);
+
+    pool = pa_mempool_new(FALSE, 0);
+    fail_unless(pool != NULL);
+
+    io_threads = NULL;
+    if (n_io_threads > 0) {
+        io_threads = pa_pstream_thread_pool_new(pa_mainloop_get_api(mainloop), n_io_threads);
+        fail_unless(io_threads != NULL);
+    }
+
+    server_pdispatch = pa_pdispatch_new(pa_mainloop_get_api(mainloop), TRUE, command_table, PA_COMMAND_MAX);
+    pa_atomic_store(&n_done, 0);
+
+    for (i = 0; i < N_CLIENTS; i++) {
+        struct client *c = &clients[i];
+        pa_iochannel *io;
+        int fds[2];
+
+        pa_zero(*c);
+
+        fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        pa_make_fd_nonblock(fds[0]);
+        pa_make_fd_nonblock(fds[1]);
+
+        io = pa_iochannel_new(pa_threaded_mainloop_get_api(client_mainloop), fds[0], fds[0]);
+        c->pstream = pa_pstream_new(pa_threaded_mainloop_get_api(client_mainloop), io, pool);
+        pa_pstream_set_die_callback(c->pstream, die_cb, NULL);
+        pa_pstream_set_receive_packet_callback(c->pstream, client_packet_cb, c);
+
+        io = pa_iochannel_new(pa_mainloop_get_api(mainloop), fds[1], fds[1]);
+        if (io_threads)
+            c->server_pstream = pa_pstream_new_threaded(pa_pstream_thread_pool_next(io_threads), io, pool);
+        else
+            c->server_pstream = pa_pstream_new(pa_mainloop_get_api(mainloop), io, pool);
+        pa_pstream_set_die_callback(c->server_pstream, die_cb, NULL);
+        pa_pstream_set_receive_packet_callback(c->server_pstream, server_packet_cb, c);
+    }
+}
+
+static void teardown(void) {
+    unsigned i;
+
+    /* Stop the clients first, so that they don't see the server go */
+    pa_threaded_mainloop_stop(client_mainloop);
+
+    for (i = 0; i < N_CLIENTS; i++) {
+        pa_pstream_unlink(clients[i].server_pstream);
+        pa_pstream_unref(clients[i].server_pstream);
+    }
+
+    if (io_threads)
+        pa_pstream_thread_pool_free(io_threads);
+
+    for (i = 0; i < N_CLIENTS; i++) {
+        pa_pstream_unlink(clients[i].pstream);
+        pa_pstream_unref(clients[i].pstream);
+    }
+
+    pa_pdispatch_unref(server_pdispatch);
+    pa_threaded_mainloop_free(client_mainloop);
+
+    /* Nothing left behind in the queues of the I/O threads */
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_allocated) == 0);
+    pa_mempool_free(pool);
+    pa_mainloop_free(mainloop);
+}
+
+static void run(unsigned n_io_threads) {
+    pa_usec_t start, elapsed, total = 0, max = 0;
+    unsigned i;
+
+    setup(n_io_threads);
+
+    start = pa_rtclock_now();
+
+    pa_threaded_mainloop_lock(client_mainloop);
+    for (i = 0; i < N_CLIENTS; i++)
+        send_request(&clients[i]);
+    pa_threaded_mainloop_unlock(client_mainloop);
+
+    fail_unless(pa_threaded_mainloop_start(client_mainloop) >= 0);
+
+    while (pa_atomic_load(&n_done) < N_CLIENTS)
+        fail_unless(pa_mainloop_iterate(mainloop, 1, NULL) >= 0);
+
+    elapsed = pa_rtclock_now() - start;
+
+    pa_threaded_mainloop_lock(client_mainloop);
+    for (i = 0; i < N_CLIENTS; i++) {
+        fail_unless(clients[i].n_replies == N_ROUNDS);
+        total += clients[i].total;
+        max = PA_MAX(max, clients[i].max);
+    }
+    pa_threaded_mainloop_unlock(client_mainloop);
+
+    fprintf(stderr, "%u I/O threads: %0.0f requests/s, round trip %0.1f us on average, %0.1f us at most\n",
+            n_io_threads,
+            (double) N_CLIENTS * N_ROUNDS * PA_USEC_PER_SEC / elapsed,
+            (double) total / (N_CLIENTS * N_ROUNDS),
+            (double) max);
+
+    teardown();
+}
+
+/* Called from the client thread */
+static void send_block(struct client *c, uint32_t seq) {
+    pa_memchunk chunk;
+
+    chunk.memblock = pa_memblock_new(pool, sizeof(seq));
+    chunk.index = 0;
+    chunk.length = sizeof(seq);
+    *(uint32_t*) pa_memblock_acquire(chunk.memblock) = seq;
+    pa_memblock_release(chunk.memblock);
+
+    pa_pstream_send_memblock(c->pstream, 0, 0, PA_SEEK_RELATIVE, &chunk);
+    pa_memblock_unref(chunk.memblock);
+}
+
+static void check_block(const pa_memchunk *chunk) {
+    uint32_t seq;
+
+    fail_unless(chunk->memblock != NULL);
+    fail_unless(chunk->length == sizeof(seq));
+
+    seq = *(uint32_t*) ((uint8_t*) pa_memblock_acquire(chunk->memblock) + chunk->index);
+    pa_memblock_release(chunk->memblock);
+
+    /* In order, and none lost */
+    fail_unless((int) seq == pa_atomic_load(&n_blocks));
+    pa_atomic_inc(&n_blocks);
+}
+
+static void server_memblock_cb(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    check_block(chunk);
+}
+
+/* Called from the I/O thread */
+static void direct_memblock_cb(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    check_block(chunk);
+    pa_atomic_inc(&n_direct_blocks);
+
+    /* Once the main loop caught up, the rest comes this way, and it
+     * might be waiting for it */
+    pa_mainloop_wakeup(mainloop);
+}
+
+static void counting_packet_cb(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    pa_atomic_inc(&n_packets);
+}
+
+/* Waits without running the main loop, the way it would if something
+ * took long */
+static void stall(void) {
+    pa_msleep(STALL_USEC / PA_USEC_PER_MSEC);
+}
+
+START_TEST (direct_test) {
+    struct client *c = &clients[0];
+    pa_tagstruct *t;
+    unsigned i;
+
+    setup(1);
+
+    pa_atomic_store(&n_blocks, 0);
+    pa_atomic_store(&n_direct_blocks, 0);
+    pa_atomic_store(&n_packets, 0);
+
+    pa_pstream_set_receive_packet_callback(c->server_pstream, counting_packet_cb, NULL);
+    pa_pstream_set_receive_memblock_callback(c->server_pstream, server_memblock_cb, NULL);
+    pa_pstream_set_direct_memblock_callback(c->server_pstream, 0, direct_memblock_cb, NULL);
+
+    fail_unless(pa_threaded_mainloop_start(client_mainloop) >= 0);
+
+    pa_threaded_mainloop_lock(client_mainloop);
+    for (i = 0; i < N_BLOCKS; i++)
+        send_block(c, i);
+    pa_threaded_mainloop_unlock(client_mainloop);
+
+    stall();
+
+    fail_unless(pa_atomic_load(&n_direct_blocks) == N_BLOCKS);
+
+    /* Nothing may overtake a packet still waiting for the main loop */
+    pa_threaded_mainloop_lock(client_mainloop);
+    t = pa_tagstruct_new(NULL, 0);
+    pa_tagstruct_putu32(t, PA_COMMAND_STAT);
+    pa_tagstruct_putu32(t, 0);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    for (i = N_BLOCKS; i < 2 * N_BLOCKS; i++)
+        send_block(c, i);
+    pa_threaded_mainloop_unlock(client_mainloop);
+
+    stall();
+
+    fail_unless(pa_atomic_load(&n_direct_blocks) == N_BLOCKS);
+    fail_unless(pa_atomic_load(&n_blocks) == N_BLOCKS);
+
+    while (pa_atomic_load(&n_blocks) < 2 * N_BLOCKS)
+        fail_unless(pa_mainloop_iterate(mainloop, 1, NULL) >= 0);
+
+    fail_unless(pa_atomic_load(&n_packets) == 1);
+
+    fprintf(stderr, "%u of %u memory blocks went past the main loop\n",
+            (unsigned) pa_atomic_load(&n_direct_blocks), 2 * N_BLOCKS);
+
+    /* Once turned off, everything goes through the main loop again */
+    pa_pstream_set_direct_memblock_callback(c->server_pstream, 0, NULL, NULL);
+    i = pa_atomic_load(&n_direct_blocks);
+
+    pa_threaded_mainloop_lock(client_mainloop);
+    send_block(c, 2 * N_BLOCKS);
+    pa_threaded_mainloop_unlock(client_mainloop);
+
+    while (pa_atomic_load(&n_blocks) < 2 * N_BLOCKS + 1)
+        fail_unless(pa_mainloop_iterate(mainloop, 1, NULL) >= 0);
+
+    fail_unless(pa_atomic_load(&n_direct_blocks) == (int) i);
+
+    teardown();
+}
+END_TEST
+
+static void hangup_die_cb(pa_pstream *p, void *userdata) {
+    /* In the main loop, and only after what came before */
+    fail_unless(pa_thread_self() == main_thread);
+    fail_unless(pa_atomic_load(&n_packets) == N_HANGUP_PACKETS);
+
+    pa_atomic_inc(&n_died);
+}
+
+/* Called from the client thread, or with it locked */
+static void send_and_hang_up(struct client *c) {
+    unsigned i;
+
+    for (i = 0; i < N_HANGUP_PACKETS; i++)
+        send_request(c);
+
+    while (pa_pstream_is_pending(c->pstream)) {
+        pa_threaded_mainloop_unlock(client_mainloop);
+        pa_msleep(1);
+        pa_threaded_mainloop_lock(client_mainloop);
+    }
+
+    pa_pstream_unlink(c->pstream);
+}
+
+START_TEST (hangup_test) {
+    struct client *c = &clients[0];
+
+    setup(1);
+
+    main_thread = pa_thread_self();
+    pa_atomic_store(&n_packets, 0);
+    pa_atomic_store(&n_died, 0);
+
+    pa_pstream_set_receive_packet_callback(c->server_pstream, counting_packet_cb, NULL);
+    pa_pstream_set_die_callback(c->server_pstream, hangup_die_cb, NULL);
+
+    fail_unless(pa_threaded_mainloop_start(client_mainloop) >= 0);
+
+    pa_threaded_mainloop_lock(client_mainloop);
+    send_and_hang_up(c);
+    pa_threaded_mainloop_unlock(client_mainloop);
+
+    while (pa_atomic_load(&n_died) == 0)
+        fail_unless(pa_mainloop_iterate(mainloop, 1, NULL) >= 0);
+
+    /* Once is enough, and nothing may follow */
+    stall();
+    while (pa_mainloop_iterate(mainloop, 0, NULL) > 0)
+        ;
+
+    fail_unless(pa_atomic_load(&n_died) == 1);
+    fail_unless(pa_atomic_load(&n_packets) == N_HANGUP_PACKETS);
+
+    teardown();
+}
+END_TEST
+
+static void counting_memblock_cb(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    pa_atomic_inc(&n_blocks);
+}
+
+START_TEST (in_flight_test) {
+    unsigned i, j;
+
+    setup(N_IO_THREADS);
+
+    pa_atomic_store(&n_packets, 0);
+    pa_atomic_store(&n_blocks, 0);
+
+    for (i = 0; i < N_CLIENTS; i++) {
+        pa_pstream_set_receive_packet_callback(clients[i].server_pstream, counting_packet_cb, NULL);
+        pa_pstream_set_receive_memblock_callback(clients[i].server_pstream, counting_memblock_cb, NULL);
+    }
+
+    fail_unless(pa_threaded_mainloop_start(client_mainloop) >= 0);
+
+    /* Requests, blocks, and for some a hangup, all of which the I/O
+     * threads pass on to a main loop which never gets to them */
+    pa_threaded_mainloop_lock(client_mainloop);
+    for (i = 0; i < N_CLIENTS; i++) {
+        for (j = 0; j < N_ROUNDS; j++) {
+            send_request(&clients[i]);
+            send_block(&clients[i], j);
+        }
+
+        if (i % 4 == 0)
+            send_and_hang_up(&clients[i]);
+    }
+    pa_threaded_mainloop_unlock(client_mainloop);
+
+    stall();
+
+    /* Whatever is still queued is dropped, without any callbacks and
+     * without leaking, which teardown() checks */
+    teardown();
+
+    fail_unless(pa_atomic_load(&n_packets) == 0);
+    fail_unless(pa_atomic_load(&n_blocks) == 0);
+}
+END_TEST
+
+START_TEST (main_loop_test) {
+    run(0);
+}
+END_TEST
+
+START_TEST (io_threads_test) {
+    run(N_IO_THREADS);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Pstream thread pool");
+    tc = tcase_create("pstreamthreadpool");
+    tcase_add_test(tc, main_loop_test);
+    tcase_add_test(tc, io_threads_test);
+    tcase_add_test(tc, direct_test);
+    tcase_add_test(tc, hangup_test);
+    tcase_add_test(tc, in_flight_test);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
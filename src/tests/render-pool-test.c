@@ -0,0 +1,102 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulsecore/render-pool.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#define N_JOBS 64
+
+struct job {
+    unsigned value;
+    pa_atomic_t runs;
+};
+
+static void job_cb(void *_job, void *userdata) {
+    struct job *j = _job;
+    pa_atomic_t *sum = userdata;
+
+    pa_atomic_inc(&j->runs);
+    pa_atomic_add(sum, (int) j->value);
+}
+
+START_TEST (render_pool_test) {
+    pa_render_pool *p;
+    struct job jobs[N_JOBS];
+    unsigned n, k, round;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    p = pa_render_pool_new(3, 0);
+    fail_unless(p != NULL);
+    fail_unless(pa_render_pool_get_n_threads(p) == 3);
+
+    /* Every job of a batch must run exactly once, whatever the batch
+     * size compared to the number of threads */
+    for (round = 0; round < 1000; round++) {
+        pa_atomic_t sum = PA_ATOMIC_INIT(0);
+
+        n = 1 + round % N_JOBS;
+
+        for (k = 0; k < n; k++) {
+            jobs[k].value = k;
+            pa_atomic_store(&jobs[k].runs, 0);
+        }
+
+        fail_unless(pa_render_pool_run(p, job_cb, jobs, sizeof(struct job), n, &sum));
+
+        for (k = 0; k < n; k++)
+            fail_unless(pa_atomic_load(&jobs[k].runs) == 1);
+
+        fail_unless(pa_atomic_load(&sum) == (int) (n * (n - 1) / 2));
+    }
+
+    pa_render_pool_free(p);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Render Pool");
+    tc = tcase_create("renderpool");
+    tcase_add_test(tc, render_pool_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
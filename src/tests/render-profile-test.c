@@ -0,0 +1,103 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/render-profile.h>
+#include <pulsecore/macro.h>
+
+START_TEST (render_profile_test) {
+    pa_render_profile p;
+    uint32_t counts[PA_RENDER_PROFILE_BUCKETS];
+    unsigned k;
+    char *s;
+
+    pa_render_profile_init(&p);
+
+    fail_unless(pa_render_profile_get(&p, PA_RENDER_PROFILE_PROCESS, counts) == 0);
+    for (k = 0; k < PA_RENDER_PROFILE_BUCKETS; k++)
+        fail_unless(counts[k] == 0);
+
+    s = pa_render_profile_to_string(&p, "\t");
+    fail_unless(*s == 0);
+    pa_xfree(s);
+
+    /* Bucket k > 0 holds [2^(k-1), 2^k) */
+    pa_render_profile_add(&p, PA_RENDER_PROFILE_PROCESS, 0);
+    pa_render_profile_add(&p, PA_RENDER_PROFILE_PROCESS, 1);
+    pa_render_profile_add(&p, PA_RENDER_PROFILE_PROCESS, 2);
+    pa_render_profile_add(&p, PA_RENDER_PROFILE_PROCESS, 3);
+    pa_render_profile_add(&p, PA_RENDER_PROFILE_PROCESS, 4);
+    pa_render_profile_add(&p, PA_RENDER_PROFILE_PROCESS, 1000);
+
+    fail_unless(pa_render_profile_get(&p, PA_RENDER_PROFILE_PROCESS, counts) == 1000);
+    fail_unless(counts[0] == 1);
+    fail_unless(counts[1] == 1);
+    fail_unless(counts[2] == 2);
+    fail_unless(counts[3] == 1);
+    fail_unless(counts[10] == 1);
+
+    /* Everything too large ends up in the last bucket */
+    pa_render_profile_add(&p, PA_RENDER_PROFILE_HEADROOM, 10 * PA_USEC_PER_SEC);
+    pa_render_profile_add(&p, PA_RENDER_PROFILE_HEADROOM, 5);
+
+    fail_unless(pa_render_profile_get(&p, PA_RENDER_PROFILE_HEADROOM, counts) == 10 * PA_USEC_PER_SEC);
+    fail_unless(counts[PA_RENDER_PROFILE_BUCKETS-1] == 1);
+    fail_unless(counts[3] == 1);
+
+    /* Metrics don't influence each other */
+    fail_unless(pa_render_profile_get(&p, PA_RENDER_PROFILE_STREAM, counts) == 0);
+    for (k = 0; k < PA_RENDER_PROFILE_BUCKETS; k++)
+        fail_unless(counts[k] == 0);
+
+    s = pa_render_profile_to_string(&p, "\t");
+    fail_unless(strstr(s, "\tprocess (max 1000 usec): <1us=1 1us=1 2us=2 4us=1 512us=1\n") != NULL);
+    fail_unless(strstr(s, "stream") == NULL);
+    pa_xfree(s);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Render Profile");
+    tc = tcase_create("renderprofile");
+    tcase_add_test(tc, render_profile_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
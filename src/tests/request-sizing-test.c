@@ -0,0 +1,262 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+
+#include <pulsecore/request-sizing.h>
+#include <pulsecore/sample-util.h>
+#include <pulsecore/watermark-controller.h>
+#include <pulsecore/macro.h>
+
+/* Drives the request sizing with simulated clients the way
+ * protocol-native.c does: every answer's turnaround goes into a
+ * watermark controller, and every ADAPT_INTERVAL answers its
+ * suggestion is passed to pa_request_sizing_adapt(). Each time that
+ * returns TRUE the client would get a PLAYBACK_BUFFER_ATTR_CHANGED. */
+
+#define ADAPT_DROPOUT_PROBABILITY 0.001
+#define ADAPT_INTERVAL 32
+#define N_ANSWERS 8192
+
+/* A stream asking for 200ms of latency on a sink running at 20ms,
+ * which takes at most 25ms at once and can go down to 2ms */
+#define TLENGTH_USEC (200*PA_USEC_PER_MSEC)
+#define MINREQ_USEC (10*PA_USEC_PER_MSEC)
+#define SINK_LATENCY_USEC (20*PA_USEC_PER_MSEC)
+#define MAX_REQUEST_USEC (25*PA_USEC_PER_MSEC)
+#define MIN_REQUEST_USEC (2*PA_USEC_PER_MSEC)
+
+static const pa_sample_spec ss = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = 44100,
+    .channels = 2
+};
+
+struct client {
+    pa_usec_t min_usec, spread_usec;
+    pa_buffer_attr attr;
+    unsigned n_events;
+    unsigned n_late_events;
+};
+
+static uint32_t seed;
+
+static unsigned rnd(unsigned n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static uint32_t bytes(pa_usec_t usec) {
+    return (uint32_t) pa_usec_to_bytes_round_up(usec, &ss);
+}
+
+static void sizing_init(pa_request_sizing *r, pa_bool_t minreq_requested) {
+    r->sample_spec = ss;
+    r->base.maxlength = bytes(4 * TLENGTH_USEC);
+    r->base.tlength = bytes(TLENGTH_USEC);
+    r->base.prebuf = r->base.tlength;
+    r->base.minreq = bytes(MINREQ_USEC);
+    r->base.fragsize = (uint32_t) -1;
+    r->minreq_requested = minreq_requested;
+    r->min_request_usec = MIN_REQUEST_USEC;
+    r->sink_latency = SINK_LATENCY_USEC;
+    r->max_request = bytes(MAX_REQUEST_USEC);
+}
+
+/* Lets the client answer n requests, each within min_usec plus up to
+ * spread_usec */
+static void run(const pa_request_sizing *r, struct client *c, unsigned n) {
+    pa_watermark_controller *wc;
+    unsigned i;
+
+    wc = pa_watermark_controller_new(ADAPT_DROPOUT_PROBABILITY);
+
+    for (i = 1; i <= n; i++) {
+        pa_watermark_controller_add(wc, c->min_usec + rnd((unsigned) c->spread_usec + 1));
+
+        if (i % ADAPT_INTERVAL != 0)
+            continue;
+
+        if (pa_request_sizing_adapt(r, pa_watermark_controller_get(wc), &c->attr)) {
+            c->n_events++;
+
+            /* Once settled it shouldn't keep changing its mind */
+            if (i > n / 2)
+                c->n_late_events++;
+        }
+    }
+
+    pa_watermark_controller_free(wc);
+
+    fprintf(stderr, "Client answering within %0.1f-%0.1f ms: minreq %0.1f ms, tlength %0.1f ms, prebuf %0.1f ms, %u changes, %u late\n",
+            (double) c->min_usec / PA_USEC_PER_MSEC,
+            (double) (c->min_usec + c->spread_usec) / PA_USEC_PER_MSEC,
+            (double) pa_bytes_to_usec(c->attr.minreq, &ss) / PA_USEC_PER_MSEC,
+            (double) pa_bytes_to_usec(c->attr.tlength, &ss) / PA_USEC_PER_MSEC,
+            (double) pa_bytes_to_usec(c->attr.prebuf, &ss) / PA_USEC_PER_MSEC,
+            c->n_events, c->n_late_events);
+}
+
+static void client_init(struct client *c, const pa_request_sizing *r, pa_usec_t min_usec, pa_usec_t spread_usec) {
+    c->min_usec = min_usec;
+    c->spread_usec = spread_usec;
+    c->attr = r->base;
+    c->n_events = c->n_late_events = 0;
+}
+
+static void check_limits(const pa_request_sizing *r, const struct client *c) {
+    fail_unless(c->attr.minreq >= bytes(MIN_REQUEST_USEC));
+    fail_unless(c->attr.minreq <= r->base.tlength / 4);
+    fail_unless(c->attr.tlength >= r->max_request + 2 * c->attr.minreq);
+    fail_unless(c->attr.tlength <= PA_MAX(r->base.tlength, r->max_request + 2 * c->attr.minreq));
+    fail_unless(c->attr.prebuf <= c->attr.tlength);
+    fail_unless(c->attr.maxlength == r->base.maxlength);
+}
+
+START_TEST (fast_slow_test) {
+    pa_request_sizing r;
+    struct client fast, slow;
+
+    seed = 1;
+    sizing_init(&r, FALSE);
+
+    /* A client answering within a millisecond gets requests as small
+     * as the sink allows, and the tlength the sink needs */
+    client_init(&fast, &r, 300, 700);
+    run(&r, &fast, N_ANSWERS);
+
+    check_limits(&r, &fast);
+    fail_unless(fast.attr.minreq <= bytes(3 * PA_USEC_PER_MSEC));
+    fail_unless(fast.attr.tlength < bytes(TLENGTH_USEC / 2));
+    fail_unless(fast.n_events >= 1);
+    fail_unless(fast.n_late_events == 0);
+
+    /* One taking 20-30ms gets to batch, as much as its latency
+     * allows */
+    client_init(&slow, &r, 20 * PA_USEC_PER_MSEC, 10 * PA_USEC_PER_MSEC);
+    run(&r, &slow, N_ANSWERS);
+
+    check_limits(&r, &slow);
+    fail_unless(slow.attr.minreq > fast.attr.minreq);
+    fail_unless(slow.attr.minreq >= bytes(40 * PA_USEC_PER_MSEC));
+    fail_unless(slow.attr.tlength > fast.attr.tlength);
+    fail_unless(slow.n_events >= 1);
+    fail_unless(slow.n_late_events == 0);
+}
+END_TEST
+
+START_TEST (slowdown_test) {
+    pa_request_sizing r;
+    struct client c;
+    uint32_t minreq;
+    unsigned n_events;
+
+    seed = 2;
+    sizing_init(&r, FALSE);
+
+    client_init(&c, &r, 300, 700);
+    run(&r, &c, N_ANSWERS);
+    minreq = c.attr.minreq;
+    n_events = c.n_events;
+
+    /* The host gets loaded, the client has to be told about larger
+     * requests */
+    c.min_usec = 8 * PA_USEC_PER_MSEC;
+    c.spread_usec = 4 * PA_USEC_PER_MSEC;
+    c.n_late_events = 0;
+    run(&r, &c, N_ANSWERS);
+
+    check_limits(&r, &c);
+    fail_unless(c.attr.minreq > 4 * minreq);
+    fail_unless(c.n_events > n_events);
+    fail_unless(c.n_late_events == 0);
+}
+END_TEST
+
+START_TEST (floor_test) {
+    pa_request_sizing r;
+    pa_buffer_attr a;
+
+    /* Without a minreq from the client requests don't go below what
+     * the sink can make use of, however fast it answers */
+    sizing_init(&r, FALSE);
+    a = r.base;
+    fail_unless(pa_request_sizing_adapt(&r, 1, &a));
+    fail_unless(a.minreq == bytes(MIN_REQUEST_USEC));
+    fail_unless(a.tlength == bytes(SINK_LATENCY_USEC) + 2 * a.minreq ||
+                a.tlength == r.max_request + 2 * a.minreq);
+
+    /* With one, not below that */
+    sizing_init(&r, TRUE);
+    a = r.base;
+    pa_request_sizing_adapt(&r, 1, &a);
+    fail_unless(a.minreq == r.base.minreq);
+
+    /* A sink which takes more at once than the client wants to
+     * buffer gets what it needs */
+    sizing_init(&r, FALSE);
+    r.max_request = bytes(TLENGTH_USEC);
+    a = r.base;
+    fail_unless(pa_request_sizing_adapt(&r, 1, &a));
+    fail_unless(a.tlength == r.max_request + 2 * a.minreq);
+
+    /* And if the sink already raised tlength beyond the client's
+     * limit, that sticks even when the sink asks for less again */
+    r.max_request = bytes(MAX_REQUEST_USEC);
+    a.tlength = bytes(2 * TLENGTH_USEC);
+    pa_request_sizing_adapt(&r, 1, &a);
+    fail_unless(a.tlength == bytes(2 * TLENGTH_USEC));
+
+    /* Changes below 10% aren't worth an event */
+    sizing_init(&r, FALSE);
+    a = r.base;
+    fail_unless(pa_request_sizing_adapt(&r, 10 * PA_USEC_PER_MSEC, &a));
+    fail_unless(!pa_request_sizing_adapt(&r, 10 * PA_USEC_PER_MSEC + 500, &a));
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Request Sizing");
+    tc = tcase_create("request-sizing");
+    tcase_add_test(tc, fast_slow_test);
+    tcase_add_test(tc, slowdown_test);
+    tcase_add_test(tc, floor_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
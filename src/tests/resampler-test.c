@@ -22,6 +22,8 @@
 #endif
 
 #include <stdio.h>
+#include <math.h>
+#include <string.h>
 #include <getopt.h>
 #include <locale.h>
 
@@ -253,6 +255,195 @@ static pa_memblock* generate_block(pa_mempool *pool, const pa_sample_spec *ss) {
     return r;
 }
 
+#define REWIND_BLOCK_FRAMES 1000
+#define REWIND_BLOCKS 20
+
+/* More blocks than the resampler keeps checkpoints for */
+#define REWIND_TOO_FAR_BLOCKS 40
+
+/* Feeds input frames from to to, in blocks which end on multiples of
+ * REWIND_BLOCK_FRAMES */
+static void run_frames(pa_resampler *r, const pa_memchunk *in, size_t fz, unsigned from, unsigned to, float *out, size_t *out_length) {
+    while (from < to) {
+        pa_memchunk i, j;
+        unsigned n;
+
+        n = PA_MIN(REWIND_BLOCK_FRAMES - from % REWIND_BLOCK_FRAMES, to - from);
+
+        i = *in;
+        i.index = from * fz;
+        i.length = n * fz;
+
+        pa_resampler_run(r, &i, &j);
+
+        if (j.memblock) {
+            if (out) {
+                memcpy((uint8_t*) out + *out_length, pa_memblock_acquire_chunk(&j), j.length);
+                pa_memblock_release(j.memblock);
+            }
+            pa_memblock_unref(j.memblock);
+
+            *out_length += j.length;
+        }
+
+        from += n;
+    }
+}
+
+static pa_memblock *rewind_signal(pa_mempool *pool, unsigned n_frames) {
+    pa_memblock *b;
+    float *d;
+    unsigned n;
+
+    b = pa_memblock_new(pool, n_frames * sizeof(float));
+
+    d = pa_memblock_acquire(b);
+    for (n = 0; n < n_frames; n++)
+        d[n] = sinf((float) n * 0.05f) * 0.5f + sinf((float) n * 0.0031f) * 0.25f;
+    pa_memblock_release(b);
+
+    return b;
+}
+
+/* Feed the same signal through two resamplers, rewind one of them by
+ * rewind_frames in the middle of the stream, and make sure both produce
+ * the same output. With a tolerance the samples may differ by that
+ * much, and the lengths by a few frames. */
+static int test_rewind(pa_mempool *pool, uint32_t from_rate, uint32_t to_rate, pa_resample_method_t method, unsigned rewind_frames, float tolerance) {
+    pa_sample_spec a, b;
+    pa_resampler *straight, *rewound;
+    pa_memchunk in;
+    float *out1, *out2;
+    size_t fz, out_max, length1 = 0, length2 = 0, in_rewound, out_rewound, n;
+    unsigned pos;
+    int ret = 0;
+
+    a.format = b.format = PA_SAMPLE_FLOAT32NE;
+    a.channels = b.channels = 1;
+    a.rate = from_rate;
+    b.rate = to_rate;
+
+    fz = pa_frame_size(&a);
+
+    in.index = 0;
+    in.length = REWIND_BLOCKS * REWIND_BLOCK_FRAMES * fz;
+    in.memblock = rewind_signal(pool, REWIND_BLOCKS * REWIND_BLOCK_FRAMES);
+
+    out_max = (REWIND_BLOCKS + 1) * (size_t) REWIND_BLOCK_FRAMES * to_rate / from_rate * fz + 4096 * fz;
+    out1 = pa_xmalloc0(out_max);
+    out2 = pa_xmalloc0(out_max);
+
+    pa_assert_se(straight = pa_resampler_new(pool, &a, NULL, &b, NULL, method, 0));
+    pa_assert_se(rewound = pa_resampler_new(pool, &a, NULL, &b, NULL, method, 0));
+
+    run_frames(straight, &in, fz, 0, REWIND_BLOCKS * REWIND_BLOCK_FRAMES, out1, &length1);
+
+    pos = REWIND_BLOCKS / 2 * REWIND_BLOCK_FRAMES;
+    run_frames(rewound, &in, fz, 0, pos, out2, &length2);
+    in_rewound = pa_resampler_rewind(rewound, rewind_frames * fz, &out_rewound);
+
+    pa_log_debug("%s %u -> %u: rewound %lu input bytes, %lu output bytes",
+                 pa_resample_method_to_string(method), from_rate, to_rate,
+                 (unsigned long) in_rewound, (unsigned long) out_rewound);
+
+    if (in_rewound != rewind_frames * fz || out_rewound > length2) {
+        pa_log_error("Rewind with method %s by %u frames went back by %lu bytes of input and %lu bytes of output.",
+                     pa_resample_method_to_string(method), rewind_frames,
+                     (unsigned long) in_rewound, (unsigned long) out_rewound);
+        ret = 1;
+        goto finish;
+    }
+
+    length2 -= out_rewound;
+    run_frames(rewound, &in, fz, pos - rewind_frames, REWIND_BLOCKS * REWIND_BLOCK_FRAMES, out2, &length2);
+
+    if (tolerance <= 0) {
+        if (length1 != length2 || memcmp(out1, out2, length1) != 0) {
+            pa_log_error("Rewound output of method %s differs from straight output (%lu vs. %lu bytes).",
+                         pa_resample_method_to_string(method), (unsigned long) length1, (unsigned long) length2);
+            ret = 1;
+        }
+
+        goto finish;
+    }
+
+    if (length1 > length2 + 4 * fz || length2 > length1 + 4 * fz) {
+        pa_log_error("Rewound output of method %s has %lu instead of %lu bytes.",
+                     pa_resample_method_to_string(method), (unsigned long) length2, (unsigned long) length1);
+        ret = 1;
+        goto finish;
+    }
+
+    for (n = 0; n < PA_MIN(length1, length2) / fz; n++)
+        if (fabsf(out1[n] - out2[n]) > tolerance) {
+            pa_log_error("Rewound output of method %s is off by %f at frame %lu.",
+                         pa_resample_method_to_string(method), out2[n] - out1[n], (unsigned long) n);
+            ret = 1;
+            break;
+        }
+
+finish:
+    pa_resampler_free(straight);
+    pa_resampler_free(rewound);
+
+    pa_xfree(out1);
+    pa_xfree(out2);
+    pa_memblock_unref(in.memblock);
+
+    return ret;
+}
+
+/* Rewinding further back than the oldest checkpoint resets the
+ * resampler and rewinds as much as asked for */
+static int test_rewind_too_far(pa_mempool *pool) {
+    pa_sample_spec a, b;
+    pa_resampler *r;
+    pa_memchunk in;
+    size_t fz, length = 0, in_length, in_rewound, out_rewound, expected;
+    int ret = 0;
+
+    a.format = b.format = PA_SAMPLE_FLOAT32NE;
+    a.channels = b.channels = 1;
+    a.rate = 44100;
+    b.rate = 48000;
+
+    fz = pa_frame_size(&a);
+
+    in.index = 0;
+    in.length = REWIND_TOO_FAR_BLOCKS * REWIND_BLOCK_FRAMES * fz;
+    in.memblock = rewind_signal(pool, REWIND_TOO_FAR_BLOCKS * REWIND_BLOCK_FRAMES);
+
+    pa_assert_se(r = pa_resampler_new(pool, &a, NULL, &b, NULL, PA_RESAMPLER_TRIVIAL, 0));
+
+    run_frames(r, &in, fz, 0, REWIND_TOO_FAR_BLOCKS * REWIND_BLOCK_FRAMES, NULL, &length);
+
+    in_length = (REWIND_TOO_FAR_BLOCKS - 2) * REWIND_BLOCK_FRAMES * fz + 10 * fz;
+    expected = pa_resampler_result(r, in_length);
+    in_rewound = pa_resampler_rewind(r, in_length, &out_rewound);
+
+    if (in_rewound != in_length || out_rewound != expected) {
+        pa_log_error("Rewind beyond the checkpoints went back by %lu bytes of input and %lu bytes of output, expected %lu and %lu.",
+                     (unsigned long) in_rewound, (unsigned long) out_rewound,
+                     (unsigned long) in_length, (unsigned long) expected);
+        ret = 1;
+    }
+
+    /* Starting afresh, a rewind within the first block goes back to
+     * its start */
+    length = 0;
+    run_frames(r, &in, fz, 0, REWIND_BLOCK_FRAMES / 2, NULL, &length);
+
+    if (pa_resampler_rewind(r, REWIND_BLOCK_FRAMES * fz, &out_rewound) != REWIND_BLOCK_FRAMES / 2 * fz || out_rewound != length) {
+        pa_log_error("Rewind beyond the start after a reset did not return to the start.");
+        ret = 1;
+    }
+
+    pa_resampler_free(r);
+    pa_memblock_unref(in.memblock);
+
+    return ret;
+}
+
 static void help(const char *argv0) {
     printf(_("%s [options]\n\n"
              "-h, --help                            Show this help\n"
@@ -473,6 +664,27 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    /* These methods can restore their state exactly after a rewind, be
+     * it to a block boundary, within an older block or within the last
+     * one */
+    for (c = 0; c < 3; c++) {
+        unsigned rewind_frames = c == 0 ? 2 * REWIND_BLOCK_FRAMES : c == 1 ? REWIND_BLOCK_FRAMES * 5 / 2 : 17;
+
+        ret |= test_rewind(pool, 44100, 48000, PA_RESAMPLER_TRIVIAL, rewind_frames, 0);
+        ret |= test_rewind(pool, 48000, 44100, PA_RESAMPLER_TRIVIAL, rewind_frames, 0);
+        ret |= test_rewind(pool, 48000, 11025, PA_RESAMPLER_PEAKS, rewind_frames, 0);
+        ret |= test_rewind(pool, 44100, 44100, PA_RESAMPLER_COPY, rewind_frames, 0);
+    }
+
+    ret |= test_rewind_too_far(pool);
+
+    /* Speex is primed from the last input frames instead, which gets
+     * the filter history right but not necessarily the exact phase */
+    if (pa_resample_method_supported(PA_RESAMPLER_SPEEX_FLOAT_BASE + 1)) {
+        ret |= test_rewind(pool, 44100, 48000, PA_RESAMPLER_SPEEX_FLOAT_BASE + 1, REWIND_BLOCK_FRAMES * 5 / 2, 0.05f);
+        ret |= test_rewind(pool, 44100, 48000, PA_RESAMPLER_SPEEX_FLOAT_BASE + 1, 17, 0.05f);
+    }
+
  quit:
     if (pool)
         pa_mempool_free(pool);
@@ -23,10 +23,20 @@
 
 #include <check.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/poll.h>
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/core-rtclock.h>
+
+#define JITTER_PERIOD_USEC (1 * PA_USEC_PER_MSEC)
+#define JITTER_ITERATIONS 1000
 
 static int before(pa_rtpoll_item *i) {
     pa_log("before");
@@ -84,15 +94,188 @@ START_TEST (rtpoll_test) {
 }
 END_TEST
 
+static void test_fd_wakeup(pa_rtpoll_backend_t backend) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i;
+    struct pollfd *pollfd;
+    int fds[2];
+    char x = 'x';
+
+    p = pa_rtpoll_new_with_backend(backend);
+    fail_unless(pa_rtpoll_get_backend(p) == backend);
+
+    fail_unless(pipe(fds) == 0);
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = fds[0];
+    pollfd->events = POLLIN;
+
+    /* Nothing to read yet, so the timer has to wake us up */
+    pa_rtpoll_set_timer_relative(p, 1000);
+    fail_unless(pa_rtpoll_run(p, TRUE) > 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == 0);
+
+    /* Now the fd has to wake us up, long before the timer */
+    fail_unless(write(fds[1], &x, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_SEC);
+    fail_unless(pa_rtpoll_run(p, TRUE) > 0);
+    fail_unless(!pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents & POLLIN);
+
+    /* Changing the fd set has to be picked up */
+    fail_unless(read(fds[0], &x, 1) == 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = fds[1];
+    pollfd->events = POLLOUT;
+    pa_rtpoll_set_timer_disabled(p);
+    fail_unless(pa_rtpoll_run(p, TRUE) > 0);
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents & POLLOUT);
+
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close(fds[0]);
+    pa_close(fds[1]);
+}
+
+/* Replaces the item watching a pipe with a new one, for a new pipe
+ * whose read end got the same fd number, the way a device that is
+ * closed and reopened in one go does. Nothing sleeps in between, so
+ * the pollfd array looks exactly like before. */
+static void test_fd_reopen(pa_rtpoll_backend_t backend) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i;
+    struct pollfd *pollfd;
+    int fds[2], fds2[2];
+    char x = 'x';
+
+    p = pa_rtpoll_new_with_backend(backend);
+
+    fail_unless(pipe(fds) == 0);
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = fds[0];
+    pollfd->events = POLLIN;
+
+    pa_rtpoll_set_timer_relative(p, 1000);
+    fail_unless(pa_rtpoll_run(p, TRUE) > 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+
+    pa_rtpoll_item_free(i);
+    pa_close(fds[1]);
+
+    fail_unless(pipe(fds2) == 0);
+    fail_unless(dup2(fds2[0], fds[0]) == fds[0]);
+    pa_close(fds2[0]);
+    fds[1] = fds2[1];
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = fds[0];
+    pollfd->events = POLLIN;
+
+    /* The new pipe has to wake us up, not the timer */
+    fail_unless(write(fds[1], &x, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_SEC);
+    fail_unless(pa_rtpoll_run(p, TRUE) > 0);
+    fail_unless(!pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents & POLLIN);
+
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close(fds[0]);
+    pa_close(fds[1]);
+}
+
+static void measure_jitter(pa_rtpoll_backend_t backend) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i;
+    struct pollfd *pollfd;
+    pa_usec_t deadline, now, late, sum = 0, max = 0;
+    int fds[2];
+    unsigned k, n;
+
+    n = getenv("MAKE_CHECK") ? JITTER_ITERATIONS / 10 : JITTER_ITERATIONS;
+
+    p = pa_rtpoll_new_with_backend(backend);
+
+    /* Give it an fd to watch too, like an IO thread always has */
+    fail_unless(pipe(fds) == 0);
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = fds[0];
+    pollfd->events = POLLIN;
+
+    deadline = pa_rtclock_now();
+
+    for (k = 0; k < n; k++) {
+        deadline += JITTER_PERIOD_USEC;
+
+        pa_rtpoll_set_timer_absolute(p, deadline);
+        fail_unless(pa_rtpoll_run(p, TRUE) > 0);
+
+        now = pa_rtclock_now();
+        late = now > deadline ? now - deadline : 0;
+
+        sum += late;
+        if (late > max)
+            max = late;
+    }
+
+    pa_log_info("%s: woke up %0.1f us late on average, %llu us at most (%u wakeups)",
+                pa_rtpoll_backend_to_string(backend),
+                (double) sum / n, (unsigned long long) max, n);
+
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close(fds[0]);
+    pa_close(fds[1]);
+}
+
+START_TEST (rtpoll_backend_test) {
+    test_fd_wakeup(PA_RTPOLL_BACKEND_POLL);
+
+    if (pa_rtpoll_backend_supported(PA_RTPOLL_BACKEND_EPOLL))
+        test_fd_wakeup(PA_RTPOLL_BACKEND_EPOLL);
+}
+END_TEST
+
+START_TEST (rtpoll_reopen_test) {
+    test_fd_reopen(PA_RTPOLL_BACKEND_POLL);
+
+    if (pa_rtpoll_backend_supported(PA_RTPOLL_BACKEND_EPOLL))
+        test_fd_reopen(PA_RTPOLL_BACKEND_EPOLL);
+}
+END_TEST
+
+START_TEST (rtpoll_jitter_test) {
+    measure_jitter(PA_RTPOLL_BACKEND_POLL);
+
+    if (pa_rtpoll_backend_supported(PA_RTPOLL_BACKEND_EPOLL))
+        measure_jitter(PA_RTPOLL_BACKEND_EPOLL);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
     TCase *tc;
     SRunner *sr;
 
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
     s = suite_create("RT Poll");
     tc = tcase_create("rtpoll");
     tcase_add_test(tc, rtpoll_test);
+    tcase_add_test(tc, rtpoll_backend_test);
+    tcase_add_test(tc, rtpoll_reopen_test);
+    tcase_add_test(tc, rtpoll_jitter_test);
     /* the default timeout is too small,
      * set it to a reasonable large one.
      */
@@ -0,0 +1,127 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include "daemon-test-util.h"
+
+/* Plays to a number of null sinks at low latency, first with one IO
+ * thread per sink and then with the sinks sharing the pool threads,
+ * and reports how many context switches the daemon did in each case. */
+
+#define NSINKS 16
+#define SAMPLE_HZ 44100
+#define LATENCY_MSEC 20
+#define PLAY_SECONDS 3
+
+static pa_stream *streams[NSINKS];
+
+static int shared = 0;
+static unsigned n_sinks = 0;
+static unsigned n_ready = 0;
+
+static int16_t silence[SAMPLE_HZ / 10 * 2];
+
+static unsigned long long switches_start = 0;
+static unsigned long long switches[2];
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_S16NE,
+    .rate = SAMPLE_HZ,
+    .channels = 2
+};
+
+static void load_next_module(pa_context *c);
+
+static void unloaded_cb(pa_context *c) {
+    /* Once more, with the shared threads */
+    shared = 1;
+    n_sinks = n_ready = 0;
+    load_next_module(c);
+}
+
+static void time_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    pa_context *c = userdata;
+    unsigned i;
+
+    a->time_free(e);
+
+    switches[shared] = daemon_test_get_switches() - switches_start;
+
+    fprintf(stderr, "%s IO threads: %llu context switches per second with %u sinks\n",
+            shared ? "Shared" : "Dedicated", switches[shared] / PLAY_SECONDS, NSINKS);
+
+    for (i = 0; i < NSINKS; i++) {
+        pa_stream_disconnect(streams[i]);
+        pa_stream_unref(streams[i]);
+        streams[i] = NULL;
+    }
+
+    daemon_test_unload_modules(c, shared ? NULL : unloaded_cb);
+}
+
+static void stream_ready_cb(pa_stream *s) {
+    pa_context *c = pa_stream_get_context(s);
+
+    if (++n_ready < NSINKS)
+        return;
+
+    fprintf(stderr, "Playing %u seconds of audio on %u sinks.\n", PLAY_SECONDS, NSINKS);
+    switches_start = daemon_test_get_switches();
+    pa_context_rttime_new(c, pa_rtclock_now() + PLAY_SECONDS * PA_USEC_PER_SEC, time_cb, c);
+}
+
+static void create_streams(pa_context *c) {
+    pa_buffer_attr attr;
+    unsigned i;
+
+    memset(&attr, 0xff, sizeof(attr));
+    attr.tlength = (uint32_t) pa_usec_to_bytes(LATENCY_MSEC * PA_USEC_PER_MSEC, &sample_spec);
+
+    for (i = 0; i < NSINKS; i++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "shared_test%u", i);
+
+        streams[i] = daemon_test_stream_new(c, "shared IO thread test", &sample_spec, NULL, stream_ready_cb);
+        daemon_test_play(streams[i], silence, sizeof(silence), 0, NULL);
+        fail_unless(pa_stream_connect_playback(streams[i], name, &attr, PA_STREAM_ADJUST_LATENCY, NULL, NULL) == 0);
+    }
+}
+
+static void load_next_module(pa_context *c) {
+    char args[64];
+
+    snprintf(args, sizeof(args), "sink_name=shared_test%u shared_thread=%s", n_sinks, shared ? "yes" : "no");
+    daemon_test_load_module(c, "module-null-sink", args, ++n_sinks < NSINKS ? load_next_module : create_streams);
+}
+
+int main(int argc, char *argv[]) {
+    return daemon_test_main("Shared IO Thread", argv[0], load_next_module);
+}
@@ -0,0 +1,342 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/util.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+/* Drives a sink without a device from a test IO thread. Checks that
+ * rewind requests which come in right after a rewind are held back by
+ * pa_sink_defer_rewind() and merged into a single rewind, and that the
+ * silence a sink input handed out is counted once, whether it is
+ * replayed by a plain rewind or dropped by a flush. */
+
+/* What sink.c holds rewinds back for */
+#define REWIND_COALESCE_USEC (5 * PA_USEC_PER_MSEC)
+
+#define BLOCK 1024
+#define MAX_REWIND (16 * BLOCK)
+
+enum {
+    SINK_MESSAGE_TEST_DEFER = PA_SINK_MESSAGE_MAX,
+    SINK_MESSAGE_TEST_UNDERRUN
+};
+
+struct defer_result {
+    pa_bool_t first_deferred;
+    pa_bool_t later_deferred;
+    pa_usec_t wait_usec;
+    pa_bool_t deferred_past_wakeup;
+    size_t merged_nbytes;
+    pa_bool_t deferred_when_due;
+    pa_bool_t deferred_when_idle;
+};
+
+struct underrun_result {
+    uint64_t after_render;
+    uint64_t after_rewind;
+    uint64_t after_replay;
+    uint64_t after_flush;
+    uint64_t after_rerender;
+};
+
+static pa_mainloop *mainloop;
+static pa_core *core;
+static pa_rtpoll *rtpoll;
+static pa_thread_mq thread_mq;
+static pa_thread *thread;
+static pa_sink *sink;
+static pa_sink_input *input;
+
+/* How much data the sink input still has to give, the rest is an
+ * underrun. Only touched from the IO thread once the input is set up. */
+static size_t input_left;
+
+static void rewind_to(pa_sink *s, size_t nbytes) {
+    pa_sink_request_rewind(s, nbytes);
+    pa_sink_process_rewind(s, s->thread_info.rewind_nbytes);
+}
+
+static void render(pa_sink *s, size_t nbytes) {
+    pa_memchunk chunk;
+
+    pa_sink_render_full(s, nbytes, &chunk);
+    pa_memblock_unref(chunk.memblock);
+}
+
+/* Called from IO thread context */
+static void test_defer(pa_sink *s, struct defer_result *r) {
+    pa_usec_t now, wait_usec = 0;
+
+    /* Make sure the last rewind is long enough ago */
+    if ((now = pa_rtclock_now()) < s->thread_info.rewind_not_before)
+        pa_msleep((unsigned) ((s->thread_info.rewind_not_before - now) / PA_USEC_PER_MSEC) + 1);
+
+    /* The first request of a burst is processed right away */
+    pa_sink_request_rewind(s, BLOCK);
+    r->first_deferred = pa_sink_defer_rewind(s, pa_rtclock_now() + PA_USEC_PER_SEC, &wait_usec);
+    pa_sink_process_rewind(s, s->thread_info.rewind_nbytes);
+
+    /* So a slow machine doesn't end the burst before we are done */
+    s->thread_info.rewind_not_before = pa_rtclock_now() + 10 * PA_USEC_PER_SEC;
+
+    /* The following ones are held back and merged */
+    pa_sink_request_rewind(s, 2 * BLOCK);
+    pa_sink_request_rewind(s, 4 * BLOCK);
+    pa_sink_request_rewind(s, BLOCK);
+    r->later_deferred = pa_sink_defer_rewind(s, pa_rtclock_now() + 20 * PA_USEC_PER_SEC, &r->wait_usec);
+    r->merged_nbytes = s->thread_info.rewind_nbytes;
+
+    /* But never past the next wakeup */
+    r->deferred_past_wakeup = pa_sink_defer_rewind(s, pa_rtclock_now() + PA_USEC_PER_MSEC, &wait_usec);
+
+    /* Once the hold back time is over they are processed */
+    s->thread_info.rewind_not_before = pa_rtclock_now();
+    r->deferred_when_due = pa_sink_defer_rewind(s, pa_rtclock_now() + PA_USEC_PER_SEC, &wait_usec);
+    pa_sink_process_rewind(s, s->thread_info.rewind_nbytes);
+
+    /* Nothing is held back when nothing was requested */
+    r->deferred_when_idle = pa_sink_defer_rewind(s, pa_rtclock_now() + PA_USEC_PER_SEC, &wait_usec);
+}
+
+/* Called from IO thread context */
+static void test_underrun(pa_sink *s, pa_sink_input *i, struct underrun_result *r) {
+
+    /* One block of data, then three blocks of silence */
+    input_left = BLOCK;
+    render(s, 4 * BLOCK);
+    r->after_render = i->thread_info.underrun_for_sink;
+
+    /* A plain rewind plays the silence from the render queue again,
+     * where it is not counted again */
+    rewind_to(s, BLOCK);
+    r->after_rewind = i->thread_info.underrun_for_sink;
+    render(s, BLOCK);
+    r->after_replay = i->thread_info.underrun_for_sink;
+
+    /* A flush drops it, peek() then counts it when the input has
+     * nothing to give */
+    pa_sink_input_request_rewind(i, 0, FALSE, TRUE, FALSE);
+    pa_sink_process_rewind(s, BLOCK);
+    r->after_flush = i->thread_info.underrun_for_sink;
+    render(s, BLOCK);
+    r->after_rerender = i->thread_info.underrun_for_sink;
+}
+
+static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    pa_sink *s = PA_SINK(o);
+
+    switch (code) {
+        case SINK_MESSAGE_TEST_DEFER:
+            test_defer(s, data);
+            return 0;
+
+        case SINK_MESSAGE_TEST_UNDERRUN:
+            test_underrun(s, input, data);
+            return 0;
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static void thread_func(void *userdata) {
+    pa_thread_mq_install(&thread_mq);
+
+    /* Nothing is rendered unless a test asks for it */
+    while (pa_rtpoll_run(rtpoll, TRUE) > 0)
+        ;
+}
+
+static int input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    void *p;
+
+    if (input_left <= 0)
+        return -1;
+
+    chunk->index = 0;
+    chunk->length = PA_MIN(nbytes, input_left);
+    chunk->memblock = pa_memblock_new(i->core->mempool, chunk->length);
+
+    p = pa_memblock_acquire(chunk->memblock);
+    memset(p, 0x10, chunk->length);
+    pa_memblock_release(chunk->memblock);
+
+    input_left -= chunk->length;
+    return 0;
+}
+
+static void input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+}
+
+static void input_kill_cb(pa_sink_input *i) {
+    pa_sink_input_unlink(i);
+}
+
+static void setup(void) {
+    pa_sample_spec ss;
+    pa_sink_new_data data;
+    pa_sink_input_new_data input_data;
+
+    mainloop = pa_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    core = pa_core_new(pa_mainloop_get_api(mainloop), FALSE, 0);
+    fail_unless(core != NULL);
+
+    rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&thread_mq, pa_mainloop_get_api(mainloop), rtpoll);
+
+    ss.format = PA_SAMPLE_S16NE;
+    ss.rate = 44100;
+    ss.channels = 2;
+
+    pa_sink_new_data_init(&data);
+    data.driver = __FILE__;
+    pa_sink_new_data_set_name(&data, "rewind_test");
+    pa_sink_new_data_set_sample_spec(&data, &ss);
+    sink = pa_sink_new(core, &data, PA_SINK_LATENCY);
+    pa_sink_new_data_done(&data);
+    fail_unless(sink != NULL);
+
+    sink->parent.process_msg = sink_process_msg;
+    pa_sink_set_asyncmsgq(sink, thread_mq.inq);
+    pa_sink_set_rtpoll(sink, rtpoll);
+    pa_sink_set_max_rewind(sink, MAX_REWIND);
+    pa_sink_set_max_request(sink, MAX_REWIND);
+    pa_sink_set_fixed_latency(sink, pa_bytes_to_usec(MAX_REWIND, &ss));
+
+    fail_unless((thread = pa_thread_new("rewind-test", thread_func, NULL)) != NULL);
+    pa_sink_put(sink);
+
+    pa_sink_input_new_data_init(&input_data);
+    input_data.driver = __FILE__;
+    pa_sink_input_new_data_set_sink(&input_data, sink, FALSE);
+    pa_sink_input_new_data_set_sample_spec(&input_data, &ss);
+    fail_unless(pa_sink_input_new(&input, core, &input_data) >= 0);
+    pa_sink_input_new_data_done(&input_data);
+
+    input->pop = input_pop_cb;
+    input->process_rewind = input_process_rewind_cb;
+    input->kill = input_kill_cb;
+    pa_sink_input_put(input);
+}
+
+static void teardown(void) {
+    pa_sink_input_unlink(input);
+    pa_sink_input_unref(input);
+
+    pa_sink_unlink(sink);
+
+    pa_asyncmsgq_send(thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(thread);
+    pa_thread_mq_done(&thread_mq);
+
+    pa_sink_unref(sink);
+    pa_rtpoll_free(rtpoll);
+
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+}
+
+START_TEST (defer_test) {
+    struct defer_result r;
+    pa_sink_rewind_stats before, after;
+
+    setup();
+
+    pa_sink_get_rewind_stats(sink, &before);
+    pa_zero(r);
+    fail_unless(pa_asyncmsgq_send(sink->asyncmsgq, PA_MSGOBJECT(sink), SINK_MESSAGE_TEST_DEFER, &r, 0, NULL) == 0);
+    pa_sink_get_rewind_stats(sink, &after);
+
+    fail_unless(!r.first_deferred);
+    fail_unless(r.later_deferred);
+    fail_unless(r.wait_usec > REWIND_COALESCE_USEC);
+    fail_unless(!r.deferred_past_wakeup);
+    fail_unless(!r.deferred_when_due);
+    fail_unless(!r.deferred_when_idle);
+
+    /* The largest of the merged requests wins */
+    fail_unless(r.merged_nbytes == 4 * BLOCK);
+
+    fail_unless(after.requests - before.requests == 4);
+    fail_unless(after.rewinds - before.rewinds == 2);
+    fail_unless(after.bytes - before.bytes == 5 * BLOCK);
+
+    teardown();
+}
+END_TEST
+
+START_TEST (underrun_test) {
+    struct underrun_result r;
+
+    setup();
+
+    pa_zero(r);
+    fail_unless(pa_asyncmsgq_send(sink->asyncmsgq, PA_MSGOBJECT(sink), SINK_MESSAGE_TEST_UNDERRUN, &r, 0, NULL) == 0);
+
+    fail_unless(r.after_render == 3 * BLOCK);
+    fail_unless(r.after_rewind == 3 * BLOCK);
+    fail_unless(r.after_replay == 3 * BLOCK);
+    fail_unless(r.after_flush == 2 * BLOCK);
+    fail_unless(r.after_rerender == 3 * BLOCK);
+
+    teardown();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Sink rewind");
+    tc = tcase_create("sinkrewind");
+    tcase_add_test(tc, defer_test);
+    tcase_add_test(tc, underrun_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -23,12 +23,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 #include <check.h>
 
 #include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
 
+#include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
+#include <pulsecore/macro.h>
 #include <pulsecore/time-smoother.h>
 
 START_TEST (smoother_test) {
@@ -86,15 +91,281 @@ START_TEST (smoother_test) {
 }
 END_TEST
 
+/* Replays a trace of smoother updates, as done by the ALSA modules,
+ * against each estimator and scores how well pa_smoother_get()
+ * predicts the remote time at the next update. A trace recorded on a
+ * real system can be passed as arguments, one update per line with
+ * local and remote time in usec, or "pause <x>" and "resume <x>".
+ * Otherwise synthetic traces with a known remote clock are used. */
+
+#define TRACE_MAX 4096
+
+/* The error is small enough once it stays below this */
+#define CONVERGED_USEC 200
+
+enum event_type {
+    EVENT_PUT,
+    EVENT_PAUSE,
+    EVENT_RESUME
+};
+
+struct event {
+    enum event_type type;
+    pa_usec_t x, y;
+    pa_usec_t truth; /* the actual remote time at x, or y if unknown */
+};
+
+struct trace {
+    struct event events[TRACE_MAX];
+    unsigned n;
+};
+
+struct score {
+    double rms_usec;
+    pa_usec_t max_usec;
+    pa_usec_t converge_usec; /* the longest time after a start or resume until the error stayed small */
+};
+
+static uint32_t seed;
+
+static double noise(double amplitude) {
+    seed = seed * 1103515245 + 12345;
+    return amplitude * ((double) ((seed >> 8) % 20001) / 10000.0 - 1.0);
+}
+
+static void add_event(struct trace *t, enum event_type type, pa_usec_t x, pa_usec_t y, pa_usec_t truth) {
+    pa_assert(t->n < TRACE_MAX);
+
+    t->events[t->n].type = type;
+    t->events[t->n].x = x;
+    t->events[t->n].y = y;
+    t->events[t->n].truth = truth;
+    t->n++;
+}
+
+/* A sound card running rate off its nominal rate, with timestamp
+ * jitter of the given amplitude, drawn from the noise generator
+ * started at the given seed. The smoother is updated at intervals
+ * doubling from 2ms to 200ms like alsa-sink.c does, and the device is
+ * suspended for 2s halfway through. */
+static void make_device_trace(struct trace *t, double rate, double jitter, uint32_t noise_seed) {
+    pa_usec_t x = 0, interval = 0, remote = 0, end = 20 * PA_USEC_PER_SEC;
+    pa_bool_t suspended = FALSE;
+
+    t->n = 0;
+    seed = noise_seed;
+
+    add_event(t, EVENT_RESUME, 0, 0, 0);
+
+    while (x < end) {
+        double y;
+
+        if (!suspended && x >= end / 2) {
+            add_event(t, EVENT_PAUSE, x, 0, 0);
+            x += 2 * PA_USEC_PER_SEC;
+            add_event(t, EVENT_RESUME, x, 0, 0);
+            suspended = TRUE;
+            interval = 0;
+        }
+
+        interval = PA_CLAMP(interval * 2, 2 * PA_USEC_PER_MSEC, 200 * PA_USEC_PER_MSEC);
+        remote += (pa_usec_t) llrint((double) interval * rate);
+        x += interval;
+
+        y = (double) remote + noise(jitter);
+        add_event(t, EVENT_PUT, x, y > 0 ? (pa_usec_t) llrint(y) : 0, remote);
+    }
+}
+
+static int load_trace(struct trace *t, const char *fn) {
+    char line[256];
+    unsigned long long x, y;
+    FILE *f;
+
+    if (!(f = fopen(fn, "r")))
+        return -1;
+
+    t->n = 0;
+
+    while (fgets(line, sizeof(line), f) && t->n < TRACE_MAX) {
+        if (sscanf(line, "pause %llu", &x) == 1)
+            add_event(t, EVENT_PAUSE, x, 0, 0);
+        else if (sscanf(line, "resume %llu", &x) == 1)
+            add_event(t, EVENT_RESUME, x, 0, 0);
+        else if (sscanf(line, "%llu %llu", &x, &y) == 2)
+            add_event(t, EVENT_PUT, x, y, y);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void replay(const struct trace *t, pa_smoother_estimator_t estimator, struct score *sc) {
+    pa_smoother *s;
+    pa_usec_t start = 0, last_bad = 0;
+    double sum = 0;
+    unsigned i, n = 0;
+    pa_bool_t started = FALSE;
+
+    s = pa_smoother_new(PA_USEC_PER_SEC, 10 * PA_USEC_PER_SEC, TRUE, TRUE, 5, 0, TRUE);
+    pa_smoother_set_estimator(s, estimator);
+
+    memset(sc, 0, sizeof(*sc));
+
+    for (i = 0; i < t->n; i++) {
+        const struct event *e = &t->events[i];
+        pa_usec_t y, err;
+
+        switch (e->type) {
+            case EVENT_PAUSE:
+                pa_smoother_pause(s, e->x);
+                break;
+
+            case EVENT_RESUME:
+                pa_smoother_resume(s, e->x, TRUE);
+                sc->converge_usec = PA_MAX(sc->converge_usec, last_bad - start);
+                start = last_bad = e->x;
+                started = TRUE;
+                break;
+
+            case EVENT_PUT:
+                if (!started) {
+                    /* A trace without a start, assume the smoother was
+                     * running before the first update and knows
+                     * nothing yet */
+                    pa_smoother_resume(s, e->x, FALSE);
+                    start = last_bad = e->x;
+                    started = TRUE;
+                } else {
+                    y = pa_smoother_get(s, e->x);
+                    err = y > e->truth ? y - e->truth : e->truth - y;
+
+                    sum += (double) err * (double) err;
+                    sc->max_usec = PA_MAX(sc->max_usec, err);
+                    n++;
+
+                    if (err > CONVERGED_USEC)
+                        last_bad = e->x;
+                }
+
+                pa_smoother_put(s, e->x, e->y);
+                break;
+        }
+    }
+
+    sc->converge_usec = PA_MAX(sc->converge_usec, last_bad - start);
+    sc->rms_usec = n > 0 ? sqrt(sum / n) : 0;
+
+    pa_smoother_free(s);
+}
+
+static void run(const char *name, const struct trace *t, struct score *spline, struct score *kalman) {
+    pa_smoother_estimator_t e;
+
+    for (e = 0; e < PA_SMOOTHER_ESTIMATOR_MAX; e++) {
+        struct score *sc = e == PA_SMOOTHER_ESTIMATOR_KALMAN ? kalman : spline;
+
+        replay(t, e, sc);
+
+        fprintf(stderr, "%s: %s: rms error %0.1f usec, max %llu usec, converged after %0.2f ms\n",
+                name, pa_smoother_estimator_to_string(e), sc->rms_usec,
+                (unsigned long long) sc->max_usec, (double) sc->converge_usec / PA_USEC_PER_MSEC);
+    }
+}
+
+static const char *trace_file = NULL;
+
+START_TEST (trace_file_test) {
+    struct trace *t;
+    struct score spline, kalman;
+
+    t = pa_xnew(struct trace, 1);
+    fail_unless(load_trace(t, trace_file) == 0);
+    fail_unless(t->n > 0);
+
+    run(trace_file, t, &spline, &kalman);
+
+    pa_xfree(t);
+}
+END_TEST
+
+START_TEST (skew_test) {
+    struct trace *t;
+    struct score spline, kalman;
+
+    /* A badly clocked USB device running 0.5% fast, with little
+     * jitter */
+    t = pa_xnew(struct trace, 1);
+    make_device_trace(t, 1.005, 20, 1);
+
+    run("skew", t, &spline, &kalman);
+
+    fail_unless(kalman.converge_usec < spline.converge_usec);
+    fail_unless(kalman.rms_usec <= spline.rms_usec);
+
+    pa_xfree(t);
+}
+END_TEST
+
+START_TEST (jitter_test) {
+    static const double jitter[] = { 100, 300, 1000 };
+    struct trace *t;
+    struct score spline, kalman;
+    unsigned i;
+    uint32_t n;
+
+    /* On time, but with timestamps off by up to the given amount. A
+     * single noise sequence may happen to suit one estimator, so try
+     * a few. */
+    t = pa_xnew(struct trace, 1);
+
+    for (i = 0; i < PA_ELEMENTSOF(jitter); i++)
+        for (n = 1; n <= 8; n++) {
+            char name[64];
+
+            make_device_trace(t, 1.0, jitter[i], n);
+
+            pa_snprintf(name, sizeof(name), "jitter %0.0f usec, seed %u", jitter[i], n);
+            run(name, t, &spline, &kalman);
+
+            fail_unless(kalman.rms_usec <= spline.rms_usec);
+            fail_unless(kalman.rms_usec <= jitter[i]);
+
+            /* The same without the initial resume, so that the first
+             * update finds the state completely unknown */
+            memmove(t->events, t->events + 1, --t->n * sizeof(struct event));
+
+            pa_snprintf(name, sizeof(name), "jitter %0.0f usec, seed %u, cold", jitter[i], n);
+            run(name, t, &spline, &kalman);
+
+            fail_unless(kalman.rms_usec <= spline.rms_usec);
+            fail_unless(kalman.rms_usec <= jitter[i]);
+        }
+
+    pa_xfree(t);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
     TCase *tc;
     SRunner *sr;
 
+    if (argc > 1)
+        trace_file = argv[1];
+
     s = suite_create("Smoother");
     tc = tcase_create("smoother");
-    tcase_add_test(tc, smoother_test);
+
+    if (trace_file)
+        tcase_add_test(tc, trace_file_test);
+    else {
+        tcase_add_test(tc, smoother_test);
+        tcase_add_test(tc, skew_test);
+        tcase_add_test(tc, jitter_test);
+    }
+
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,236 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include "daemon-test-util.h"
+
+/* Takes a full snapshot and checks it against the sink and source
+ * output lists, the latter usually being empty. A delta right after
+ * must come back empty. Then loads a null sink and checks that a delta
+ * has it, unloads it again and checks that the next delta tells it
+ * went away. A generation the daemon doesn't know must get a full
+ * snapshot. */
+
+#define SINK_NAME "snapshot_test"
+
+static unsigned n_list_sinks = 0;
+static unsigned n_list_source_outputs = 0;
+
+static unsigned n_sinks = 0;
+static unsigned n_source_outputs = 0;
+static unsigned n_others = 0;
+static uint32_t test_sink_index = PA_INVALID_INDEX;
+static int test_sink_seen = 0;
+static int test_sink_removed = 0;
+static unsigned n_removed = 0;
+static unsigned n_modules_removed = 0;
+
+static uint64_t generation = 0;
+
+static pa_snapshot_callbacks callbacks;
+
+static void reset(void) {
+    n_sinks = 0;
+    n_source_outputs = 0;
+    n_others = 0;
+    test_sink_seen = 0;
+    test_sink_removed = 0;
+    n_removed = 0;
+    n_modules_removed = 0;
+}
+
+/* Only counted, for the classes the test doesn't look into */
+#define COUNT_CB(name, type)                                            \
+    static void name(pa_context *c, const type *i, int eol, void *userdata) { \
+        if (!eol)                                                       \
+            n_others++;                                                 \
+    }
+
+COUNT_CB(snapshot_module_cb, pa_module_info)
+COUNT_CB(snapshot_client_cb, pa_client_info)
+COUNT_CB(snapshot_card_cb, pa_card_info)
+COUNT_CB(snapshot_source_cb, pa_source_info)
+COUNT_CB(snapshot_sink_input_cb, pa_sink_input_info)
+COUNT_CB(snapshot_sample_cb, pa_sample_info)
+
+static void snapshot_sink_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    if (eol)
+        return;
+
+    n_sinks++;
+
+    if (strcmp(i->name, SINK_NAME) == 0) {
+        test_sink_seen = 1;
+        test_sink_index = i->index;
+    }
+}
+
+static void snapshot_source_output_cb(pa_context *c, const pa_source_output_info *i, int eol, void *userdata) {
+    if (!eol)
+        n_source_outputs++;
+}
+
+static void snapshot_removed_cb(pa_context *c, pa_subscription_event_type_t facility, uint32_t idx, void *userdata) {
+    n_removed++;
+
+    if (facility == PA_SUBSCRIPTION_EVENT_SINK && idx == test_sink_index)
+        test_sink_removed = 1;
+    else if (facility == PA_SUBSCRIPTION_EVENT_MODULE)
+        n_modules_removed++;
+}
+
+static void unknown_done_cb(pa_context *c, int success, uint64_t g, int full, void *userdata) {
+    fail_unless(success);
+
+    /* Nothing to go by, so everything */
+    fail_unless(full);
+    fail_unless(g >= generation);
+    fail_unless(n_sinks == n_list_sinks);
+
+    pa_context_disconnect(c);
+}
+
+static void removed_done_cb(pa_context *c, int success, uint64_t g, int full, void *userdata) {
+    fail_unless(success);
+    fail_unless(!full);
+    fail_unless(g > generation);
+    fail_unless(!test_sink_seen);
+    fail_unless(test_sink_removed);
+    fail_unless(n_modules_removed >= 1);
+
+    generation = g;
+
+    /* No daemon instance starts out at generation 1 */
+    reset();
+    callbacks.done = unknown_done_cb;
+    pa_operation_unref(pa_context_get_snapshot_delta(c, 1, &callbacks, NULL));
+}
+
+static void unloaded_cb(pa_context *c) {
+    reset();
+    callbacks.done = removed_done_cb;
+    pa_operation_unref(pa_context_get_snapshot_delta(c, generation, &callbacks, NULL));
+}
+
+static void added_done_cb(pa_context *c, int success, uint64_t g, int full, void *userdata) {
+    fail_unless(success);
+    fail_unless(!full);
+    fail_unless(g > generation);
+    fail_unless(test_sink_seen);
+    fail_unless(n_sinks <= n_list_sinks + 1);
+
+    fprintf(stderr, "Delta after loading a sink: %u of %u sinks\n", n_sinks, n_list_sinks + 1);
+
+    generation = g;
+    daemon_test_unload_modules(c, unloaded_cb);
+}
+
+static void loaded_cb(pa_context *c) {
+    reset();
+    callbacks.done = added_done_cb;
+    pa_operation_unref(pa_context_get_snapshot_delta(c, generation, &callbacks, NULL));
+}
+
+static void unchanged_done_cb(pa_context *c, int success, uint64_t g, int full, void *userdata) {
+    fail_unless(success);
+    fail_unless(!full);
+
+    /* Nothing happened in between, so every section is empty */
+    fail_unless(g == generation);
+    fail_unless(n_sinks == 0);
+    fail_unless(n_source_outputs == 0);
+    fail_unless(n_others == 0);
+    fail_unless(n_removed == 0);
+
+    daemon_test_load_module(c, "module-null-sink", "sink_name=" SINK_NAME, loaded_cb);
+}
+
+static void full_done_cb(pa_context *c, int success, uint64_t g, int full, void *userdata) {
+    fail_unless(success);
+    fail_unless(full);
+    fail_unless(g > 0);
+    fail_unless(n_sinks == n_list_sinks);
+    fail_unless(n_source_outputs == n_list_source_outputs);
+    fail_unless(n_others > 0);
+    fail_unless(n_removed == 0);
+    fail_unless(!test_sink_seen);
+
+    fprintf(stderr, "Full snapshot: %u sinks, %u source outputs, %u other objects\n",
+            n_sinks, n_source_outputs, n_others);
+
+    generation = g;
+
+    reset();
+    callbacks.done = unchanged_done_cb;
+    pa_operation_unref(pa_context_get_snapshot_delta(c, generation, &callbacks, NULL));
+}
+
+static void list_source_output_cb(pa_context *c, const pa_source_output_info *i, int eol, void *userdata) {
+    fail_unless(eol >= 0);
+
+    if (!eol) {
+        n_list_source_outputs++;
+        return;
+    }
+
+    reset();
+    callbacks.done = full_done_cb;
+    pa_operation_unref(pa_context_get_snapshot(c, &callbacks, NULL));
+}
+
+static void list_sink_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    fail_unless(eol >= 0);
+
+    if (!eol) {
+        n_list_sinks++;
+        return;
+    }
+
+    pa_operation_unref(pa_context_get_source_output_info_list(c, list_source_output_cb, NULL));
+}
+
+static void context_ready_cb(pa_context *c) {
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.module = snapshot_module_cb;
+    callbacks.client = snapshot_client_cb;
+    callbacks.card = snapshot_card_cb;
+    callbacks.sink = snapshot_sink_cb;
+    callbacks.source = snapshot_source_cb;
+    callbacks.sink_input = snapshot_sink_input_cb;
+    callbacks.source_output = snapshot_source_output_cb;
+    callbacks.sample = snapshot_sample_cb;
+    callbacks.removed = snapshot_removed_cb;
+
+    pa_operation_unref(pa_context_get_sink_info_list(c, list_sink_cb, NULL));
+}
+
+int main(int argc, char *argv[]) {
+    return daemon_test_main("Snapshot", argv[0], context_ready_cb);
+}
@@ -0,0 +1,307 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/tagstruct.h>
+#include <pulsecore/packet.h>
+#include <pulsecore/native-common.h>
+#include <pulsecore/macro.h>
+
+/* Encodes the reply to a sink info request the way protocol-native.c
+ * does for a current client, once into a plain tagstruct and once into
+ * one sized up front, and reports how long building the reply and
+ * turning it into a packet takes. The sized reply must come out the
+ * same, and must not need to grow its buffer. Also checks that an
+ * empty one can be embedded in another, like the empty sections of a
+ * snapshot reply. */
+
+#define N_REPLIES 200000
+/* What protocol-native.c asks for */
+#define SIZE_HINT 2048
+
+static pa_sample_spec ss;
+static pa_channel_map map;
+static pa_cvolume volume;
+static pa_proplist *proplist;
+static pa_format_info *formats[2];
+
+static const char* const ports[][2] = {
+    { "analog-output-speaker", "Speakers" },
+    { "analog-output-headphones", "Headphones" },
+    { "hdmi-output-0", "HDMI / DisplayPort" }
+};
+
+static void setup(void) {
+    ss.format = PA_SAMPLE_S16LE;
+    ss.rate = 44100;
+    ss.channels = 2;
+
+    pa_channel_map_init_stereo(&map);
+    pa_cvolume_set(&volume, 2, PA_VOLUME_NORM / 2);
+
+    proplist = pa_proplist_new();
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_DESCRIPTION, "Built-in Audio Analog Stereo");
+    pa_proplist_sets(proplist, "alsa.resolution_bits", "16");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_API, "alsa");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_CLASS, "sound");
+    pa_proplist_sets(proplist, "alsa.class", "generic");
+    pa_proplist_sets(proplist, "alsa.subclass", "generic-mix");
+    pa_proplist_sets(proplist, "alsa.name", "ALC892 Analog");
+    pa_proplist_sets(proplist, "alsa.id", "ALC892 Analog");
+    pa_proplist_sets(proplist, "alsa.subdevice", "0");
+    pa_proplist_sets(proplist, "alsa.subdevice_name", "subdevice #0");
+    pa_proplist_sets(proplist, "alsa.device", "0");
+    pa_proplist_sets(proplist, "alsa.card", "0");
+    pa_proplist_sets(proplist, "alsa.card_name", "HDA Intel PCH");
+    pa_proplist_sets(proplist, "alsa.long_card_name", "HDA Intel PCH at 0xf7f10000 irq 30");
+    pa_proplist_sets(proplist, "alsa.driver_name", "snd_hda_intel");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_BUS_PATH, "pci-0000:00:1b.0");
+    pa_proplist_sets(proplist, "sysfs.path", "/devices/pci0000:00/0000:00:1b.0/sound/card0");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_BUS, "pci");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_VENDOR_ID, "8086");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_VENDOR_NAME, "Intel Corporation");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_PRODUCT_NAME, "7 Series/C210 Series Chipset Family High Definition Audio Controller");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_FORM_FACTOR, "internal");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_STRING, "front:0");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE, "352800");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE, "176400");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_ACCESS_MODE, "mmap+timer");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_PROFILE_NAME, "analog-stereo");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_PROFILE_DESCRIPTION, "Analog Stereo");
+    pa_proplist_sets(proplist, PA_PROP_DEVICE_ICON_NAME, "audio-card-pci");
+
+    formats[0] = pa_format_info_new();
+    formats[0]->encoding = PA_ENCODING_PCM;
+    formats[1] = pa_format_info_new();
+    formats[1]->encoding = PA_ENCODING_AC3_IEC61937;
+    pa_format_info_set_rate(formats[1], 48000);
+}
+
+static void teardown(void) {
+    pa_format_info_free(formats[0]);
+    pa_format_info_free(formats[1]);
+    pa_proplist_free(proplist);
+}
+
+/* What sink_fill_tagstruct() puts in, protocol version 24 and up */
+static void fill_sink_info(pa_tagstruct *t, uint32_t tag) {
+    unsigned i;
+
+    pa_tagstruct_putu32(t, PA_COMMAND_REPLY);
+    pa_tagstruct_putu32(t, tag);
+
+    pa_tagstruct_put(
+        t,
+        PA_TAG_U32, 0,
+        PA_TAG_STRING, "alsa_output.pci-0000_00_1b.0.analog-stereo",
+        PA_TAG_STRING, pa_proplist_gets(proplist, PA_PROP_DEVICE_DESCRIPTION),
+        PA_TAG_SAMPLE_SPEC, &ss,
+        PA_TAG_CHANNEL_MAP, &map,
+        PA_TAG_U32, 4,
+        PA_TAG_CVOLUME, &volume,
+        PA_TAG_BOOLEAN, FALSE,
+        PA_TAG_U32, 0,
+        PA_TAG_STRING, "alsa_output.pci-0000_00_1b.0.analog-stereo.monitor",
+        PA_TAG_USEC, (pa_usec_t) 23220,
+        PA_TAG_STRING, "module-alsa-card.c",
+        PA_TAG_U32, 0x6f,
+        PA_TAG_INVALID);
+
+    pa_tagstruct_put_proplist(t, proplist);
+    pa_tagstruct_put_usec(t, 23220);
+
+    pa_tagstruct_put_volume(t, PA_VOLUME_NORM);
+    pa_tagstruct_putu32(t, 0);
+    pa_tagstruct_putu32(t, 65537);
+    pa_tagstruct_putu32(t, 0);
+
+    pa_tagstruct_putu32(t, PA_ELEMENTSOF(ports));
+    for (i = 0; i < PA_ELEMENTSOF(ports); i++) {
+        pa_tagstruct_puts(t, ports[i][0]);
+        pa_tagstruct_puts(t, ports[i][1]);
+        pa_tagstruct_putu32(t, 9000 - i * 100);
+        pa_tagstruct_putu32(t, 0); /* Availability unknown */
+    }
+    pa_tagstruct_puts(t, ports[0][0]);
+
+    pa_tagstruct_putu8(t, PA_ELEMENTSOF(formats));
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++)
+        pa_tagstruct_put_format_info(t, formats[i]);
+}
+
+static void check_reply(pa_packet *packet, uint32_t tag) {
+    pa_tagstruct *t;
+    uint32_t command, tag2, idx;
+    const char *name;
+
+    t = pa_tagstruct_new(packet->data, packet->length);
+
+    fail_unless(pa_tagstruct_getu32(t, &command) == 0);
+    fail_unless(command == PA_COMMAND_REPLY);
+    fail_unless(pa_tagstruct_getu32(t, &tag2) == 0);
+    fail_unless(tag2 == tag);
+    fail_unless(pa_tagstruct_getu32(t, &idx) == 0);
+    fail_unless(idx == 0);
+    fail_unless(pa_tagstruct_gets(t, &name) == 0);
+    fail_unless(strcmp(name, "alsa_output.pci-0000_00_1b.0.analog-stereo") == 0);
+
+    pa_tagstruct_free(t);
+}
+
+START_TEST (sized_test) {
+    pa_packet *plain, *sized;
+    pa_tagstruct *t;
+    const uint8_t *data;
+    size_t length;
+
+    setup();
+
+    t = pa_tagstruct_new(NULL, 0);
+    fill_sink_info(t, 1);
+    plain = pa_tagstruct_free_packet(t);
+
+    fprintf(stderr, "A sink info reply takes %lu bytes.\n", (unsigned long) plain->length);
+    fail_unless(plain->length <= SIZE_HINT);
+
+    /* What protocol-native.c asks for is enough, so the buffer must
+     * stay where it is */
+    t = pa_tagstruct_new_sized(SIZE_HINT);
+    data = pa_tagstruct_data(t, &length);
+    fail_unless(length == 0);
+    fill_sink_info(t, 1);
+    fail_unless(pa_tagstruct_data(t, &length) == data);
+    sized = pa_tagstruct_free_packet(t);
+
+    fail_unless(sized->length == plain->length);
+    fail_unless(memcmp(sized->data, plain->data, plain->length) == 0);
+    check_reply(sized, 1);
+
+    pa_packet_unref(plain);
+    pa_packet_unref(sized);
+
+    /* One that starts out too small just grows */
+    t = pa_tagstruct_new_sized(16);
+    fill_sink_info(t, 2);
+    sized = pa_tagstruct_free_packet(t);
+    check_reply(sized, 2);
+    pa_packet_unref(sized);
+
+    teardown();
+}
+END_TEST
+
+START_TEST (empty_test) {
+    pa_tagstruct *reply, *section;
+    pa_packet *packet;
+    const uint8_t *data;
+    const void *p;
+    size_t length;
+    uint32_t l;
+
+    /* Nothing asked for, nothing put in */
+    section = pa_tagstruct_new_sized(0);
+    data = pa_tagstruct_data(section, &length);
+    fail_unless(length == 0);
+
+    reply = pa_tagstruct_new_sized(0);
+    pa_tagstruct_putu32(reply, (uint32_t) length);
+    pa_tagstruct_put_arbitrary(reply, data, length);
+    pa_tagstruct_putu32(reply, 4711);
+    pa_tagstruct_free(section);
+
+    packet = pa_tagstruct_free_packet(reply);
+    reply = pa_tagstruct_new(packet->data, packet->length);
+
+    fail_unless(pa_tagstruct_getu32(reply, &l) == 0);
+    fail_unless(l == 0);
+    fail_unless(pa_tagstruct_get_arbitrary(reply, &p, l) == 0);
+    fail_unless(pa_tagstruct_getu32(reply, &l) == 0);
+    fail_unless(l == 4711);
+    fail_unless(pa_tagstruct_eof(reply));
+
+    pa_tagstruct_free(reply);
+    pa_packet_unref(packet);
+}
+END_TEST
+
+START_TEST (benchmark_test) {
+    pa_usec_t start, plain_usec, sized_usec;
+    unsigned i;
+
+    setup();
+
+    start = pa_rtclock_now();
+    for (i = 0; i < N_REPLIES; i++) {
+        pa_tagstruct *t = pa_tagstruct_new(NULL, 0);
+
+        fill_sink_info(t, i);
+        pa_packet_unref(pa_tagstruct_free_packet(t));
+    }
+    plain_usec = pa_rtclock_now() - start;
+
+    start = pa_rtclock_now();
+    for (i = 0; i < N_REPLIES; i++) {
+        pa_tagstruct *t = pa_tagstruct_new_sized(SIZE_HINT);
+
+        fill_sink_info(t, i);
+        pa_packet_unref(pa_tagstruct_free_packet(t));
+    }
+    sized_usec = pa_rtclock_now() - start;
+
+    fprintf(stderr, "plain: %0.0f ns per sink info reply\n", (double) plain_usec * 1000 / N_REPLIES);
+    fprintf(stderr, "sized: %0.0f ns per sink info reply\n", (double) sized_usec * 1000 / N_REPLIES);
+
+    teardown();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Tagstruct");
+    tc = tcase_create("tagstruct");
+    tcase_add_test(tc, sized_test);
+    tcase_add_test(tc, empty_test);
+    tcase_add_test(tc, benchmark_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,289 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/watermark-controller.h>
+#include <pulsecore/macro.h>
+
+/* Replays traces of wakeup lateness plus processing time against a
+ * simulated timer-scheduled device, once with the old step-wise
+ * watermark logic of the ALSA modules and once with the watermark
+ * controller, and reports the resulting watermark and dropouts.
+ *
+ * A trace recorded on a real system can be passed as the only
+ * argument, one line per wakeup with the lateness and the processing
+ * time in usec. Otherwise built-in traces are used. */
+
+#define N_SAMPLES 20000
+
+/* A device running at 50 ms latency, with the limits the ALSA modules
+ * use */
+#define LATENCY_USEC (50*PA_USEC_PER_MSEC)
+#define MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)
+#define MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)
+#define DEFAULT_WATERMARK_USEC (20*PA_USEC_PER_MSEC)
+#define INC_STEP_USEC (10*PA_USEC_PER_MSEC)
+#define DEC_STEP_USEC (5*PA_USEC_PER_MSEC)
+#define VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)
+#define DEC_THRESHOLD_USEC (100*PA_USEC_PER_MSEC)
+#define DEC_INTERVAL_USEC (1*PA_USEC_PER_SEC)
+
+#define PROBABILITY 0.0001
+
+struct result {
+    unsigned dropouts;
+    pa_usec_t average;
+    pa_usec_t final;
+};
+
+static uint32_t seed;
+
+static unsigned rnd(unsigned n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+/* An idle desktop: short delays with the rare small spike */
+static void make_idle_trace(pa_usec_t *t) {
+    unsigned i;
+
+    seed = 1;
+
+    for (i = 0; i < N_SAMPLES; i++)
+        t[i] = rnd(5000) == 0 ? 3000 + rnd(2000) : 200 + rnd(300);
+}
+
+/* A loaded host: a few ms of delay and a long tail */
+static void make_loaded_trace(pa_usec_t *t) {
+    unsigned i;
+
+    seed = 2;
+
+    for (i = 0; i < N_SAMPLES; i++) {
+        unsigned r = rnd(10000);
+
+        if (r < 10)
+            t[i] = 15000 + rnd(10000);
+        else if (r < 100)
+            t[i] = 5000 + rnd(7000);
+        else
+            t[i] = 1000 + rnd(3000);
+    }
+}
+
+/* An idle desktop which was stalled once */
+static void make_hiccup_trace(pa_usec_t *t) {
+    make_idle_trace(t);
+
+    t[2000] = 35000;
+}
+
+static pa_usec_t clamp_watermark(pa_usec_t wm) {
+    return PA_CLAMP(wm, MIN_WAKEUP_USEC, LATENCY_USEC - MIN_SLEEP_USEC);
+}
+
+/* What alsa-sink.c did before the controller was introduced */
+static void run_step(const pa_usec_t *trace, unsigned n, struct result *r) {
+    pa_usec_t wm = DEFAULT_WATERMARK_USEC, now = 0, dec_not_before = 0, sum = 0;
+    unsigned i;
+
+    r->dropouts = 0;
+
+    for (i = 0; i < n; i++) {
+        now += LATENCY_USEC - wm;
+        sum += wm;
+
+        if (trace[i] > wm) {
+            r->dropouts++;
+            wm = clamp_watermark(PA_MIN(wm * 2, wm + INC_STEP_USEC));
+            dec_not_before = 0;
+        } else if (wm - trace[i] > DEC_THRESHOLD_USEC) {
+            if (dec_not_before > 0 && dec_not_before <= now) {
+                wm = clamp_watermark(wm < DEC_STEP_USEC ? wm / 2 : PA_MAX(wm / 2, wm - DEC_STEP_USEC));
+                dec_not_before = now + VERIFY_AFTER_USEC;
+            } else if (dec_not_before <= 0)
+                dec_not_before = now + VERIFY_AFTER_USEC;
+        } else
+            dec_not_before = 0;
+    }
+
+    r->average = sum / n;
+    r->final = wm;
+}
+
+/* What alsa-sink.c and alsa-source.c do now */
+static void run_controller(const pa_usec_t *trace, unsigned n, struct result *r) {
+    pa_watermark_controller *c;
+    pa_usec_t wm = DEFAULT_WATERMARK_USEC, now = 0, dec_not_before = 0, sum = 0;
+    unsigned i;
+
+    c = pa_watermark_controller_new(PROBABILITY);
+    r->dropouts = 0;
+
+    for (i = 0; i < n; i++) {
+        pa_usec_t target;
+
+        now += LATENCY_USEC - wm;
+        sum += wm;
+
+        if (trace[i] > wm) {
+            r->dropouts++;
+            wm = clamp_watermark(PA_MIN(wm * 2, wm + INC_STEP_USEC));
+            pa_watermark_controller_dropout(c, wm);
+        } else if ((target = pa_watermark_controller_get(c)) > 0) {
+            pa_usec_t old = wm;
+
+            if (target > wm)
+                wm = clamp_watermark(target);
+            else if (target < wm && dec_not_before <= now)
+                wm = clamp_watermark(PA_MAX(target, wm / 2));
+
+            if (wm != old)
+                dec_not_before = now + DEC_INTERVAL_USEC;
+        }
+
+        pa_watermark_controller_add(c, trace[i]);
+    }
+
+    pa_watermark_controller_free(c);
+
+    r->average = sum / n;
+    r->final = wm;
+}
+
+static void run(const char *name, const pa_usec_t *trace, unsigned n, struct result *step, struct result *controller) {
+    run_step(trace, n, step);
+    run_controller(trace, n, controller);
+
+    fprintf(stderr, "%s: step-wise: %u dropouts, average watermark %0.2f ms, final %0.2f ms\n", name,
+            step->dropouts, (double) step->average / PA_USEC_PER_MSEC, (double) step->final / PA_USEC_PER_MSEC);
+    fprintf(stderr, "%s: controller: %u dropouts, average watermark %0.2f ms, final %0.2f ms\n", name,
+            controller->dropouts, (double) controller->average / PA_USEC_PER_MSEC, (double) controller->final / PA_USEC_PER_MSEC);
+}
+
+static const char *trace_file = NULL;
+
+START_TEST (trace_file_test) {
+    pa_usec_t *trace;
+    unsigned long long lateness, process;
+    unsigned n = 0, size = 1024;
+    struct result step, controller;
+    FILE *f;
+
+    f = fopen(trace_file, "r");
+    fail_unless(f != NULL);
+
+    trace = pa_xnew(pa_usec_t, size);
+
+    while (fscanf(f, "%llu %llu", &lateness, &process) == 2) {
+        if (n >= size)
+            trace = pa_xrenew(pa_usec_t, trace, size *= 2);
+
+        trace[n++] = (pa_usec_t) (lateness + process);
+    }
+
+    fclose(f);
+    fail_unless(n > 0);
+
+    run(trace_file, trace, n, &step, &controller);
+
+    pa_xfree(trace);
+}
+END_TEST
+
+START_TEST (idle_test) {
+    pa_usec_t trace[N_SAMPLES];
+    struct result step, controller;
+
+    make_idle_trace(trace);
+    run("idle", trace, N_SAMPLES, &step, &controller);
+
+    /* Nothing ever comes close, so we should get away with very little */
+    fail_unless(controller.dropouts == 0);
+    fail_unless(controller.average < step.average / 2);
+}
+END_TEST
+
+START_TEST (loaded_test) {
+    pa_usec_t trace[N_SAMPLES];
+    struct result step, controller;
+
+    make_loaded_trace(trace);
+    run("loaded", trace, N_SAMPLES, &step, &controller);
+
+    /* The controller needs to stay close to the requested dropout
+     * rate, but should not go all the way up like the old logic */
+    fail_unless(controller.dropouts <= 2 * PROBABILITY * N_SAMPLES);
+    fail_unless(controller.average <= step.average);
+}
+END_TEST
+
+START_TEST (hiccup_test) {
+    pa_usec_t trace[N_SAMPLES];
+    struct result step, controller;
+
+    make_hiccup_trace(trace);
+    run("hiccup", trace, N_SAMPLES, &step, &controller);
+
+    /* A single stall must not leave us with a high watermark forever */
+    fail_unless(controller.dropouts <= step.dropouts);
+    fail_unless(controller.final < step.final / 2);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (argc > 1)
+        trace_file = argv[1];
+
+    s = suite_create("Watermark Controller");
+    tc = tcase_create("watermarkcontroller");
+
+    if (trace_file)
+        tcase_add_test(tc, trace_file_test);
+    else {
+        tcase_add_test(tc, idle_test);
+        tcase_add_test(tc, loaded_test);
+        tcase_add_test(tc, hiccup_test);
+    }
+
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}